@@ -68,6 +68,10 @@ static char *results_path           = NULL;
 static char * bpfFilter             = NULL; /**< bpf filter  */
 static char *_protoFilePath         = NULL; /**< Protocol file path  */
 static char *_customCategoryFilePath= NULL; /**< Custom categories file path  */
+static char *_rulesetFilePath       = NULL; /**< Compiled ruleset to load */
+static char *_rulesetSavePath       = NULL; /**< Compiled ruleset to write */
+static struct ndpi_ruleset *ruleset = NULL; /**< Rules shared by all the threads */
+static struct ndpi_lru_cache *shared_lru_caches[ndpi_lru_cache_verdict + 1]; /**< Caches shared by all the threads (-W) */
 #ifdef HAVE_JSON_C
 static char *_statsFilePath         = NULL; /**< Top stats file path */
 static char *_diagnoseFilePath      = NULL; /**< Top stats file path */
@@ -84,7 +88,9 @@ u_int8_t enable_protocol_guess = 1, enable_payload_analyzer = 0;
 u_int8_t verbose = 0, json_flag = 0, enable_joy_stats = 0;
 int nDPI_LogLevel = 0;
 char *_debug_protocols = NULL;
-static u_int8_t stats_flag = 0, bpf_filter_flag = 0;
+static u_int8_t stats_flag = 0, bpf_filter_flag = 0, disable_prefix_filter = 0, domain_match = 0,
+  category_filter = 0, shared_caches = 0, dissector_stats_flag = 0, classification_stats_flag = 0;
+static u_int32_t dns_cache_num_entries = 0, verdict_cache_num_entries = 0, verdict_cache_verify_pkts = 0;
 #ifdef HAVE_JSON_C
 static u_int8_t file_first_time = 1;
 #endif
@@ -94,6 +100,7 @@ static u_int32_t pcap_analysis_duration = (u_int32_t)-1;
 static u_int16_t decode_tunnels = 0;
 static u_int16_t num_loops = 1;
 static u_int8_t shutdown_app = 0, quiet_mode = 0;
+static volatile u_int8_t reload_ruleset = 0, reload_stop = 0; /**< SIGHUP received, end of capture */
 static u_int8_t num_threads = 1;
 static struct timeval startup_time, begin, end;
 #ifdef linux
@@ -193,9 +200,6 @@ struct reader_thread {
   struct ndpi_workflow *workflow;
   pthread_t pthread;
   u_int64_t last_idle_scan_time;
-  u_int32_t idle_scan_idx;
-  u_int32_t num_idle_flows;
-  struct ndpi_flow_info *idle_flows[IDLE_SCAN_BUDGET];
 };
 
 // array for every thread created for a flow
@@ -345,7 +349,7 @@ static void help(u_int long_help) {
 	 "[-f <filter>][-s <duration>][-m <duration>]\n"
 	 "          [-p <protos>][-l <loops> [-q][-d][-J][-h][-e <len>][-t][-v <level>]\n"
 	 "          [-n <threads>][-w <file>][-c <file>][-C <file>][-j <file>][-x <file>]\n"
-	 "          [-T <num>][-U <num>]\n\n"
+	 "          [-T <num>][-U <num>][-z][-R <file>][-S <file>]\n\n"
 	 "Usage:\n"
 	 "  -i <file.pcap|device>     | Specify a pcap file/playlist to read packets from or a\n"
 	 "                            | device for live capture (comma-separated list)\n"
@@ -361,6 +365,25 @@ static void help(u_int long_help) {
          "  -g <id:id...>             | Thread affinity mask (one core id per thread)\n"
 #endif
 	 "  -d                        | Disable protocol guess and use only DPI\n"
+	 "  -z                        | Disable the first payload byte dissector prefilter\n"
+	 "                            | (compare the dissector calls with and without it)\n"
+	 "  -D                        | Match the -p hosts and -c names as domains (suffix\n"
+	 "                            | match on label boundaries) instead of substrings.\n"
+	 "                            | The built-in hosts and categories are not affected\n"
+	 "  -B                        | Skip the category lookups of the hostnames not passing\n"
+	 "                            | a Bloom filter of the -c names\n"
+	 "  -W                        | Share the Ookla, STUN, tinc, DNS (-Y) and verdict (-E) caches\n"
+	 "                            | among the threads\n"
+	 "  -Y <num entries>          | Classify the flows towards the addresses of the DNS\n"
+	 "                            | responses seen earlier (cache size). Default: disabled\n"
+	 "  -E <num entries>[:<pkts>] | Classify the flows towards a server endpoint as its last\n"
+	 "                            | flow (cache size). With <pkts> the cached verdict is\n"
+	 "                            | verified on the first <pkts> packets. Default: disabled\n"
+	 "  -K                        | Print the calls, cycles, detections and exclusions of\n"
+	 "                            | each dissector at exit (nDPI configured with\n"
+	 "                            | --enable-dissector-profiling)\n"
+	 "  -L                        | Print how many packets, bytes and msec the flows of each\n"
+	 "                            | protocol needed to be classified, and the giveups\n"
 	 "  -e <len>                  | Min human readeable string match len. Default %u\n"
 	 "  -q                        | Quiet mode\n"
 	 "  -J                        | Display flow SPLT (sequence of packet length and time)\n"
@@ -375,6 +398,13 @@ static void help(u_int long_help) {
 	 "                            | Default: %u:%u:%u:%u:%u\n"
 	 "  -r                        | Print nDPI version and git revision\n"
 	 "  -c <path>                 | Load custom categories from the specified file\n"
+	 "  -S <path>                 | Compile hosts, IPs and categories (including -p and -c\n"
+	 "                            | files) into the specified ruleset file and quit\n"
+	 "  -R <path>                 | Load hosts, IPs and categories from a ruleset file\n"
+	 "                            | written with -S (-p must be the same protos file)\n"
+	 "                            | On live captures SIGHUP reloads the ruleset file (or\n"
+	 "                            | the -p/-c files) without stopping the detection.\n"
+	 "                            | Replace the file with -S or rename(), never in place\n"
 	 "  -C <path>                 | Write output in CSV format on the specified file\n"
 	 "  -w <path>                 | Write test output on the specified file. This is useful for\n"
 	 "                            | testing purposes in order to compare results across runs\n"
@@ -444,6 +474,15 @@ static struct option longopts[] = {
   /* ndpiReader options */
   { "enable-protocol-guess", no_argument, NULL, 'd'},
   { "categories", required_argument, NULL, 'c'},
+  { "domain-match", no_argument, NULL, 'D'},
+  { "category-filter", no_argument, NULL, 'B'},
+  { "shared-caches", no_argument, NULL, 'W'},
+  { "dns-cache", required_argument, NULL, 'Y'},
+  { "verdict-cache", required_argument, NULL, 'E'},
+  { "dissector-stats", no_argument, NULL, 'K'},
+  { "classification-stats", no_argument, NULL, 'L'},
+  { "ruleset", required_argument, NULL, 'R'},
+  { "save-ruleset", required_argument, NULL, 'S'},
   { "csv-dump", required_argument, NULL, 'C'},
   { "interface", required_argument, NULL, 'i'},
   { "filter", required_argument, NULL, 'f'},
@@ -637,7 +676,7 @@ static void parseOptions(int argc, char **argv) {
   }
 #endif
 
-  while((opt = getopt_long(argc, argv, "e:c:C:df:g:i:hp:P:l:s:tv:V:n:j:Jrp:w:q0123:456:7:89:m:b:x:T:U:",
+  while((opt = getopt_long(argc, argv, "e:c:C:df:g:i:hp:P:l:s:tv:V:n:j:Jrp:w:q0123:456:7:89:m:b:x:T:U:zDBWY:E:KLR:S:",
 			   longopts, &option_idx)) != EOF) {
 #ifdef DEBUG_TRACE
     if(trace) fprintf(trace, " #### -%c [%s] #### \n", opt, optarg ? optarg : "");
@@ -648,6 +687,47 @@ static void parseOptions(int argc, char **argv) {
       enable_protocol_guess = 0;
       break;
 
+    case 'z':
+      disable_prefix_filter = 1;
+      break;
+
+    case 'D':
+      domain_match = 1;
+      break;
+
+    case 'B':
+      category_filter = 1;
+      break;
+
+    case 'W':
+      shared_caches = 1;
+      break;
+
+    case 'Y':
+      dns_cache_num_entries = atoi(optarg);
+      break;
+
+    case 'E':
+      if(sscanf(optarg, "%u:%u", &verdict_cache_num_entries, &verdict_cache_verify_pkts) < 1)
+	help(0);
+      break;
+
+    case 'K':
+      dissector_stats_flag = 1;
+      break;
+
+    case 'L':
+      classification_stats_flag = 1;
+      break;
+
+    case 'R':
+      _rulesetFilePath = optarg;
+      break;
+
+    case 'S':
+      _rulesetSavePath = optarg;
+      break;
+
     case 'e':
       human_readeable_string_len = atoi(optarg);
       break;
@@ -857,11 +937,12 @@ static void parseOptions(int argc, char **argv) {
     }
 
     // check parameters
-    if(!bpf_filter_flag && (_pcap_file[0] == NULL || strcmp(_pcap_file[0], "") == 0)) {
+    if(!bpf_filter_flag && (_rulesetSavePath == NULL)
+       && (_pcap_file[0] == NULL || strcmp(_pcap_file[0], "") == 0)) {
       help(0);
     }
 
-    if(strchr(_pcap_file[0], ',')) { /* multiple ingress interfaces */
+    if(_pcap_file[0] && strchr(_pcap_file[0], ',')) { /* multiple ingress interfaces */
       num_threads = 0;               /* setting number of threads = number of interfaces */
       __pcap_file = strtok(_pcap_file[0], ",");
       while(__pcap_file != NULL && num_threads < MAX_NUM_READER_THREADS) {
@@ -1268,18 +1349,14 @@ static void printFlow(u_int16_t id, struct ndpi_flow_info *flow, u_int16_t threa
 /**
  * @brief Unknown Proto Walker
  */
-static void node_print_unknown_proto_walker(const void *node,
-					    ndpi_VISIT which, int depth, void *user_data) {
-  struct ndpi_flow_info *flow = *(struct ndpi_flow_info**)node;
+static void node_print_unknown_proto_walker(void *node, void *user_data) {
+  struct ndpi_flow_info *flow = (struct ndpi_flow_info*)node;
   u_int16_t thread_id = *((u_int16_t*)user_data);
 
   if(flow->detected_protocol.app_protocol != NDPI_PROTOCOL_UNKNOWN) return;
 
-  if((which == ndpi_preorder) || (which == ndpi_leaf)) {
-    /* Avoid walking the same node multiple times */
-    all_flows[num_flows].thread_id = thread_id, all_flows[num_flows].flow = flow;
-    num_flows++;
-  }
+  all_flows[num_flows].thread_id = thread_id, all_flows[num_flows].flow = flow;
+  num_flows++;
 }
 
 /* ********************************** */
@@ -1287,18 +1364,14 @@ static void node_print_unknown_proto_walker(const void *node,
 /**
  * @brief Known Proto Walker
  */
-static void node_print_known_proto_walker(const void *node,
-					  ndpi_VISIT which, int depth, void *user_data) {
-  struct ndpi_flow_info *flow = *(struct ndpi_flow_info**)node;
+static void node_print_known_proto_walker(void *node, void *user_data) {
+  struct ndpi_flow_info *flow = (struct ndpi_flow_info*)node;
   u_int16_t thread_id = *((u_int16_t*)user_data);
 
   if(flow->detected_protocol.app_protocol == NDPI_PROTOCOL_UNKNOWN) return;
 
-  if((which == ndpi_preorder) || (which == ndpi_leaf)) {
-    /* Avoid walking the same node multiple times */
-    all_flows[num_flows].thread_id = thread_id, all_flows[num_flows].flow = flow;
-    num_flows++;
-  }
+  all_flows[num_flows].thread_id = thread_id, all_flows[num_flows].flow = flow;
+  num_flows++;
 }
 
 /* ********************************** */
@@ -1306,24 +1379,22 @@ static void node_print_known_proto_walker(const void *node,
 /**
  * @brief Proto Guess Walker
  */
-static void node_proto_guess_walker(const void *node, ndpi_VISIT which, int depth, void *user_data) {
-  struct ndpi_flow_info *flow = *(struct ndpi_flow_info **) node;
+static void node_proto_guess_walker(void *node, void *user_data) {
+  struct ndpi_flow_info *flow = (struct ndpi_flow_info *) node;
   u_int16_t thread_id = *((u_int16_t *) user_data);
 
-  if((which == ndpi_preorder) || (which == ndpi_leaf)) { /* Avoid walking the same node multiple times */
-    if((!flow->detection_completed) && flow->ndpi_flow) {
-      u_int8_t proto_guessed;
-  
-      flow->detected_protocol = ndpi_detection_giveup(ndpi_thread_info[0].workflow->ndpi_struct,
-						      flow->ndpi_flow, enable_protocol_guess, &proto_guessed);
-    }
-    
-    process_ndpi_collected_info(ndpi_thread_info[thread_id].workflow, flow);
+  if((!flow->detection_completed) && flow->ndpi_flow) {
+    u_int8_t proto_guessed;
 
-    ndpi_thread_info[thread_id].workflow->stats.protocol_counter[flow->detected_protocol.app_protocol]       += flow->src2dst_packets + flow->dst2src_packets;
-    ndpi_thread_info[thread_id].workflow->stats.protocol_counter_bytes[flow->detected_protocol.app_protocol] += flow->src2dst_bytes + flow->dst2src_bytes;
-    ndpi_thread_info[thread_id].workflow->stats.protocol_flows[flow->detected_protocol.app_protocol]++;
+    flow->detected_protocol = ndpi_detection_giveup(ndpi_thread_info[0].workflow->ndpi_struct,
+						    flow->ndpi_flow, enable_protocol_guess, &proto_guessed);
   }
+
+  process_ndpi_collected_info(ndpi_thread_info[thread_id].workflow, flow);
+
+  ndpi_thread_info[thread_id].workflow->stats.protocol_counter[flow->detected_protocol.app_protocol]       += flow->src2dst_packets + flow->dst2src_packets;
+  ndpi_thread_info[thread_id].workflow->stats.protocol_counter_bytes[flow->detected_protocol.app_protocol] += flow->src2dst_bytes + flow->dst2src_bytes;
+  ndpi_thread_info[thread_id].workflow->stats.protocol_flows[flow->detected_protocol.app_protocol]++;
 }
 
 /* *********************************************** */
@@ -1724,70 +1795,40 @@ static void deletePortsStats(struct port_stats *stats) {
 /**
  * @brief Ports stats
  */
-static void port_stats_walker(const void *node, ndpi_VISIT which, int depth, void *user_data) {
-  if((which == ndpi_preorder) || (which == ndpi_leaf)) { /* Avoid walking the same node multiple times */
-    struct ndpi_flow_info *flow = *(struct ndpi_flow_info **) node;
-    u_int16_t thread_id = *(int *)user_data;
-    u_int16_t sport, dport;
-    char proto[16];
-    int r;
+static void port_stats_walker(void *node, void *user_data) {
+  struct ndpi_flow_info *flow = (struct ndpi_flow_info *) node;
+  u_int16_t thread_id = *(int *)user_data;
+  u_int16_t sport, dport;
+  char proto[16];
+  int r;
 
-    sport = ntohs(flow->src_port), dport = ntohs(flow->dst_port);
+  sport = ntohs(flow->src_port), dport = ntohs(flow->dst_port);
 
-    /* get app level protocol */
-    if(flow->detected_protocol.master_protocol)
-      ndpi_protocol2name(ndpi_thread_info[thread_id].workflow->ndpi_struct,
+  /* get app level protocol */
+  if(flow->detected_protocol.master_protocol)
+    ndpi_protocol2name(ndpi_thread_info[thread_id].workflow->ndpi_struct,
 			 flow->detected_protocol, proto, sizeof(proto));
-    else
-      strncpy(proto, ndpi_get_proto_name(ndpi_thread_info[thread_id].workflow->ndpi_struct,
+  else
+    strncpy(proto, ndpi_get_proto_name(ndpi_thread_info[thread_id].workflow->ndpi_struct,
 					 flow->detected_protocol.app_protocol),sizeof(proto));
 
-    if(((r = strcmp(ipProto2Name(flow->protocol), "TCP")) == 0)
-       && (flow->src2dst_packets == 1) && (flow->dst2src_packets == 0)) {
-      updateScanners(&scannerHosts, flow->src_ip, flow->ip_version, dport);
-    }
+  if(((r = strcmp(ipProto2Name(flow->protocol), "TCP")) == 0)
+     && (flow->src2dst_packets == 1) && (flow->dst2src_packets == 0)) {
+    updateScanners(&scannerHosts, flow->src_ip, flow->ip_version, dport);
+  }
 
-    updateReceivers(&receivers, flow->dst_ip, flow->ip_version,
-                    flow->src2dst_packets, &topReceivers);
+  updateReceivers(&receivers, flow->dst_ip, flow->ip_version,
+                  flow->src2dst_packets, &topReceivers);
 
-    updatePortStats(&srcStats, sport, flow->src_ip, flow->ip_version,
-                    flow->src2dst_packets, flow->src2dst_bytes, proto);
+  updatePortStats(&srcStats, sport, flow->src_ip, flow->ip_version,
+                  flow->src2dst_packets, flow->src2dst_bytes, proto);
 
-    updatePortStats(&dstStats, dport, flow->dst_ip, flow->ip_version,
-                    flow->dst2src_packets, flow->dst2src_bytes, proto);
-  }
+  updatePortStats(&dstStats, dport, flow->dst_ip, flow->ip_version,
+                  flow->dst2src_packets, flow->dst2src_bytes, proto);
 }
 
 /* *********************************************** */
 
-/**
- * @brief Idle Scan Walker
- */
-static void node_idle_scan_walker(const void *node, ndpi_VISIT which, int depth, void *user_data) {
-  struct ndpi_flow_info *flow = *(struct ndpi_flow_info **) node;
-  u_int16_t thread_id = *((u_int16_t *) user_data);
-
-  if(ndpi_thread_info[thread_id].num_idle_flows == IDLE_SCAN_BUDGET) /* TODO optimise with a budget-based walk */
-    return;
-
-  if((which == ndpi_preorder) || (which == ndpi_leaf)) { /* Avoid walking the same node multiple times */
-    if(flow->last_seen + MAX_IDLE_TIME < ndpi_thread_info[thread_id].workflow->last_time) {
-
-      /* update stats */
-      node_proto_guess_walker(node, which, depth, user_data);
-
-      if((flow->detected_protocol.app_protocol == NDPI_PROTOCOL_UNKNOWN) && !undetected_flows_deleted)
-        undetected_flows_deleted = 1;
-
-      ndpi_free_flow_info_half(flow);
-      ndpi_thread_info[thread_id].workflow->stats.ndpi_flow_count--;
-
-      /* adding to a queue (we can't delete it from the tree inline ) */
-      ndpi_thread_info[thread_id].idle_flows[ndpi_thread_info[thread_id].num_idle_flows++] = flow;
-    }
-  }
-}
-
 /* *********************************************** */
 
 /**
@@ -1849,12 +1890,16 @@ static void debug_printf(u_int32_t protocol, void *id_struct,
 static void setupDetection(u_int16_t thread_id, pcap_t * pcap_handle) {
   NDPI_PROTOCOL_BITMASK all;
   struct ndpi_workflow_prefs prefs;
+  u_int i;
 
   memset(&prefs, 0, sizeof(prefs));
   prefs.decode_tunnels = decode_tunnels;
-  prefs.num_roots = NUM_ROOTS;
+  prefs.flow_table_size = FLOW_TABLE_SIZE;
   prefs.max_ndpi_flows = MAX_NDPI_FLOWS;
   prefs.quiet_mode = quiet_mode;
+  prefs.use_huge_pages = 1;
+  prefs.ruleset = ruleset;
+  prefs.dissect_extra_packets = (dns_cache_num_entries > 0); /* The DNS responses fill the cache */
 
   memset(&ndpi_thread_info[thread_id], 0, sizeof(ndpi_thread_info[thread_id]));
   ndpi_thread_info[thread_id].workflow = ndpi_workflow_init(&prefs, pcap_handle);
@@ -1864,7 +1909,26 @@ static void setupDetection(u_int16_t thread_id, pcap_t * pcap_handle) {
 				 ndpi_pref_http_dont_dissect_response, 0);
   ndpi_set_detection_preferences(ndpi_thread_info[thread_id].workflow->ndpi_struct,
 				 ndpi_pref_dns_dont_dissect_response, 0);
-  
+  ndpi_set_detection_preferences(ndpi_thread_info[thread_id].workflow->ndpi_struct,
+				 ndpi_pref_disable_dissector_prefix_filter, disable_prefix_filter);
+  ndpi_set_detection_preferences(ndpi_thread_info[thread_id].workflow->ndpi_struct,
+				 ndpi_pref_enable_domain_match, domain_match);
+  ndpi_set_detection_preferences(ndpi_thread_info[thread_id].workflow->ndpi_struct,
+				 ndpi_pref_enable_category_filter, category_filter);
+  ndpi_set_detection_preferences(ndpi_thread_info[thread_id].workflow->ndpi_struct,
+				 ndpi_pref_dns_cache_num_entries, dns_cache_num_entries);
+  ndpi_set_detection_preferences(ndpi_thread_info[thread_id].workflow->ndpi_struct,
+				 ndpi_pref_verdict_cache_num_entries, verdict_cache_num_entries);
+  ndpi_set_detection_preferences(ndpi_thread_info[thread_id].workflow->ndpi_struct,
+				 ndpi_pref_verdict_cache_verify_packets, verdict_cache_verify_pkts);
+  ndpi_set_detection_preferences(ndpi_thread_info[thread_id].workflow->ndpi_struct,
+				 ndpi_pref_enable_classification_stats, classification_stats_flag);
+
+  if(shared_caches) {
+    for(i = 0; i <= ndpi_lru_cache_verdict; i++)
+      ndpi_set_lru_cache(ndpi_thread_info[thread_id].workflow->ndpi_struct, i, shared_lru_caches[i]);
+  }
+
   ndpi_workflow_set_flow_detected_callback(ndpi_thread_info[thread_id].workflow,
 					   on_protocol_discovered,
 					   (void *)(uintptr_t)thread_id);
@@ -1890,6 +1954,39 @@ static void setupDetection(u_int16_t thread_id, pcap_t * pcap_handle) {
 
 /* *********************************************** */
 
+/**
+ * @brief Caches used by the modules of all the threads (-W)
+ */
+static void setupSharedCaches(void) {
+  shared_lru_caches[ndpi_lru_cache_ookla] = ndpi_lru_cache_init_shared(NDPI_OOKLA_CACHE_NUM_ENTRIES * num_threads,
+								       NDPI_OOKLA_CACHE_TTL, 16 * num_threads);
+  shared_lru_caches[ndpi_lru_cache_stun] = ndpi_lru_cache_init_shared(NDPI_STUN_CACHE_NUM_ENTRIES * num_threads,
+								      NDPI_STUN_CACHE_TTL, 16 * num_threads);
+  shared_lru_caches[ndpi_lru_cache_tinc] = ndpi_lru_cache_init_shared(TINC_CACHE_MAX_SIZE * num_threads, 0, 1);
+
+  if(dns_cache_num_entries > 0)
+    shared_lru_caches[ndpi_lru_cache_dns] = ndpi_lru_cache_init_shared(dns_cache_num_entries, 0, 16 * num_threads);
+
+  if(verdict_cache_num_entries > 0)
+    shared_lru_caches[ndpi_lru_cache_verdict] = ndpi_lru_cache_init_shared(verdict_cache_num_entries,
+									  NDPI_VERDICT_CACHE_TTL, 16 * num_threads);
+}
+
+/* *********************************************** */
+
+static void releaseSharedCaches(void) {
+  u_int i;
+
+  for(i = 0; i <= ndpi_lru_cache_verdict; i++) {
+    if(shared_lru_caches[i] != NULL) {
+      ndpi_lru_free_cache(shared_lru_caches[i]);
+      shared_lru_caches[i] = NULL;
+    }
+  }
+}
+
+/* *********************************************** */
+
 /**
  * @brief End of detection and free flow
  */
@@ -1899,6 +1996,111 @@ static void terminateDetection(u_int16_t thread_id) {
 
 /* *********************************************** */
 
+/**
+ * @brief Module with the protocols (-p) and categories (-c) loaded
+ */
+static struct ndpi_detection_module_struct* loadRules(void) {
+  struct ndpi_detection_module_struct *ndpi_struct = ndpi_init_detection_module();
+
+  if(ndpi_struct == NULL) return(NULL);
+
+  ndpi_set_detection_preferences(ndpi_struct, ndpi_pref_enable_domain_match, domain_match);
+  ndpi_set_detection_preferences(ndpi_struct, ndpi_pref_enable_category_filter, category_filter);
+
+  if(_protoFilePath != NULL)
+    ndpi_load_protocols_file(ndpi_struct, _protoFilePath);
+
+  if(_customCategoryFilePath)
+    ndpi_load_categories_file(ndpi_struct, _customCategoryFilePath);
+
+  return(ndpi_struct);
+}
+
+/* *********************************************** */
+
+/**
+ * @brief Compile the protocols (-p) and categories (-c) into a ruleset file (-S)
+ */
+static int saveRuleset(const char *path) {
+  struct ndpi_detection_module_struct *ndpi_struct = loadRules();
+  int rc;
+
+  if(ndpi_struct == NULL) return(-1);
+
+  if((rc = ndpi_save_ruleset(ndpi_struct, path)) != 0)
+    printf("Unable to write ruleset %s\n", path);
+
+  ndpi_exit_detection_module(ndpi_struct);
+
+  return(rc);
+}
+
+/* *********************************************** */
+
+/**
+ * @brief Rules shared by the threads: read from -R or compiled once from -p/-c
+ */
+static struct ndpi_ruleset* setupRuleset(void) {
+  struct ndpi_detection_module_struct *ndpi_struct;
+  struct ndpi_ruleset *r;
+
+  if(_rulesetFilePath != NULL)
+    return(ndpi_load_ruleset(_rulesetFilePath));
+
+  if((ndpi_struct = loadRules()) == NULL)
+    return(NULL);
+
+  /* NULL when not supported: each thread then compiles its own rules */
+  r = ndpi_compile_ruleset(ndpi_struct);
+  ndpi_exit_detection_module(ndpi_struct);
+
+  return(r);
+}
+
+/* *********************************************** */
+
+#ifndef WIN32
+
+static void sighupproc(int sig) {
+  reload_ruleset = 1;
+}
+
+/* *********************************************** */
+
+/**
+ * @brief Rebuild the ruleset on SIGHUP while the threads keep capturing
+ */
+static void* ruleset_reload_thread(void *arg) {
+  while(!reload_stop) {
+    struct ndpi_ruleset *update;
+
+    sleep(1);
+
+    if(!reload_ruleset)
+      continue;
+
+    reload_ruleset = 0;
+
+    if((update = setupRuleset()) == NULL) {
+      printf("Unable to reload the ruleset: keeping the current one\n");
+      continue;
+    }
+
+    /* The threads switch to the update at their next packet */
+    if(ndpi_publish_ruleset(ruleset, update) == 0) {
+      ndpi_release_ruleset(ruleset);
+      ruleset = update;
+    } else
+      ndpi_release_ruleset(update);
+  }
+
+  return(NULL);
+}
+
+#endif
+
+/* *********************************************** */
+
 /**
  * @brief Traffic stats format
  */
@@ -2314,9 +2516,8 @@ static void printFlowsStats() {
 
     num_flows = 0;
     for(thread_id = 0; thread_id < num_threads; thread_id++) {
-      for(i=0; i<NUM_ROOTS; i++)
-	ndpi_twalk(ndpi_thread_info[thread_id].workflow->ndpi_flows_root[i],
-		   node_print_known_proto_walker, &thread_id);
+      ndpi_flow_table_walk(ndpi_thread_info[thread_id].workflow->flows,
+			   node_print_known_proto_walker, &thread_id);
     }
 
     if((verbose == 2) || (verbose == 3)) {
@@ -2659,9 +2860,8 @@ static void printFlowsStats() {
     num_flows = 0;
     for(thread_id = 0; thread_id < num_threads; thread_id++) {
       if(ndpi_thread_info[thread_id].workflow->stats.protocol_counter[0] > 0) {
-	for(i=0; i<NUM_ROOTS; i++)
-	  ndpi_twalk(ndpi_thread_info[thread_id].workflow->ndpi_flows_root[i],
-		     node_print_unknown_proto_walker, &thread_id);
+	ndpi_flow_table_walk(ndpi_thread_info[thread_id].workflow->flows,
+			     node_print_unknown_proto_walker, &thread_id);
       }
     }
 
@@ -2675,9 +2875,8 @@ static void printFlowsStats() {
 
     num_flows = 0;
     for(thread_id = 0; thread_id < num_threads; thread_id++) {
-      for(i=0; i<NUM_ROOTS; i++)
-	ndpi_twalk(ndpi_thread_info[thread_id].workflow->ndpi_flows_root[i],
-		   node_print_known_proto_walker, &thread_id);
+      ndpi_flow_table_walk(ndpi_thread_info[thread_id].workflow->flows,
+			   node_print_known_proto_walker, &thread_id);
     }
 
     for(i=0; i<num_flows; i++)
@@ -2689,6 +2888,172 @@ static void printFlowsStats() {
 
 /* *********************************************** */
 
+static int cmpDissectorStats(const void *_a, const void *_b) {
+  const struct ndpi_dissector_stats *a = (const struct ndpi_dissector_stats*)_a;
+  const struct ndpi_dissector_stats *b = (const struct ndpi_dissector_stats*)_b;
+
+  if(a->num_cycles < b->num_cycles) return(1);
+  else if(a->num_cycles > b->num_cycles) return(-1);
+  else return(0);
+}
+
+/* *********************************************** */
+
+/**
+ * @brief Print the counters of each dissector summed over the threads,
+ *        most expensive dissectors first
+ */
+static void printDissectorStats(void) {
+  struct ndpi_dissector_stats *stats, *thread_stats;
+  int thread_id, i, num_stats = 0, n;
+
+  stats = (struct ndpi_dissector_stats*)calloc(NDPI_MAX_SUPPORTED_PROTOCOLS + 1, sizeof(struct ndpi_dissector_stats));
+  thread_stats = (struct ndpi_dissector_stats*)calloc(NDPI_MAX_SUPPORTED_PROTOCOLS + 1, sizeof(struct ndpi_dissector_stats));
+
+  if((stats == NULL) || (thread_stats == NULL))
+    goto free_stats;
+
+  for(thread_id = 0; thread_id < num_threads; thread_id++) {
+    struct ndpi_detection_module_struct *ndpi_struct = ndpi_thread_info[thread_id].workflow->ndpi_struct;
+
+    if((n = ndpi_get_dissector_stats(ndpi_struct, thread_stats, NDPI_MAX_SUPPORTED_PROTOCOLS + 1)) < 0) {
+      printf("\nDissector statistics are not available: configure nDPI with --enable-dissector-profiling\n");
+      goto free_stats;
+    }
+
+    /* All the threads have the same dissectors in the same order */
+    for(i = 0; i < n; i++) {
+      stats[i].protocol_id = thread_stats[i].protocol_id;
+      stats[i].num_calls += thread_stats[i].num_calls;
+      stats[i].num_cycles += thread_stats[i].num_cycles;
+      stats[i].num_detections += thread_stats[i].num_detections;
+      stats[i].num_exclusions += thread_stats[i].num_exclusions;
+    }
+
+    num_stats = n;
+  }
+
+  qsort(stats, num_stats, sizeof(struct ndpi_dissector_stats), cmpDissectorStats);
+
+  printf("\nDissector statistics:\n");
+  printf("\t%-20s %12s %16s %11s %10s %10s\n",
+	 "Dissector", "Calls", "Cycles", "Cycles/Call", "Detections", "Exclusions");
+
+  for(i = 0; i < num_stats; i++) {
+    if(stats[i].num_calls == 0)
+      continue;
+
+    printf("\t%-20s %12llu %16llu %11.1f %10llu %10llu\n",
+	   ndpi_get_proto_name(ndpi_thread_info[0].workflow->ndpi_struct, stats[i].protocol_id),
+	   (long long unsigned int)stats[i].num_calls,
+	   (long long unsigned int)stats[i].num_cycles,
+	   (float)stats[i].num_cycles / (float)stats[i].num_calls,
+	   (long long unsigned int)stats[i].num_detections,
+	   (long long unsigned int)stats[i].num_exclusions);
+  }
+
+free_stats:
+  free(stats);
+  free(thread_stats);
+}
+
+/* *********************************************** */
+
+/**
+ * @brief Format the upper bound of the histogram bin holding the pct percentile
+ */
+static char* formatHistogramPercentile(const u_int64_t *bins, u_int64_t total, u_int pct,
+				       char *buf, u_int buf_len) {
+  u_int64_t seen = 0, threshold = (total * pct + 99) / 100;
+  u_int i;
+
+  for(i = 0; i < NDPI_CLASSIFICATION_HISTOGRAM_BINS - 1; i++) {
+    if((seen += bins[i]) >= threshold)
+      break;
+  }
+
+  if(i == 0)
+    snprintf(buf, buf_len, "0");
+  else if(i == NDPI_CLASSIFICATION_HISTOGRAM_BINS - 1)
+    snprintf(buf, buf_len, ">=%llu", 1ULL << (NDPI_CLASSIFICATION_HISTOGRAM_BINS - 2));
+  else
+    snprintf(buf, buf_len, "<%llu", 1ULL << i);
+
+  return(buf);
+}
+
+/* *********************************************** */
+
+/**
+ * @brief Print the median and the 95th percentile of the packets, payload
+ *        bytes and msec needed to classify the flows of each protocol
+ */
+static void printClassificationStats(void) {
+  u_int num_protocols = ndpi_get_num_supported_protocols(ndpi_thread_info[0].workflow->ndpi_struct);
+  struct ndpi_classification_stats stats, thread_stats;
+  char buf[6][16];
+  int thread_id, i;
+  u_int proto_id;
+
+  printf("\nClassification effort:\n");
+  printf("\t%-20s %8s %8s %9s %9s %9s %9s %9s %9s\n", "Protocol", "Flows", "Giveups",
+	 "Pkts p50", "Pkts p95", "Bytes p50", "Bytes p95", "Msec p50", "Msec p95");
+
+  for(proto_id = 0; proto_id < num_protocols; proto_id++) {
+    memset(&stats, 0, sizeof(stats));
+
+    for(thread_id = 0; thread_id < num_threads; thread_id++) {
+      if(ndpi_get_classification_stats(ndpi_thread_info[thread_id].workflow->ndpi_struct,
+				       proto_id, &thread_stats) != 0)
+	continue;
+
+      stats.num_classified += thread_stats.num_classified;
+      stats.num_giveups += thread_stats.num_giveups;
+
+      for(i = 0; i < NDPI_CLASSIFICATION_HISTOGRAM_BINS; i++) {
+	stats.packets[i] += thread_stats.packets[i];
+	stats.bytes[i] += thread_stats.bytes[i];
+	stats.ticks[i] += thread_stats.ticks[i];
+      }
+    }
+
+    if((stats.num_classified == 0) && (stats.num_giveups == 0))
+      continue;
+
+    if(stats.num_classified == 0) {
+      for(i = 0; i < 6; i++) snprintf(buf[i], sizeof(buf[i]), "-");
+    } else {
+      formatHistogramPercentile(stats.packets, stats.num_classified, 50, buf[0], sizeof(buf[0]));
+      formatHistogramPercentile(stats.packets, stats.num_classified, 95, buf[1], sizeof(buf[1]));
+      formatHistogramPercentile(stats.bytes, stats.num_classified, 50, buf[2], sizeof(buf[2]));
+      formatHistogramPercentile(stats.bytes, stats.num_classified, 95, buf[3], sizeof(buf[3]));
+      formatHistogramPercentile(stats.ticks, stats.num_classified, 50, buf[4], sizeof(buf[4]));
+      formatHistogramPercentile(stats.ticks, stats.num_classified, 95, buf[5], sizeof(buf[5]));
+    }
+
+    printf("\t%-20s %8llu %8llu %9s %9s %9s %9s %9s %9s\n",
+	   ndpi_get_proto_name(ndpi_thread_info[0].workflow->ndpi_struct, proto_id),
+	   (long long unsigned int)stats.num_classified, (long long unsigned int)stats.num_giveups,
+	   buf[0], buf[1], buf[2], buf[3], buf[4], buf[5]);
+  }
+}
+
+/* *********************************************** */
+
+/**
+ * @brief Add the counters of an LRU cache to the total
+ */
+static void addLruCacheStats(struct ndpi_lru_cache_stats *total, const struct ndpi_lru_cache_stats *stats) {
+  total->n_insert += stats->n_insert;
+  total->n_search += stats->n_search;
+  total->n_found += stats->n_found;
+  total->n_evicted += stats->n_evicted;
+  total->n_expired += stats->n_expired;
+  total->n_contended += stats->n_contended;
+}
+
+/* *********************************************** */
+
 /**
  * @brief Print result
  */
@@ -2705,20 +3070,27 @@ static void printResults(u_int64_t processing_time_usec, u_int64_t setup_time_us
   json_object *jObj_main = NULL, *jObj_trafficStats, *jArray_detProto = NULL, *jObj;
 #endif
   long long unsigned int breed_stats[NUM_BREEDS] = { 0 };
+  u_int64_t num_dissector_calls = 0;
+  struct ndpi_category_filter_stats filter_stats, cumulative_filter_stats;
+  struct ndpi_verdict_cache_stats verdict_stats, cumulative_verdict_stats;
+  u_int8_t has_filter = 0;
+  struct ndpi_lru_cache_stats lru_stats, cumulative_lru_stats[ndpi_lru_cache_verdict + 1];
+  static const char *lru_cache_names[ndpi_lru_cache_verdict + 1] = { "Ookla", "STUN", "tinc", "DNS", "Verdict" };
 
   memset(&cumulative_stats, 0, sizeof(cumulative_stats));
+  memset(&cumulative_filter_stats, 0, sizeof(cumulative_filter_stats));
+  memset(&cumulative_verdict_stats, 0, sizeof(cumulative_verdict_stats));
+  memset(cumulative_lru_stats, 0, sizeof(cumulative_lru_stats));
 
   for(thread_id = 0; thread_id < num_threads; thread_id++) {
     if((ndpi_thread_info[thread_id].workflow->stats.total_wire_bytes == 0)
        && (ndpi_thread_info[thread_id].workflow->stats.raw_packet_count == 0))
       continue;
 
-    for(i=0; i<NUM_ROOTS; i++) {
-      ndpi_twalk(ndpi_thread_info[thread_id].workflow->ndpi_flows_root[i],
-		 node_proto_guess_walker, &thread_id);
-      if(verbose == 3 || stats_flag) ndpi_twalk(ndpi_thread_info[thread_id].workflow->ndpi_flows_root[i],
-						port_stats_walker, &thread_id);
-    }
+    ndpi_flow_table_walk(ndpi_thread_info[thread_id].workflow->flows,
+			 node_proto_guess_walker, &thread_id);
+    if(verbose == 3 || stats_flag) ndpi_flow_table_walk(ndpi_thread_info[thread_id].workflow->flows,
+							port_stats_walker, &thread_id);
 
     /* Stats aggregation */
     cumulative_stats.guessed_flow_protocols += ndpi_thread_info[thread_id].workflow->stats.guessed_flow_protocols;
@@ -2744,6 +3116,34 @@ static void printResults(u_int64_t processing_time_usec, u_int64_t setup_time_us
     for(i = 0; i < sizeof(cumulative_stats.packet_len)/sizeof(cumulative_stats.packet_len[0]); i++)
       cumulative_stats.packet_len[i] += ndpi_thread_info[thread_id].workflow->stats.packet_len[i];
     cumulative_stats.max_packet_len += ndpi_thread_info[thread_id].workflow->stats.max_packet_len;
+    num_dissector_calls += ndpi_get_num_dissector_calls(ndpi_thread_info[thread_id].workflow->ndpi_struct);
+
+    if(ndpi_get_category_filter_stats(ndpi_thread_info[thread_id].workflow->ndpi_struct, &filter_stats) == 0) {
+      cumulative_filter_stats.num_rejected += filter_stats.num_rejected;
+      cumulative_filter_stats.num_matched += filter_stats.num_matched;
+      cumulative_filter_stats.num_false_positives += filter_stats.num_false_positives;
+      has_filter = 1;
+    }
+
+    ndpi_get_verdict_cache_stats(ndpi_thread_info[thread_id].workflow->ndpi_struct, &verdict_stats);
+    cumulative_verdict_stats.n_cached += verdict_stats.n_cached;
+    cumulative_verdict_stats.n_hits += verdict_stats.n_hits;
+    cumulative_verdict_stats.n_verified += verdict_stats.n_verified;
+    cumulative_verdict_stats.n_mismatch += verdict_stats.n_mismatch;
+
+    if(!shared_caches) {
+      for(i = 0; i <= ndpi_lru_cache_verdict; i++)
+	if(ndpi_get_lru_cache_stats(ndpi_thread_info[thread_id].workflow->ndpi_struct, i, &lru_stats) == 0)
+	  addLruCacheStats(&cumulative_lru_stats[i], &lru_stats);
+    }
+  }
+
+  /* The shared caches are counted once, whatever thread used them */
+  for(i = 0; shared_caches && (i <= ndpi_lru_cache_verdict); i++) {
+    if(shared_lru_caches[i] != NULL) {
+      ndpi_lru_get_stats(shared_lru_caches[i], &lru_stats);
+      addLruCacheStats(&cumulative_lru_stats[i], &lru_stats);
+    }
   }
 
   if(cumulative_stats.total_wire_bytes == 0)
@@ -2787,6 +3187,39 @@ static void printResults(u_int64_t processing_time_usec, u_int64_t setup_time_us
       printf("\tPacket Len 256-1024:   %-13lu\n", (unsigned long)cumulative_stats.packet_len[3]);
       printf("\tPacket Len 1024-1500:  %-13lu\n", (unsigned long)cumulative_stats.packet_len[4]);
       printf("\tPacket Len > 1500:     %-13lu\n", (unsigned long)cumulative_stats.packet_len[5]);
+      printf("\tDissector calls:       %-13llu (%.2f per IP packet)\n",
+	     (long long unsigned int)num_dissector_calls,
+	     cumulative_stats.ip_packet_count ? (float)num_dissector_calls/(float)cumulative_stats.ip_packet_count : 0);
+
+      if(has_filter)
+	printf("\tCategory filter:       %llu rejected / %llu matched / %llu false positives\n",
+	       (long long unsigned int)cumulative_filter_stats.num_rejected,
+	       (long long unsigned int)cumulative_filter_stats.num_matched,
+	       (long long unsigned int)cumulative_filter_stats.num_false_positives);
+
+      for(i = 0; i <= ndpi_lru_cache_verdict; i++) {
+	if(cumulative_lru_stats[i].n_insert || cumulative_lru_stats[i].n_search) {
+	  printf("\t%-7s LRU cache:     %llu inserts / %llu searches / %llu found / %llu evicted / %llu expired",
+		 lru_cache_names[i],
+		 (long long unsigned int)cumulative_lru_stats[i].n_insert,
+		 (long long unsigned int)cumulative_lru_stats[i].n_search,
+		 (long long unsigned int)cumulative_lru_stats[i].n_found,
+		 (long long unsigned int)cumulative_lru_stats[i].n_evicted,
+		 (long long unsigned int)cumulative_lru_stats[i].n_expired);
+
+	  if(shared_caches)
+	    printf(" / %llu contended", (long long unsigned int)cumulative_lru_stats[i].n_contended);
+
+	  printf("\n");
+	}
+      }
+
+      if(verdict_cache_num_entries > 0)
+	printf("\tVerdict cache:         %llu cached / %llu hits / %llu verified / %llu mismatches\n",
+	       (long long unsigned int)cumulative_verdict_stats.n_cached,
+	       (long long unsigned int)cumulative_verdict_stats.n_hits,
+	       (long long unsigned int)cumulative_verdict_stats.n_verified,
+	       (long long unsigned int)cumulative_verdict_stats.n_mismatch);
 
       if(processing_time_usec > 0) {
 	char buf[32], buf1[32], when[64];
@@ -2811,6 +3244,9 @@ static void printResults(u_int64_t processing_time_usec, u_int64_t setup_time_us
 
       if(enable_protocol_guess)
 	printf("\tGuessed flow protos:   %-13u\n", cumulative_stats.guessed_flow_protocols);
+
+      if(classification_stats_flag)
+	printClassificationStats();
     }
   }
 
@@ -3167,26 +3603,26 @@ static void ndpi_process_packet(u_char *args,
   /* Idle flows cleanup */
   if(live_capture) {
     if(ndpi_thread_info[thread_id].last_idle_scan_time + IDLE_SCAN_PERIOD < ndpi_thread_info[thread_id].workflow->last_time) {
-      /* scan for idle flows */
-      ndpi_twalk(ndpi_thread_info[thread_id].workflow->ndpi_flows_root[ndpi_thread_info[thread_id].idle_scan_idx],
-		 node_idle_scan_walker, &thread_id);
-
-      /* remove idle flows (unfortunately we cannot do this inline) */
-      while(ndpi_thread_info[thread_id].num_idle_flows > 0) {
-	/* search and delete the idle flow from the "ndpi_flow_root" (see struct reader thread) - here flows are the node of a b-tree */
-	ndpi_tdelete(ndpi_thread_info[thread_id].idle_flows[--ndpi_thread_info[thread_id].num_idle_flows],
-		     &ndpi_thread_info[thread_id].workflow->ndpi_flows_root[ndpi_thread_info[thread_id].idle_scan_idx],
-		     ndpi_workflow_node_cmp);
-
-	/* free the memory associated to idle flow in "idle_flows" - (see struct reader thread)*/
-	ndpi_free_flow_info_half(ndpi_thread_info[thread_id].idle_flows[ndpi_thread_info[thread_id].num_idle_flows]);
-	ndpi_free(ndpi_thread_info[thread_id].idle_flows[ndpi_thread_info[thread_id].num_idle_flows]);
-      }
+      struct ndpi_flow_info *idle;
+      u_int32_t num_idle_flows = 0;
+
+      /* idle flows are the oldest ones: stop at the first active flow */
+      while((num_idle_flows++ < IDLE_SCAN_BUDGET)
+	    && ((idle = ndpi_workflow_get_idle_flow(ndpi_thread_info[thread_id].workflow, MAX_IDLE_TIME)) != NULL)) {
+	/* update stats */
+	node_proto_guess_walker(idle, &thread_id);
 
-      if(++ndpi_thread_info[thread_id].idle_scan_idx == ndpi_thread_info[thread_id].workflow->prefs.num_roots)
-	ndpi_thread_info[thread_id].idle_scan_idx = 0;
+	if((idle->detected_protocol.app_protocol == NDPI_PROTOCOL_UNKNOWN) && !undetected_flows_deleted)
+	  undetected_flows_deleted = 1;
+
+	ndpi_thread_info[thread_id].workflow->stats.ndpi_flow_count--;
+	ndpi_flow_info_freer(idle);
+      }
 
       ndpi_thread_info[thread_id].last_idle_scan_time = ndpi_thread_info[thread_id].workflow->last_time;
+
+      /* Move to the last published ruleset even if all flows are classified */
+      ndpi_ruleset_quiescent(ndpi_thread_info[thread_id].workflow->ndpi_struct);
     }
   }
 
@@ -3235,7 +3671,6 @@ static void ndpi_process_packet(u_char *args,
 	   thread_id, (unsigned long)ndpi_thread_info[thread_id].workflow->stats.raw_packet_count, header->caplen);
 
   if((pcap_end.tv_sec-pcap_start.tv_sec) > pcap_analysis_duration) {
-    int i;
     u_int64_t processing_time_usec, setup_time_usec;
 
     gettimeofday(&end, NULL);
@@ -3244,13 +3679,17 @@ static void ndpi_process_packet(u_char *args,
 
     printResults(processing_time_usec, setup_time_usec);
 
-    for(i=0; i<ndpi_thread_info[thread_id].workflow->prefs.num_roots; i++) {
-      ndpi_tdestroy(ndpi_thread_info[thread_id].workflow->ndpi_flows_root[i], ndpi_flow_info_freer);
-      ndpi_thread_info[thread_id].workflow->ndpi_flows_root[i] = NULL;
-
-      memset(&ndpi_thread_info[thread_id].workflow->stats, 0, sizeof(struct ndpi_stats));
+    ndpi_flow_table_destroy(ndpi_thread_info[thread_id].workflow->flows, ndpi_flow_info_freer);
+    ndpi_thread_info[thread_id].workflow->lru_head = ndpi_thread_info[thread_id].workflow->lru_tail = NULL;
+    ndpi_thread_info[thread_id].workflow->flows = ndpi_flow_table_init(ndpi_thread_info[thread_id].workflow->prefs.flow_table_size,
+								       ndpi_workflow_node_cmp);
+    if(ndpi_thread_info[thread_id].workflow->flows == NULL) {
+      fprintf(stderr, "Unable to allocate the flow table\n");
+      exit(-1);
     }
 
+    memset(&ndpi_thread_info[thread_id].workflow->stats, 0, sizeof(struct ndpi_stats));
+
     if(!quiet_mode)
       printf("\n-------------------------------------------\n\n");
 
@@ -3269,8 +3708,23 @@ static void ndpi_process_packet(u_char *args,
  * @brief Call pcap_loop() to process packets from a live capture or savefile
  */
 static void runPcapLoop(u_int16_t thread_id) {
-  if((!shutdown_app) && (ndpi_thread_info[thread_id].workflow->pcap_handle != NULL))
-    pcap_loop(ndpi_thread_info[thread_id].workflow->pcap_handle, -1, &ndpi_process_packet, (u_char*)&thread_id);
+  pcap_t *pcap_handle = ndpi_thread_info[thread_id].workflow->pcap_handle;
+
+  if(shutdown_app || (pcap_handle == NULL))
+    return;
+
+  if(!live_capture) {
+    pcap_loop(pcap_handle, -1, &ndpi_process_packet, (u_char*)&thread_id);
+    return;
+  }
+
+  /*
+    pcap_dispatch() returns at every read timeout, also with no traffic:
+    the thread then releases the rulesets it no longer needs
+  */
+  while(!shutdown_app
+	&& (pcap_dispatch(pcap_handle, -1, &ndpi_process_packet, (u_char*)&thread_id) >= 0))
+    ndpi_ruleset_quiescent(ndpi_thread_info[thread_id].workflow->ndpi_struct);
 }
 
 /**
@@ -3303,6 +3757,7 @@ void * processing_thread(void *_thread_id) {
     u_int i;
 
     if(num == 0) {
+      ndpi_ruleset_quiescent(ndpi_thread_info[thread_id].workflow->ndpi_struct);
       usleep(1);
       continue;
     }
@@ -3358,6 +3813,9 @@ void test_lib() {
   if(trace) fprintf(trace, "Num threads: %d\n", num_threads);
 #endif
 
+  if(shared_caches)
+    setupSharedCaches();
+
   for(thread_id = 0; thread_id < num_threads; thread_id++) {
     pcap_t *cap;
 
@@ -3373,6 +3831,10 @@ void test_lib() {
 
   int status;
   void * thd_res;
+#ifndef WIN32
+  pthread_t reload_thread;
+  u_int8_t reload_enabled = 0;
+#endif
 
   /* Running processing threads */
   for(thread_id = 0; thread_id < num_threads; thread_id++) {
@@ -3383,6 +3845,17 @@ void test_lib() {
       exit(-1);
     }
   }
+
+#ifndef WIN32
+  if(live_capture && (ruleset != NULL)) {
+    reload_stop = 0;
+
+    if(pthread_create(&reload_thread, NULL, ruleset_reload_thread, NULL) == 0) {
+      reload_enabled = 1;
+      signal(SIGHUP, sighupproc);
+    }
+  }
+#endif
   /* Waiting for completion */
   for(thread_id = 0; thread_id < num_threads; thread_id++) {
     status = pthread_join(ndpi_thread_info[thread_id].pthread, &thd_res);
@@ -3397,6 +3870,13 @@ void test_lib() {
     }
   }
 
+#ifndef WIN32
+  if(reload_enabled) {
+    reload_stop = 1;
+    pthread_join(reload_thread, NULL);
+  }
+#endif
+
   gettimeofday(&end, NULL);
   processing_time_usec = end.tv_sec*1000000 + end.tv_usec - (begin.tv_sec*1000000 + begin.tv_usec);
   setup_time_usec = begin.tv_sec*1000000 + begin.tv_usec - (startup_time.tv_sec*1000000 + startup_time.tv_usec);
@@ -3404,6 +3884,9 @@ void test_lib() {
   /* Printing cumulative results */
   printResults(processing_time_usec, setup_time_usec);
 
+  if(dissector_stats_flag)
+    printDissectorStats();
+
   if(stats_flag) {
 #ifdef HAVE_JSON_C
     json_close_stats_file();
@@ -3417,6 +3900,8 @@ void test_lib() {
     terminateDetection(thread_id);
   }
 
+  releaseSharedCaches();
+
 #ifdef HAVE_JSON_C
   json_destroy();
 #endif
@@ -4146,6 +4631,14 @@ int orginal_main(int argc, char **argv) {
 
     parseOptions(argc, argv);
 
+    if(_rulesetSavePath != NULL)
+      return(saveRuleset(_rulesetSavePath));
+
+    if(((ruleset = setupRuleset()) == NULL) && (_rulesetFilePath != NULL)) {
+      printf("Invalid ruleset file %s\n", _rulesetFilePath);
+      return(-1);
+    }
+
     if(bpf_filter_flag) {
 #ifdef HAVE_JSON_C
       produceBpfFilter(_diagnoseFilePath);
@@ -4173,6 +4666,7 @@ int orginal_main(int argc, char **argv) {
     if(results_file)  fclose(results_file);
     if(extcap_dumper) pcap_dump_close(extcap_dumper);
     if(ndpi_info_mod) ndpi_exit_detection_module(ndpi_info_mod);
+    if(ruleset)       ndpi_release_ruleset(ruleset);
     if(csv_fp)        fclose(csv_fp);
 
     return 0;
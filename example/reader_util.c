@@ -311,9 +311,9 @@ void ndpi_report_payload_stats() {
 /* ***************************************************** */
 
 void ndpi_free_flow_info_half(struct ndpi_flow_info *flow) {
-  if(flow->ndpi_flow) { ndpi_flow_free(flow->ndpi_flow); flow->ndpi_flow = NULL; }
-  if(flow->src_id)    { ndpi_free(flow->src_id); flow->src_id = NULL; }
-  if(flow->dst_id)    { ndpi_free(flow->dst_id); flow->dst_id = NULL; }
+  if(flow->ndpi_flow) { ndpi_free_flow_data(flow->ndpi_flow); ndpi_slab_free(flow->ndpi_flow); flow->ndpi_flow = NULL; }
+  if(flow->src_id)    { ndpi_slab_free(flow->src_id); flow->src_id = NULL; }
+  if(flow->dst_id)    { ndpi_slab_free(flow->dst_id); flow->dst_id = NULL; }
 }
 
 /* ***************************************************** */
@@ -401,6 +401,20 @@ static int parse_debug_proto(struct ndpi_detection_module_struct *ndpi_mod, char
 
 /* ***************************************************** */
 
+/**
+ * @brief Allocates a series whose values are stored in the same slab object
+ */
+static struct ndpi_analyze_struct* ndpi_flow_alloc_data_analysis(struct ndpi_workflow *workflow) {
+  struct ndpi_analyze_struct *s = ndpi_slab_alloc(workflow->analysis_slab);
+
+  if(s != NULL)
+    s->num_values_array_len = DATA_ANALUYSIS_SLIDING_WINDOW, s->values = (u_int32_t*)&s[1];
+
+  return(s);
+}
+
+/* ***************************************************** */
+
 extern char *_debug_protocols;
 static int _debug_protocols_ok = 0;
 
@@ -413,7 +427,10 @@ struct ndpi_workflow* ndpi_workflow_init(const struct ndpi_workflow_prefs * pref
   set_ndpi_flow_malloc(NULL), set_ndpi_flow_free(NULL);
 
   /* TODO: just needed here to init ndpi malloc wrapper */
-  module = ndpi_init_detection_module();
+  if(prefs->ruleset)
+    module = ndpi_init_detection_module_with_ruleset(prefs->ruleset);
+  else
+    module = ndpi_init_detection_module();
 
   if(module == NULL) {
     NDPI_LOG(0, NULL, NDPI_LOG_ERROR, "global structure initialization failed\n");
@@ -446,7 +463,20 @@ struct ndpi_workflow* ndpi_workflow_init(const struct ndpi_workflow_prefs * pref
     module->debug_bitmask = debug_bitmask;
 #endif
 
-  workflow->ndpi_flows_root = ndpi_calloc(workflow->prefs.num_roots, sizeof(void *));
+  workflow->flows = ndpi_flow_table_init(workflow->prefs.flow_table_size, ndpi_workflow_node_cmp);
+
+  workflow->flow_info_slab = ndpi_slab_init(sizeof(struct ndpi_flow_info), prefs->use_huge_pages);
+  workflow->ndpi_flow_slab = ndpi_slab_init(SIZEOF_FLOW_STRUCT, prefs->use_huge_pages);
+  workflow->id_slab        = ndpi_slab_init(SIZEOF_ID_STRUCT, prefs->use_huge_pages);
+  workflow->analysis_slab  = ndpi_slab_init(sizeof(struct ndpi_analyze_struct)
+					    + DATA_ANALUYSIS_SLIDING_WINDOW * sizeof(u_int32_t),
+					    prefs->use_huge_pages);
+
+  if((workflow->flow_info_slab == NULL) || (workflow->ndpi_flow_slab == NULL)
+     || (workflow->id_slab == NULL) || (workflow->analysis_slab == NULL) || (workflow->flows == NULL)) {
+    NDPI_LOG(0, NULL, NDPI_LOG_ERROR, "flow table initialization failed\n");
+    exit(-1);
+  }
 
   return workflow;
 }
@@ -458,32 +488,66 @@ void ndpi_flow_info_freer(void *node) {
 
   ndpi_free_flow_info_half(flow);
 
-  if(flow->iat_c_to_s) ndpi_free_data_analysis(flow->iat_c_to_s);
-  if(flow->iat_s_to_c) ndpi_free_data_analysis(flow->iat_s_to_c);
-
-  if(flow->pktlen_c_to_s) ndpi_free_data_analysis(flow->pktlen_c_to_s);
-  if(flow->pktlen_s_to_c) ndpi_free_data_analysis(flow->pktlen_s_to_c);
-
-  if(flow->iat_flow) ndpi_free_data_analysis(flow->iat_flow);
+  /* The series values are in the same slab object (see ndpi_flow_alloc_data_analysis) */
+  ndpi_slab_free(flow->iat_c_to_s), ndpi_slab_free(flow->iat_s_to_c);
+  ndpi_slab_free(flow->pktlen_c_to_s), ndpi_slab_free(flow->pktlen_s_to_c);
+  ndpi_slab_free(flow->iat_flow);
 
-  ndpi_free(flow);
+  ndpi_slab_free(flow);
 }
 
 /* ***************************************************** */
 
 void ndpi_workflow_free(struct ndpi_workflow * workflow) {
-  u_int i;
+  ndpi_flow_table_destroy(workflow->flows, ndpi_flow_info_freer);
 
-  for(i=0; i<workflow->prefs.num_roots; i++)
-    ndpi_tdestroy(workflow->ndpi_flows_root[i], ndpi_flow_info_freer);
+  ndpi_slab_destroy(workflow->flow_info_slab), ndpi_slab_destroy(workflow->ndpi_flow_slab);
+  ndpi_slab_destroy(workflow->id_slab), ndpi_slab_destroy(workflow->analysis_slab);
 
   ndpi_exit_detection_module(workflow->ndpi_struct);
-  free(workflow->ndpi_flows_root);
   free(workflow);
 }
 
 /* ***************************************************** */
 
+/* Moves the flow at the tail of the LRU list: as the workflow time never goes
+   back, the list is ordered by last_seen */
+static void ndpi_workflow_lru_touch(struct ndpi_workflow * workflow, struct ndpi_flow_info *flow) {
+  if(workflow->lru_tail == flow)
+    return;
+
+  if(flow->lru_next != NULL) {
+    /* Unlink */
+    if(flow->lru_prev) flow->lru_prev->lru_next = flow->lru_next; else workflow->lru_head = flow->lru_next;
+    flow->lru_next->lru_prev = flow->lru_prev;
+  }
+
+  flow->lru_prev = workflow->lru_tail, flow->lru_next = NULL;
+
+  if(workflow->lru_tail) workflow->lru_tail->lru_next = flow; else workflow->lru_head = flow;
+  workflow->lru_tail = flow;
+}
+
+/* ***************************************************** */
+
+struct ndpi_flow_info* ndpi_workflow_get_idle_flow(struct ndpi_workflow * workflow,
+						   u_int64_t max_idle_time) {
+  struct ndpi_flow_info *flow = workflow->lru_head;
+
+  if((flow == NULL) || (flow->last_seen + max_idle_time >= workflow->last_time))
+    return(NULL);
+
+  workflow->lru_head = flow->lru_next;
+  if(workflow->lru_head) workflow->lru_head->lru_prev = NULL; else workflow->lru_tail = NULL;
+  flow->lru_next = NULL;
+
+  ndpi_flow_table_remove(workflow->flows, flow->hashval, flow);
+
+  return(flow);
+}
+
+/* ***************************************************** */
+
 int ndpi_workflow_node_cmp(const void *a, const void *b) {
   const struct ndpi_flow_info *fa = (const struct ndpi_flow_info*)a;
   const struct ndpi_flow_info *fb = (const struct ndpi_flow_info*)b;
@@ -655,7 +719,7 @@ static struct ndpi_flow_info *get_ndpi_flow_info(struct ndpi_workflow * workflow
 						 u_int16_t *payload_len,
 						 u_int8_t *src_to_dst_direction,
                                                  struct timeval when) {
-  u_int32_t idx, l4_offset, hashval;
+  u_int32_t l4_offset, hashval;
   struct ndpi_flow_info flow;
   void *ret;
   const u_int8_t *l3, *l4;
@@ -746,26 +810,8 @@ static struct ndpi_flow_info *get_ndpi_flow_info(struct ndpi_workflow * workflow
 	 flow.src_ip, flow.src_port, flow.dst_ip, flow.dst_port);
 #endif
 
-  idx = hashval % workflow->prefs.num_roots;
-  ret = ndpi_tfind(&flow, &workflow->ndpi_flows_root[idx], ndpi_workflow_node_cmp);
-
-  /* to avoid two nodes in one binary tree for a flow */
-  int is_changed = 0;
-  if(ret == NULL) {
-    u_int32_t orig_src_ip = flow.src_ip;
-    u_int16_t orig_src_port = flow.src_port;
-    u_int32_t orig_dst_ip = flow.dst_ip;
-    u_int16_t orig_dst_port = flow.dst_port;
-
-    flow.src_ip = orig_dst_ip;
-    flow.src_port = orig_dst_port;
-    flow.dst_ip = orig_src_ip;
-    flow.dst_port = orig_src_port;
-
-    is_changed = 1;
-
-    ret = ndpi_tfind(&flow, &workflow->ndpi_flows_root[idx], ndpi_workflow_node_cmp);
-  }
+  /* The hash and ndpi_workflow_node_cmp() match both flow directions */
+  ret = ndpi_flow_table_find(workflow->flows, hashval, &flow);
 
   if(ret == NULL) {
     if(workflow->stats.ndpi_flow_count == workflow->prefs.max_ndpi_flows) {
@@ -774,7 +820,7 @@ static struct ndpi_flow_info *get_ndpi_flow_info(struct ndpi_workflow * workflow
 	       workflow->prefs.max_ndpi_flows);
       exit(-1);
     } else {
-      struct ndpi_flow_info *newflow = (struct ndpi_flow_info*)malloc(sizeof(struct ndpi_flow_info));
+      struct ndpi_flow_info *newflow = (struct ndpi_flow_info*)ndpi_slab_alloc(workflow->flow_info_slab);
 
       if(newflow == NULL) {
 	NDPI_LOG(0, workflow->ndpi_struct, NDPI_LOG_ERROR, "[NDPI] %s(1): not enough memory\n", __FUNCTION__);
@@ -782,18 +828,17 @@ static struct ndpi_flow_info *get_ndpi_flow_info(struct ndpi_workflow * workflow
       } else
         workflow->num_allocated_flows++;
 
-      memset(newflow, 0, sizeof(struct ndpi_flow_info));
       newflow->flow_id = flow_id++;
       newflow->hashval = hashval;
       newflow->protocol = iph->protocol, newflow->vlan_id = vlan_id;
       newflow->src_ip = iph->saddr, newflow->dst_ip = iph->daddr;
       newflow->src_port = htons(*sport), newflow->dst_port = htons(*dport);
       newflow->ip_version = version;
-      newflow->iat_c_to_s = ndpi_alloc_data_analysis(DATA_ANALUYSIS_SLIDING_WINDOW),
-	newflow->iat_s_to_c =  ndpi_alloc_data_analysis(DATA_ANALUYSIS_SLIDING_WINDOW);
-      newflow->pktlen_c_to_s = ndpi_alloc_data_analysis(DATA_ANALUYSIS_SLIDING_WINDOW),
-	newflow->pktlen_s_to_c =  ndpi_alloc_data_analysis(DATA_ANALUYSIS_SLIDING_WINDOW),
-	newflow->iat_flow = ndpi_alloc_data_analysis(DATA_ANALUYSIS_SLIDING_WINDOW);;
+      newflow->iat_c_to_s = ndpi_flow_alloc_data_analysis(workflow),
+	newflow->iat_s_to_c =  ndpi_flow_alloc_data_analysis(workflow);
+      newflow->pktlen_c_to_s = ndpi_flow_alloc_data_analysis(workflow),
+	newflow->pktlen_s_to_c =  ndpi_flow_alloc_data_analysis(workflow),
+	newflow->iat_flow = ndpi_flow_alloc_data_analysis(workflow);
 
       if(version == IPVERSION) {
 	inet_ntop(AF_INET, &newflow->src_ip, newflow->src_name, sizeof(newflow->src_name));
@@ -805,28 +850,30 @@ static struct ndpi_flow_info *get_ndpi_flow_info(struct ndpi_workflow * workflow
 	patchIPv6Address(newflow->src_name), patchIPv6Address(newflow->dst_name);
       }
 
-      if((newflow->ndpi_flow = ndpi_flow_malloc(SIZEOF_FLOW_STRUCT)) == NULL) {
+      if((newflow->ndpi_flow = ndpi_slab_alloc(workflow->ndpi_flow_slab)) == NULL) {
 	NDPI_LOG(0, workflow->ndpi_struct, NDPI_LOG_ERROR, "[NDPI] %s(2): not enough memory\n", __FUNCTION__);
-	free(newflow);
+	ndpi_flow_info_freer(newflow);
 	return(NULL);
-      } else
-	memset(newflow->ndpi_flow, 0, SIZEOF_FLOW_STRUCT);
+      }
 
-      if((newflow->src_id = ndpi_malloc(SIZEOF_ID_STRUCT)) == NULL) {
+      if((newflow->src_id = ndpi_slab_alloc(workflow->id_slab)) == NULL) {
 	NDPI_LOG(0, workflow->ndpi_struct, NDPI_LOG_ERROR, "[NDPI] %s(3): not enough memory\n", __FUNCTION__);
-	free(newflow);
+	ndpi_flow_info_freer(newflow);
 	return(NULL);
-      } else
-	memset(newflow->src_id, 0, SIZEOF_ID_STRUCT);
+      }
 
-      if((newflow->dst_id = ndpi_malloc(SIZEOF_ID_STRUCT)) == NULL) {
+      if((newflow->dst_id = ndpi_slab_alloc(workflow->id_slab)) == NULL) {
 	NDPI_LOG(0, workflow->ndpi_struct, NDPI_LOG_ERROR, "[NDPI] %s(4): not enough memory\n", __FUNCTION__);
-	free(newflow);
+	ndpi_flow_info_freer(newflow);
 	return(NULL);
-      } else
-	memset(newflow->dst_id, 0, SIZEOF_ID_STRUCT);
+      }
+
+      if(ndpi_flow_table_insert(workflow->flows, hashval, newflow) != 0) {
+	NDPI_LOG(0, workflow->ndpi_struct, NDPI_LOG_ERROR, "[NDPI] %s(5): not enough memory\n", __FUNCTION__);
+	ndpi_flow_info_freer(newflow);
+	return(NULL);
+      }
 
-      ndpi_tsearch(newflow, &workflow->ndpi_flows_root[idx], ndpi_workflow_node_cmp); /* Add */
       workflow->stats.ndpi_flow_count++;
 
       *src = newflow->src_id, *dst = newflow->dst_id;
@@ -844,28 +891,16 @@ static struct ndpi_flow_info *get_ndpi_flow_info(struct ndpi_workflow * workflow
       return newflow;
     }
   } else {
-    struct ndpi_flow_info *rflow = *(struct ndpi_flow_info**)ret;
-
-    if(is_changed) {
-      if(rflow->src_ip == iph->saddr
-	 && rflow->dst_ip == iph->daddr
-	 && rflow->src_port == htons(*sport)
-	 && rflow->dst_port == htons(*dport)
-	 )
-	*src = rflow->dst_id, *dst = rflow->src_id, *src_to_dst_direction = 0, rflow->bidirectional = 1;
-      else
-	*src = rflow->src_id, *dst = rflow->dst_id, *src_to_dst_direction = 1;
-    }
-    else {
-      if(rflow->src_ip == iph->saddr
-	 && rflow->dst_ip == iph->daddr
-	 && rflow->src_port == htons(*sport)
-	 && rflow->dst_port == htons(*dport)
-	 )
-	*src = rflow->src_id, *dst = rflow->dst_id, *src_to_dst_direction = 1;
-      else
-	*src = rflow->dst_id, *dst = rflow->src_id, *src_to_dst_direction = 0, rflow->bidirectional = 1;
-    }
+    struct ndpi_flow_info *rflow = (struct ndpi_flow_info*)ret;
+
+    if(rflow->src_ip == iph->saddr
+       && rflow->dst_ip == iph->daddr
+       && rflow->src_port == htons(*sport)
+       && rflow->dst_port == htons(*dport)
+       )
+      *src = rflow->src_id, *dst = rflow->dst_id, *src_to_dst_direction = 1;
+    else
+      *src = rflow->dst_id, *dst = rflow->src_id, *src_to_dst_direction = 0, rflow->bidirectional = 1;
     if (src_to_dst_direction) {
       if (rflow->entropy.src2dst_pkt_count < max_num_packets_per_flow) {
         rflow->entropy.src2dst_pkt_len[rflow->entropy.src2dst_pkt_count] = l4_data_len;
@@ -938,40 +973,43 @@ static struct ndpi_flow_info *get_ndpi_flow_info6(struct ndpi_workflow * workflo
 /* ****************************************************** */
 
 void process_ndpi_collected_info(struct ndpi_workflow * workflow, struct ndpi_flow_info *flow) {
+  const union ndpi_flow_protos *protos;
 
   if(!flow->ndpi_flow) return;
 
+  protos = ndpi_flow_get_protos(flow->ndpi_flow);
+
   snprintf(flow->host_server_name, sizeof(flow->host_server_name), "%s",
 	   flow->ndpi_flow->host_server_name);
 
   if(flow->detected_protocol.app_protocol == NDPI_PROTOCOL_DHCP) {
-    snprintf(flow->dhcp_fingerprint, sizeof(flow->dhcp_fingerprint), "%s", flow->ndpi_flow->protos.dhcp.fingerprint);
+    snprintf(flow->dhcp_fingerprint, sizeof(flow->dhcp_fingerprint), "%s", protos->dhcp.fingerprint);
   } else if(flow->detected_protocol.app_protocol == NDPI_PROTOCOL_BITTORRENT) {
     u_int i, j, n = 0;
 
     for(i=0, j = 0; j < sizeof(flow->bittorent_hash)-1; i++) {
       sprintf(&flow->bittorent_hash[j], "%02x",
-	      flow->ndpi_flow->protos.bittorrent.hash[i]);
+	      protos->bittorrent.hash[i]);
 
-      j += 2, n += flow->ndpi_flow->protos.bittorrent.hash[i];
+      j += 2, n += protos->bittorrent.hash[i];
     }
 
     if(n == 0) flow->bittorent_hash[0] = '\0';
   }
   /* MDNS */
   else if(flow->detected_protocol.app_protocol == NDPI_PROTOCOL_MDNS) {
-    snprintf(flow->info, sizeof(flow->info), "%s", flow->ndpi_flow->protos.mdns.answer);
+    snprintf(flow->info, sizeof(flow->info), "%s", protos->mdns.answer);
   }
   /* UBNTAC2 */
   else if(flow->detected_protocol.app_protocol == NDPI_PROTOCOL_UBNTAC2) {
-    snprintf(flow->info, sizeof(flow->info), "%s", flow->ndpi_flow->protos.ubntac2.version);
+    snprintf(flow->info, sizeof(flow->info), "%s", protos->ubntac2.version);
   }
   /* KERBEROS */
   else if(flow->detected_protocol.app_protocol == NDPI_PROTOCOL_KERBEROS) {
-    if(flow->ndpi_flow->protos.kerberos.cname[0] != '\0') {
+    if(protos->kerberos.cname[0] != '\0') {
       snprintf(flow->info, sizeof(flow->info), "%s (%s)",
-	       flow->ndpi_flow->protos.kerberos.cname,
-	       flow->ndpi_flow->protos.kerberos.realm);
+	       protos->kerberos.cname,
+	       protos->kerberos.realm);
     }
   }
   /* HTTP */
@@ -985,34 +1023,34 @@ void process_ndpi_collected_info(struct ndpi_workflow * workflow, struct ndpi_fl
     /* SSH */
     if(flow->detected_protocol.app_protocol == NDPI_PROTOCOL_SSH) {
       snprintf(flow->ssh_tls.client_info, sizeof(flow->ssh_tls.client_info), "%s",
-	       flow->ndpi_flow->protos.ssh.client_signature);
+	       protos->ssh.client_signature);
       snprintf(flow->ssh_tls.server_info, sizeof(flow->ssh_tls.server_info), "%s",
-	       flow->ndpi_flow->protos.ssh.server_signature);
+	       protos->ssh.server_signature);
       snprintf(flow->ssh_tls.client_hassh, sizeof(flow->ssh_tls.client_hassh), "%s",
-	       flow->ndpi_flow->protos.ssh.hassh_client);
+	       protos->ssh.hassh_client);
       snprintf(flow->ssh_tls.server_hassh, sizeof(flow->ssh_tls.server_hassh), "%s",
-	       flow->ndpi_flow->protos.ssh.hassh_server);
+	       protos->ssh.hassh_server);
     }
     /* TLS */
     else if((flow->detected_protocol.app_protocol == NDPI_PROTOCOL_TLS)
 	    || (flow->detected_protocol.master_protocol == NDPI_PROTOCOL_TLS)
-	    || (flow->ndpi_flow->protos.stun_ssl.ssl.ja3_client[0] != '\0')
+	    || (protos->stun_ssl.ssl.ja3_client[0] != '\0')
 	    ) {
-      flow->ssh_tls.ssl_version = flow->ndpi_flow->protos.stun_ssl.ssl.ssl_version;
+      flow->ssh_tls.ssl_version = protos->stun_ssl.ssl.ssl_version;
       snprintf(flow->ssh_tls.client_info, sizeof(flow->ssh_tls.client_info), "%s",
-	       flow->ndpi_flow->protos.stun_ssl.ssl.client_certificate);
+	       protos->stun_ssl.ssl.client_certificate);
       snprintf(flow->ssh_tls.server_info, sizeof(flow->ssh_tls.server_info), "%s",
-	       flow->ndpi_flow->protos.stun_ssl.ssl.server_certificate);
+	       protos->stun_ssl.ssl.server_certificate);
       snprintf(flow->ssh_tls.server_organization, sizeof(flow->ssh_tls.server_organization), "%s",
-	       flow->ndpi_flow->protos.stun_ssl.ssl.server_organization);
-      flow->ssh_tls.notBefore = flow->ndpi_flow->protos.stun_ssl.ssl.notBefore;
-      flow->ssh_tls.notAfter = flow->ndpi_flow->protos.stun_ssl.ssl.notAfter;
+	       protos->stun_ssl.ssl.server_organization);
+      flow->ssh_tls.notBefore = protos->stun_ssl.ssl.notBefore;
+      flow->ssh_tls.notAfter = protos->stun_ssl.ssl.notAfter;
       snprintf(flow->ssh_tls.ja3_client, sizeof(flow->ssh_tls.ja3_client), "%s",
-	       flow->ndpi_flow->protos.stun_ssl.ssl.ja3_client);
+	       protos->stun_ssl.ssl.ja3_client);
       snprintf(flow->ssh_tls.ja3_server, sizeof(flow->ssh_tls.ja3_server), "%s",
-	       flow->ndpi_flow->protos.stun_ssl.ssl.ja3_server);
-      flow->ssh_tls.server_unsafe_cipher = flow->ndpi_flow->protos.stun_ssl.ssl.server_unsafe_cipher;
-      flow->ssh_tls.server_cipher = flow->ndpi_flow->protos.stun_ssl.ssl.server_cipher;
+	       protos->stun_ssl.ssl.ja3_server);
+      flow->ssh_tls.server_unsafe_cipher = protos->stun_ssl.ssl.server_unsafe_cipher;
+      flow->ssh_tls.server_cipher = protos->stun_ssl.ssl.server_cipher;
       memcpy(flow->ssh_tls.sha1_cert_fingerprint,
 	     flow->ndpi_flow->l4.tcp.tls_sha1_certificate_fingerprint, 20);
     }
@@ -1176,6 +1214,7 @@ static struct ndpi_proto packet_processing(struct ndpi_workflow * workflow,
       flow->first_seen = time;
 
     flow->last_seen = time;
+    ndpi_workflow_lru_touch(workflow, flow);
 
     /* Copy packets entropy if num packets count == 10 */
     ndpi_clear_entropy_stats(flow);
@@ -1230,6 +1269,8 @@ static struct ndpi_proto packet_processing(struct ndpi_workflow * workflow,
 	 && (flow->detected_protocol.master_protocol == NDPI_PROTOCOL_TLS)
 	 && (!flow->ndpi_flow->l4.tcp.tls_srv_cert_fingerprint_processed))
 	; /* Wait for certificate fingerprint */
+      else if((!enough_packets) && flow->ndpi_flow->ext && flow->ndpi_flow->ext->cached_verdict)
+	; /* Provisional verdict of the verdict cache: wait for the dissectors */
       else {
 	/* New protocol detected or give up */
 	flow->detection_completed = 1;
@@ -1248,6 +1289,16 @@ static struct ndpi_proto packet_processing(struct ndpi_workflow * workflow,
 	process_ndpi_collected_info(workflow, flow);
       }
     }
+  } else if(workflow->prefs.dissect_extra_packets && flow->check_extra_packets && (flow->ndpi_flow != NULL)) {
+    ndpi_detection_process_packet(workflow->ndpi_struct, ndpi_flow,
+				  iph ? (uint8_t *)iph : (uint8_t *)iph6,
+				  ipsize, time, src, dst);
+
+    if((!ndpi_flow->check_extra_packets)
+       || (ndpi_flow->num_extra_packets_checked >= ndpi_flow->max_extra_packets_to_check)) {
+      flow->check_extra_packets = 0;
+      process_ndpi_collected_info(workflow, flow);
+    }
   }
 
   return(flow->detected_protocol);
@@ -62,8 +62,8 @@ extern int dpdk_port_init(int port, struct rte_mempool *mbuf_pool);
 #define MAX_NUM_READER_THREADS     16
 #define IDLE_SCAN_PERIOD           10 /* msec (use TICK_RESOLUTION = 1000) */
 #define MAX_IDLE_TIME           30000
-#define IDLE_SCAN_BUDGET         1024
-#define NUM_ROOTS                 512
+#define IDLE_SCAN_BUDGET         1024 /* Max flows purged per idle scan */
+#define FLOW_TABLE_SIZE          4096 /* Initial size: the table grows */
 #define MAX_EXTRA_PACKETS_TO_CHECK  7
 #define MAX_NDPI_FLOWS      200000000
 #define TICK_RESOLUTION          1000
@@ -202,7 +202,9 @@ typedef struct ndpi_flow_info {
 
   struct ndpi_entropy entropy;
   struct ndpi_entropy last_entropy;
-  
+
+  /* Workflow list of flows ordered by last_seen (see ndpi_workflow_get_idle_flow) */
+  struct ndpi_flow_info *lru_prev, *lru_next;
 } ndpi_flow_info_t;
 
 
@@ -227,8 +229,11 @@ typedef struct ndpi_stats {
 typedef struct ndpi_workflow_prefs {
   u_int8_t decode_tunnels;
   u_int8_t quiet_mode;
-  u_int32_t num_roots;
+  u_int8_t use_huge_pages;
+  u_int32_t flow_table_size;
   u_int32_t max_ndpi_flows;
+  struct ndpi_ruleset *ruleset; /* rules shared by the workflows (if any) */
+  u_int8_t dissect_extra_packets; /* keep passing packets to the detected flows asking for more */
 } ndpi_workflow_prefs_t;
 
 struct ndpi_workflow;
@@ -253,9 +258,13 @@ typedef struct ndpi_workflow {
   pcap_t *pcap_handle;
 
   /* allocated by prefs */
-  void **ndpi_flows_root;
+  struct ndpi_flow_table *flows;
+  struct ndpi_flow_info *lru_head, *lru_tail; /* Least/most recently seen flow */
   struct ndpi_detection_module_struct *ndpi_struct;
   u_int32_t num_allocated_flows;
+
+  /* Per-flow objects allocators: all released with the workflow */
+  struct ndpi_slab *flow_info_slab, *ndpi_flow_slab, *id_slab, *analysis_slab;
  } ndpi_workflow_t;
 
 
@@ -274,6 +283,13 @@ void ndpi_workflow_free(struct ndpi_workflow * workflow);
 void ndpi_free_flow_info_half(struct ndpi_flow_info *flow);
 
 
+/* Unlink from the workflow and return the least recently seen flow when it
+   has been idle for more than max_idle_time, NULL otherwise: the caller
+   frees the flow */
+struct ndpi_flow_info* ndpi_workflow_get_idle_flow(struct ndpi_workflow * workflow,
+						   u_int64_t max_idle_time);
+
+
 /* Process a packet and update the workflow  */
 struct ndpi_proto ndpi_workflow_process_packet(struct ndpi_workflow * workflow,
 					       const struct pcap_pkthdr *header,
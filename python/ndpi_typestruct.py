@@ -92,13 +92,6 @@ class ndpi_proto_defaults_t(Structure):
         ("func", CFUNCTYPE(None, POINTER(ndpi_detection_module_struct), POINTER(ndpi_flow_struct))),
     ]
 
-class ndpi_default_ports_tree_node_t(Structure):
-    _fields_ = [
-        ("proto", ndpi_proto_defaults_t),
-        ("customUserProto",c_uint8),
-        ("default_port", c_int16)
-    ]
-
 # NDPI_PROTOCOL_BITTORRENT
 class spinlock_t(Structure):
     _fields_ = [("val", c_int)] #missing volatile
@@ -148,10 +141,42 @@ class bt_announce(Structure): # 192 bytes
         ("name", c_uint8 * 149) # 149 bytes
     ]
 
-class ndpi_lru_cache(Structure): # 192 bytes
+class ndpi_lru_cache_stats(Structure):
+    _fields_ = [
+        ("n_insert", c_uint64),
+        ("n_search", c_uint64),
+        ("n_found", c_uint64),
+        ("n_evicted", c_uint64),
+        ("n_expired", c_uint64),
+        ("n_contended", c_uint64),
+    ]
+
+class ndpi_verdict_cache_stats(Structure):
     _fields_ = [
-        ("num_entries", c_uint32),
-        ("entries", POINTER(c_uint32)),
+        ("n_cached", c_uint64),
+        ("n_hits", c_uint64),
+        ("n_verified", c_uint64),
+        ("n_mismatch", c_uint64),
+    ]
+
+class ndpi_lru_cache_shard(Structure):
+    _fields_ = [
+        ("lock", spinlock_t),
+        ("stats", ndpi_lru_cache_stats),
+        ("unused", c_uint8 * 8),
+    ]
+
+class ndpi_lru_cache(Structure):
+    _fields_ = [
+        ("num_sets", c_uint32),
+        ("ttl", c_uint32),
+        ("num_shards", c_uint32),
+        ("num_refs", c_uint32),
+        ("mem", c_void_p),
+        ("entries", c_void_p),
+        ("shards", POINTER(ndpi_lru_cache_shard)),
+        ("secret", c_uint64 * 2),
+        ("stats", ndpi_lru_cache_stats),
     ]
 
 class cache_entry(Structure):
@@ -212,20 +237,8 @@ ndpi_detection_module_struct._fields_ = [
         ("callback_buffer", ndpi_call_function_struct * (ndpi.ndpi_wrap_ndpi_max_supported_protocols() + 1)),
     ("callback_buffer_size", c_uint32),
 
-        ("callback_buffer_tcp_no_payload", ndpi_call_function_struct * (ndpi.ndpi_wrap_ndpi_max_supported_protocols() + 1)),
-    ("callback_buffer_size_tcp_no_payload", c_uint32),
-
-        ("callback_buffer_tcp_payload", ndpi_call_function_struct * (ndpi.ndpi_wrap_ndpi_max_supported_protocols() + 1)),
-    ("callback_buffer_size_tcp_payload", c_uint32),
-
-        ("callback_buffer_udp", ndpi_call_function_struct * (ndpi.ndpi_wrap_ndpi_max_supported_protocols() + 1)),
-    ("callback_buffer_size_udp", c_uint32),
-
-        ("callback_buffer_non_tcp_udp", ndpi_call_function_struct * (ndpi.ndpi_wrap_ndpi_max_supported_protocols() + 1)),
-    ("callback_buffer_size_non_tcp_udp", c_uint32),
-
-        ("tcpRoot", POINTER(ndpi_default_ports_tree_node_t)),
-    ("udpRoot", POINTER(ndpi_default_ports_tree_node_t)),
+        ("tcp_default_ports", POINTER(c_uint16)),
+    ("udp_default_ports", POINTER(c_uint16)),
 
         ("ndpi_log_level", c_uint), #default error
 
@@ -301,9 +314,28 @@ ndpi_detection_module_struct._fields_ = [
 
     # NDPI_PROTOCOL_OOKLA
         ("ookla_cache", POINTER(ndpi_lru_cache)),
+    ("ookla_cache_num_entries", c_uint32),
+    ("ookla_cache_ttl", c_uint32),
 
     # NDPI_PROTOCOL_TINC
-        ("tinc_cache", POINTER(cache)),
+        ("tinc_cache", POINTER(ndpi_lru_cache)),
+
+    # NDPI_PROTOCOL_STUN and subprotocols
+        ("stun_cache", POINTER(ndpi_lru_cache)),
+    ("stun_cache_num_entries", c_uint32),
+    ("stun_cache_ttl", c_uint32),
+
+    # NDPI_PROTOCOL_DNS
+        ("dns_cache", POINTER(ndpi_lru_cache)),
+    ("dns_cache_num_entries", c_uint32),
+    ("dns_cache_max_ttl", c_uint32),
+
+    # Server endpoint verdict cache
+        ("verdict_cache", POINTER(ndpi_lru_cache)),
+    ("verdict_cache_num_entries", c_uint32),
+    ("verdict_cache_ttl", c_uint32),
+    ("verdict_cache_verify_pkts", c_uint8),
+    ("verdict_stats", ndpi_verdict_cache_stats),
 
         ("proto_defaults", ndpi_proto_defaults_t * (ndpi.ndpi_wrap_ndpi_max_supported_protocols() + ndpi.ndpi_wrap_ndpi_max_num_custom_protocols())),
 
@@ -372,7 +404,10 @@ class ndpi_id_struct(Structure):
     ]
 
 #struct flow
+# The l4 structures are packed: their u_int32_t bitfields are declared on bytes
+# (ctypes does not pack bitfields across its containers), with the same layout
 class ndpi_flow_tcp_struct(Structure):
+    _pack_ = 1
     _fields_ = [
         # NDPI_PROTOCOL_MAIL_SMTP
         ('smtp_command_bitmask', c_uint16),
@@ -384,31 +419,38 @@ class ndpi_flow_tcp_struct(Structure):
         ('irc_port', c_uint8),
         ('h323_valid_packets', c_uint8),
         ('gnutella_msg_id', c_uint8 * 3),
-        ('irc_3a_counter', c_uint32, 3),
-        ('irc_stage2', c_uint32, 5),
-        ('irc_direction', c_uint32, 2),
-        ('irc_0x1000_full', c_uint32, 1),
-        ('soulseek_stage', c_uint32, 2),
-        ('tds_stage', c_uint32, 3),
-        ('usenet_stage', c_uint32, 2),
-        ('imesh_stage', c_uint32, 4),
-        ('http_setup_dir', c_uint32, 2),
-        ('http_stage', c_uint32, 2),
-        ('http_empty_line_seen', c_uint32, 1),
-        ('http_wait_for_retransmission', c_uint32, 1),
-        ('gnutella_stage', c_uint32, 2),
-        ('mms_stage', c_uint32, 2),
-        ('yahoo_sip_comm', c_uint32, 1),
-        ('yahoo_http_proxy_stage', c_uint32, 2),
-        ('msn_stage', c_uint32, 3),
-        ('msn_ssl_ft', c_uint32, 2),
-        ('ssh_stage', c_uint32, 3),
-        ('vnc_stage', c_uint32, 2),
-        ('telnet_stage', c_uint32, 2),
-        ('ssl_seen_client_cert', c_uint8, 1),
-        ('ssl_seen_server_cert', c_uint8, 1),
-        ('ssl_seen_certificate', c_uint8, 1),
-        ('ssl_stage', c_uint8, 2),
+        ('irc_3a_counter', c_uint8, 3),
+        ('irc_stage2', c_uint8, 5),
+        ('irc_direction', c_uint8, 2),
+        ('irc_0x1000_full', c_uint8, 1),
+        ('soulseek_stage', c_uint8, 2),
+        ('tds_stage', c_uint8, 3),
+        ('usenet_stage', c_uint8, 2),
+        ('imesh_stage', c_uint8, 4),
+        ('http_setup_dir', c_uint8, 2),
+        ('http_stage', c_uint8, 2),
+        ('http_empty_line_seen', c_uint8, 1),
+        ('http_wait_for_retransmission', c_uint8, 1),
+        ('gnutella_stage', c_uint8, 2),
+        ('mms_stage', c_uint8, 2),
+        ('yahoo_sip_comm', c_uint8, 1),
+        ('yahoo_http_proxy_stage', c_uint8, 2),
+        ('msn_stage', c_uint8, 3),
+        ('msn_ssl_ft', c_uint8, 2),
+        ('ssh_stage', c_uint8, 3),
+        ('vnc_stage', c_uint8, 2),
+        ('telnet_stage', c_uint8, 2),
+        ('tls_srv_cert_fingerprint_ctx', c_void_p),
+        ('tls_seen_client_cert', c_uint8, 1),
+        ('tls_seen_server_cert', c_uint8, 1),
+        ('tls_seen_certificate', c_uint8, 1),
+        ('tls_srv_cert_fingerprint_found', c_uint8, 1),
+        ('tls_srv_cert_fingerprint_processed', c_uint8, 1),
+        ('tls_stage', c_uint8, 2),
+        ('_pad', c_uint8, 1),
+        ('tls_record_offset', c_int16),
+        ('tls_fingerprint_len', c_int16),
+        ('tls_sha1_certificate_fingerprint', c_uint8 * 20),
         ('postgres_stage', c_uint32, 3),
         ('ddlink_server_direction', c_uint32, 1),
         ('seen_syn', c_uint32, 1),
@@ -430,23 +472,24 @@ class ndpi_flow_tcp_struct(Structure):
         ('teamviewer_stage', c_uint8),
         ('prev_zmq_pkt_len', c_uint8),
         ('prev_zmq_pkt', c_ubyte * 10),
-        ('ppstream_stage', c_uint32, 3),
+        ('ppstream_stage', c_uint8, 3),
         ('memcached_matches', c_uint8),
         ('nest_log_sink_matches', c_uint8),
     ]
 
 class ndpi_flow_udp_struct(Structure):
+    _pack_ = 1
     _fields_ = [
         ('battlefield_msg_id', c_uint32),
         ('snmp_msg_id', c_uint32),
-        ('battlefield_stage', c_uint32, 3),
-        ('snmp_stage', c_uint32, 2),
-        ('ppstream_stage', c_uint32, 3),
-        ('halflife2_stage', c_uint32, 2),
-        ('tftp_stage', c_uint32, 1),
-        ('aimini_stage', c_uint32, 5),
-        ('xbox_stage', c_uint32, 1),
-        ('wsus_stage', c_uint32, 1),
+        ('battlefield_stage', c_uint8, 3),
+        ('snmp_stage', c_uint8, 2),
+        ('ppstream_stage', c_uint8, 3),
+        ('halflife2_stage', c_uint8, 2),
+        ('tftp_stage', c_uint8, 1),
+        ('aimini_stage', c_uint8, 5),
+        ('xbox_stage', c_uint8, 1),
+        ('wsus_stage', c_uint8, 1),
         ('skype_packet_id', c_uint8),
         ('teamviewer_stage', c_uint8),
         ('eaq_pkt_id', c_uint8),
@@ -454,6 +497,8 @@ class ndpi_flow_udp_struct(Structure):
         ('rx_conn_epoch', c_uint32),
         ('rx_conn_id', c_uint32),
         ('memcached_matches', c_uint8),
+        ('wireguard_stage', c_uint8),
+        ('wireguard_peer_index', c_uint32 * 2),
     ]
 
 # the tcp / udp / other l4 value union used to reduce the number of bytes for tcp or udp protocol states
@@ -472,7 +517,7 @@ class http(Structure):
 
 class dns(Structure): # the only fields useful for nDPI and ntopng
     _fields_ = [
-        ("num_queries", c_uint8), ("num_answers", c_uint8), ("reply_code", c_uint8),
+        ("num_queries", c_uint8), ("num_answers", c_uint8), ("reply_code", c_uint8), ("is_query", c_uint8),
         ("query_type", c_uint16), ("query_class", c_uint16), ("rsp_type", c_uint16),
         ("rsp_addr", ndpi_ip_addr_t) # The first address in a DNS response packet
     ]
@@ -480,34 +525,36 @@ class dns(Structure): # the only fields useful for nDPI and ntopng
 class ntp(Structure):
     _fields_ = [("request_code", c_uint8), ("version", c_uint8)]
 
+class kerberos(Structure):
+    _fields_ = [("cname", c_char * 24), ("realm", c_char * 24)]
+
 class ssl(Structure):
     _fields_ = [
-        ("ssl_version", c_uint8),
+        ("ssl_version", c_uint16),
         ("client_certificate", c_char * 64), ("server_certificate", c_char * 64), ("server_organization",  c_char * 64),
+        ("notBefore", c_uint32), ("notAfter", c_uint32),
         ("ja3_client", c_char * 33), ("ja3_server", c_char * 33),
         ("server_cipher", c_uint16),
         ("server_unsafe_cipher", c_int)
     ]
 
-class stun(Structure):
+class stun_ssl(Structure): # the STUN counters are in ndpi_flow_struct.stun
+    _fields_ = [("ssl", ssl)]
+
+class ssh(Structure):
     _fields_ = [
-        ("num_udp_pkts", c_uint8),
-        ("num_processed_pkts", c_uint8),
-        ("num_binding_requests", c_uint8),
-        ("is_skype", c_uint8)
+        ("client_signature", c_char * 48), ("server_signature", c_char * 48),
+        ("hassh_client", c_char * 33), ("hassh_server", c_char * 33)
     ]
 
-class stun_ssl(Union): # We can have STUN over SSL thus they need to live together
-    _fields_ = [("ssl", ssl),("stun",stun)]
-
-class ssh(Structure):
-    _fields_ = [("client_signature", c_char * 48), ("server_signature", c_char * 48)]
+class imo(Structure):
+    _fields_ = [("last_one_byte_pkt", c_uint8), ("last_byte", c_uint8)]
 
 class mdns(Structure):
     _fields_ = [("answer", c_char * 96)]
 
 class ubntac2(Structure):
-    _fields_ = [("version", c_char * 96)]
+    _fields_ = [("version", c_char * 32)]
 
 class http2(Structure):
     _fields_ = [
@@ -521,15 +568,18 @@ class bittorrent(Structure): # Bittorrent hash
 class dhcp(Structure):
     _fields_ = [
         ("fingerprint", c_char * 48),
-        ("nat_ip", c_char * 48)
+        ("class_ident", c_char * 48)
     ]
 
+# Per-flow protocol metadata, allocated by the dissectors only when they need it
 class protos(Union):
     _fields_ = [
         ("dns", dns),
         ("ntp", ntp),
+        ("kerberos", kerberos),
         ("stun_ssl", stun_ssl),
         ("ssh", ssh),
+        ("imo", imo),
         ("mdns", mdns),
         ("ubntac2", ubntac2),
         ("http", http2),
@@ -537,7 +587,16 @@ class protos(Union):
         ("dhcp", dhcp)
     ]
 
+# NDPI_PROTOCOL_STUN (kept in the flow as it is updated for every UDP flow)
+class stun(Structure):
+    _fields_ = [
+        ("num_udp_pkts", c_uint8),
+        ("num_processed_pkts", c_uint8),
+        ("num_binding_requests", c_uint8)
+    ]
+
 class tinc_cache_entry(Structure):
+    _pack_ = 1
     _fields_ = [
         ('src_address', c_uint32),
         ('dst_address', c_uint32),
@@ -665,12 +724,14 @@ ndpi_flow_struct._fields_ = [
     ("guessed_host_protocol_id", c_uint16),
     ("guessed_category", c_uint16),
     ("guessed_header_category", c_uint16),
+    ("l4_proto", c_uint8),
     ("protocol_id_already_guessed", c_uint8, 1),
     ("host_already_guessed", c_uint8, 1),
     ("init_finished", c_uint8, 1),
     ("setup_packet_direction", c_uint8, 1),
     ("packet_direction", c_uint8, 1),
     ("check_extra_packets", c_uint8, 1),
+    ("classification_accounted", c_uint8, 1),
 
   # if ndpi_struct->direction_detect_disable == 1 tcp sequence number connection tracking
     ("next_tcp_seq_nr", c_uint32 * 2),
@@ -679,12 +740,14 @@ ndpi_flow_struct._fields_ = [
     ("num_extra_packets_checked", c_uint8),
     ("num_processed_pkts", c_uint8),  # <= WARNING it can wrap but we do expect people to giveup earlier
 
+    ("ext", c_void_p),
+
     ("extra_packets_func", CFUNCTYPE(c_int,POINTER(ndpi_detection_module_struct),POINTER(ndpi_flow_struct))),
 
     ("l4", l4),
 
   # Pointer to src or dst that identifies the server of this connection
-    ("server_id", ndpi_id_struct),
+    ("server_id", POINTER(ndpi_id_struct)),
     # HTTP host or DNS query
     ("host_server_name", c_ubyte * 256),
 
@@ -697,13 +760,21 @@ ndpi_flow_struct._fields_ = [
 
 
     ("http", http),
-    ("protos", protos),
+
+  # Protocol specific metadata: allocated by the dissectors only when they need it, NULL for most flows
+    ("protos", POINTER(protos)),
+
+  # NDPI_PROTOCOL_STUN (kept here as it is updated for every UDP flow)
+    ("stun", stun),
 
   # ALL protocol specific 64 bit variables here
 
   # protocols which have marked a connection as this connection cannot be protocol XXX, multiple u_int64_t
     ("excluded_protocol_bitmask", NDPI_PROTOCOL_BITMASK),
 
+  # callback_buffer entries no longer worth calling for this flow
+    ("excluded_callbacks", c_uint64 * ndpi.ndpi_wrap_ndpi_callback_bitmap_words()),
+
     ("category", c_int),
 
     ('redis_s2d_first_char', c_uint8),
@@ -732,9 +803,10 @@ ndpi_flow_struct._fields_ = [
     ('ftp_control_stage', c_uint8, 2),
     ('rtmp_stage', c_uint8, 2),
     ('pando_stage', c_uint8, 3),
-    ('steam_stage1', c_uint16, 3),
-    ('steam_stage2', c_uint16, 2),
-    ('steam_stage3', c_uint16, 2),
+    ('steam_stage', c_uint8, 3), # u_int16_t bitfields in C: the bytes give the same layout
+    ('steam_stage1', c_uint8, 3),
+    ('steam_stage2', c_uint8, 2),
+    ('steam_stage3', c_uint8, 2),
     ('pplive_stage1', c_uint8, 3),
     ('pplive_stage2', c_uint8, 2),
     ('pplive_stage3', c_uint8, 2),
@@ -749,7 +821,8 @@ ndpi_flow_struct._fields_ = [
     ('csgo_id2', c_uint32),
     ('kxun_counter', c_uint16),
     ('iqiyi_counter', c_uint16),
-    ('packet', ndpi_packet_struct),
+    ('tls_certificate_detected', c_uint8, 4),
+    ('tls_certificate_num_checks', c_uint8, 4),
     ('flow', POINTER(ndpi_flow_struct)),
     ('src', POINTER(ndpi_id_struct)),
     ('dst', POINTER(ndpi_id_struct))
@@ -50,6 +50,10 @@ int ndpi_wrap_ndpi_procol_size(){
   return NDPI_PROTOCOL_SIZE;
 }
 
+int ndpi_wrap_ndpi_callback_bitmap_words(){
+  return NDPI_CALLBACK_BITMAP_WORDS;
+}
+
 void ndpi_wrap_NDPI_BITMASK_SET_ALL(NDPI_PROTOCOL_BITMASK* bitmask){
   NDPI_ONE(bitmask);
 }
@@ -34,7 +34,7 @@ extern "C" {
   /* The #define below is used for apps that dynamically link with nDPI to make
      sure that datastructures and in sync across versions
   */
-#define NDPI_API_VERSION                      1
+#define NDPI_API_VERSION                      2
 
 #define SIZEOF_ID_STRUCT                      ( sizeof(struct ndpi_id_struct)   )
 #define SIZEOF_FLOW_STRUCT                    ( sizeof(struct ndpi_flow_struct) )
@@ -46,6 +46,9 @@ extern "C" {
 #define NO_ADD_TO_DETECTION_BITMASK           0
 #define SAVE_DETECTION_BITMASK_AS_UNKNOWN     1
 #define NO_SAVE_DETECTION_BITMASK_AS_UNKNOWN  0
+#define EXCLUDE_ON_PREFIX_MISMATCH            1
+#define NO_EXCLUDE_ON_PREFIX_MISMATCH         0
+#define EXCLUDE_ON_FIRST_PACKET_PREFIX_MISMATCH 2
 
 
   /**
@@ -126,6 +129,31 @@ extern "C" {
   u_int16_t ndpi_network_ptree_match(struct ndpi_detection_module_struct *ndpi_struct,
 				     struct in_addr *pin);
 
+  /**
+   * Same as ndpi_network_ptree_match() for num addresses at once, faster
+   * than num calls
+   *
+   * @par    ndpi_struct  = the struct created for the protocol detection
+   * @par    pins         = IP host addresses (network byte order)
+   * @par    num          = number of addresses
+   * @par    protocols    = where the nDPI protocol IDs are returned
+   *
+   */
+  void ndpi_network_ptree_match_batch(struct ndpi_detection_module_struct *ndpi_struct,
+				      const struct in_addr *pins, u_int num, u_int16_t *protocols);
+
+  /**
+   * Returns the nDPI protocol id for IP-based protocol detection of an
+   * IPv6 address
+   *
+   * @par    ndpi_struct  = the struct created for the protocol detection
+   * @par    pin          = IPv6 host address (network byte order)
+   * @return the nDPI protocol ID
+   *
+   */
+  u_int16_t ndpi_network_ptree6_match(struct ndpi_detection_module_struct *ndpi_struct,
+				      const struct ndpi_in6_addr *pin);
+
   /**
    * Init single protocol match
    *
@@ -144,6 +172,108 @@ extern "C" {
    */
   struct ndpi_detection_module_struct *ndpi_init_detection_module(void);
 
+  /**
+   * Returns a new initialized detection module whose host/content automata
+   * and IP trees are mapped from a ruleset file written by ndpi_save_ruleset().
+   * The protocols file used to write the ruleset (if any) must still be
+   * loaded with ndpi_load_protocols_file() for protocol names and ports,
+   * while the hosts, IPs and categories of the ruleset cannot be changed
+   *
+   * @par     path = the path of the ruleset file
+   * @return  the initialized detection module or NULL if the file is invalid
+   *
+   */
+  struct ndpi_detection_module_struct *ndpi_init_detection_module_from_ruleset(const char *path);
+
+  /**
+   * Returns a new initialized detection module using the automata and the
+   * IP trees of a ruleset, as ndpi_init_detection_module_from_ruleset().
+   * The ruleset is shared: each module only allocates its own mutable state
+   * (caches, packet and debug state), so a module per thread does not
+   * duplicate the rules. The module keeps a reference to the ruleset
+   *
+   * @par     ruleset = the ruleset
+   * @return  the initialized detection module
+   *
+   */
+  struct ndpi_detection_module_struct *ndpi_init_detection_module_with_ruleset(struct ndpi_ruleset *ruleset);
+
+  /**
+   * Writes the host/content automata and the IP trees of a module (after
+   * loading its protocols and categories) to a ruleset file. The file is
+   * written aside and then renamed over path, so that the rulesets loaded
+   * from the previous file keep their pages
+   *
+   * @par     ndpi_mod = the detection module
+   * @par     path     = the path of the ruleset file
+   * @return  0 if the file is written correctly;
+   *          -1 else
+   *
+   */
+  int ndpi_save_ruleset(struct ndpi_detection_module_struct *ndpi_mod, const char *path);
+
+  /**
+   * Compiles in memory the host/content automata and the IP trees of a
+   * module (after loading its protocols and categories) into a ruleset
+   *
+   * @par     ndpi_mod = the detection module
+   * @return  the ruleset (released with ndpi_release_ruleset()) or NULL
+   *
+   */
+  struct ndpi_ruleset* ndpi_compile_ruleset(struct ndpi_detection_module_struct *ndpi_mod);
+
+  /**
+   * Maps read-only a ruleset file written by ndpi_save_ruleset(). The
+   * file is used in place: while it is loaded it must only be replaced by
+   * renaming a new file over it (as ndpi_save_ruleset() does), never
+   * truncated nor rewritten
+   *
+   * @par     path = the path of the ruleset file
+   * @return  the ruleset (released with ndpi_release_ruleset()) or NULL
+   *          if the file is invalid
+   *
+   */
+  struct ndpi_ruleset* ndpi_load_ruleset(const char *path);
+
+  /**
+   * Releases a reference to a ruleset: it is freed when the last module
+   * using it exits
+   *
+   * @par     ruleset = the ruleset
+   *
+   */
+  void ndpi_release_ruleset(struct ndpi_ruleset *ruleset);
+
+  /**
+   * Publishes an update of a ruleset (e.g. compiled in a background thread
+   * after reloading the protocols and categories). The modules using the
+   * ruleset switch to the update when they start processing their next
+   * unclassified packet or call ndpi_ruleset_quiescent(), and the old
+   * ruleset is freed once no module uses it anymore: the chain of the
+   * published rulesets stays pinned in memory until every module has moved.
+   * Protocol names and ports are not part of a ruleset: the update must be
+   * built with the same protocol definitions
+   *
+   * @par     ruleset = the ruleset being replaced
+   * @par     update  = the new ruleset (the caller keeps its reference)
+   * @return  0 if the update has been published;
+   *          -1 if ruleset has already been replaced
+   *
+   */
+  int ndpi_publish_ruleset(struct ndpi_ruleset *ruleset, struct ndpi_ruleset *update);
+
+  /**
+   * Marks a quiescent point of a module: it moves to the last update published
+   * for its ruleset, releasing the ones it replaces. Modules only seeing
+   * already classified flows, or no traffic at all, must call it periodically
+   * (e.g. from the idle flows scan) so that the old rulesets can be freed.
+   * It must be called by the thread owning the module, between packets
+   *
+   * @par     ndpi_struct = the detection module
+   *
+   */
+  void ndpi_ruleset_quiescent(struct ndpi_detection_module_struct *ndpi_struct);
+
   /**
    * Frees the memory allocated in the specified flow
    *
@@ -152,6 +282,68 @@ extern "C" {
    */
   void ndpi_free_flow(struct ndpi_flow_struct *flow);
 
+  /**
+   * Frees the memory referenced by the specified flow but not the flow
+   * itself, for flows allocated with a custom allocator
+   *
+   * @par flow  = the flow whose data has to be released
+   *
+   */
+  void ndpi_free_flow_data(struct ndpi_flow_struct *flow);
+
+  /**
+   * Returns the protocol metadata of the flow, allocating it if needed.
+   * To be used by the dissectors before writing flow->protos
+   *
+   * @par flow  = the flow
+   * @return the flow protocol metadata, or NULL if it cannot be allocated
+   *
+   */
+  union ndpi_flow_protos *ndpi_flow_alloc_protos(struct ndpi_flow_struct *flow);
+
+  /**
+   * Returns the protocol metadata of the flow for reading: flows whose
+   * metadata has never been allocated return an all-zero instance
+   *
+   * @par flow  = the flow
+   * @return the flow protocol metadata (never NULL)
+   *
+   */
+  const union ndpi_flow_protos *ndpi_flow_get_protos(const struct ndpi_flow_struct *flow);
+
+  /**
+   * Returns the compact verdict of a flow, i.e. what ndpi_detection_process_packet
+   * returns for it, so that the caller can cache it in its own flow table
+   *
+   * @par ndpi_struct  = the detection module
+   * @par flow         = the flow
+   * @par verdict      = the verdict to fill
+   * @return 1 if the verdict is final (protocol detected and no extra dissection), 0 otherwise
+   *
+   */
+  u_int8_t ndpi_flow_get_verdict(struct ndpi_detection_module_struct *ndpi_struct,
+				 struct ndpi_flow_struct *flow,
+				 ndpi_flow_verdict *verdict);
+
+  /**
+   * Fills the verdict of a flow and frees the flow through the allocator
+   * that owns it. Call it once ndpi_flow_get_verdict reports a final
+   * verdict: the flow must not be used afterwards
+   *
+   * @par ndpi_struct  = the detection module
+   * @par flow         = the flow to release
+   * @par verdict      = the verdict to fill (may be NULL)
+   * @par flow_free    = frees the flow storage (e.g. ndpi_slab_free for the flows
+   *                     taken with ndpi_slab_alloc), after the flow data has been
+   *                     freed with ndpi_free_flow_data. NULL for the flows
+   *                     allocated with ndpi_flow_malloc, freed with ndpi_flow_free
+   *
+   */
+  void ndpi_flow_release(struct ndpi_detection_module_struct *ndpi_struct,
+			 struct ndpi_flow_struct *flow,
+			 ndpi_flow_verdict *verdict,
+			 void (*flow_free)(void *ptr));
+
   /**
    * Enables cache support.
    * In nDPI is used for some protocol (i.e. Skype)
@@ -197,6 +389,30 @@ extern "C" {
 					   u_int8_t b_save_bitmask_unknow,
 					   u_int8_t b_add_detection_bitmask);
 
+  /**
+   * Restricts a callback registered with ndpi_set_bitmask_protocol_detection
+   * to packets whose payload starts with one of the given bytes.
+   * Must be called after ndpi_set_bitmask_protocol_detection with the same index
+   *
+   * @par ndpi_struct                 = the detection module
+   * @par idx                         = the index of the callback_buffer
+   * @par first_payload_bytes         = the accepted values of the first payload byte
+   * @par num_first_payload_bytes     = the number of entries of first_payload_bytes
+   * @par b_exclude_on_prefix_mismatch = if set as "true" the protocol is excluded from
+   *                                    the flow on mismatch (the dissector would do the same),
+   *                                    otherwise the dissector is just not invoked.
+   *                                    EXCLUDE_ON_FIRST_PACKET_PREFIX_MISMATCH checks the prefix
+   *                                    only on the first payload packet of the flow, for the
+   *                                    dissectors that exclude themselves there (e.g. SSH) but
+   *                                    accept any payload later on
+   *
+   */
+  void ndpi_set_bitmask_protocol_prefix(struct ndpi_detection_module_struct *ndpi_struct,
+					const u_int32_t idx,
+					const u_int8_t *first_payload_bytes,
+					u_int16_t num_first_payload_bytes,
+					u_int8_t b_exclude_on_prefix_mismatch);
+
   /**
    * Sets the protocol bitmask2
    *
@@ -278,6 +494,36 @@ extern "C" {
 					      const u_int64_t current_tick,
 					      struct ndpi_id_struct *src,
 					      struct ndpi_id_struct *dst);
+
+  /**
+   * Processes a burst of packets (e.g. as received from a DPDK port) and returns
+   * the detected protocol of each of them in ret[].
+   * Packets are handled as with ndpi_detection_process_packet, in order for each
+   * flow; packets of different flows may be processed grouped by L4 protocol.
+   * Already detected flows that do not need extra dissection are answered
+   * without touching their packet state.
+   *
+   * @par    ndpi_struct   = the detection module
+   * @par    flows         = array of pointers to the connection state machines
+   * @par    packets       = array of pointers to the Layer 3 (IP header)
+   * @par    packetlens    = array of packet lengths
+   * @par    current_ticks = array of packet timestamps
+   * @par    srcs          = array of pointers to the source subscriber state machines
+   * @par    dsts          = array of pointers to the destination subscriber state machines
+   * @par    num_packets   = the number of entries of the arrays above
+   * @par    ret           = array of num_packets entries filled with the detected protocols
+   *
+   */
+  void ndpi_detection_process_packet_burst(struct ndpi_detection_module_struct *ndpi_struct,
+					   struct ndpi_flow_struct **flows,
+					   const unsigned char **packets,
+					   const unsigned short *packetlens,
+					   const u_int64_t *current_ticks,
+					   struct ndpi_id_struct **srcs,
+					   struct ndpi_id_struct **dsts,
+					   u_int32_t num_packets,
+					   ndpi_protocol *ret);
+
   /**
    * Get the main protocol of the passed flows for the detected module
    *
@@ -422,6 +668,17 @@ extern "C" {
 				  struct ndpi_flow_struct *flow,
 				  u_int16_t master_protocol_id,
 				  const char *_file, const char *_func,int _line);
+  /**
+   * Revert a previous exclusion of a protocol so that its dissector is called again
+   *
+   * @par    ndpi_struct         = the detection module
+   * @par    flow                = the flow
+   * @par    protocol_id         = the protocol to search again
+   *
+   */
+  void ndpi_include_protocol(struct ndpi_detection_module_struct *ndpi_struct,
+			     struct ndpi_flow_struct *flow,
+			     u_int16_t protocol_id);
   /**
    * Check if the string -bigram_to_match- match with a bigram of -automa-
    *
@@ -634,6 +891,29 @@ extern "C" {
    */
   u_int ndpi_get_num_supported_protocols(struct ndpi_detection_module_struct *ndpi_mod);
 
+  /**
+   * Get the number of dissector invocations since the module was created
+   *
+   * @par     ndpi_mod = the detection module
+   * @return  the number of dissector calls
+   *
+   */
+  u_int64_t ndpi_get_num_dissector_calls(struct ndpi_detection_module_struct *ndpi_mod);
+
+  /**
+   * Get the counters of each dissector since the module was created.
+   * They are only collected when the library is configured with
+   * --enable-dissector-profiling
+   *
+   * @par     ndpi_mod      = the detection module
+   * @par     stats         = the array where the counters are copied
+   * @par     max_num_stats = the number of entries of stats
+   * @return  the number of entries copied, or -1 if profiling is not compiled in
+   *
+   */
+  int ndpi_get_dissector_stats(struct ndpi_detection_module_struct *ndpi_mod,
+			       struct ndpi_dissector_stats *stats, u_int32_t max_num_stats);
+
   /**
    * Get the nDPI version release
    *
@@ -767,6 +1047,10 @@ extern "C" {
 				 u_int32_t saddr,
 				 u_int32_t daddr,
 				 ndpi_protocol *ret);
+  int ndpi_fill_ip6_protocol_category(struct ndpi_detection_module_struct *ndpi_struct,
+				      const struct ndpi_in6_addr *saddr,
+				      const struct ndpi_in6_addr *daddr,
+				      ndpi_protocol *ret);
   int ndpi_match_custom_category(struct ndpi_detection_module_struct *ndpi_struct,
 				 char *name, u_int name_len, unsigned long *id);
   void ndpi_fill_protocol_category(struct ndpi_detection_module_struct *ndpi_struct,
@@ -774,6 +1058,18 @@ extern "C" {
 				   ndpi_protocol *ret);
   int ndpi_get_custom_category_match(struct ndpi_detection_module_struct *ndpi_struct,
 				     char *name_or_ip, u_int name_len, unsigned long *id);
+
+  /**
+   * Returns the counters of the Bloom filter skipping the category hostname
+   * lookups (ndpi_pref_enable_category_filter)
+   *
+   * @par     ndpi_struct = the detection module
+   * @par     stats       = where the counters are returned
+   * @return  0 on success, -1 if the module has no filter
+   *
+   */
+  int ndpi_get_category_filter_stats(struct ndpi_detection_module_struct *ndpi_struct,
+				     struct ndpi_category_filter_stats *stats);
   int ndpi_set_detection_preferences(struct ndpi_detection_module_struct *ndpi_mod,
 				     ndpi_detection_preference pref,
 				     int value);
@@ -789,11 +1085,121 @@ extern "C" {
   void ndpi_set_log_level(struct ndpi_detection_module_struct *ndpi_mod, u_int l);
 
   /* LRU cache */
-  struct ndpi_lru_cache* ndpi_lru_cache_init(u_int32_t num_entries);
+
+  /**
+   * Creates a set associative cache (NDPI_LRU_CACHE_WAYS ways) of at least
+   * num_entries entries whose entries expire ttl seconds after they have
+   * been added (0 = never)
+   *
+   * @return  the cache or NULL if num_entries is 0 or in case of error
+   *
+   */
+  struct ndpi_lru_cache* ndpi_lru_cache_init(u_int32_t num_entries, u_int32_t ttl);
+
+  /**
+   * Same as ndpi_lru_cache_init() for a cache that can be used by several
+   * threads at once (see ndpi_set_lru_cache). Its sets are split into
+   * num_shards shards (rounded up to a power of 2), each with its own lock
+   *
+   */
+  struct ndpi_lru_cache* ndpi_lru_cache_init_shared(u_int32_t num_entries, u_int32_t ttl, u_int32_t num_shards);
+
+  /**
+   * Releases a reference to the cache, freeing it with the last one
+   *
+   */
   void ndpi_lru_free_cache(struct ndpi_lru_cache *c);
-  u_int8_t ndpi_lru_find_cache(struct ndpi_lru_cache *c, u_int32_t key,
-			       u_int16_t *value, u_int8_t clean_key_when_found);
-  void ndpi_lru_add_to_cache(struct ndpi_lru_cache *c, u_int32_t key, u_int16_t value);
+
+  /**
+   * Hashes a 16 bytes key (e.g. an IPv6 address) into a cache key with
+   * SipHash-2-4, keyed with a random secret of the cache: the keys that
+   * collide cannot be computed without it. The modules sharing a cache
+   * share its secret
+   *
+   */
+  u_int64_t ndpi_lru_hash_128(const struct ndpi_lru_cache *c, const void *data);
+
+  /**
+   * Looks up key at the packet time now_sec (seconds)
+   *
+   * @par     value = where the cached value is returned
+   * @return  1 if found, 0 otherwise
+   *
+   */
+  u_int8_t ndpi_lru_find_cache(struct ndpi_lru_cache *c, u_int64_t key,
+			       u_int32_t *value, u_int8_t clean_key_when_found, u_int32_t now_sec);
+
+  /**
+   * Adds or updates key, evicting the least recently used entry of its set
+   * if there is no room. Only the NDPI_LRU_CACHE_VALUE_MASK bits of value
+   * are stored
+   *
+   */
+  void ndpi_lru_add_to_cache(struct ndpi_lru_cache *c, u_int64_t key, u_int32_t value, u_int32_t now_sec);
+
+  /**
+   * Same as ndpi_lru_add_to_cache() with an entry specific ttl (0 = never
+   * expires) instead of the one of the cache
+   *
+   */
+  void ndpi_lru_add_to_cache_ttl(struct ndpi_lru_cache *c, u_int64_t key, u_int32_t value,
+				 u_int32_t now_sec, u_int32_t ttl);
+  void ndpi_lru_get_stats(struct ndpi_lru_cache *c, struct ndpi_lru_cache_stats *stats);
+
+  /**
+   * Returns the counters of one of the caches of the module
+   *
+   * @return  0 on success, -1 if the cache has not been allocated (yet)
+   *
+   */
+  int ndpi_get_lru_cache_stats(struct ndpi_detection_module_struct *ndpi_struct,
+			       ndpi_lru_cache_type cache_type, struct ndpi_lru_cache_stats *stats);
+
+  /**
+   * Makes the module use c (typically a shared cache used by the modules of
+   * all the threads) instead of its own cache of that type, taking a
+   * reference to it. It must be called before the module processes packets
+   *
+   * @return  0 on success, -1 if the cache type is unknown
+   *
+   */
+  int ndpi_set_lru_cache(struct ndpi_detection_module_struct *ndpi_struct,
+			 ndpi_lru_cache_type cache_type, struct ndpi_lru_cache *c);
+
+  /**
+   * Remembers that addr was returned by a DNS response for a hostname of
+   * protocol and/or of a custom category (NDPI_PROTOCOL_CATEGORY_UNSPECIFIED
+   * if none), for ttl seconds (capped by ndpi_pref_dns_cache_max_ttl): the
+   * flows towards addr are then classified on their first packet. It does
+   * nothing unless ndpi_pref_dns_cache_num_entries has been set
+   *
+   */
+  void ndpi_dns_cache_add(struct ndpi_detection_module_struct *ndpi_struct,
+			  const ndpi_ip_addr_t *addr, u_int8_t is_ipv6,
+			  u_int16_t protocol, ndpi_protocol_category_t category, u_int32_t ttl);
+
+  /**
+   * Returns the counters of the server endpoint verdict cache
+   * (ndpi_pref_verdict_cache_num_entries). Its hit rate is given by the
+   * counters of the ndpi_lru_cache_verdict cache
+   *
+   */
+  void ndpi_get_verdict_cache_stats(struct ndpi_detection_module_struct *ndpi_struct,
+				    struct ndpi_verdict_cache_stats *stats);
+
+  /**
+   * Returns the packets, payload bytes and ticks that the flows of a
+   * protocol needed to be classified, and how many were given up
+   * (ndpi_pref_enable_classification_stats)
+   *
+   * @par    ndpi_struct = the detection module
+   * @par    protocol_id = the protocol (detected_protocol_stack[0])
+   * @par    stats       = where the counters are copied
+   * @return 0 on success, -1 if the statistics are disabled or the protocol is unknown
+   *
+   */
+  int ndpi_get_classification_stats(struct ndpi_detection_module_struct *ndpi_struct,
+				    u_int16_t protocol_id, struct ndpi_classification_stats *stats);
   
   /**
    * Add a string to match to an automata
@@ -931,6 +1337,272 @@ extern "C" {
   const char* ndpi_data_ratio2str(float ratio);
   
   void ndpi_data_print_window_values(struct ndpi_analyze_struct *s); /* debug */
+
+  /* Slab allocator */
+
+  /**
+   * Creates an allocator of obj_size bytes objects. Objects are carved
+   * out of NDPI_SLAB_CHUNK_SIZE chunks that are never returned to the
+   * system before ndpi_slab_destroy(). A slab must be used by one thread
+   *
+   * @par obj_size        = size of the objects
+   * @par use_huge_pages  = back the chunks with huge pages when available
+   * @return  the slab or NULL in case of error
+   *
+   */
+  struct ndpi_slab* ndpi_slab_init(u_int32_t obj_size, u_int8_t use_huge_pages);
+
+  /**
+   * Returns a zeroed object, or NULL when out of memory
+   *
+   */
+  void* ndpi_slab_alloc(struct ndpi_slab *s);
+
+  /**
+   * Puts an object back into the slab it was allocated from
+   *
+   */
+  void ndpi_slab_free(void *ptr);
+
+  /**
+   * Releases all the chunks of the slab at once, including the objects
+   * that are still allocated
+   *
+   */
+  void ndpi_slab_destroy(struct ndpi_slab *s);
+
+  /**
+   * Binds a slab to the calling thread for ndpi_slab_flow_malloc().
+   * Install ndpi_slab_flow_malloc/ndpi_slab_flow_free with
+   * set_ndpi_flow_malloc/set_ndpi_flow_free to allocate the flows of each
+   * thread from its own slab of SIZEOF_FLOW_STRUCT objects.
+   * Every thread calling ndpi_flow_malloc() must bind a slab first
+   *
+   */
+  void ndpi_slab_set_thread_flow_slab(struct ndpi_slab *s);
+
+  /**
+   * Allocates a flow from the slab bound to the calling thread.
+   * There is no fallback to ndpi_malloc(): ndpi_slab_flow_free() finds the
+   * owning slab from the object address, so it must only get slab objects
+   *
+   * @par size  = the flow size (at most the object size of the slab)
+   * @return  the flow, or NULL when out of memory, when no slab is bound to
+   *          the thread or when size exceeds the slab object size
+   *
+   */
+  void* ndpi_slab_flow_malloc(size_t size);
+
+  /**
+   * Frees the data of a flow returned by ndpi_slab_flow_malloc()
+   * and puts it back into its slab
+   *
+   */
+  void ndpi_slab_flow_free(void *ptr);
+
+  /* Flow hash table */
+
+  /**
+   * Creates an open addressing hash table sized for num_entries entries:
+   * it grows when needed. Entries are compared with cmp() that returns 0
+   * when the key matches the entry. The table is not thread safe
+   *
+   * @par num_entries  = expected number of entries
+   * @par cmp          = key/entry comparison function
+   * @return  the table or NULL in case of error
+   *
+   */
+  struct ndpi_flow_table* ndpi_flow_table_init(u_int32_t num_entries,
+					       int (*cmp)(const void *a, const void *b));
+
+  /**
+   * Returns the entry matching the key, or NULL. Equal keys must have the
+   * same hash
+   *
+   */
+  void* ndpi_flow_table_find(struct ndpi_flow_table *t, u_int32_t hash, const void *key);
+
+  /**
+   * Adds an entry that is not yet in the table
+   *
+   * @return  0 on success, -1 when out of memory
+   *
+   */
+  int ndpi_flow_table_insert(struct ndpi_flow_table *t, u_int32_t hash, void *entry);
+
+  /**
+   * Removes the entry matching the key from the table and returns it
+   *
+   */
+  void* ndpi_flow_table_remove(struct ndpi_flow_table *t, u_int32_t hash, const void *key);
+
+  /**
+   * Calls walker() for every entry: the table must not be modified meanwhile.
+   * ndpi_flow_table_walk_slots() walks num_slots slots starting at
+   * first_slot and returns the slot where to continue (0 after the last one)
+   *
+   */
+  void ndpi_flow_table_walk(struct ndpi_flow_table *t,
+			    void (*walker)(void *entry, void *user_data),
+			    void *user_data);
+  u_int32_t ndpi_flow_table_walk_slots(struct ndpi_flow_table *t,
+				       u_int32_t first_slot, u_int32_t num_slots,
+				       void (*walker)(void *entry, void *user_data),
+				       void *user_data);
+
+  /**
+   * Frees the table, calling free_entry() (when not NULL) for every entry
+   *
+   */
+  void ndpi_flow_table_destroy(struct ndpi_flow_table *t, void (*free_entry)(void *entry));
+
+  /* Domain suffix trie */
+
+  /**
+   * Creates an empty set of domain names, matched on label boundaries:
+   * "example.com" matches "example.com" and "www.example.com" but not
+   * "badexample.com". The trie is not thread safe while it is updated
+   *
+   * @return  the trie or NULL in case of error
+   *
+   */
+  struct ndpi_domain_trie* ndpi_domain_trie_init(void);
+
+  /**
+   * Adds a domain name ("example.com", ".example.com" or "*.example.com")
+   * with its value, replacing the previous value of the same domain
+   *
+   * @return  0 on success, -1 if domain is not a valid host name or when out of memory
+   *
+   */
+  int ndpi_domain_trie_add(struct ndpi_domain_trie *t, const char *domain, u_int32_t value);
+
+  /**
+   * Looks up the longest domain that name is or belongs to (case insensitive)
+   *
+   * @par value  = where the value of the domain is returned
+   * @return  1 if found, 0 otherwise
+   *
+   */
+  int ndpi_domain_trie_match(const struct ndpi_domain_trie *t, const char *name, u_int name_len,
+			     u_int32_t *value);
+
+  /**
+   * Frees the trie
+   *
+   */
+  void ndpi_domain_trie_free(struct ndpi_domain_trie *t);
+
+  /* IPv4 longest prefix match */
+
+  /**
+   * Creates an empty set of IPv4 prefixes. Lookups cost one memory access
+   * for the addresses matching at most a /16, two up to a /24 and three
+   * beyond. The set is not thread safe while it is updated
+   *
+   * @return  the set or NULL in case of error
+   *
+   */
+  struct ndpi_lpm4* ndpi_lpm4_init(void);
+
+  /**
+   * Adds a prefix (the address bits past the prefix length are ignored)
+   * with its value (lower than 0x7FFFFFFF), replacing the previous value
+   * of the same prefix. Prefixes can be added in any order
+   *
+   * @return  0 on success, -1 if bits is larger than 32, if value is too large or when out of memory
+   *
+   */
+  int ndpi_lpm4_add(struct ndpi_lpm4 *t, u_int32_t addr /* network byte order */, u_int8_t bits, u_int32_t value);
+
+  /**
+   * Looks up the longest prefix containing addr (network byte order)
+   *
+   * @par value  = where the value of the prefix is returned
+   * @return  1 if found, 0 otherwise
+   *
+   */
+  int ndpi_lpm4_match(const struct ndpi_lpm4 *t, u_int32_t addr, u_int32_t *value);
+
+  /**
+   * Looks up num addresses (network byte order) at once, overlapping their
+   * memory accesses: values[i] is the value of the longest prefix containing
+   * addrs[i], or not_found
+   *
+   */
+  void ndpi_lpm4_match_batch(const struct ndpi_lpm4 *t, const u_int32_t *addrs, u_int num,
+			     u_int32_t *values, u_int32_t not_found);
+
+  /**
+   * Frees the set
+   *
+   */
+  void ndpi_lpm4_free(struct ndpi_lpm4 *t);
+
+  /* IPv6 longest prefix match */
+
+  /**
+   * Creates an empty set of IPv6 prefixes. Lookups cost one memory access
+   * for the first 16 bits of the address and one per following byte
+   * covered by the prefixes. The set is not thread safe while it is updated
+   *
+   * @return  the set or NULL in case of error
+   *
+   */
+  struct ndpi_lpm6* ndpi_lpm6_init(void);
+
+  /**
+   * Adds a prefix (the address bits past the prefix length are ignored)
+   * with its value, replacing the previous value of the same prefix
+   *
+   * @return  0 on success, -1 if bits is larger than 128 or when out of memory
+   *
+   */
+  int ndpi_lpm6_add(struct ndpi_lpm6 *t, const struct ndpi_in6_addr *addr, u_int8_t bits, u_int32_t value);
+
+  /**
+   * Looks up the longest prefix containing addr
+   *
+   * @par value  = where the value of the prefix is returned
+   * @return  1 if found, 0 otherwise
+   *
+   */
+  int ndpi_lpm6_match(const struct ndpi_lpm6 *t, const struct ndpi_in6_addr *addr, u_int32_t *value);
+
+  /**
+   * Frees the set
+   *
+   */
+  void ndpi_lpm6_free(struct ndpi_lpm6 *t);
+
+  /* Bloom filter */
+
+  /**
+   * Creates an empty blocked Bloom filter sized for num_keys keys. Keys are
+   * 64 bit hashes: both halves must be well distributed
+   *
+   * @return  the filter or NULL in case of error
+   *
+   */
+  struct ndpi_bloom* ndpi_bloom_init(u_int32_t num_keys);
+
+  /**
+   * Adds a key to the filter
+   *
+   */
+  void ndpi_bloom_add(struct ndpi_bloom *b, u_int64_t hash);
+
+  /**
+   * Tests a key: 0 means that it has not been added, 1 that it probably has
+   *
+   */
+  int ndpi_bloom_contains(const struct ndpi_bloom *b, u_int64_t hash);
+
+  /**
+   * Frees the filter
+   *
+   */
+  void ndpi_bloom_free(struct ndpi_bloom *b);
 #ifdef __cplusplus
 }
 #endif
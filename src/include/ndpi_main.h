@@ -149,6 +149,45 @@ extern "C" {
 #define ndpi_match_strprefix(payload, payload_len, str)			\
   ndpi_match_prefix((payload), (payload_len), (str), (sizeof(str)-1))
 
+  /* Compiled rulesets (ndpi_ruleset.c) */
+  struct ndpi_ruleset* ndpi_ruleset_get(struct ndpi_ruleset *r);
+  const void* ndpi_ruleset_get_section(struct ndpi_ruleset *r, u_int id, size_t *len);
+  int ndpi_ruleset_lpm4_match(struct ndpi_ruleset *r, u_int id,
+			      u_int32_t addr /* network byte order */, u_int32_t *value);
+  void ndpi_ruleset_lpm4_match_batch(struct ndpi_ruleset *r, u_int id, const u_int32_t *addrs, u_int num,
+				     u_int32_t *values, u_int32_t not_found);
+  int ndpi_ruleset_domain_match(struct ndpi_ruleset *r, u_int id,
+				const char *name, u_int name_len, u_int32_t *value);
+  int ndpi_ruleset_lpm6_match(struct ndpi_ruleset *r, u_int id,
+			      const struct ndpi_in6_addr *addr, u_int32_t *value);
+
+  /* Domain trie images (ndpi_domain_trie.c) */
+  size_t ndpi_domain_trie_image_size(const struct ndpi_domain_trie *t);
+  void ndpi_domain_trie_write_image(const struct ndpi_domain_trie *t, void *buf);
+  int ndpi_domain_trie_image_check(const void *buf, size_t len);
+  int ndpi_domain_trie_image_match(const void *buf, size_t len,
+				   const char *name, u_int name_len, u_int32_t *value);
+
+  /* Bloom filter images (ndpi_bloom.c) */
+  size_t ndpi_bloom_image_size(const struct ndpi_bloom *b);
+  void ndpi_bloom_write_image(const struct ndpi_bloom *b, void *buf);
+  int ndpi_bloom_image_check(const void *buf, size_t len);
+  int ndpi_bloom_image_contains(const void *buf, u_int64_t hash);
+
+  /* IPv4 longest prefix match images (ndpi_lpm.c) */
+  size_t ndpi_lpm4_image_size(const struct ndpi_lpm4 *t);
+  void ndpi_lpm4_write_image(const struct ndpi_lpm4 *t, void *buf);
+  int ndpi_lpm4_image_check(const void *buf, size_t len);
+  int ndpi_lpm4_image_match(const void *buf, u_int32_t addr, u_int32_t *value);
+  void ndpi_lpm4_image_match_batch(const void *buf, const u_int32_t *addrs, u_int num,
+				   u_int32_t *values, u_int32_t not_found);
+
+  /* IPv6 longest prefix match images (ndpi_lpm.c) */
+  size_t ndpi_lpm6_image_size(const struct ndpi_lpm6 *t);
+  void ndpi_lpm6_write_image(const struct ndpi_lpm6 *t, void *buf);
+  int ndpi_lpm6_image_check(const void *buf, size_t len);
+  int ndpi_lpm6_image_match(const void *buf, const struct ndpi_in6_addr *addr, u_int32_t *value);
+
 #ifdef __cplusplus
 }
 #endif
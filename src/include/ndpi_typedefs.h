@@ -445,15 +445,75 @@ typedef enum {
 } ndpi_http_method;
 
 struct ndpi_lru_cache_entry {
-  u_int32_t key; /* Store the whole key to avoid ambiguities */
-  u_int32_t is_full:1, value:16, pad:15;
+  u_int64_t key;       /* Store the whole key to avoid ambiguities */
+  u_int32_t expiry;    /* Packet time (sec) after which the entry is stale, 0 = never */
+  u_int32_t value:29 /* NDPI_LRU_CACHE_VALUE_MASK */, is_full:1,
+    rank:2; /* rank 0 is the most recently used way of the set */
 };
-  
+
+struct ndpi_lru_cache_stats {
+  u_int64_t n_insert, n_search, n_found;
+  u_int64_t n_evicted;   /* Valid entries replaced by an insert */
+  u_int64_t n_expired;   /* Entries found older than the TTL */
+  u_int64_t n_contended; /* Shared caches: lock acquisitions that had to wait */
+};
+
+struct ndpi_lru_cache_shard {
+  spinlock_t lock;
+  struct ndpi_lru_cache_stats stats;
+  u_int8_t unused[8]; /* One cache line per shard */
+};
+
 struct ndpi_lru_cache {
-  u_int32_t num_entries;
-  struct ndpi_lru_cache_entry *entries;
+  u_int32_t num_sets, ttl /* sec, 0 = no expiry (default of ndpi_lru_add_to_cache) */;
+  u_int32_t num_shards /* 0 = not shared */, num_refs;
+  void *mem;
+  struct ndpi_lru_cache_entry *entries; /* NDPI_LRU_CACHE_WAYS per set, each set in a cache line */
+  struct ndpi_lru_cache_shard *shards;
+  u_int64_t secret[2]; /* SipHash key of the long keys, see ndpi_lru_hash_128() */
+  struct ndpi_lru_cache_stats stats; /* Not shared caches only */
+};
+
+struct ndpi_verdict_cache_stats {
+  u_int64_t n_cached;   /* Verdicts of the dissectors added to the cache */
+  u_int64_t n_hits;     /* Flows classified from the cache */
+  u_int64_t n_verified; /* Cached verdicts checked against the dissectors... */
+  u_int64_t n_mismatch; /* ...that turned out to be different */
 };
 
+/*
+  Effort needed to classify the flows of a protocol
+  (ndpi_pref_enable_classification_stats). The histograms are log scale:
+  bin 0 counts the zero values, bin i the values in [2^(i-1), 2^i), the
+  last bin also the ones above
+*/
+#define NDPI_CLASSIFICATION_HISTOGRAM_BINS 20
+
+struct ndpi_classification_stats {
+  u_int64_t num_classified; /* Flows detected by the dissectors or the caches */
+  u_int64_t num_giveups;    /* Flows given up (ndpi_detection_giveup), possibly guessed as this protocol */
+  u_int64_t packets[NDPI_CLASSIFICATION_HISTOGRAM_BINS]; /* Packets up to the classification... */
+  u_int64_t bytes[NDPI_CLASSIFICATION_HISTOGRAM_BINS];   /* ...their payload bytes... */
+  u_int64_t ticks[NDPI_CLASSIFICATION_HISTOGRAM_BINS];   /* ...and the ticks elapsed since the first packet */
+};
+
+/* Counters of a dissector (library configured with --enable-dissector-profiling) */
+struct ndpi_dissector_stats {
+  u_int16_t protocol_id;    /* Protocol of the dissector */
+  u_int64_t num_calls;
+  u_int64_t num_cycles;     /* TSC cycles (nanoseconds where there is no TSC) spent in the dissector */
+  u_int64_t num_detections; /* Calls that detected a protocol... */
+  u_int64_t num_exclusions; /* ...and that excluded the dissector protocol */
+};
+
+typedef enum {
+  ndpi_lru_cache_ookla = 0,
+  ndpi_lru_cache_stun,
+  ndpi_lru_cache_tinc,
+  ndpi_lru_cache_dns,
+  ndpi_lru_cache_verdict,
+} ndpi_lru_cache_type;
+
 struct ndpi_id_struct {
   /**
      detected_protocol_bitmask:
@@ -820,20 +880,29 @@ struct ndpi_packet_struct {
   u_int8_t tcp_retransmission;
   u_int8_t l4_protocol;
 
-  u_int8_t tls_certificate_detected:4, tls_certificate_num_checks:4;
   u_int8_t packet_lines_parsed_complete:1,
     packet_direction:1, empty_line_position_set:1, pad:5;
 };
 
 struct ndpi_detection_module_struct;
 struct ndpi_flow_struct;
+struct ndpi_ruleset;
 
 struct ndpi_call_function_struct {
   NDPI_PROTOCOL_BITMASK detection_bitmask;
   NDPI_PROTOCOL_BITMASK excluded_protocol_bitmask;
   NDPI_SELECTION_BITMASK_PROTOCOL_SIZE ndpi_selection_bitmask;
   void (*func) (struct ndpi_detection_module_struct *, struct ndpi_flow_struct *flow);
+  u_int16_t ndpi_protocol_id;
   u_int8_t detection_feature;
+  u_int8_t has_payload_prefix:1, exclude_on_prefix_mismatch:1, prefix_on_first_packet:1;
+  u_int64_t first_payload_bytes[4]; /* accepted values of the first payload byte */
+};
+
+/* Callbacks whose selection bitmask matches a given packet selection bitmask */
+struct ndpi_call_function_dispatch {
+  NDPI_SELECTION_BITMASK_PROTOCOL_SIZE ndpi_selection_packet;
+  u_int64_t callbacks[NDPI_CALLBACK_BITMAP_WORDS]; /* one bit per callback_buffer entry */
 };
 
 struct ndpi_subprotocol_conf_struct {
@@ -930,6 +999,19 @@ typedef enum {
    ndpi_pref_dns_dont_dissect_response,
    ndpi_pref_direction_detect_disable,
    ndpi_pref_disable_metadata_export,
+   ndpi_pref_disable_dissector_prefix_filter,
+   ndpi_pref_enable_domain_match,
+   ndpi_pref_enable_category_filter,
+   ndpi_pref_ookla_cache_num_entries,
+   ndpi_pref_ookla_cache_ttl,
+   ndpi_pref_stun_cache_num_entries,
+   ndpi_pref_stun_cache_ttl,
+   ndpi_pref_dns_cache_num_entries,
+   ndpi_pref_dns_cache_max_ttl,
+   ndpi_pref_verdict_cache_num_entries,
+   ndpi_pref_verdict_cache_ttl,
+   ndpi_pref_verdict_cache_verify_packets,
+   ndpi_pref_enable_classification_stats,
 } ndpi_detection_preference;
 
 /* ntop extensions */
@@ -943,12 +1025,6 @@ typedef struct ndpi_proto_defaults {
   void (*func) (struct ndpi_detection_module_struct *, struct ndpi_flow_struct *flow);
 } ndpi_proto_defaults_t;
 
-typedef struct ndpi_default_ports_tree_node {
-  ndpi_proto_defaults_t *proto;
-  u_int8_t customUserProto;
-  u_int16_t default_port;
-} ndpi_default_ports_tree_node_t;
-
 typedef struct _ndpi_automa {
   void *ac_automa; /* Real type is AC_AUTOMATA_t */
   u_int8_t ac_automa_finalized;
@@ -966,9 +1042,23 @@ typedef struct ndpi_proto {
 
 #define NDPI_PROTOCOL_NULL { NDPI_PROTOCOL_UNKNOWN , NDPI_PROTOCOL_UNKNOWN }
 
+/* Classification result of a flow that can be kept once its ndpi_flow_struct is released */
+typedef struct ndpi_flow_verdict {
+  ndpi_protocol protocol;
+  u_int8_t detection_completed:1, /* a protocol has been detected */
+    extra_dissection:1;           /* more packets are needed (e.g. TLS certificate) */
+} ndpi_flow_verdict;
+
 #define NUM_CUSTOM_CATEGORIES      5
 #define CUSTOM_CATEGORY_LABEL_LEN 32
 
+/* Hostname lookups of ndpi_match_custom_category (see ndpi_get_category_filter_stats) */
+struct ndpi_category_filter_stats {
+  u_int64_t num_rejected;        /* Lookups skipped by the filter */
+  u_int64_t num_matched;         /* Lookups passing the filter with a match */
+  u_int64_t num_false_positives; /* Lookups passing the filter without a match */
+};
+
 #ifdef NDPI_LIB_COMPILATION
 
 /* Needed to have access to HAVE_* defines */
@@ -989,6 +1079,31 @@ struct hs {
 };
 #endif
 
+/* Sections of a compiled ruleset file (see ndpi_ruleset.c) */
+enum ndpi_ruleset_section {
+  NDPI_RULESET_HOST_AUTOMA = 0,
+  NDPI_RULESET_CONTENT_AUTOMA,
+  NDPI_RULESET_BIGRAMS_AUTOMA,
+  NDPI_RULESET_IMPOSSIBLE_BIGRAMS_AUTOMA,
+  NDPI_RULESET_CATEGORIES_AUTOMA,
+  NDPI_RULESET_PROTOCOLS_LPM4,
+  NDPI_RULESET_CATEGORIES_LPM4,
+  NDPI_RULESET_HOST_DOMAINS,
+  NDPI_RULESET_CATEGORIES_DOMAINS,
+  NDPI_RULESET_CATEGORIES_FILTER,
+  NDPI_RULESET_PROTOCOLS_LPM6,
+  NDPI_RULESET_CATEGORIES_LPM6,
+  NDPI_RULESET_NUM_SECTIONS
+};
+
+struct ndpi_ruleset {
+  void *base; /* images, never modified once built */
+  size_t len;
+  u_int32_t num_refs; /* one per module using it, plus the creator one */
+  u_int8_t mapped;    /* base is a mapping of a ruleset file */
+  struct ndpi_ruleset *next; /* published update (referenced), set once */
+};
+
 struct ndpi_detection_module_struct {
   NDPI_PROTOCOL_BITMASK detection_bitmask;
   NDPI_PROTOCOL_BITMASK generic_http_packet_bitmask;
@@ -1004,19 +1119,28 @@ struct ndpi_detection_module_struct {
   struct ndpi_call_function_struct callback_buffer[NDPI_MAX_SUPPORTED_PROTOCOLS + 1];
   u_int32_t callback_buffer_size;
 
-  struct ndpi_call_function_struct callback_buffer_tcp_no_payload[NDPI_MAX_SUPPORTED_PROTOCOLS + 1];
-  u_int32_t callback_buffer_size_tcp_no_payload;
-
-  struct ndpi_call_function_struct callback_buffer_tcp_payload[NDPI_MAX_SUPPORTED_PROTOCOLS + 1];
-  u_int32_t callback_buffer_size_tcp_payload;
+  /*
+    precompiled dispatch sets, indexed by the packet selection bitmask;
+    the last entry holds all the callbacks of the transport
+  */
+  struct ndpi_call_function_dispatch dispatch_tcp_no_payload[NDPI_SELECTION_DISPATCH_SIZE + 1],
+    dispatch_tcp_payload[NDPI_SELECTION_DISPATCH_SIZE + 1],
+    dispatch_udp[NDPI_SELECTION_DISPATCH_SIZE + 1],
+    dispatch_non_tcp_udp[NDPI_SELECTION_DISPATCH_SIZE + 1];
 
-  struct ndpi_call_function_struct callback_buffer_udp[NDPI_MAX_SUPPORTED_PROTOCOLS + 1];
-  u_int32_t callback_buffer_size_udp;
+  /* callbacks that can be invoked when the payload starts with a given byte */
+  u_int64_t prefix_callbacks[256][NDPI_CALLBACK_BITMAP_WORDS];
+  u_int64_t num_dissector_calls;
+  struct ndpi_dissector_stats *dissector_stats; /* One per callback_buffer entry, NULL unless profiling */
 
-  struct ndpi_call_function_struct callback_buffer_non_tcp_udp[NDPI_MAX_SUPPORTED_PROTOCOLS + 1];
-  u_int32_t callback_buffer_size_non_tcp_udp;
+  /*
+    Scratch area of the packet being dissected: it is rebuilt for every
+    packet, hence it lives here and not in ndpi_flow_struct
+  */
+  struct ndpi_packet_struct packet;
 
-  ndpi_default_ports_tree_node_t *tcpRoot, *udpRoot;
+  /* Indexed by port (see addDefaultPort) */
+  u_int16_t *tcp_default_ports, *udp_default_ports;
 
   ndpi_log_level_t ndpi_log_level; /* default error */
 
@@ -1054,12 +1178,31 @@ struct ndpi_detection_module_struct {
 #else
     ndpi_automa hostnames, hostnames_shadow;
 #endif
-    void *ipAddresses, *ipAddresses_shadow; /* Patricia */
+    struct ndpi_lpm4 *ipAddresses, *ipAddresses_shadow;
+    struct ndpi_lpm6 *ipAddresses6, *ipAddresses6_shadow;
+    struct ndpi_domain_trie *domains, *domains_shadow; /* ndpi_pref_enable_domain_match */
+
+    /* ndpi_pref_enable_category_filter: hostnames not matching the filter
+       are not searched. Keys of the names loaded since the last swap */
+    struct ndpi_bloom *filter;
+    u_int64_t *filter_keys;
+    u_int32_t num_filter_keys, max_filter_keys;
+    u_int8_t filter_unusable; /* A name has no key */
+    struct ndpi_category_filter_stats filter_stats;
+
     u_int8_t categories_loaded;
   } custom_categories;
 
   /* IP-based protocol detection */
-  void *protocols_ptree;
+  struct ndpi_lpm4 *protocols_lpm4;
+  struct ndpi_lpm6 *protocols_lpm6;
+
+  /* Hosts added as domains (ndpi_pref_enable_domain_match) */
+  struct ndpi_domain_trie *host_domains;
+
+  /* When not NULL the automata and the IP trees above are images of this
+     ruleset, shared with the other modules created from it */
+  struct ndpi_ruleset *ruleset;
 
   /* irc parameters */
   u_int32_t irc_timeout;
@@ -1096,18 +1239,36 @@ struct ndpi_detection_module_struct {
 
   /* NDPI_PROTOCOL_OOKLA */
   struct ndpi_lru_cache *ookla_cache;
+  u_int32_t ookla_cache_num_entries, ookla_cache_ttl;
 
   /* NDPI_PROTOCOL_TINC */
-  struct cache *tinc_cache;
+  struct ndpi_lru_cache *tinc_cache;
 
   /* NDPI_PROTOCOL_STUN and subprotocols */
   struct ndpi_lru_cache *stun_cache;
+  u_int32_t stun_cache_num_entries, stun_cache_ttl;
+
+  /* NDPI_PROTOCOL_DNS: server address -> protocol of the hostname it was resolved for */
+  struct ndpi_lru_cache *dns_cache;
+  u_int32_t dns_cache_num_entries /* 0 = disabled */, dns_cache_max_ttl;
+
+  /* Server endpoint (address, port, L4 protocol) -> verdict of its last flow */
+  struct ndpi_lru_cache *verdict_cache;
+  u_int32_t verdict_cache_num_entries /* 0 = disabled */, verdict_cache_ttl;
+  u_int8_t verdict_cache_verify_pkts; /* Dissect the first packets of the flows all the same */
+  struct ndpi_verdict_cache_stats verdict_stats;
+
+  /* ndpi_pref_enable_classification_stats: indexed by protocol id, NULL = disabled */
+  struct ndpi_classification_stats *classification_stats;
 
   ndpi_proto_defaults_t proto_defaults[NDPI_MAX_SUPPORTED_PROTOCOLS+NDPI_MAX_NUM_CUSTOM_PROTOCOLS];
 
   u_int8_t http_dont_dissect_response:1, dns_dont_dissect_response:1,
     direction_detect_disable:1, /* disable internal detection of packet direction */
-    disable_metadata_export:1   /* No metadata is exported */
+    disable_metadata_export:1,  /* No metadata is exported */
+    disable_dissector_prefix_filter:1, /* Do not skip dissectors by first payload byte */
+    domain_match:1, /* Match the user loaded hosts and categories by domain suffix */
+    category_filter:1 /* Bloom filter in front of the category hostnames */
     ;
 
   void *hyperscan; /* Intel Hyperscan */
@@ -1121,6 +1282,87 @@ typedef enum {
    ndpi_cipher_insecure = NDPI_CIPHER_INSECURE
 } ndpi_cipher_weakness;
 
+/* Per-flow protocol metadata, see ndpi_flow_struct.protos */
+union ndpi_flow_protos {
+  /* the only fields useful for nDPI and ntopng */
+  struct {
+    u_int8_t num_queries, num_answers, reply_code, is_query;
+    u_int16_t query_type, query_class, rsp_type;
+    ndpi_ip_addr_t rsp_addr; /* The first address in a DNS response packet */
+  } dns;
+
+  struct {
+    u_int8_t request_code;
+    u_int8_t version;
+  } ntp;
+
+  struct {
+    char cname[24], realm[24];
+  } kerberos;
+
+  struct {
+    struct {
+      u_int16_t ssl_version;
+      char client_certificate[64], server_certificate[64], server_organization[64];
+      u_int32_t notBefore, notAfter;
+      char ja3_client[33], ja3_server[33];
+      u_int16_t server_cipher;
+      ndpi_cipher_weakness server_unsafe_cipher;
+    } ssl;
+  } stun_ssl; /* STUN counters are in ndpi_flow_struct.stun */
+
+  struct {
+    char client_signature[48], server_signature[48];
+    char hassh_client[33], hassh_server[33];
+  } ssh;
+
+  struct {
+    u_int8_t last_one_byte_pkt, last_byte;
+  } imo;
+  
+  struct {
+    char answer[96];
+  } mdns;
+
+  struct {
+    char version[32];
+  } ubntac2;
+
+  struct {
+    /* Via HTTP User-Agent */
+    u_char detected_os[32];
+    /* Via HTTP X-Forwarded-For */
+    u_char nat_ip[24];
+  } http;
+
+  struct {
+    /* Bittorrent hash */
+    u_char hash[20];
+  } bittorrent;
+
+  struct {
+    char fingerprint[48];
+    char class_ident[48];
+  } dhcp;
+};
+
+/*
+  Per flow state of the features disabled by default, allocated on demand
+  so that the flows do not pay for them when they are not used
+*/
+struct ndpi_flow_ext {
+  /* Server endpoint verdict cache (ndpi_pref_verdict_cache_num_entries) */
+  u_int64_t verdict_key;     /* Server endpoint, 0 = nothing to cache */
+  u_int32_t cached_verdict;  /* Provisional verdict being verified, 0 = none */
+
+  /* ndpi_pref_enable_classification_stats: packets seen until the flow is classified */
+  struct {
+    u_int64_t first_tick;
+    u_int32_t num_bytes; /* Payload */
+    u_int16_t num_packets;
+  } classification;
+};
+
 struct ndpi_flow_struct {
   u_int16_t detected_protocol_stack[NDPI_PROTOCOL_SIZE];
 #ifndef WIN32
@@ -1130,7 +1372,8 @@ struct ndpi_flow_struct {
 
   /* init parameter, internal used to set up timestamp,... */
   u_int16_t guessed_protocol_id, guessed_host_protocol_id, guessed_category, guessed_header_category;
-  u_int8_t l4_proto, protocol_id_already_guessed:1, host_already_guessed:1, init_finished:1, setup_packet_direction:1, packet_direction:1, check_extra_packets:1;
+  u_int8_t l4_proto, protocol_id_already_guessed:1, host_already_guessed:1, init_finished:1, setup_packet_direction:1, packet_direction:1, check_extra_packets:1,
+    classification_accounted:1;
 
   /*
     if ndpi_struct->direction_detect_disable == 1
@@ -1142,6 +1385,9 @@ struct ndpi_flow_struct {
   u_int8_t num_extra_packets_checked;
   u_int8_t num_processed_pkts; /* <= WARNING it can wrap but we do expect people to giveup earlier */
 
+  /* Optional features state: NULL unless one of them is enabled */
+  struct ndpi_flow_ext *ext;
+
   int (*extra_packets_func) (struct ndpi_detection_module_struct *, struct ndpi_flow_struct *flow);
 
   /*
@@ -1176,80 +1422,28 @@ struct ndpi_flow_struct {
     u_int16_t response_status_code; /* 200, 404, etc. */
   } http;
 
-  union {
-    /* the only fields useful for nDPI and ntopng */
-    struct {
-      u_int8_t num_queries, num_answers, reply_code, is_query;
-      u_int16_t query_type, query_class, rsp_type;
-      ndpi_ip_addr_t rsp_addr; /* The first address in a DNS response packet */
-    } dns;
-
-    struct {
-      u_int8_t request_code;
-      u_int8_t version;
-    } ntp;
-
-    struct {
-      char cname[24], realm[24];
-    } kerberos;
-
-    struct {
-      struct {
-	u_int16_t ssl_version;
-	char client_certificate[64], server_certificate[64], server_organization[64];
-	u_int32_t notBefore, notAfter;
-	char ja3_client[33], ja3_server[33];
-	u_int16_t server_cipher;
-	ndpi_cipher_weakness server_unsafe_cipher;
-      } ssl;
-
-      struct {
-	u_int8_t num_udp_pkts, num_processed_pkts, num_binding_requests;
-      } stun;
-
-      /* We can have STUN over SSL/TLS thus they need to live together */
-    } stun_ssl;
-
-    struct {
-      char client_signature[48], server_signature[48];
-      char hassh_client[33], hassh_server[33];
-    } ssh;
-
-    struct {
-      u_int8_t last_one_byte_pkt, last_byte;
-    } imo;
-    
-    struct {
-      char answer[96];
-    } mdns;
-
-    struct {
-      char version[32];
-    } ubntac2;
-
-    struct {
-      /* Via HTTP User-Agent */
-      u_char detected_os[32];
-      /* Via HTTP X-Forwarded-For */
-      u_char nat_ip[24];
-    } http;
-
-    struct {
-      /* Bittorrent hash */
-      u_char hash[20];
-    } bittorrent;
+  /*
+    Protocol specific metadata: allocated by the dissectors only when they
+    need it (see ndpi_flow_alloc_protos), NULL for most flows
+  */
+  union ndpi_flow_protos *protos;
 
-    struct {
-      char fingerprint[48];
-      char class_ident[48];
-    } dhcp;
-  } protos;
+  /* NDPI_PROTOCOL_STUN (kept here as it is updated for every UDP flow) */
+  struct {
+    u_int8_t num_udp_pkts, num_processed_pkts, num_binding_requests;
+  } stun;
 
   /*** ALL protocol specific 64 bit variables here ***/
 
   /* protocols which have marked a connection as this connection cannot be protocol XXX, multiple u_int64_t */
   NDPI_PROTOCOL_BITMASK excluded_protocol_bitmask;
 
+  /*
+    callback_buffer entries no longer worth calling for this flow: the
+    dissectors still alive are the ones whose bit is not set here
+  */
+  u_int64_t excluded_callbacks[NDPI_CALLBACK_BITMAP_WORDS];
+
   ndpi_protocol_category_t category;
 
   /* NDPI_PROTOCOL_REDIS */
@@ -1331,8 +1525,10 @@ struct ndpi_flow_struct {
   /* NDPI_PROTOCOL_1KXUN || NDPI_PROTOCOL_IQIYI */
   u_int16_t kxun_counter, iqiyi_counter;
 
+  /* NDPI_PROTOCOL_TLS */
+  u_int8_t tls_certificate_detected:4, tls_certificate_num_checks:4;
+
   /* internal structures to save functions calls */
-  struct ndpi_packet_struct packet;
   struct ndpi_flow_struct *flow;
   struct ndpi_id_struct *src;
   struct ndpi_id_struct *dst;
@@ -1356,6 +1552,12 @@ typedef struct {
   u_int8_t value;
 } ndpi_network;
 
+typedef struct {
+  const char *network; /* IPv6 address */
+  u_int8_t cidr;
+  u_int8_t value;
+} ndpi_network6;
+
 typedef struct {
   int protocol_id;
   ndpi_protocol_category_t protocol_category;
@@ -1438,4 +1640,78 @@ struct ndpi_analyze_struct {
 #define MAX_SERIES_LEN      512
 #define MIN_SERIES_LEN      8
 
+/* **************************************** */
+
+struct ndpi_slab_chunk;
+
+/* Allocator of fixed-size objects (see ndpi_slab_init) */
+struct ndpi_slab {
+  u_int32_t obj_size, objs_per_chunk;
+  u_int8_t use_huge_pages;
+  void *free_list; /* Released objects, linked through their first word */
+  u_int8_t *next_obj, *chunk_end; /* Never used area of the last chunk */
+  struct ndpi_slab_chunk *chunks;
+  u_int32_t num_chunks, num_huge_page_chunks;
+  u_int64_t num_allocs, num_in_use;
+};
+
+/* Open addressing hash table (see ndpi_flow_table_init) */
+struct ndpi_flow_table {
+  u_int8_t *ctrl; /* Per slot: 7 bits of the entry hash, or empty/deleted */
+  void **entries;
+  u_int32_t *hashes;
+  u_int32_t num_groups, num_entries, num_deleted;
+  int (*cmp)(const void *a, const void *b);
+};
+
+/* Blocked Bloom filter (see ndpi_bloom_init) */
+struct ndpi_bloom {
+  void *mem;
+  u_int64_t *blocks; /* Cache line aligned */
+  u_int32_t num_blocks;
+};
+
+struct ndpi_domain_trie_node {
+  u_int32_t parent, label; /* Label offset in ndpi_domain_trie.labels */
+  u_int32_t value;
+  u_int8_t label_len, has_value;
+};
+
+struct ndpi_domain_trie_slot {
+  u_int32_t hash, node; /* node 0 (the root) marks an empty slot */
+};
+
+/* Domain names by reversed labels (see ndpi_domain_trie_init) */
+struct ndpi_domain_trie {
+  struct ndpi_domain_trie_node *nodes;
+  struct ndpi_domain_trie_slot *slots; /* (parent, label) -> child */
+  char *labels;
+  u_int32_t num_nodes, max_nodes, num_slots, labels_len, max_labels_len;
+};
+
+/* IPv4 longest prefix match (see ndpi_lpm4_init) */
+struct ndpi_lpm4 {
+  u_int32_t *entries; /* The root table and then the tables of the third and fourth bytes */
+  u_int8_t *lens;     /* Prefix length + 1 of the value of each entry, 0 if none */
+  u_int32_t num_entries, max_entries;
+};
+
+struct ndpi_lpm6_entry {
+  u_int32_t child;  /* Index of the child table or (leaf) of the only prefix below, 0 if none */
+  u_int32_t prefix; /* Longest prefix covering the entry at this level, 0 if none */
+};
+
+struct ndpi_lpm6_prefix {
+  struct ndpi_in6_addr addr, mask;
+  u_int32_t value;
+  u_int8_t bits, unused[3];
+};
+
+/* IPv6 longest prefix match (see ndpi_lpm6_init) */
+struct ndpi_lpm6 {
+  struct ndpi_lpm6_entry *entries; /* The root table and then the child tables */
+  struct ndpi_lpm6_prefix *prefixes;
+  u_int32_t num_entries, max_entries, num_prefixes, max_prefixes;
+};
+
 #endif /* __NDPI_TYPEDEFS_H__ */
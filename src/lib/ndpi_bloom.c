@@ -0,0 +1,179 @@
+/*
+ * ndpi_bloom.c
+ *
+ * Copyright (C) 2020 - ntop.org
+ *
+ * This file is part of nDPI, an open source deep packet inspection
+ * library.
+ *
+ * nDPI is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * nDPI is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with nDPI.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "ndpi_config.h"
+#endif
+
+#include <stdlib.h>
+#include <sys/types.h>
+#include "ndpi_api.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/*
+  Blocked Bloom filter: the upper half of a key hash selects a 64 bytes
+  block (a cache line) and the hash sets one bit in each of its eight 64
+  bit words, so a lookup costs a single cache miss. With
+  NDPI_BLOOM_BITS_PER_KEY bits per key about 0.5% of the lookups of keys
+  not in the set are false positives.
+*/
+
+#define NDPI_BLOOM_BITS_PER_KEY  16
+#define NDPI_BLOOM_BLOCK_WORDS    8
+
+struct ndpi_bloom_image {
+  u_int32_t num_blocks;
+  u_int8_t unused[60]; /* Keep the blocks cache line aligned */
+};
+
+/* ********************************************************************************* */
+
+/* The upper 48 bits of bits hold the bit index of each word */
+static inline u_int64_t ndpi_bloom_bits(u_int64_t hash) {
+  return(hash * 0xff51afd7ed558ccdULL);
+}
+
+#define NDPI_BLOOM_WORD_MASK(bits, i) (((u_int64_t)1) << (((bits) >> (16 + 6 * (i))) & 63))
+
+/* ********************************************************************************* */
+
+static inline u_int64_t* ndpi_bloom_block(const struct ndpi_bloom *b, u_int64_t hash) {
+  return(&b->blocks[((hash >> 32) * b->num_blocks >> 32) * NDPI_BLOOM_BLOCK_WORDS]);
+}
+
+/* ********************************************************************************* */
+
+struct ndpi_bloom* ndpi_bloom_init(u_int32_t num_keys) {
+  struct ndpi_bloom *b = ndpi_calloc(1, sizeof(struct ndpi_bloom));
+  size_t len;
+
+  if(b == NULL)
+    return(NULL);
+
+  b->num_blocks = ((u_int64_t)num_keys * NDPI_BLOOM_BITS_PER_KEY + 511) / 512;
+  if(b->num_blocks == 0) b->num_blocks = 1;
+
+  len = (size_t)b->num_blocks * NDPI_BLOOM_BLOCK_WORDS * sizeof(u_int64_t);
+
+  if((b->mem = ndpi_calloc(1, len + 63)) == NULL) {
+    ndpi_free(b);
+    return(NULL);
+  }
+
+  b->blocks = (u_int64_t*)(((uintptr_t)b->mem + 63) & ~((uintptr_t)63));
+
+  return(b);
+}
+
+/* ********************************************************************************* */
+
+void ndpi_bloom_add(struct ndpi_bloom *b, u_int64_t hash) {
+  u_int64_t bits = ndpi_bloom_bits(hash), *block = ndpi_bloom_block(b, hash);
+  u_int i;
+
+  for(i=0; i<NDPI_BLOOM_BLOCK_WORDS; i++)
+    block[i] |= NDPI_BLOOM_WORD_MASK(bits, i);
+}
+
+/* ********************************************************************************* */
+
+int ndpi_bloom_contains(const struct ndpi_bloom *b, u_int64_t hash) {
+  u_int64_t bits = ndpi_bloom_bits(hash);
+  const u_int64_t *block = ndpi_bloom_block(b, hash);
+  u_int i;
+#ifdef __SSE2__
+  __m128i missing = _mm_setzero_si128();
+#else
+  u_int64_t missing = 0;
+#endif
+
+  /* The masks are built in registers: storing and reloading them would stall */
+#ifdef __SSE2__
+  for(i=0; i<NDPI_BLOOM_BLOCK_WORDS; i += 2)
+    missing = _mm_or_si128(missing, _mm_andnot_si128(_mm_load_si128((const __m128i*)&block[i]),
+						      _mm_set_epi64x(NDPI_BLOOM_WORD_MASK(bits, i + 1),
+								     NDPI_BLOOM_WORD_MASK(bits, i))));
+
+  return(_mm_movemask_epi8(_mm_cmpeq_epi8(missing, _mm_setzero_si128())) == 0xFFFF);
+#else
+  for(i=0; i<NDPI_BLOOM_BLOCK_WORDS; i++)
+    missing |= NDPI_BLOOM_WORD_MASK(bits, i) & ~block[i];
+
+  return(missing == 0);
+#endif
+}
+
+/* ********************************************************************************* */
+
+void ndpi_bloom_free(struct ndpi_bloom *b) {
+  if(b) {
+    if(b->mem) ndpi_free(b->mem);
+    ndpi_free(b);
+  }
+}
+
+/* ********************************************************************************* */
+
+size_t ndpi_bloom_image_size(const struct ndpi_bloom *b) {
+  return(sizeof(struct ndpi_bloom_image)
+	 + (size_t)b->num_blocks * NDPI_BLOOM_BLOCK_WORDS * sizeof(u_int64_t));
+}
+
+/* ********************************************************************************* */
+
+void ndpi_bloom_write_image(const struct ndpi_bloom *b, void *buf) {
+  struct ndpi_bloom_image *img = (struct ndpi_bloom_image*)buf;
+
+  memset(img, 0, sizeof(struct ndpi_bloom_image));
+  img->num_blocks = b->num_blocks;
+  memcpy(&img[1], b->blocks, (size_t)b->num_blocks * NDPI_BLOOM_BLOCK_WORDS * sizeof(u_int64_t));
+}
+
+/* ********************************************************************************* */
+
+int ndpi_bloom_image_check(const void *buf, size_t len) {
+  const struct ndpi_bloom_image *img = (const struct ndpi_bloom_image*)buf;
+
+  if((len < sizeof(struct ndpi_bloom_image))
+     || (img->num_blocks == 0)
+     || (len != sizeof(struct ndpi_bloom_image)
+	 + (u_int64_t)img->num_blocks * NDPI_BLOOM_BLOCK_WORDS * sizeof(u_int64_t)))
+    return(-1);
+
+  return(0);
+}
+
+/* ********************************************************************************* */
+
+/* buf must be 16 bytes aligned */
+int ndpi_bloom_image_contains(const void *buf, u_int64_t hash) {
+  const struct ndpi_bloom_image *img = (const struct ndpi_bloom_image*)buf;
+  struct ndpi_bloom b;
+
+  b.mem = NULL, b.blocks = (u_int64_t*)&img[1], b.num_blocks = img->num_blocks;
+
+  return(ndpi_bloom_contains(&b, hash));
+}
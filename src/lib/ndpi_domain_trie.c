@@ -0,0 +1,403 @@
+/*
+ * ndpi_domain_trie.c
+ *
+ * Copyright (C) 2020 - ntop.org
+ *
+ * This file is part of nDPI, an open source deep packet inspection
+ * library.
+ *
+ * nDPI is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * nDPI is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with nDPI.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "ndpi_config.h"
+#endif
+
+#include <stdlib.h>
+#include <sys/types.h>
+#include "ndpi_api.h"
+
+/*
+  Domain names are stored label by label starting from the TLD, so that
+  "www.example.com" is the path com -> example -> www: a lookup walks the
+  labels of a name from the right and returns the value of the longest
+  domain it ends with, at a cost proportional to its number of labels.
+
+  There are no per node child lists: the edges live in a single open
+  addressing table keyed by (parent node, label) and the labels are packed
+  in a single pool. A node takes 16 bytes, plus its label and about 11
+  bytes of table: the three arrays have no pointers and are also the image
+  of the trie in a compiled ruleset.
+*/
+
+#define NDPI_DOMAIN_MAX_LABEL_LEN  63
+#define NDPI_DOMAIN_MAX_LEN       253
+
+struct ndpi_domain_trie_image {
+  u_int32_t num_nodes, num_slots, labels_len, unused;
+  /* Followed by nodes[num_nodes], slots[num_slots] and labels[labels_len] */
+};
+
+/* ********************************************************************************* */
+
+static inline u_int8_t ndpi_domain_lower(u_int8_t c) {
+  return(((c >= 'A') && (c <= 'Z')) ? (c + 'a' - 'A') : c);
+}
+
+/* ********************************************************************************* */
+
+static u_int32_t ndpi_domain_trie_hash(u_int32_t parent, const char *label, u_int8_t label_len) {
+  u_int32_t h = 2166136261U ^ (parent * 0x9E3779B1); /* FNV-1a seeded with the parent */
+  u_int8_t i;
+
+  for(i=0; i<label_len; i++)
+    h = (h ^ ndpi_domain_lower(label[i])) * 16777619U;
+
+  return(h);
+}
+
+/* ********************************************************************************* */
+
+static u_int32_t ndpi_domain_trie_child(const struct ndpi_domain_trie *t, u_int32_t parent,
+					const char *label, u_int8_t label_len, u_int32_t hash) {
+  u_int32_t mask = t->num_slots - 1, i = hash & mask;
+
+  if(t->num_slots == 0)
+    return(0);
+
+  /* There is always an empty slot (the root is never in the table) */
+  while(t->slots[i].node != 0) {
+    if(t->slots[i].hash == hash) {
+      const struct ndpi_domain_trie_node *n = &t->nodes[t->slots[i].node];
+
+      if((n->parent == parent) && (n->label_len == label_len)) {
+	const char *l = &t->labels[n->label];
+	u_int8_t j;
+
+	for(j=0; (j<label_len) && (l[j] == (char)ndpi_domain_lower(label[j])); j++)
+	  ;
+
+	if(j == label_len)
+	  return(t->slots[i].node);
+      }
+    }
+
+    i = (i + 1) & mask;
+  }
+
+  return(0);
+}
+
+/* ********************************************************************************* */
+
+static void ndpi_domain_trie_put_slot(struct ndpi_domain_trie_slot *slots, u_int32_t num_slots,
+				      u_int32_t hash, u_int32_t node) {
+  u_int32_t mask = num_slots - 1, i = hash & mask;
+
+  while(slots[i].node != 0)
+    i = (i + 1) & mask;
+
+  slots[i].hash = hash, slots[i].node = node;
+}
+
+/* ********************************************************************************* */
+
+static int ndpi_domain_trie_grow_slots(struct ndpi_domain_trie *t) {
+  u_int32_t num_slots = t->num_slots * 2, i;
+  struct ndpi_domain_trie_slot *slots = ndpi_calloc(num_slots, sizeof(struct ndpi_domain_trie_slot));
+
+  if(slots == NULL)
+    return(-1);
+
+  for(i=1; i<t->num_nodes; i++) {
+    const struct ndpi_domain_trie_node *n = &t->nodes[i];
+
+    ndpi_domain_trie_put_slot(slots, num_slots,
+			      ndpi_domain_trie_hash(n->parent, &t->labels[n->label], n->label_len), i);
+  }
+
+  ndpi_free(t->slots);
+  t->slots = slots, t->num_slots = num_slots;
+
+  return(0);
+}
+
+/* ********************************************************************************* */
+
+static u_int32_t ndpi_domain_trie_new_node(struct ndpi_domain_trie *t, u_int32_t parent,
+					   const char *label, u_int8_t label_len, u_int32_t hash) {
+  struct ndpi_domain_trie_node *n;
+  u_int8_t i;
+
+  if(t->num_nodes == t->max_nodes) {
+    void *nodes = ndpi_realloc(t->nodes, t->max_nodes * sizeof(struct ndpi_domain_trie_node),
+			       2 * t->max_nodes * sizeof(struct ndpi_domain_trie_node));
+
+    if(nodes == NULL) return(0);
+    t->nodes = nodes, t->max_nodes *= 2;
+  }
+
+  if(t->labels_len + label_len > t->max_labels_len) {
+    u_int32_t max_labels_len = 2 * t->max_labels_len + label_len;
+    char *labels = ndpi_realloc(t->labels, t->labels_len, max_labels_len);
+
+    if(labels == NULL) return(0);
+    t->labels = labels, t->max_labels_len = max_labels_len;
+  }
+
+  /* Keep the table at most 3/4 full */
+  if((t->num_nodes >= (t->num_slots / 4) * 3) && (ndpi_domain_trie_grow_slots(t) != 0))
+    return(0);
+
+  n = &t->nodes[t->num_nodes];
+  n->parent = parent, n->label = t->labels_len, n->label_len = label_len;
+  n->value = 0, n->has_value = 0;
+
+  for(i=0; i<label_len; i++)
+    t->labels[t->labels_len++] = ndpi_domain_lower(label[i]);
+
+  ndpi_domain_trie_put_slot(t->slots, t->num_slots, hash, t->num_nodes);
+
+  return(t->num_nodes++);
+}
+
+/* ********************************************************************************* */
+
+struct ndpi_domain_trie* ndpi_domain_trie_init(void) {
+  struct ndpi_domain_trie *t = ndpi_calloc(1, sizeof(struct ndpi_domain_trie));
+
+  if(t == NULL)
+    return(NULL);
+
+  t->max_nodes = 1024, t->num_slots = 2048, t->max_labels_len = 8192;
+  t->nodes  = ndpi_calloc(t->max_nodes, sizeof(struct ndpi_domain_trie_node));
+  t->slots  = ndpi_calloc(t->num_slots, sizeof(struct ndpi_domain_trie_slot));
+  t->labels = ndpi_malloc(t->max_labels_len);
+
+  if((t->nodes == NULL) || (t->slots == NULL) || (t->labels == NULL)) {
+    ndpi_domain_trie_free(t);
+    return(NULL);
+  }
+
+  t->num_nodes = 1; /* The root */
+
+  return(t);
+}
+
+/* ********************************************************************************* */
+
+int ndpi_domain_trie_add(struct ndpi_domain_trie *t, const char *domain, u_int32_t value) {
+  size_t len = strlen(domain), i, end;
+  u_int32_t node = 0;
+
+  /* "*.example.com", ".example.com" and "example.com." are "example.com" */
+  if((len >= 2) && (domain[0] == '*') && (domain[1] == '.'))
+    domain += 2, len -= 2;
+  else if((len > 0) && (domain[0] == '.'))
+    domain++, len--;
+
+  if((len > 0) && (domain[len-1] == '.'))
+    len--;
+
+  if((len == 0) || (len > NDPI_DOMAIN_MAX_LEN))
+    return(-1);
+
+  /* Only host names: anything else is left to the substring matching */
+  for(i=0, end=0; i<len; i++) {
+    u_int8_t c = ndpi_domain_lower(domain[i]);
+
+    if(c == '.') {
+      if((i == end) || (i - end > NDPI_DOMAIN_MAX_LABEL_LEN)) return(-1);
+      end = i + 1;
+    } else if(!(((c >= 'a') && (c <= 'z')) || ((c >= '0') && (c <= '9')) || (c == '-') || (c == '_')))
+      return(-1);
+  }
+
+  if(len - end > NDPI_DOMAIN_MAX_LABEL_LEN)
+    return(-1);
+
+  for(end = len; ; ) {
+    size_t start = end;
+    u_int32_t hash, child;
+
+    while((start > 0) && (domain[start-1] != '.'))
+      start--;
+
+    hash = ndpi_domain_trie_hash(node, &domain[start], end - start);
+
+    if(((child = ndpi_domain_trie_child(t, node, &domain[start], end - start, hash)) == 0)
+       && ((child = ndpi_domain_trie_new_node(t, node, &domain[start], end - start, hash)) == 0))
+      return(-1);
+
+    node = child;
+
+    if(start == 0)
+      break;
+
+    end = start - 1;
+  }
+
+  t->nodes[node].value = value, t->nodes[node].has_value = 1;
+
+  return(0);
+}
+
+/* ********************************************************************************* */
+
+int ndpi_domain_trie_match(const struct ndpi_domain_trie *t, const char *name, u_int name_len,
+			   u_int32_t *value) {
+  u_int32_t node = 0;
+  u_int end = name_len;
+  int found = 0;
+
+  if((end > 0) && (name[end-1] == '.'))
+    end--;
+
+  while(end > 0) {
+    u_int start = end;
+
+    while((start > 0) && (name[start-1] != '.'))
+      start--;
+
+    if((start == end) || (end - start > NDPI_DOMAIN_MAX_LABEL_LEN))
+      break;
+
+    if((node = ndpi_domain_trie_child(t, node, &name[start], end - start,
+				      ndpi_domain_trie_hash(node, &name[start], end - start))) == 0)
+      break;
+
+    if(t->nodes[node].has_value)
+      *value = t->nodes[node].value, found = 1;
+
+    if(start == 0)
+      break;
+
+    end = start - 1;
+  }
+
+  return(found);
+}
+
+/* ********************************************************************************* */
+
+void ndpi_domain_trie_free(struct ndpi_domain_trie *t) {
+  if(t) {
+    if(t->nodes)  ndpi_free(t->nodes);
+    if(t->slots)  ndpi_free(t->slots);
+    if(t->labels) ndpi_free(t->labels);
+    ndpi_free(t);
+  }
+}
+
+/* ********************************************************************************* */
+
+size_t ndpi_domain_trie_image_size(const struct ndpi_domain_trie *t) {
+  return(sizeof(struct ndpi_domain_trie_image)
+	 + (t ? (t->num_nodes * sizeof(struct ndpi_domain_trie_node)
+		 + t->num_slots * sizeof(struct ndpi_domain_trie_slot)
+		 + t->labels_len) : 0));
+}
+
+/* ********************************************************************************* */
+
+void ndpi_domain_trie_write_image(const struct ndpi_domain_trie *t, void *buf) {
+  struct ndpi_domain_trie_image *img = (struct ndpi_domain_trie_image*)buf;
+  u_int8_t *ptr = (u_int8_t*)&img[1];
+
+  memset(img, 0, sizeof(struct ndpi_domain_trie_image));
+
+  if(t == NULL)
+    return;
+
+  img->num_nodes = t->num_nodes, img->num_slots = t->num_slots, img->labels_len = t->labels_len;
+
+  memcpy(ptr, t->nodes, t->num_nodes * sizeof(struct ndpi_domain_trie_node));
+  ptr += t->num_nodes * sizeof(struct ndpi_domain_trie_node);
+  memcpy(ptr, t->slots, t->num_slots * sizeof(struct ndpi_domain_trie_slot));
+  ptr += t->num_slots * sizeof(struct ndpi_domain_trie_slot);
+  memcpy(ptr, t->labels, t->labels_len);
+}
+
+/* ********************************************************************************* */
+
+/* Read-only view of an image: returns -1 if it is not consistent */
+static int ndpi_domain_trie_image_view(const void *buf, size_t len, struct ndpi_domain_trie *t) {
+  const struct ndpi_domain_trie_image *img = (const struct ndpi_domain_trie_image*)buf;
+
+  if(len < sizeof(struct ndpi_domain_trie_image))
+    return(-1);
+
+  if(len != ndpi_domain_trie_image_size(NULL)
+     + (u_int64_t)img->num_nodes * sizeof(struct ndpi_domain_trie_node)
+     + (u_int64_t)img->num_slots * sizeof(struct ndpi_domain_trie_slot)
+     + img->labels_len)
+    return(-1);
+
+  memset(t, 0, sizeof(struct ndpi_domain_trie));
+  t->num_nodes = img->num_nodes, t->num_slots = img->num_slots, t->labels_len = img->labels_len;
+  t->nodes  = (struct ndpi_domain_trie_node*)&img[1];
+  t->slots  = (struct ndpi_domain_trie_slot*)&t->nodes[t->num_nodes];
+  t->labels = (char*)&t->slots[t->num_slots];
+
+  return(0);
+}
+
+/* ********************************************************************************* */
+
+int ndpi_domain_trie_image_check(const void *buf, size_t len) {
+  struct ndpi_domain_trie t;
+  u_int32_t i, num_used = 0;
+
+  if(ndpi_domain_trie_image_view(buf, len, &t) != 0)
+    return(-1);
+
+  if(t.num_slots == 0)
+    return((t.num_nodes <= 1) ? 0 : -1);
+
+  /* Lookups rely on a power of two table with at least an empty slot */
+  if(t.num_slots & (t.num_slots - 1))
+    return(-1);
+
+  for(i=0; i<t.num_slots; i++) {
+    if(t.slots[i].node != 0) {
+      if(t.slots[i].node >= t.num_nodes) return(-1);
+      num_used++;
+    }
+  }
+
+  if(num_used >= t.num_slots)
+    return(-1);
+
+  for(i=1; i<t.num_nodes; i++) {
+    if((t.nodes[i].parent >= t.num_nodes)
+       || (t.nodes[i].label > t.labels_len)
+       || (t.nodes[i].label_len > t.labels_len - t.nodes[i].label))
+      return(-1);
+  }
+
+  return(0);
+}
+
+/* ********************************************************************************* */
+
+int ndpi_domain_trie_image_match(const void *buf, size_t len,
+				 const char *name, u_int name_len, u_int32_t *value) {
+  struct ndpi_domain_trie t;
+
+  if(ndpi_domain_trie_image_view(buf, len, &t) != 0)
+    return(0);
+
+  return(ndpi_domain_trie_match(&t, name, name_len, value));
+}
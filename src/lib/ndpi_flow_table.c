@@ -0,0 +1,310 @@
+/*
+ * ndpi_flow_table.c
+ *
+ * Copyright (C) 2020 - ntop.org
+ *
+ * This file is part of nDPI, an open source deep packet inspection
+ * library.
+ *
+ * nDPI is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * nDPI is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with nDPI.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "ndpi_config.h"
+#endif
+
+#include <stdlib.h>
+#include <sys/types.h>
+#include "ndpi_api.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/*
+  Open addressing table in the style of Swiss tables: slots are grouped by
+  NDPI_FLOW_TABLE_GROUP_SIZE and every slot has a control byte holding 7 bits
+  of the entry hash (or EMPTY/DELETED). A lookup compares the tag against the
+  whole group at once and only calls cmp() for the matching slots: a probe
+  touches the group control bytes and the entries it compares.
+
+  Groups are probed quadratically and a probe stops at the first group having
+  an EMPTY slot: an entry can then be emptied when its group has an EMPTY slot
+  and needs a DELETED marker otherwise.
+*/
+
+#define NDPI_FLOW_TABLE_EMPTY    0x80
+#define NDPI_FLOW_TABLE_DELETED  0xFE
+
+/* ********************************************************************************* */
+
+static inline u_int32_t ndpi_flow_table_mix(u_int32_t h) {
+  /* murmur3 finalizer: callers may use weak hashes (e.g. sum of the 5-tuple) */
+  h ^= h >> 16, h *= 0x85ebca6b;
+  h ^= h >> 13, h *= 0xc2b2ae35;
+  h ^= h >> 16;
+
+  return(h);
+}
+
+/* ********************************************************************************* */
+
+/* Bit i is set when the control byte i of the group is equal to c */
+static inline u_int32_t ndpi_flow_table_match(const u_int8_t *group, u_int8_t c) {
+#ifdef __SSE2__
+  __m128i g = _mm_loadu_si128((const __m128i*)group);
+
+  return((u_int32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(g, _mm_set1_epi8((char)c))));
+#else
+  u_int32_t i, ret = 0;
+
+  for(i = 0; i < NDPI_FLOW_TABLE_GROUP_SIZE; i++)
+    if(group[i] == c) ret |= (1u << i);
+
+  return(ret);
+#endif
+}
+
+/* ********************************************************************************* */
+
+/* Bit i is set when the slot i of the group is EMPTY or DELETED */
+static inline u_int32_t ndpi_flow_table_match_free(const u_int8_t *group) {
+#ifdef __SSE2__
+  return((u_int32_t)_mm_movemask_epi8(_mm_loadu_si128((const __m128i*)group)));
+#else
+  u_int32_t i, ret = 0;
+
+  for(i = 0; i < NDPI_FLOW_TABLE_GROUP_SIZE; i++)
+    if(group[i] & 0x80) ret |= (1u << i);
+
+  return(ret);
+#endif
+}
+
+/* ********************************************************************************* */
+
+static int ndpi_flow_table_alloc(struct ndpi_flow_table *t, u_int32_t num_groups) {
+  u_int32_t num_slots = num_groups * NDPI_FLOW_TABLE_GROUP_SIZE;
+
+  t->ctrl    = (u_int8_t*)ndpi_malloc(num_slots);
+  t->entries = (void**)ndpi_calloc(num_slots, sizeof(void*));
+  t->hashes  = (u_int32_t*)ndpi_calloc(num_slots, sizeof(u_int32_t));
+
+  if((t->ctrl == NULL) || (t->entries == NULL) || (t->hashes == NULL)) {
+    if(t->ctrl)    ndpi_free(t->ctrl);
+    if(t->entries) ndpi_free(t->entries);
+    if(t->hashes)  ndpi_free(t->hashes);
+    return(-1);
+  }
+
+  memset(t->ctrl, NDPI_FLOW_TABLE_EMPTY, num_slots);
+  t->num_groups = num_groups, t->num_entries = 0, t->num_deleted = 0;
+
+  return(0);
+}
+
+/* ********************************************************************************* */
+
+/* Returns the slot where an entry with the (mixed) hash h can be stored */
+static u_int32_t ndpi_flow_table_free_slot(struct ndpi_flow_table *t, u_int32_t h) {
+  u_int32_t mask = t->num_groups - 1, g = h & mask, i;
+
+  for(i = 1; ; i++) {
+    u_int32_t m = ndpi_flow_table_match_free(&t->ctrl[g * NDPI_FLOW_TABLE_GROUP_SIZE]);
+
+    if(m)
+      return(g * NDPI_FLOW_TABLE_GROUP_SIZE + __builtin_ctz(m));
+
+    g = (g + i) & mask;
+  }
+}
+
+/* ********************************************************************************* */
+
+static int ndpi_flow_table_rehash(struct ndpi_flow_table *t, u_int32_t num_groups) {
+  struct ndpi_flow_table old = *t;
+  u_int32_t i, num_slots = old.num_groups * NDPI_FLOW_TABLE_GROUP_SIZE;
+
+  if(ndpi_flow_table_alloc(t, num_groups) != 0) {
+    *t = old;
+    return(-1);
+  }
+
+  for(i = 0; i < num_slots; i++) {
+    if(!(old.ctrl[i] & 0x80)) {
+      u_int32_t slot = ndpi_flow_table_free_slot(t, old.hashes[i]);
+
+      t->ctrl[slot] = old.ctrl[i], t->entries[slot] = old.entries[i], t->hashes[slot] = old.hashes[i];
+      t->num_entries++;
+    }
+  }
+
+  ndpi_free(old.ctrl), ndpi_free(old.entries), ndpi_free(old.hashes);
+
+  return(0);
+}
+
+/* ********************************************************************************* */
+
+struct ndpi_flow_table* ndpi_flow_table_init(u_int32_t num_entries,
+					     int (*cmp)(const void *a, const void *b)) {
+  struct ndpi_flow_table *t = ndpi_calloc(1, sizeof(struct ndpi_flow_table));
+  u_int32_t num_groups = 1;
+
+  if(t == NULL)
+    return(NULL);
+
+  /* Keep the load factor below 7/8 */
+  while(num_groups * NDPI_FLOW_TABLE_GROUP_SIZE * 7 < num_entries * 8)
+    num_groups <<= 1;
+
+  t->cmp = cmp;
+
+  if(ndpi_flow_table_alloc(t, num_groups) != 0) {
+    ndpi_free(t);
+    return(NULL);
+  }
+
+  return(t);
+}
+
+/* ********************************************************************************* */
+
+static int32_t ndpi_flow_table_find_slot(struct ndpi_flow_table *t, u_int32_t h, const void *key) {
+  u_int32_t mask = t->num_groups - 1, g = h & mask, i;
+  u_int8_t tag = h >> 25;
+
+  for(i = 1; i <= t->num_groups; i++) {
+    const u_int8_t *group = &t->ctrl[g * NDPI_FLOW_TABLE_GROUP_SIZE];
+    u_int32_t m = ndpi_flow_table_match(group, tag);
+
+    while(m) {
+      u_int32_t slot = g * NDPI_FLOW_TABLE_GROUP_SIZE + __builtin_ctz(m);
+
+      if(t->cmp(key, t->entries[slot]) == 0)
+	return(slot);
+
+      m &= m - 1;
+    }
+
+    if(ndpi_flow_table_match(group, NDPI_FLOW_TABLE_EMPTY))
+      break;
+
+    g = (g + i) & mask;
+  }
+
+  return(-1);
+}
+
+/* ********************************************************************************* */
+
+void* ndpi_flow_table_find(struct ndpi_flow_table *t, u_int32_t hash, const void *key) {
+  int32_t slot = ndpi_flow_table_find_slot(t, ndpi_flow_table_mix(hash), key);
+
+  return((slot == -1) ? NULL : t->entries[slot]);
+}
+
+/* ********************************************************************************* */
+
+int ndpi_flow_table_insert(struct ndpi_flow_table *t, u_int32_t hash, void *entry) {
+  u_int32_t h = ndpi_flow_table_mix(hash), slot;
+  u_int32_t num_slots = t->num_groups * NDPI_FLOW_TABLE_GROUP_SIZE;
+
+  if((t->num_entries + t->num_deleted + 1) * 8 > num_slots * 7) {
+    /* Grow, or just drop the DELETED markers when they are many */
+    u_int32_t num_groups = ((t->num_entries + 1) * 16 > num_slots * 7) ? (t->num_groups << 1) : t->num_groups;
+
+    if(ndpi_flow_table_rehash(t, num_groups) != 0)
+      return(-1);
+  }
+
+  slot = ndpi_flow_table_free_slot(t, h);
+
+  if(t->ctrl[slot] == NDPI_FLOW_TABLE_DELETED) t->num_deleted--;
+  t->ctrl[slot] = h >> 25, t->entries[slot] = entry, t->hashes[slot] = h;
+  t->num_entries++;
+
+  return(0);
+}
+
+/* ********************************************************************************* */
+
+void* ndpi_flow_table_remove(struct ndpi_flow_table *t, u_int32_t hash, const void *key) {
+  int32_t slot = ndpi_flow_table_find_slot(t, ndpi_flow_table_mix(hash), key);
+  u_int32_t group;
+  void *entry;
+
+  if(slot == -1)
+    return(NULL);
+
+  entry = t->entries[slot], group = slot - (slot % NDPI_FLOW_TABLE_GROUP_SIZE);
+
+  if(ndpi_flow_table_match(&t->ctrl[group], NDPI_FLOW_TABLE_EMPTY))
+    t->ctrl[slot] = NDPI_FLOW_TABLE_EMPTY; /* No probe goes past this group */
+  else
+    t->ctrl[slot] = NDPI_FLOW_TABLE_DELETED, t->num_deleted++;
+
+  t->entries[slot] = NULL;
+  t->num_entries--;
+
+  return(entry);
+}
+
+/* ********************************************************************************* */
+
+u_int32_t ndpi_flow_table_walk_slots(struct ndpi_flow_table *t,
+				     u_int32_t first_slot, u_int32_t num_slots,
+				     void (*walker)(void *entry, void *user_data),
+				     void *user_data) {
+  u_int32_t i, tot_slots = t->num_groups * NDPI_FLOW_TABLE_GROUP_SIZE;
+  u_int32_t last_slot;
+
+  if(first_slot >= tot_slots)
+    first_slot = 0;
+
+  last_slot = ((num_slots > tot_slots - first_slot) ? tot_slots : (first_slot + num_slots));
+
+  for(i = first_slot; i < last_slot; i++)
+    if(!(t->ctrl[i] & 0x80))
+      walker(t->entries[i], user_data);
+
+  return((last_slot == tot_slots) ? 0 : last_slot);
+}
+
+/* ********************************************************************************* */
+
+void ndpi_flow_table_walk(struct ndpi_flow_table *t,
+			  void (*walker)(void *entry, void *user_data),
+			  void *user_data) {
+  ndpi_flow_table_walk_slots(t, 0, t->num_groups * NDPI_FLOW_TABLE_GROUP_SIZE, walker, user_data);
+}
+
+/* ********************************************************************************* */
+
+void ndpi_flow_table_destroy(struct ndpi_flow_table *t, void (*free_entry)(void *entry)) {
+  if(t == NULL)
+    return;
+
+  if(free_entry) {
+    u_int32_t i, num_slots = t->num_groups * NDPI_FLOW_TABLE_GROUP_SIZE;
+
+    for(i = 0; i < num_slots; i++)
+      if(!(t->ctrl[i] & 0x80))
+	free_entry(t->entries[i]);
+  }
+
+  ndpi_free(t->ctrl), ndpi_free(t->entries), ndpi_free(t->hashes);
+  ndpi_free(t);
+}
@@ -0,0 +1,624 @@
+/*
+ * ndpi_lpm.c
+ *
+ * Copyright (C) 2020 - ntop.org
+ *
+ * This file is part of nDPI, an open source deep packet inspection
+ * library.
+ *
+ * nDPI is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * nDPI is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with nDPI.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "ndpi_config.h"
+#endif
+
+#include <stdlib.h>
+#include <sys/types.h>
+#include "ndpi_api.h"
+
+/*
+  IPv6 longest prefix match on a multibit trie: the first 16 bits of the
+  address index the root table, then each of the following bytes indexes
+  a 256 entries child table. A prefix is stored (expanded) in the table
+  of the level its last bit falls in, so a /32 is found with 3 memory
+  accesses and a /48 with 5, instead of one per bit as in a patricia tree.
+
+  Tables are only created where prefixes share a path: the only prefix
+  below an entry is kept there as a leaf, compared with the whole address,
+  and pushed down when another prefix needs the child table.
+
+  Tables are stored one after the other in a single array and referenced
+  by index (the root being at 0, a 0 child means no child), so the trie
+  can be written as an image and mmap()ed.
+*/
+
+#define NDPI_LPM6_ROOT_BITS     16
+#define NDPI_LPM6_ROOT_ENTRIES  (1 << NDPI_LPM6_ROOT_BITS)
+#define NDPI_LPM6_STRIDE_BITS    8
+#define NDPI_LPM6_TABLE_ENTRIES (1 << NDPI_LPM6_STRIDE_BITS)
+#define NDPI_LPM6_MAX_DEPTH     ((128 - NDPI_LPM6_ROOT_BITS) / NDPI_LPM6_STRIDE_BITS)
+#define NDPI_LPM6_LEAF          0x80000000 /* The child is a prefix */
+
+struct ndpi_lpm6_image {
+  u_int32_t num_entries, num_prefixes;
+  u_int32_t unused[2];
+};
+
+/* ********************************************************************************* */
+
+static inline u_int32_t ndpi_lpm6_key(const struct ndpi_in6_addr *addr, u_int level) {
+  return((level == 0) ? ((addr->u6_addr.u6_addr8[0] << 8) | addr->u6_addr.u6_addr8[1]) : addr->u6_addr.u6_addr8[1 + level]);
+}
+
+/* ********************************************************************************* */
+
+static inline int ndpi_lpm6_prefix_contains(const struct ndpi_lpm6_prefix *p, const struct ndpi_in6_addr *addr) {
+  return((((addr->u6_addr.u6_addr64[0] ^ p->addr.u6_addr.u6_addr64[0]) & p->mask.u6_addr.u6_addr64[0])
+	  | ((addr->u6_addr.u6_addr64[1] ^ p->addr.u6_addr.u6_addr64[1]) & p->mask.u6_addr.u6_addr64[1])) == 0);
+}
+
+/* ********************************************************************************* */
+
+static int ndpi_lpm6_grow(struct ndpi_lpm6 *t, u_int32_t num_entries) {
+  if(t->num_entries + num_entries > t->max_entries) {
+    u_int32_t max_entries = t->max_entries ? (t->max_entries * 2) : (NDPI_LPM6_ROOT_ENTRIES + 16 * NDPI_LPM6_TABLE_ENTRIES);
+    struct ndpi_lpm6_entry *entries;
+
+    while(max_entries < t->num_entries + num_entries) max_entries *= 2;
+
+    if((max_entries >= NDPI_LPM6_LEAF)
+       || ((entries = ndpi_calloc(max_entries, sizeof(struct ndpi_lpm6_entry))) == NULL))
+      return(-1);
+
+    if(t->entries) {
+      memcpy(entries, t->entries, t->num_entries * sizeof(struct ndpi_lpm6_entry));
+      ndpi_free(t->entries);
+    }
+
+    t->entries = entries, t->max_entries = max_entries;
+  }
+
+  t->num_entries += num_entries; /* Already zeroed */
+
+  return(0);
+}
+
+/* ********************************************************************************* */
+
+struct ndpi_lpm6* ndpi_lpm6_init(void) {
+  return(ndpi_calloc(1, sizeof(struct ndpi_lpm6)));
+}
+
+/* ********************************************************************************* */
+
+static int ndpi_lpm6_insert(struct ndpi_lpm6 *t, u_int32_t prefix) {
+  struct ndpi_in6_addr addr = t->prefixes[prefix].addr;
+  u_int8_t bits = t->prefixes[prefix].bits;
+  u_int32_t table = 0, first, num, i;
+  u_int depth, level;
+
+  depth = (bits <= NDPI_LPM6_ROOT_BITS) ? 0 : ((bits - NDPI_LPM6_ROOT_BITS + NDPI_LPM6_STRIDE_BITS - 1) / NDPI_LPM6_STRIDE_BITS);
+
+  /* Tables of the levels above the one of the prefix */
+  for(level=0; level<depth; level++) {
+    u_int32_t idx = table + ndpi_lpm6_key(&addr, level), child = t->entries[idx].child;
+
+    if(child == 0) {
+      t->entries[idx].child = NDPI_LPM6_LEAF | prefix;
+      return(0);
+    }
+
+    if(child & NDPI_LPM6_LEAF) {
+      /* Push the leaf down: link the new table only once it exists */
+      u_int32_t new_table = t->num_entries;
+
+      if(ndpi_lpm6_grow(t, NDPI_LPM6_TABLE_ENTRIES) != 0)
+	return(-1);
+
+      t->entries[idx].child = new_table;
+
+      if(ndpi_lpm6_insert(t, child & ~NDPI_LPM6_LEAF) != 0)
+	return(-1);
+    }
+
+    table = t->entries[idx].child;
+  }
+
+  /* Expand the prefix over the entries it covers, unless they hold a longer one */
+  first = ndpi_lpm6_key(&addr, depth);
+  num = 1 << (NDPI_LPM6_ROOT_BITS + depth * NDPI_LPM6_STRIDE_BITS - bits);
+
+  for(i=first; i<first + num; i++) {
+    struct ndpi_lpm6_entry *e = &t->entries[table + i];
+
+    if((e->prefix == 0) || (t->prefixes[e->prefix].bits <= bits))
+      e->prefix = prefix;
+  }
+
+  return(0);
+}
+
+/* ********************************************************************************* */
+
+int ndpi_lpm6_add(struct ndpi_lpm6 *t, const struct ndpi_in6_addr *addr, u_int8_t bits, u_int32_t value) {
+  struct ndpi_lpm6_prefix *p;
+  u_int32_t i;
+
+  if(bits > 128)
+    return(-1);
+
+  /* The root table is only allocated with the first prefix */
+  if((t->num_entries == 0) && (ndpi_lpm6_grow(t, NDPI_LPM6_ROOT_ENTRIES) != 0))
+    return(-1);
+
+  if(t->num_prefixes == t->max_prefixes) {
+    u_int32_t max_prefixes = t->max_prefixes ? (t->max_prefixes * 2) : 64;
+    struct ndpi_lpm6_prefix *prefixes;
+
+    if((max_prefixes >= NDPI_LPM6_LEAF)
+       || ((prefixes = ndpi_calloc(max_prefixes, sizeof(struct ndpi_lpm6_prefix))) == NULL))
+      return(-1);
+
+    if(t->prefixes) {
+      memcpy(prefixes, t->prefixes, t->num_prefixes * sizeof(struct ndpi_lpm6_prefix));
+      ndpi_free(t->prefixes);
+    }
+
+    t->prefixes = prefixes, t->max_prefixes = max_prefixes;
+
+    if(t->num_prefixes == 0)
+      t->num_prefixes = 1; /* Prefix 0 means no prefix */
+  }
+
+  p = &t->prefixes[t->num_prefixes];
+  memset(p, 0, sizeof(struct ndpi_lpm6_prefix));
+  p->value = value, p->bits = bits;
+
+  for(i=0; i<bits; i += 8)
+    p->mask.u6_addr.u6_addr8[i / 8] = (bits - i >= 8) ? 0xFF : (0xFF00 >> (bits - i));
+
+  for(i=0; i<16; i++)
+    p->addr.u6_addr.u6_addr8[i] = addr->u6_addr.u6_addr8[i] & p->mask.u6_addr.u6_addr8[i];
+
+  return(ndpi_lpm6_insert(t, t->num_prefixes++));
+}
+
+/* ********************************************************************************* */
+
+/* Prefixes found deeper are longer: the last one found is the best */
+static u_int32_t ndpi_lpm6_search(const struct ndpi_lpm6_entry *entries, const struct ndpi_lpm6_prefix *prefixes,
+				  const struct ndpi_in6_addr *addr) {
+  const struct ndpi_lpm6_entry *e = &entries[ndpi_lpm6_key(addr, 0)];
+  u_int32_t prefix = e->prefix;
+  u_int level;
+
+  for(level=1; e->child != 0; level++) {
+    if(e->child & NDPI_LPM6_LEAF) {
+      if(ndpi_lpm6_prefix_contains(&prefixes[e->child & ~NDPI_LPM6_LEAF], addr))
+	prefix = e->child & ~NDPI_LPM6_LEAF;
+      break;
+    }
+
+    if(level > NDPI_LPM6_MAX_DEPTH)
+      break; /* Bad image */
+
+    e = &entries[e->child + ndpi_lpm6_key(addr, level)];
+
+    if(e->prefix != 0)
+      prefix = e->prefix;
+  }
+
+  return(prefix);
+}
+
+/* ********************************************************************************* */
+
+int ndpi_lpm6_match(const struct ndpi_lpm6 *t, const struct ndpi_in6_addr *addr, u_int32_t *value) {
+  u_int32_t prefix;
+
+  if((t == NULL) || (t->num_entries == 0))
+    return(0);
+
+  if((prefix = ndpi_lpm6_search(t->entries, t->prefixes, addr)) == 0)
+    return(0);
+
+  *value = t->prefixes[prefix].value;
+  return(1);
+}
+
+/* ********************************************************************************* */
+
+void ndpi_lpm6_free(struct ndpi_lpm6 *t) {
+  if(t) {
+    if(t->entries)  ndpi_free(t->entries);
+    if(t->prefixes) ndpi_free(t->prefixes);
+    ndpi_free(t);
+  }
+}
+
+/* ********************************************************************************* */
+
+size_t ndpi_lpm6_image_size(const struct ndpi_lpm6 *t) {
+  return(sizeof(struct ndpi_lpm6_image)
+	 + (t ? ((size_t)t->num_entries * sizeof(struct ndpi_lpm6_entry)
+		 + (size_t)t->num_prefixes * sizeof(struct ndpi_lpm6_prefix)) : 0));
+}
+
+/* ********************************************************************************* */
+
+void ndpi_lpm6_write_image(const struct ndpi_lpm6 *t, void *buf) {
+  struct ndpi_lpm6_image *img = (struct ndpi_lpm6_image*)buf;
+  struct ndpi_lpm6_entry *entries = (struct ndpi_lpm6_entry*)&img[1];
+
+  memset(img, 0, sizeof(struct ndpi_lpm6_image));
+
+  if((t == NULL) || (t->num_entries == 0))
+    return;
+
+  img->num_entries = t->num_entries, img->num_prefixes = t->num_prefixes;
+  memcpy(entries, t->entries, (size_t)t->num_entries * sizeof(struct ndpi_lpm6_entry));
+  memcpy(&entries[t->num_entries], t->prefixes, (size_t)t->num_prefixes * sizeof(struct ndpi_lpm6_prefix));
+}
+
+/* ********************************************************************************* */
+
+int ndpi_lpm6_image_check(const void *buf, size_t len) {
+  const struct ndpi_lpm6_image *img = (const struct ndpi_lpm6_image*)buf;
+  const struct ndpi_lpm6_entry *entries = (const struct ndpi_lpm6_entry*)&img[1];
+  u_int32_t i;
+
+  if((len < sizeof(struct ndpi_lpm6_image))
+     || (len != sizeof(struct ndpi_lpm6_image)
+	 + (u_int64_t)img->num_entries * sizeof(struct ndpi_lpm6_entry)
+	 + (u_int64_t)img->num_prefixes * sizeof(struct ndpi_lpm6_prefix)))
+    return(-1);
+
+  if(img->num_entries == 0)
+    return(0);
+
+  if((img->num_entries < NDPI_LPM6_ROOT_ENTRIES)
+     || ((img->num_entries - NDPI_LPM6_ROOT_ENTRIES) % NDPI_LPM6_TABLE_ENTRIES))
+    return(-1);
+
+  /* Children must be tables or prefixes: lookups do not check indexes */
+  for(i=0; i<img->num_entries; i++) {
+    u_int32_t child = entries[i].child;
+
+    if(((child & NDPI_LPM6_LEAF) && ((child & ~NDPI_LPM6_LEAF) >= img->num_prefixes))
+       || ((child != 0) && !(child & NDPI_LPM6_LEAF)
+	&& ((child < NDPI_LPM6_ROOT_ENTRIES)
+	    || ((child - NDPI_LPM6_ROOT_ENTRIES) % NDPI_LPM6_TABLE_ENTRIES)
+	    || (child >= img->num_entries)))
+       || (entries[i].prefix >= img->num_prefixes))
+      return(-1);
+  }
+
+  return(0);
+}
+
+/* ********************************************************************************* */
+
+/* buf must come from ndpi_lpm6_write_image() and pass ndpi_lpm6_image_check() */
+int ndpi_lpm6_image_match(const void *buf, const struct ndpi_in6_addr *addr, u_int32_t *value) {
+  const struct ndpi_lpm6_image *img = (const struct ndpi_lpm6_image*)buf;
+  const struct ndpi_lpm6_entry *entries = (const struct ndpi_lpm6_entry*)&img[1];
+  const struct ndpi_lpm6_prefix *prefixes = (const struct ndpi_lpm6_prefix*)&entries[img->num_entries];
+  u_int32_t prefix;
+
+  if((img->num_entries == 0) || ((prefix = ndpi_lpm6_search(entries, prefixes, addr)) == 0))
+    return(0);
+
+  *value = prefixes[prefix].value;
+  return(1);
+}
+
+/* ********************************************************************************* */
+
+/*
+  IPv4 longest prefix match with leaf pushing: the first 16 bits of the
+  address index the root table, whose entries hold either the value of
+  the longest prefix covering them or, when longer prefixes start there,
+  a 256 entries table for the third byte (and so on for the fourth).
+  Values are copied down to the tables, so a lookup is one memory access
+  for the addresses matching at most a /16, two up to a /24 and three
+  beyond, and no comparison (the DIR-24-8 scheme with a 16 bits first
+  level, whose table fits in the caches).
+
+  An entry is 0 (no prefix), the value + 1 or NDPI_LPM4_CHILD | the index
+  of its table.
+*/
+
+#define NDPI_LPM4_ROOT_ENTRIES  (1 << 16)
+#define NDPI_LPM4_TABLE_ENTRIES 256
+#define NDPI_LPM4_CHILD         0x80000000
+
+struct ndpi_lpm4_image {
+  u_int32_t num_entries;
+  u_int32_t unused[3];
+};
+
+/* ********************************************************************************* */
+
+static int ndpi_lpm4_grow(struct ndpi_lpm4 *t, u_int32_t num_entries) {
+  if(t->num_entries + num_entries > t->max_entries) {
+    u_int32_t max_entries = t->max_entries ? (t->max_entries * 2) : (NDPI_LPM4_ROOT_ENTRIES + 16 * NDPI_LPM4_TABLE_ENTRIES);
+    u_int32_t *entries;
+    u_int8_t *lens;
+
+    while(max_entries < t->num_entries + num_entries) max_entries *= 2;
+
+    if(max_entries >= NDPI_LPM4_CHILD)
+      return(-1);
+
+    entries = ndpi_calloc(max_entries, sizeof(u_int32_t));
+    lens = ndpi_calloc(max_entries, sizeof(u_int8_t));
+
+    if((entries == NULL) || (lens == NULL)) {
+      if(entries) ndpi_free(entries);
+      if(lens)    ndpi_free(lens);
+      return(-1);
+    }
+
+    if(t->entries) {
+      memcpy(entries, t->entries, t->num_entries * sizeof(u_int32_t));
+      memcpy(lens, t->lens, t->num_entries * sizeof(u_int8_t));
+      ndpi_free(t->entries), ndpi_free(t->lens);
+    }
+
+    t->entries = entries, t->lens = lens, t->max_entries = max_entries;
+  }
+
+  t->num_entries += num_entries; /* Already zeroed */
+
+  return(0);
+}
+
+/* ********************************************************************************* */
+
+struct ndpi_lpm4* ndpi_lpm4_init(void) {
+  return(ndpi_calloc(1, sizeof(struct ndpi_lpm4)));
+}
+
+/* ********************************************************************************* */
+
+/* Returns the table of an entry, creating it (filled with the entry) if needed, or 0 */
+static u_int32_t ndpi_lpm4_child(struct ndpi_lpm4 *t, u_int32_t idx) {
+  u_int32_t child, i;
+
+  if(t->entries[idx] & NDPI_LPM4_CHILD)
+    return(t->entries[idx] & ~NDPI_LPM4_CHILD);
+
+  child = t->num_entries;
+
+  if(ndpi_lpm4_grow(t, NDPI_LPM4_TABLE_ENTRIES) != 0)
+    return(0);
+
+  for(i=0; i<NDPI_LPM4_TABLE_ENTRIES; i++)
+    t->entries[child + i] = t->entries[idx], t->lens[child + i] = t->lens[idx];
+
+  t->entries[idx] = NDPI_LPM4_CHILD | child;
+
+  return(child);
+}
+
+/* ********************************************************************************* */
+
+/* Sets the entries (and their tables) not covered by a prefix longer than len */
+static void ndpi_lpm4_fill(struct ndpi_lpm4 *t, u_int32_t first, u_int32_t num, u_int32_t entry, u_int8_t len) {
+  u_int32_t i;
+
+  for(i=first; i<first + num; i++) {
+    if(t->entries[i] & NDPI_LPM4_CHILD)
+      ndpi_lpm4_fill(t, t->entries[i] & ~NDPI_LPM4_CHILD, NDPI_LPM4_TABLE_ENTRIES, entry, len);
+    else if(t->lens[i] <= len)
+      t->entries[i] = entry, t->lens[i] = len;
+  }
+}
+
+/* ********************************************************************************* */
+
+int ndpi_lpm4_add(struct ndpi_lpm4 *t, u_int32_t addr /* network byte order */, u_int8_t bits, u_int32_t value) {
+  u_int32_t a, table, entry = value + 1;
+  u_int8_t len = bits + 1; /* 0 means no prefix */
+
+  if((bits > 32) || (entry >= NDPI_LPM4_CHILD))
+    return(-1);
+
+  /* The root table is only allocated with the first prefix */
+  if((t->num_entries == 0) && (ndpi_lpm4_grow(t, NDPI_LPM4_ROOT_ENTRIES) != 0))
+    return(-1);
+
+  a = bits ? (ntohl(addr) & (0xFFFFFFFF << (32 - bits))) : 0;
+
+  if(bits <= 16) {
+    ndpi_lpm4_fill(t, a >> 16, 1 << (16 - bits), entry, len);
+    return(0);
+  }
+
+  if((table = ndpi_lpm4_child(t, a >> 16)) == 0)
+    return(-1);
+
+  if(bits <= 24) {
+    ndpi_lpm4_fill(t, table + ((a >> 8) & 0xFF), 1 << (24 - bits), entry, len);
+    return(0);
+  }
+
+  if((table = ndpi_lpm4_child(t, table + ((a >> 8) & 0xFF))) == 0)
+    return(-1);
+
+  ndpi_lpm4_fill(t, table + (a & 0xFF), 1 << (32 - bits), entry, len);
+
+  return(0);
+}
+
+/* ********************************************************************************* */
+
+static inline u_int32_t ndpi_lpm4_search(const u_int32_t *entries, u_int32_t addr /* network byte order */) {
+  u_int32_t a = ntohl(addr), e = entries[a >> 16];
+
+  if(e & NDPI_LPM4_CHILD) {
+    e = entries[(e & ~NDPI_LPM4_CHILD) + ((a >> 8) & 0xFF)];
+
+    if(e & NDPI_LPM4_CHILD)
+      e = entries[(e & ~NDPI_LPM4_CHILD) + (a & 0xFF)];
+  }
+
+  return((e & NDPI_LPM4_CHILD) ? 0 : e); /* A fourth level only exists in bad images */
+}
+
+/* ********************************************************************************* */
+
+/*
+  The lookups are interleaved level by level: the (independent) memory
+  accesses of the addresses of a batch overlap, instead of paying one
+  cache miss after the other
+*/
+static void ndpi_lpm4_search_batch(const u_int32_t *entries, const u_int32_t *addrs, u_int num,
+				   u_int32_t *values, u_int32_t not_found) {
+  u_int32_t a[16], e[16];
+  u_int i, j, n;
+
+  for(i=0; i<num; i += n) {
+    n = ndpi_min(num - i, 16);
+
+    for(j=0; j<n; j++)
+      a[j] = ntohl(addrs[i + j]), e[j] = entries[a[j] >> 16];
+
+    for(j=0; j<n; j++)
+      if(e[j] & NDPI_LPM4_CHILD)
+	e[j] = entries[(e[j] & ~NDPI_LPM4_CHILD) + ((a[j] >> 8) & 0xFF)];
+
+    for(j=0; j<n; j++)
+      if(e[j] & NDPI_LPM4_CHILD)
+	e[j] = entries[(e[j] & ~NDPI_LPM4_CHILD) + (a[j] & 0xFF)];
+
+    for(j=0; j<n; j++)
+      values[i + j] = ((e[j] == 0) || (e[j] & NDPI_LPM4_CHILD)) ? not_found : (e[j] - 1);
+  }
+}
+
+/* ********************************************************************************* */
+
+int ndpi_lpm4_match(const struct ndpi_lpm4 *t, u_int32_t addr, u_int32_t *value) {
+  u_int32_t e;
+
+  if((t == NULL) || (t->num_entries == 0) || ((e = ndpi_lpm4_search(t->entries, addr)) == 0))
+    return(0);
+
+  *value = e - 1;
+  return(1);
+}
+
+/* ********************************************************************************* */
+
+void ndpi_lpm4_match_batch(const struct ndpi_lpm4 *t, const u_int32_t *addrs, u_int num,
+			   u_int32_t *values, u_int32_t not_found) {
+  u_int i;
+
+  if((t != NULL) && (t->num_entries != 0))
+    ndpi_lpm4_search_batch(t->entries, addrs, num, values, not_found);
+  else {
+    for(i=0; i<num; i++)
+      values[i] = not_found;
+  }
+}
+
+/* ********************************************************************************* */
+
+void ndpi_lpm4_free(struct ndpi_lpm4 *t) {
+  if(t) {
+    if(t->entries) ndpi_free(t->entries);
+    if(t->lens)    ndpi_free(t->lens);
+    ndpi_free(t);
+  }
+}
+
+/* ********************************************************************************* */
+
+size_t ndpi_lpm4_image_size(const struct ndpi_lpm4 *t) {
+  return(sizeof(struct ndpi_lpm4_image) + (size_t)t->num_entries * sizeof(u_int32_t));
+}
+
+/* ********************************************************************************* */
+
+void ndpi_lpm4_write_image(const struct ndpi_lpm4 *t, void *buf) {
+  struct ndpi_lpm4_image *img = (struct ndpi_lpm4_image*)buf;
+
+  memset(img, 0, sizeof(struct ndpi_lpm4_image));
+
+  if(t->num_entries == 0)
+    return;
+
+  img->num_entries = t->num_entries;
+  memcpy(&img[1], t->entries, (size_t)t->num_entries * sizeof(u_int32_t));
+}
+
+/* ********************************************************************************* */
+
+int ndpi_lpm4_image_check(const void *buf, size_t len) {
+  const struct ndpi_lpm4_image *img = (const struct ndpi_lpm4_image*)buf;
+  const u_int32_t *entries = (const u_int32_t*)&img[1];
+  u_int32_t i;
+
+  if((len < sizeof(struct ndpi_lpm4_image))
+     || (len != sizeof(struct ndpi_lpm4_image) + (u_int64_t)img->num_entries * sizeof(u_int32_t))
+     || ((img->num_entries != 0)
+	 && ((img->num_entries < NDPI_LPM4_ROOT_ENTRIES)
+	     || ((img->num_entries - NDPI_LPM4_ROOT_ENTRIES) % NDPI_LPM4_TABLE_ENTRIES))))
+    return(-1);
+
+  /* Children must be tables: lookups do not check indexes */
+  for(i=0; i<img->num_entries; i++) {
+    u_int32_t table = entries[i] & ~NDPI_LPM4_CHILD;
+
+    if((entries[i] & NDPI_LPM4_CHILD)
+       && ((table < NDPI_LPM4_ROOT_ENTRIES)
+	   || ((table - NDPI_LPM4_ROOT_ENTRIES) % NDPI_LPM4_TABLE_ENTRIES)
+	   || (table >= img->num_entries)))
+      return(-1);
+  }
+
+  return(0);
+}
+
+/* ********************************************************************************* */
+
+/* buf must come from ndpi_lpm4_write_image() and pass ndpi_lpm4_image_check() */
+int ndpi_lpm4_image_match(const void *buf, u_int32_t addr, u_int32_t *value) {
+  const struct ndpi_lpm4_image *img = (const struct ndpi_lpm4_image*)buf;
+  u_int32_t e;
+
+  if((img->num_entries == 0) || ((e = ndpi_lpm4_search((const u_int32_t*)&img[1], addr)) == 0))
+    return(0);
+
+  *value = e - 1;
+  return(1);
+}
+
+/* ********************************************************************************* */
+
+void ndpi_lpm4_image_match_batch(const void *buf, const u_int32_t *addrs, u_int num,
+				 u_int32_t *values, u_int32_t not_found) {
+  const struct ndpi_lpm4_image *img = (const struct ndpi_lpm4_image*)buf;
+  u_int i;
+
+  if(img->num_entries != 0)
+    ndpi_lpm4_search_batch((const u_int32_t*)&img[1], addrs, num, values, not_found);
+  else {
+    for(i=0; i<num; i++)
+      values[i] = not_found;
+  }
+}
@@ -29,7 +29,6 @@
 #include <errno.h>
 #include <sys/types.h>
 #include "ahocorasick.h"
-#include "libcache.h"
 
 #define NDPI_CURRENT_PROTO NDPI_PROTOCOL_UNKNOWN
 
@@ -45,12 +44,15 @@
 #include <sys/endian.h>
 #endif
 
+#if defined(NDPI_ENABLE_DISSECTOR_PROFILING) && (defined(__x86_64__) || defined(__i386__))
+#include <x86intrin.h>
+#endif
+
 #include "ndpi_content_match.c.inc"
-#include "third_party/include/ndpi_patricia.h"
 #include "third_party/include/ht_hash.h"
 
 /* stun.c */
-extern u_int32_t get_stun_lru_key(struct ndpi_flow_struct *flow);
+extern u_int64_t get_stun_lru_key(struct ndpi_packet_struct *packet, u_int8_t rev);
 
 static int _ndpi_debug_callbacks = 0;
 
@@ -71,12 +73,12 @@ static void addDefaultPort(struct ndpi_detection_module_struct *ndpi_str,
 			   ndpi_port_range *range,
 			   ndpi_proto_defaults_t *def,
 			   u_int8_t customUserProto,
-			   ndpi_default_ports_tree_node_t **root,
+			   u_int16_t *ports,
 			   const char *_func, int _line);
 
 static int removeDefaultPort(ndpi_port_range *range,
 			     ndpi_proto_defaults_t *def,
-			     ndpi_default_ports_tree_node_t **root);
+			     u_int16_t *ports);
 
 /* ****************************************** */
 
@@ -283,6 +285,22 @@ void ndpi_exclude_protocol(struct ndpi_detection_module_struct *ndpi_str,
 
 /* ********************************************************************************** */
 
+void ndpi_include_protocol(struct ndpi_detection_module_struct *ndpi_str,
+			   struct ndpi_flow_struct *flow,
+			   u_int16_t protocol_id) {
+  if(protocol_id < NDPI_MAX_SUPPORTED_PROTOCOLS+NDPI_MAX_NUM_CUSTOM_PROTOCOLS) {
+    u_int16_t idx = ndpi_str->proto_defaults[protocol_id].protoIdx;
+
+    NDPI_DEL_PROTOCOL_FROM_BITMASK(flow->excluded_protocol_bitmask, protocol_id);
+
+    /* Put the dissector back in the flow candidate set */
+    if(ndpi_str->callback_buffer[idx].ndpi_protocol_id == protocol_id)
+      NDPI_CALLBACK_CLR(flow->excluded_callbacks, idx);
+  }
+}
+
+/* ********************************************************************************** */
+
 void ndpi_set_proto_defaults(struct ndpi_detection_module_struct *ndpi_str,
 			     ndpi_protocol_breed_t breed, u_int16_t protoId,
 			     u_int8_t can_have_a_subprotocol,
@@ -320,70 +338,41 @@ void ndpi_set_proto_defaults(struct ndpi_detection_module_struct *ndpi_str,
   for(j=0; j<MAX_DEFAULT_PORTS; j++) {
     if(udpDefPorts[j].port_low != 0)
       addDefaultPort(ndpi_str, &udpDefPorts[j],
-		     &ndpi_str->proto_defaults[protoId], 0, &ndpi_str->udpRoot, __FUNCTION__,__LINE__);
+		     &ndpi_str->proto_defaults[protoId], 0, ndpi_str->udp_default_ports, __FUNCTION__,__LINE__);
 
     if(tcpDefPorts[j].port_low != 0)
       addDefaultPort(ndpi_str, &tcpDefPorts[j],
-		     &ndpi_str->proto_defaults[protoId], 0, &ndpi_str->tcpRoot, __FUNCTION__,__LINE__);
+		     &ndpi_str->proto_defaults[protoId], 0, ndpi_str->tcp_default_ports, __FUNCTION__,__LINE__);
   }
 }
 
 /* ******************************************************************** */
 
-static int ndpi_default_ports_tree_node_t_cmp(const void *a, const void *b)
-{
-  ndpi_default_ports_tree_node_t *fa = (ndpi_default_ports_tree_node_t*)a;
-  ndpi_default_ports_tree_node_t *fb = (ndpi_default_ports_tree_node_t*)b;
-
-  //printf("[NDPI] %s(%d, %d)\n", __FUNCTION__, fa->default_port, fb->default_port);
-
-  return((fa->default_port == fb->default_port) ? 0 : ((fa->default_port < fb->default_port) ? -1 : 1));
-}
-
-/* ******************************************************************** */
-
-void ndpi_default_ports_tree_node_t_walker(const void *node, const ndpi_VISIT which, const int depth)
-{
-  ndpi_default_ports_tree_node_t *f = *(ndpi_default_ports_tree_node_t **)node;
-
-  printf("<%d>Walk on node %s (%u)\n",
-	 depth,
-	 which == ndpi_preorder?"ndpi_preorder":
-	 which == ndpi_postorder?"ndpi_postorder":
-	 which == ndpi_endorder?"ndpi_endorder":
-	 which == ndpi_leaf?"ndpi_leaf": "unknown",
-	 f->default_port);
-}
-
-/* ******************************************************************** */
+/*
+  The default ports tables are indexed by port: an entry holds the id of
+  the protocol using that port by default (0 if none), or'ed with
+  NDPI_DEFAULT_PORT_CUSTOM for the protocols defined by the user
+*/
+#define NDPI_DEFAULT_PORT_CUSTOM     0x8000
+#define NDPI_DEFAULT_PORT_ID_MASK    0x7FFF
 
 static void addDefaultPort(struct ndpi_detection_module_struct *ndpi_str,
 			   ndpi_port_range *range,
 			   ndpi_proto_defaults_t *def,
 			   u_int8_t customUserProto,
-			   ndpi_default_ports_tree_node_t **root,
+			   u_int16_t *ports,
 			   const char *_func, int _line) {
-  u_int16_t port;
-
-  for(port=range->port_low; port<=range->port_high; port++) {
-    ndpi_default_ports_tree_node_t *node = (ndpi_default_ports_tree_node_t*)ndpi_malloc(sizeof(ndpi_default_ports_tree_node_t));
-    ndpi_default_ports_tree_node_t *ret;
-
-    if(!node) {
-      NDPI_LOG_ERR(ndpi_str, "%s:%d not enough memory\n", _func, _line);
-      break;
-    }
+  u_int32_t port;
 
-    node->proto = def, node->default_port = port, node->customUserProto = customUserProto;
-    ret = (ndpi_default_ports_tree_node_t*)ndpi_tsearch(node, (void*)root, ndpi_default_ports_tree_node_t_cmp); /* Add it to the tree */
+  if(def->protoId == NDPI_PROTOCOL_UNKNOWN)
+    return;
 
-    if(ret != node) {
+  for(port=range->port_low; port<=range->port_high; port++) {
+    if(ports[port] != 0)
       NDPI_LOG_DBG(ndpi_str, "[NDPI] %s:%d found duplicate for port %u: overwriting it with new value\n",
 		   _func, _line, port);
 
-      ret->proto = def;
-      ndpi_free(node);
-    }
+    ports[port] = def->protoId | (customUserProto ? NDPI_DEFAULT_PORT_CUSTOM : 0);
   }
 }
 
@@ -397,25 +386,17 @@ static void addDefaultPort(struct ndpi_detection_module_struct *ndpi_str,
 */
 static int removeDefaultPort(ndpi_port_range *range,
 			     ndpi_proto_defaults_t *def,
-			     ndpi_default_ports_tree_node_t **root)
+			     u_int16_t *ports)
 {
-  ndpi_default_ports_tree_node_t node;
-  u_int16_t port;
+  u_int32_t port;
+  int rc = -1;
 
   for(port=range->port_low; port<=range->port_high; port++) {
-    ndpi_default_ports_tree_node_t *ret;
-
-    node.proto = def, node.default_port = port;
-    ret = (ndpi_default_ports_tree_node_t*)ndpi_tdelete(&node, (void*)root,
-							  ndpi_default_ports_tree_node_t_cmp); /* Add it to the tree */
-
-    if(ret != NULL) {
-      ndpi_free((ndpi_default_ports_tree_node_t*)ret);
-      return(0);
-    }
+    if((ports[port] & NDPI_DEFAULT_PORT_ID_MASK) == def->protoId)
+      ports[port] = 0, rc = 0;
   }
 
-  return(-1);
+  return(rc);
 }
 
 /* ****************************************************** */
@@ -432,6 +413,8 @@ static int ndpi_string_to_automa(struct ndpi_detection_module_struct *ndpi_str,
     return(-1);
   }
 
+  if(ndpi_str->ruleset != NULL) return(0); /* Compiled automata are read-only */
+
   if(automa->ac_automa == NULL) return(-2);
   ac_pattern.astring = value,
     ac_pattern.rep.number = protocol_id,
@@ -456,12 +439,59 @@ static int ndpi_string_to_automa(struct ndpi_detection_module_struct *ndpi_str,
 
 /* ****************************************************** */
 
+/*
+  Adds name to a domain trie (allocated on demand) when it has at least two
+  labels: returns -1 for anything else, that is then matched as a substring
+*/
+static int ndpi_add_domain(struct ndpi_domain_trie **trie, const char *name, u_int32_t value) {
+  const char *dot;
+
+  if(strncmp(name, "*.", 2) == 0)
+    name += 2;
+  else if(name[0] == '.')
+    name++;
+
+  if(((dot = strchr(name, '.')) == NULL) || (dot == name) || (dot[1] == '\0'))
+    return(-1);
+
+  if((*trie == NULL) && ((*trie = ndpi_domain_trie_init()) == NULL))
+    return(-1);
+
+  return(ndpi_domain_trie_add(*trie, name, value));
+}
+
+/* ****************************************************** */
+
+static int ndpi_match_domain(struct ndpi_detection_module_struct *ndpi_str, u_int section,
+			     const char *name, u_int name_len, u_int32_t *value) {
+  struct ndpi_domain_trie *trie;
+
+  if(ndpi_str->ruleset != NULL)
+    return(ndpi_ruleset_domain_match(ndpi_str->ruleset, section, name, name_len, value));
+
+  trie = (section == NDPI_RULESET_HOST_DOMAINS) ? ndpi_str->host_domains : ndpi_str->custom_categories.domains;
+
+  return(trie ? ndpi_domain_trie_match(trie, name, name_len, value) : 0);
+}
+
+/* ****************************************************** */
+
 static int ndpi_add_host_url_subprotocol(struct ndpi_detection_module_struct *ndpi_str,
 					 char *_value, int protocol_id,
 					 ndpi_protocol_category_t category,
 					 ndpi_protocol_breed_t breed) {
   int rv;
-  char *value = ndpi_strdup(_value);
+  char *value;
+
+  if(ndpi_str->ruleset != NULL)
+    return(0); /* The ruleset host automa already contains the value */
+
+  if(ndpi_str->domain_match
+     && (ndpi_add_domain(&ndpi_str->host_domains, _value,
+			 (u_int32_t)protocol_id | ((u_int32_t)category << 16) | ((u_int32_t)breed << 24)) == 0))
+    return(0);
+
+  value = ndpi_strdup(_value);
 
   if(!value) return(-1);
 
@@ -720,6 +750,78 @@ int ndpi_set_detection_preferences(struct ndpi_detection_module_struct *ndpi_str
     ndpi_str->disable_metadata_export = (u_int8_t)value;
     break;
 
+  case ndpi_pref_disable_dissector_prefix_filter:
+    ndpi_str->disable_dissector_prefix_filter = (u_int8_t)value;
+    break;
+
+  case ndpi_pref_enable_domain_match:
+    ndpi_str->domain_match = (u_int8_t)value;
+    break;
+
+  case ndpi_pref_enable_category_filter:
+    ndpi_str->category_filter = (u_int8_t)value;
+    break;
+
+    /* The cache sizes apply when the caches are allocated, i.e. before the first packet */
+  case ndpi_pref_ookla_cache_num_entries:
+    if(value < 0) return(-1);
+    ndpi_str->ookla_cache_num_entries = (u_int32_t)value;
+    break;
+
+  case ndpi_pref_ookla_cache_ttl:
+    if(value < 0) return(-1);
+    ndpi_str->ookla_cache_ttl = (u_int32_t)value;
+    if(ndpi_str->ookla_cache) ndpi_str->ookla_cache->ttl = ndpi_str->ookla_cache_ttl;
+    break;
+
+  case ndpi_pref_stun_cache_num_entries:
+    if(value < 0) return(-1);
+    ndpi_str->stun_cache_num_entries = (u_int32_t)value;
+    break;
+
+  case ndpi_pref_stun_cache_ttl:
+    if(value < 0) return(-1);
+    ndpi_str->stun_cache_ttl = (u_int32_t)value;
+    if(ndpi_str->stun_cache) ndpi_str->stun_cache->ttl = ndpi_str->stun_cache_ttl;
+    break;
+
+  case ndpi_pref_dns_cache_num_entries:
+    if(value < 0) return(-1);
+    ndpi_str->dns_cache_num_entries = (u_int32_t)value;
+    break;
+
+  case ndpi_pref_dns_cache_max_ttl:
+    if(value < 0) return(-1);
+    ndpi_str->dns_cache_max_ttl = (u_int32_t)value;
+    break;
+
+  case ndpi_pref_verdict_cache_num_entries:
+    if(value < 0) return(-1);
+    ndpi_str->verdict_cache_num_entries = (u_int32_t)value;
+    break;
+
+  case ndpi_pref_verdict_cache_ttl:
+    if(value < 0) return(-1);
+    ndpi_str->verdict_cache_ttl = (u_int32_t)value;
+    if(ndpi_str->verdict_cache) ndpi_str->verdict_cache->ttl = ndpi_str->verdict_cache_ttl;
+    break;
+
+  case ndpi_pref_verdict_cache_verify_packets:
+    if((value < 0) || (value > 0xFF)) return(-1);
+    ndpi_str->verdict_cache_verify_pkts = (u_int8_t)value;
+    break;
+
+  case ndpi_pref_enable_classification_stats:
+    if(value && (ndpi_str->classification_stats == NULL)) {
+      if((ndpi_str->classification_stats = ndpi_calloc(NDPI_MAX_SUPPORTED_PROTOCOLS + NDPI_MAX_NUM_CUSTOM_PROTOCOLS,
+						       sizeof(struct ndpi_classification_stats))) == NULL)
+	return(-1);
+    } else if((!value) && ndpi_str->classification_stats) {
+      ndpi_free(ndpi_str->classification_stats);
+      ndpi_str->classification_stats = NULL;
+    }
+    break;
+
   default:
     return(-1);
   }
@@ -1835,33 +1937,52 @@ static int ac_match_handler(AC_MATCH_t *m, AC_TEXT_t *txt, AC_REP_t *match) {
 
 /* ******************************************************************** */
 
-static int fill_prefix_v4(prefix_t *p, struct in_addr *a, int b, int mb) {
-  do {
-    if(b < 0 || b > mb)
-      return(-1);
+u_int16_t ndpi_network_ptree_match(struct ndpi_detection_module_struct *ndpi_str,
+				   struct in_addr *pin /* network byte order */) {
+  u_int32_t value;
 
-    memset(p, 0, sizeof(prefix_t));
-    memcpy(&p->add.sin, a, (mb+7)/8);
-    p->family = AF_INET;
-    p->bitlen = b;
-    p->ref_count = 0;
-  } while(0);
+  if(ndpi_str->ruleset != NULL)
+    return(ndpi_ruleset_lpm4_match(ndpi_str->ruleset, NDPI_RULESET_PROTOCOLS_LPM4,
+				   pin->s_addr, &value) ? value : NDPI_PROTOCOL_UNKNOWN);
 
-  return(0);
+  return(ndpi_lpm4_match(ndpi_str->protocols_lpm4, pin->s_addr, &value) ? value : NDPI_PROTOCOL_UNKNOWN);
 }
 
 /* ******************************************* */
 
-u_int16_t ndpi_network_ptree_match(struct ndpi_detection_module_struct *ndpi_str,
-				   struct in_addr *pin /* network byte order */) {
-  prefix_t prefix;
-  patricia_node_t *node;
+void ndpi_network_ptree_match_batch(struct ndpi_detection_module_struct *ndpi_str,
+				    const struct in_addr *pins, u_int num, u_int16_t *protocols) {
+  u_int32_t addrs[16], values[16];
+  u_int i, j, n;
+
+  for(i=0; i<num; i += n) {
+    n = ndpi_min(num - i, 16);
+
+    for(j=0; j<n; j++)
+      addrs[j] = pins[i + j].s_addr;
+
+    if(ndpi_str->ruleset != NULL)
+      ndpi_ruleset_lpm4_match_batch(ndpi_str->ruleset, NDPI_RULESET_PROTOCOLS_LPM4, addrs, n,
+				    values, NDPI_PROTOCOL_UNKNOWN);
+    else
+      ndpi_lpm4_match_batch(ndpi_str->protocols_lpm4, addrs, n, values, NDPI_PROTOCOL_UNKNOWN);
+
+    for(j=0; j<n; j++)
+      protocols[i + j] = values[j];
+  }
+}
 
-  /* Make sure all in network byte order otherwise compares wont work */
-  fill_prefix_v4(&prefix, pin, 32, ((patricia_tree_t*)ndpi_str->protocols_ptree)->maxbits);
-  node = ndpi_patricia_search_best(ndpi_str->protocols_ptree, &prefix);
+/* ******************************************* */
+
+u_int16_t ndpi_network_ptree6_match(struct ndpi_detection_module_struct *ndpi_str,
+				    const struct ndpi_in6_addr *pin /* network byte order */) {
+  u_int32_t value;
 
-  return(node ? node->value.user_value : NDPI_PROTOCOL_UNKNOWN);
+  if(ndpi_str->ruleset != NULL)
+    return(ndpi_ruleset_lpm6_match(ndpi_str->ruleset, NDPI_RULESET_PROTOCOLS_LPM6,
+				   pin, &value) ? value : NDPI_PROTOCOL_UNKNOWN);
+
+  return(ndpi_lpm6_match(ndpi_str->protocols_lpm6, pin, &value) ? value : NDPI_PROTOCOL_UNKNOWN);
 }
 
 /* ******************************************* */
@@ -1876,7 +1997,7 @@ static u_int8_t tor_ptree_match(struct ndpi_detection_module_struct *ndpi_str, s
 
 u_int8_t ndpi_is_tor_flow(struct ndpi_detection_module_struct *ndpi_str,
 			  struct ndpi_flow_struct *flow) {
-  struct ndpi_packet_struct *packet = &flow->packet;
+  struct ndpi_packet_struct *packet = &ndpi_str->packet;
 
   if(packet->tcp != NULL) {
     if(packet->iph) {
@@ -1890,33 +2011,44 @@ u_int8_t ndpi_is_tor_flow(struct ndpi_detection_module_struct *ndpi_str,
 
 /* ******************************************* */
 
-static patricia_node_t* add_to_ptree(patricia_tree_t *tree, int family,
-				     void *addr, int bits) {
-  prefix_t prefix;
-  patricia_node_t *node;
+static void ndpi_init_ptree_ipv4(struct ndpi_detection_module_struct *ndpi_str,
+				 struct ndpi_lpm4 *lpm, ndpi_network host_list[]) {
+  int i;
+
+  for(i=0; host_list[i].network != 0x0; i++)
+    ndpi_lpm4_add(lpm, htonl(host_list[i].network), host_list[i].cidr, host_list[i].value);
+}
+
+/* ******************************************* */
 
-  fill_prefix_v4(&prefix, (struct in_addr*)addr, bits, tree->maxbits);
+static void ndpi_init_ptree_ipv6(struct ndpi_detection_module_struct *ndpi_str,
+				 struct ndpi_lpm6 *lpm, ndpi_network6 host_list[]) {
+  int i;
 
-  node = ndpi_patricia_lookup(tree, &prefix);
+  for(i=0; host_list[i].network != NULL; i++) {
+    struct ndpi_in6_addr pin;
 
-  return(node);
+    if(inet_pton(AF_INET6, host_list[i].network, &pin) == 1)
+      ndpi_lpm6_add(lpm, &pin, host_list[i].cidr, host_list[i].value);
+  }
 }
 
 /* ******************************************* */
 
-static void ndpi_init_ptree_ipv4(struct ndpi_detection_module_struct *ndpi_str,
-				 void *ptree, ndpi_network host_list[]) {
-  int i;
+/* Parses "<IPv6 address>[/<bits>]", the bits defaulting to 128 */
+static int ndpi_parse_ipv6_prefix(char *value, struct ndpi_in6_addr *pin, u_int8_t *bits) {
+  char *ptr = strrchr(value, '/');
 
-  for(i=0; host_list[i].network != 0x0; i++) {
-    struct in_addr pin;
-    patricia_node_t *node;
+  *bits = 128;
 
-    pin.s_addr = htonl(host_list[i].network);
-    if((node = add_to_ptree(ptree, AF_INET,
-			    &pin, host_list[i].cidr /* bits */)) != NULL)
-      node->value.user_value = host_list[i].value;
+  if(ptr) {
+    ptr[0] = '\0';
+    ptr++;
+    if(atoi(ptr)>=0 && atoi(ptr)<=128)
+      *bits = atoi(ptr);
   }
+
+  return((inet_pton(AF_INET6, value, pin) == 1) ? 0 : -1);
 }
 
 /* ******************************************* */
@@ -1924,11 +2056,23 @@ static void ndpi_init_ptree_ipv4(struct ndpi_detection_module_struct *ndpi_str,
 static int ndpi_add_host_ip_subprotocol(struct ndpi_detection_module_struct *ndpi_str,
 					char *value, int protocol_id) {
 
-  patricia_node_t *node;
   struct in_addr pin;
   int bits = 32;
   char *ptr = strrchr(value, '/');
 
+  if(ndpi_str->ruleset != NULL)
+    return(0); /* The ruleset IP tree already contains the value */
+
+  if(strchr(value, ':') != NULL) {
+    struct ndpi_in6_addr pin6;
+    u_int8_t bits6;
+
+    if(ndpi_parse_ipv6_prefix(value, &pin6, &bits6) == 0)
+      ndpi_lpm6_add(ndpi_str->protocols_lpm6, &pin6, bits6, protocol_id);
+
+    return(0);
+  }
+
   if(ptr) {
     ptr[0] = '\0';
     ptr++;
@@ -1936,10 +2080,8 @@ static int ndpi_add_host_ip_subprotocol(struct ndpi_detection_module_struct *ndp
       bits = atoi(ptr);
   }
 
-  inet_pton(AF_INET, value, &pin);
-
-  if((node = add_to_ptree(ndpi_str->protocols_ptree, AF_INET, &pin, bits)) != NULL)
-    node->value.user_value = protocol_id;
+  if(inet_pton(AF_INET, value, &pin) == 1)
+    ndpi_lpm4_add(ndpi_str->protocols_lpm4, pin.s_addr, bits, protocol_id);
 
   return(0);
 }
@@ -2094,7 +2236,80 @@ static const char* categories[] = {
 
 /* ******************************************************************** */
 
-struct ndpi_detection_module_struct *ndpi_init_detection_module(void) {
+/* Automa of a module built from a ruleset section (NULL if the section is not an automa) */
+static ndpi_automa* ndpi_ruleset_automa(struct ndpi_detection_module_struct *ndpi_str, u_int section) {
+  switch(section) {
+  case NDPI_RULESET_HOST_AUTOMA:               return(&ndpi_str->host_automa);
+  case NDPI_RULESET_CONTENT_AUTOMA:            return(&ndpi_str->content_automa);
+  case NDPI_RULESET_BIGRAMS_AUTOMA:            return(&ndpi_str->bigrams_automa);
+  case NDPI_RULESET_IMPOSSIBLE_BIGRAMS_AUTOMA: return(&ndpi_str->impossible_bigrams_automa);
+#ifndef HAVE_HYPERSCAN
+  case NDPI_RULESET_CATEGORIES_AUTOMA:         return(&ndpi_str->custom_categories.hostnames);
+#endif
+  default:
+    return(NULL);
+  }
+}
+
+/* ******************************************************************** */
+
+static AC_AUTOMATA_t* ndpi_init_ruleset_automa(struct ndpi_ruleset *ruleset, u_int section) {
+  size_t len;
+  const void *image = ndpi_ruleset_get_section(ruleset, section, &len);
+
+  return(ac_automata_init_image(ac_match_handler, image, len));
+}
+
+/* ******************************************************************** */
+
+/*
+  Moves a module to the updates published for its ruleset. It must be
+  called between packets, when no automa search is in progress
+*/
+static void ndpi_update_ruleset(struct ndpi_detection_module_struct *ndpi_str) {
+  struct ndpi_ruleset *next, *prev;
+
+  /* next is referenced by the current ruleset, so it cannot be freed here */
+  while((next = __atomic_load_n(&ndpi_str->ruleset->next, __ATOMIC_ACQUIRE)) != NULL) {
+    AC_AUTOMATA_t *update[NDPI_RULESET_NUM_SECTIONS] = { NULL };
+    u_int i;
+
+    for(i=0; i<NDPI_RULESET_NUM_SECTIONS; i++) {
+      if(ndpi_ruleset_automa(ndpi_str, i)
+	 && ((update[i] = ndpi_init_ruleset_automa(next, i)) == NULL)) {
+	/* Out of memory: keep the current rules and try again later */
+	while(i-- > 0)
+	  if(update[i]) ac_automata_release(update[i], 0);
+
+	return;
+      }
+    }
+
+    for(i=0; i<NDPI_RULESET_NUM_SECTIONS; i++) {
+      ndpi_automa *automa = ndpi_ruleset_automa(ndpi_str, i);
+
+      if(automa) {
+	ac_automata_release((AC_AUTOMATA_t*)automa->ac_automa, 0);
+	automa->ac_automa = update[i];
+      }
+    }
+
+    prev = ndpi_str->ruleset;
+    ndpi_str->ruleset = ndpi_ruleset_get(next);
+    ndpi_release_ruleset(prev);
+  }
+}
+
+/* ******************************************************************** */
+
+void ndpi_ruleset_quiescent(struct ndpi_detection_module_struct *ndpi_str) {
+  if(ndpi_str && (ndpi_str->ruleset != NULL))
+    ndpi_update_ruleset(ndpi_str);
+}
+
+/* ******************************************************************** */
+
+static struct ndpi_detection_module_struct *ndpi_init_detection_module_ruleset(struct ndpi_ruleset *ruleset) {
   struct ndpi_detection_module_struct *ndpi_str = ndpi_malloc(sizeof(struct ndpi_detection_module_struct));
   int i;
 
@@ -2107,19 +2322,37 @@ struct ndpi_detection_module_struct *ndpi_init_detection_module(void) {
 
   memset(ndpi_str, 0, sizeof(struct ndpi_detection_module_struct));
 
+  if(ruleset != NULL)
+    ndpi_str->ruleset = ndpi_ruleset_get(ruleset);
+
 #ifdef NDPI_ENABLE_DEBUG_MESSAGES
   set_ndpi_debug_function(ndpi_str, (ndpi_debug_function_ptr)ndpi_debug_printf);
 #endif /* NDPI_ENABLE_DEBUG_MESSAGES */
 
-  if((ndpi_str->protocols_ptree = ndpi_New_Patricia(32 /* IPv4 */)) != NULL)
-    ndpi_init_ptree_ipv4(ndpi_str, ndpi_str->protocols_ptree, host_protocol_list);
+  if(((ndpi_str->protocols_lpm4 = ndpi_lpm4_init()) != NULL) && (ruleset == NULL))
+    ndpi_init_ptree_ipv4(ndpi_str, ndpi_str->protocols_lpm4, host_protocol_list);
+
+  if(((ndpi_str->protocols_lpm6 = ndpi_lpm6_init()) != NULL) && (ruleset == NULL))
+    ndpi_init_ptree_ipv6(ndpi_str, ndpi_str->protocols_lpm6, host_protocol_list6);
 
   NDPI_BITMASK_RESET(ndpi_str->detection_bitmask);
 #ifdef NDPI_ENABLE_DEBUG_MESSAGES
   ndpi_str->user_data = NULL;
 #endif
 
+#ifdef NDPI_ENABLE_DISSECTOR_PROFILING
+  if((ndpi_str->dissector_stats = ndpi_calloc(NDPI_MAX_SUPPORTED_PROTOCOLS + 1,
+					      sizeof(struct ndpi_dissector_stats))) == NULL) {
+    ndpi_exit_detection_module(ndpi_str);
+    return(NULL);
+  }
+#endif
+
   ndpi_str->ticks_per_second = 1000; /* ndpi_str->ticks_per_second */
+  ndpi_str->ookla_cache_num_entries = NDPI_OOKLA_CACHE_NUM_ENTRIES, ndpi_str->ookla_cache_ttl = NDPI_OOKLA_CACHE_TTL;
+  ndpi_str->stun_cache_num_entries = NDPI_STUN_CACHE_NUM_ENTRIES, ndpi_str->stun_cache_ttl = NDPI_STUN_CACHE_TTL;
+  ndpi_str->dns_cache_max_ttl = NDPI_DNS_CACHE_MAX_TTL; /* The DNS cache is disabled by default */
+  ndpi_str->verdict_cache_ttl = NDPI_VERDICT_CACHE_TTL; /* So is the verdict cache */
   ndpi_str->tcp_max_retransmission_window_size = NDPI_DEFAULT_MAX_TCP_RETRANSMISSION_WINDOW_SIZE;
   ndpi_str->directconnect_connection_ip_tick_timeout =
     NDPI_DIRECTCONNECT_CONNECTION_IP_TICK_TIMEOUT * ndpi_str->ticks_per_second;
@@ -2143,14 +2376,32 @@ struct ndpi_detection_module_struct *ndpi_init_detection_module(void) {
   ndpi_str->ndpi_num_supported_protocols = NDPI_MAX_SUPPORTED_PROTOCOLS;
   ndpi_str->ndpi_num_custom_protocols = 0;
 
-  ndpi_str->host_automa.ac_automa               = ac_automata_init(ac_match_handler);
-  ndpi_str->content_automa.ac_automa            = ac_automata_init(ac_match_handler);
-  ndpi_str->bigrams_automa.ac_automa            = ac_automata_init(ac_match_handler);
-  ndpi_str->impossible_bigrams_automa.ac_automa = ac_automata_init(ac_match_handler);
+  if(ruleset != NULL) {
+    for(i=0; i<NDPI_RULESET_NUM_SECTIONS; i++) {
+      ndpi_automa *automa = ndpi_ruleset_automa(ndpi_str, i);
+
+      if(automa == NULL)
+	continue;
+
+      automa->ac_automa_finalized = 1;
+
+      if((automa->ac_automa = ndpi_init_ruleset_automa(ruleset, i)) == NULL) {
+	NDPI_LOG_ERR(ndpi_str, "[NDPI] invalid ruleset automata\n");
+	ndpi_exit_detection_module(ndpi_str);
+	return(NULL);
+      }
+    }
+  } else {
+    ndpi_str->host_automa.ac_automa               = ac_automata_init(ac_match_handler);
+    ndpi_str->content_automa.ac_automa            = ac_automata_init(ac_match_handler);
+    ndpi_str->bigrams_automa.ac_automa            = ac_automata_init(ac_match_handler);
+    ndpi_str->impossible_bigrams_automa.ac_automa = ac_automata_init(ac_match_handler);
+  }
 
   if((sizeof(categories)/sizeof(char*)) != NDPI_PROTOCOL_NUM_CATEGORIES) {
     NDPI_LOG_ERR(ndpi_str, "[NDPI] invalid categories length: expected %u, got %u\n",
 		 NDPI_PROTOCOL_NUM_CATEGORIES, (unsigned int)(sizeof(categories)/sizeof(char*)));
+    ndpi_exit_detection_module(ndpi_str);
     return(NULL);
   }
 
@@ -2158,16 +2409,32 @@ struct ndpi_detection_module_struct *ndpi_init_detection_module(void) {
   ndpi_str->custom_categories.num_to_load = 0, ndpi_str->custom_categories.to_load = NULL;
   ndpi_str->custom_categories.hostnames = NULL;
 #else
-  ndpi_str->custom_categories.hostnames.ac_automa        = ac_automata_init(ac_match_handler);
-  ndpi_str->custom_categories.hostnames_shadow.ac_automa = ac_automata_init(ac_match_handler);
+  if(ruleset == NULL) {
+    ndpi_str->custom_categories.hostnames.ac_automa        = ac_automata_init(ac_match_handler);
+    ndpi_str->custom_categories.hostnames_shadow.ac_automa = ac_automata_init(ac_match_handler);
+  }
 #endif
 
-  ndpi_str->custom_categories.ipAddresses                = ndpi_New_Patricia(32 /* IPv4 */);
-  ndpi_str->custom_categories.ipAddresses_shadow         = ndpi_New_Patricia(32 /* IPv4 */);
-
-  if((ndpi_str->custom_categories.ipAddresses == NULL)
-     || (ndpi_str->custom_categories.ipAddresses_shadow == NULL))
+  ndpi_str->custom_categories.ipAddresses                = ndpi_lpm4_init();
+  ndpi_str->custom_categories.ipAddresses_shadow         = ndpi_lpm4_init();
+  ndpi_str->custom_categories.ipAddresses6               = ndpi_lpm6_init();
+  ndpi_str->custom_categories.ipAddresses6_shadow        = ndpi_lpm6_init();
+
+  ndpi_str->tcp_default_ports = ndpi_calloc(65536, sizeof(u_int16_t));
+  ndpi_str->udp_default_ports = ndpi_calloc(65536, sizeof(u_int16_t));
+
+  if((ndpi_str->tcp_default_ports == NULL)
+     || (ndpi_str->udp_default_ports == NULL)
+     || (ndpi_str->custom_categories.ipAddresses == NULL)
+     || (ndpi_str->custom_categories.ipAddresses_shadow == NULL)
+     || (ndpi_str->custom_categories.ipAddresses6 == NULL)
+     || (ndpi_str->custom_categories.ipAddresses6_shadow == NULL)
+     || (ndpi_str->protocols_lpm4 == NULL)
+     || (ndpi_str->protocols_lpm6 == NULL)) {
+    /* Frees what was allocated so far and drops the ruleset reference */
+    ndpi_exit_detection_module(ndpi_str);
     return(NULL);
+  }
 
   ndpi_init_protocol_defaults(ndpi_str);
 
@@ -2180,6 +2447,36 @@ struct ndpi_detection_module_struct *ndpi_init_detection_module(void) {
 
 /* *********************************************** */
 
+struct ndpi_detection_module_struct *ndpi_init_detection_module(void) {
+  return(ndpi_init_detection_module_ruleset(NULL));
+}
+
+/* *********************************************** */
+
+struct ndpi_detection_module_struct *ndpi_init_detection_module_with_ruleset(struct ndpi_ruleset *ruleset) {
+  if(ruleset == NULL)
+    return(NULL);
+
+  return(ndpi_init_detection_module_ruleset(ruleset));
+}
+
+/* *********************************************** */
+
+struct ndpi_detection_module_struct *ndpi_init_detection_module_from_ruleset(const char *path) {
+  struct ndpi_ruleset *ruleset = ndpi_load_ruleset(path);
+  struct ndpi_detection_module_struct *ndpi_str;
+
+  if(ruleset == NULL)
+    return(NULL);
+
+  ndpi_str = ndpi_init_detection_module_ruleset(ruleset);
+  ndpi_release_ruleset(ruleset); /* Now owned by the module */
+
+  return(ndpi_str);
+}
+
+/* *********************************************** */
+
 /* Wrappers */
 void* ndpi_init_automa(void) {
   return(ac_automata_init(ac_match_handler));
@@ -2282,71 +2579,226 @@ static int hyperscanCustomEventHandler(unsigned int id,
 
 /* *********************************************** */
 
-int ndpi_match_custom_category(struct ndpi_detection_module_struct *ndpi_str,
-			       char *name, u_int name_len, unsigned long *id) {
-#ifdef HAVE_HYPERSCAN
-    if(ndpi_str->custom_categories.hostnames == NULL)
-      return(-1);
-    else {
-      hs_error_t rc;
+/* Hash of the len (4 or 8) bytes at ptr, regardless of their case */
+static inline u_int64_t ndpi_category_filter_key(const char *ptr, u_int len) {
+  u_int64_t h = 0;
 
-      *id = (unsigned long)-1;
+  memcpy(&h, ptr, len);
+  h |= (len == 8) ? 0x2020202020202020ULL : 0x20202020ULL;
 
-      rc = hs_scan(ndpi_str->custom_categories.hostnames->database,
-		   name, name_len, 0,
-		   ndpi_str->custom_categories.hostnames->scratch,
-		   hyperscanCustomEventHandler, id);
+  h = (h ^ (h >> 33)) * 0xff51afd7ed558ccdULL;
+  h = (h ^ (h >> 33)) * 0xc4ceb9fe1a85ec53ULL;
 
-      if(rc == HS_SCAN_TERMINATED) {
-#ifdef DEBUG
-	printf("[HS] Found category %lu for %s\n", *id, name);
-#endif
-	return(0);
-      } else
-	return(-1);
-    }
-#else
-    return(ndpi_match_string_id(ndpi_str->custom_categories.hostnames.ac_automa, name, name_len, id));
-#endif
+  return(h ^ (h >> 33));
 }
 
 /* *********************************************** */
 
-int ndpi_get_custom_category_match(struct ndpi_detection_module_struct *ndpi_str,
-				   char *name_or_ip, u_int name_len, unsigned long *id) {
-  char ipbuf[64], *ptr;
-  struct in_addr pin;
-  u_int cp_len = ndpi_min(sizeof(ipbuf)-1, name_len);
-
-  if(!ndpi_str->custom_categories.categories_loaded)
-    return(-1);
-
-  if(cp_len > 0) {
-    memcpy(ipbuf, name_or_ip, cp_len);
-    ipbuf[cp_len] = '\0';
-  } else
-    ipbuf[0] = '\0';
+/*
+  The filter key of a category name is made of the 8 bytes ending with its
+  first '.' preceded by 7 bytes at least (e.g. "netflix." for
+  "netflix.com"), else of the 4 bytes ending with the first '.' preceded
+  by 3 bytes ("icq." for "icq.com"). The hostnames matching the name have
+  the same bytes before one of their dots, so only those are tested. The
+  filter is not used when a name has no key, nor with Hyperscan where '.'
+  matches any byte
+*/
+static void ndpi_category_filter_add_name(struct ndpi_detection_module_struct *ndpi_str,
+					  const char *name) {
+  size_t len = strlen(name);
+  u_int key_len = 8;
+  const char *dot = (len > 7) ? strchr(&name[7], '.') : NULL;
 
-  ptr = strrchr(ipbuf, '/');
+  if(dot == NULL)
+    key_len = 4, dot = (len > 3) ? strchr(&name[3], '.') : NULL;
 
-  if(ptr)
-    ptr[0] = '\0';
+#ifdef HAVE_HYPERSCAN
+  dot = NULL;
+#endif
 
-  if(inet_pton(AF_INET, ipbuf, &pin) == 1) {
-    /* Search IP */
-    prefix_t prefix;
-    patricia_node_t *node;
+  if(dot == NULL) {
+    ndpi_str->custom_categories.filter_unusable = 1;
+    return;
+  }
 
-    /* Make sure all in network byte order otherwise compares wont work */
-    fill_prefix_v4(&prefix, &pin, 32, ((patricia_tree_t*)ndpi_str->protocols_ptree)->maxbits);
-    node = ndpi_patricia_search_best(ndpi_str->custom_categories.ipAddresses, &prefix);
+  if(ndpi_str->custom_categories.num_filter_keys == ndpi_str->custom_categories.max_filter_keys) {
+    u_int32_t max_keys = ndpi_str->custom_categories.max_filter_keys ? 2 * ndpi_str->custom_categories.max_filter_keys : 1024;
+    u_int64_t *keys = ndpi_str->custom_categories.filter_keys ?
+      ndpi_realloc(ndpi_str->custom_categories.filter_keys,
+		   ndpi_str->custom_categories.max_filter_keys * sizeof(u_int64_t),
+		   max_keys * sizeof(u_int64_t)) : ndpi_malloc(max_keys * sizeof(u_int64_t));
 
-    if(node) {
-      *id = node->value.user_value;
-      return(0);
+    if(keys == NULL) {
+      ndpi_str->custom_categories.filter_unusable = 1;
+      return;
     }
 
-    return(-1);
+    ndpi_str->custom_categories.filter_keys = keys, ndpi_str->custom_categories.max_filter_keys = max_keys;
+  }
+
+  ndpi_str->custom_categories.filter_keys[ndpi_str->custom_categories.num_filter_keys++] =
+    ndpi_category_filter_key(dot + 1 - key_len, key_len);
+}
+
+/* *********************************************** */
+
+/* 0 if no category name can match, 1 if one may match, -1 without a filter */
+static int ndpi_category_filter_match(struct ndpi_detection_module_struct *ndpi_str,
+				      const char *name, u_int name_len) {
+  const struct ndpi_bloom *filter = ndpi_str->custom_categories.filter;
+  const void *image = NULL;
+  size_t len;
+  u_int i;
+
+  if(ndpi_str->ruleset != NULL) {
+    if(((image = ndpi_ruleset_get_section(ndpi_str->ruleset, NDPI_RULESET_CATEGORIES_FILTER, &len)) == NULL)
+       || (len == 0))
+      return(-1);
+  } else if(filter == NULL)
+    return(-1);
+
+  for(i=3; i<name_len; i++) {
+    if(name[i] == '.') {
+      u_int64_t key = ndpi_category_filter_key(&name[i - 3], 4);
+
+      if(image ? ndpi_bloom_image_contains(image, key) : ndpi_bloom_contains(filter, key))
+	return(1);
+
+      if(i >= 7) {
+	key = ndpi_category_filter_key(&name[i - 7], 8);
+
+	if(image ? ndpi_bloom_image_contains(image, key) : ndpi_bloom_contains(filter, key))
+	  return(1);
+      }
+    }
+  }
+
+  return(0);
+}
+
+/* *********************************************** */
+
+int ndpi_get_category_filter_stats(struct ndpi_detection_module_struct *ndpi_str,
+				   struct ndpi_category_filter_stats *stats) {
+  size_t len = 0;
+
+  if(ndpi_str->ruleset != NULL)
+    ndpi_ruleset_get_section(ndpi_str->ruleset, NDPI_RULESET_CATEGORIES_FILTER, &len);
+  else if(ndpi_str->custom_categories.filter != NULL)
+    len = 1;
+
+  if(len == 0)
+    return(-1);
+
+  *stats = ndpi_str->custom_categories.filter_stats;
+  return(0);
+}
+
+/* *********************************************** */
+
+static int ndpi_search_custom_category(struct ndpi_detection_module_struct *ndpi_str,
+				       char *name, u_int name_len, unsigned long *id) {
+#ifdef HAVE_HYPERSCAN
+    if(ndpi_str->custom_categories.hostnames == NULL)
+      return(-1);
+    else {
+      hs_error_t rc;
+
+      *id = (unsigned long)-1;
+
+      rc = hs_scan(ndpi_str->custom_categories.hostnames->database,
+		   name, name_len, 0,
+		   ndpi_str->custom_categories.hostnames->scratch,
+		   hyperscanCustomEventHandler, id);
+
+      if(rc == HS_SCAN_TERMINATED) {
+#ifdef DEBUG
+	printf("[HS] Found category %lu for %s\n", *id, name);
+#endif
+	return(0);
+      } else
+	return(-1);
+    }
+#else
+    return(ndpi_match_string_id(ndpi_str->custom_categories.hostnames.ac_automa, name, name_len, id));
+#endif
+}
+
+/* *********************************************** */
+
+int ndpi_match_custom_category(struct ndpi_detection_module_struct *ndpi_str,
+			       char *name, u_int name_len, unsigned long *id) {
+  u_int32_t category;
+  int filtered, rc;
+
+  if(ndpi_match_domain(ndpi_str, NDPI_RULESET_CATEGORIES_DOMAINS, name, name_len, &category)) {
+    *id = category;
+    return(0);
+  }
+
+  if((filtered = ndpi_category_filter_match(ndpi_str, name, name_len)) == 0) {
+    ndpi_str->custom_categories.filter_stats.num_rejected++;
+    return(-1);
+  }
+
+  rc = ndpi_search_custom_category(ndpi_str, name, name_len, id);
+
+  if(filtered == 1) {
+    if(rc == 0)
+      ndpi_str->custom_categories.filter_stats.num_matched++;
+    else
+      ndpi_str->custom_categories.filter_stats.num_false_positives++;
+  }
+
+  return(rc);
+}
+
+/* *********************************************** */
+
+int ndpi_get_custom_category_match(struct ndpi_detection_module_struct *ndpi_str,
+				   char *name_or_ip, u_int name_len, unsigned long *id) {
+  char ipbuf[64], *ptr;
+  struct in_addr pin;
+  struct ndpi_in6_addr pin6;
+  u_int cp_len = ndpi_min(sizeof(ipbuf)-1, name_len);
+
+  if(!ndpi_str->custom_categories.categories_loaded)
+    return(-1);
+
+  if(cp_len > 0) {
+    memcpy(ipbuf, name_or_ip, cp_len);
+    ipbuf[cp_len] = '\0';
+  } else
+    ipbuf[0] = '\0';
+
+  ptr = strrchr(ipbuf, '/');
+
+  if(ptr)
+    ptr[0] = '\0';
+
+  if(inet_pton(AF_INET, ipbuf, &pin) == 1) {
+    /* Search IP */
+    u_int32_t value;
+
+    if(ndpi_str->ruleset != NULL) {
+      if(!ndpi_ruleset_lpm4_match(ndpi_str->ruleset, NDPI_RULESET_CATEGORIES_LPM4, pin.s_addr, &value))
+	return(-1);
+    } else if(!ndpi_lpm4_match(ndpi_str->custom_categories.ipAddresses, pin.s_addr, &value))
+      return(-1);
+
+    *id = value;
+    return(0);
+  } else if(inet_pton(AF_INET6, ipbuf, &pin6) == 1) {
+    u_int32_t value;
+
+    if(ndpi_str->ruleset != NULL) {
+      if(!ndpi_ruleset_lpm6_match(ndpi_str->ruleset, NDPI_RULESET_CATEGORIES_LPM6, &pin6, &value))
+	return(-1);
+    } else if(!ndpi_lpm6_match(ndpi_str->custom_categories.ipAddresses6, &pin6, &value))
+      return(-1);
+
+    *id = value;
+    return(0);
   } else
     /* Search Host */
     return(ndpi_match_custom_category(ndpi_str, name_or_ip, name_len, id));
@@ -2354,10 +2806,6 @@ int ndpi_get_custom_category_match(struct ndpi_detection_module_struct *ndpi_str
 
 /* *********************************************** */
 
-static void free_ptree_data(void *data) { ; }
-
-/* ****************************************************** */
-
 void ndpi_exit_detection_module(struct ndpi_detection_module_struct *ndpi_str) {
   if(ndpi_str != NULL) {
     int i;
@@ -2369,7 +2817,7 @@ void ndpi_exit_detection_module(struct ndpi_detection_module_struct *ndpi_str) {
 
     /* NDPI_PROTOCOL_TINC */
     if(ndpi_str->tinc_cache)
-      cache_free((cache_t)(ndpi_str->tinc_cache));
+      ndpi_lru_free_cache(ndpi_str->tinc_cache);
 
     if(ndpi_str->ookla_cache)
       ndpi_lru_free_cache(ndpi_str->ookla_cache);
@@ -2377,13 +2825,25 @@ void ndpi_exit_detection_module(struct ndpi_detection_module_struct *ndpi_str) {
     if(ndpi_str->stun_cache)
       ndpi_lru_free_cache(ndpi_str->stun_cache);
 
-    if(ndpi_str->protocols_ptree)
-      ndpi_Destroy_Patricia((patricia_tree_t*)ndpi_str->protocols_ptree, free_ptree_data);
+    if(ndpi_str->dns_cache)
+      ndpi_lru_free_cache(ndpi_str->dns_cache);
+
+    if(ndpi_str->verdict_cache)
+      ndpi_lru_free_cache(ndpi_str->verdict_cache);
+
+    if(ndpi_str->dissector_stats)
+      ndpi_free(ndpi_str->dissector_stats);
+
+    if(ndpi_str->classification_stats)
+      ndpi_free(ndpi_str->classification_stats);
 
-    if(ndpi_str->udpRoot != NULL)
-      ndpi_tdestroy(ndpi_str->udpRoot, ndpi_free);
-    if(ndpi_str->tcpRoot != NULL)
-      ndpi_tdestroy(ndpi_str->tcpRoot, ndpi_free);
+    ndpi_lpm4_free(ndpi_str->protocols_lpm4);
+    ndpi_lpm6_free(ndpi_str->protocols_lpm6);
+
+    if(ndpi_str->tcp_default_ports != NULL)
+      ndpi_free(ndpi_str->tcp_default_ports);
+    if(ndpi_str->udp_default_ports != NULL)
+      ndpi_free(ndpi_str->udp_default_ports);
 
     if(ndpi_str->host_automa.ac_automa != NULL)
       ac_automata_release((AC_AUTOMATA_t*)ndpi_str->host_automa.ac_automa, 1 /* free patterns strings memory */);
@@ -2417,11 +2877,21 @@ void ndpi_exit_detection_module(struct ndpi_detection_module_struct *ndpi_str) {
       ac_automata_release((AC_AUTOMATA_t*)ndpi_str->custom_categories.hostnames_shadow.ac_automa, 1 /* free patterns strings memory */);
 #endif
 
-    if(ndpi_str->custom_categories.ipAddresses != NULL)
-      ndpi_Destroy_Patricia((patricia_tree_t*)ndpi_str->custom_categories.ipAddresses, free_ptree_data);
+    ndpi_lpm4_free(ndpi_str->custom_categories.ipAddresses);
+    ndpi_lpm4_free(ndpi_str->custom_categories.ipAddresses_shadow);
+    ndpi_lpm6_free(ndpi_str->custom_categories.ipAddresses6);
+    ndpi_lpm6_free(ndpi_str->custom_categories.ipAddresses6_shadow);
+
+    ndpi_domain_trie_free(ndpi_str->custom_categories.domains);
+    ndpi_domain_trie_free(ndpi_str->custom_categories.domains_shadow);
+    ndpi_domain_trie_free(ndpi_str->host_domains);
 
-    if(ndpi_str->custom_categories.ipAddresses_shadow != NULL)
-      ndpi_Destroy_Patricia((patricia_tree_t*)ndpi_str->custom_categories.ipAddresses_shadow, free_ptree_data);
+    ndpi_bloom_free(ndpi_str->custom_categories.filter);
+    if(ndpi_str->custom_categories.filter_keys)
+      ndpi_free(ndpi_str->custom_categories.filter_keys);
+
+    /* After the automata using its images */
+    ndpi_release_ruleset(ndpi_str->ruleset);
 
     ndpi_free(ndpi_str);
   }
@@ -2447,31 +2917,21 @@ int ndpi_get_protocol_id_master_proto(struct ndpi_detection_module_struct *ndpi_
 
 /* ****************************************************** */
 
-static ndpi_default_ports_tree_node_t* ndpi_get_guessed_protocol_id(struct ndpi_detection_module_struct *ndpi_str,
-								    u_int8_t proto, u_int16_t sport, u_int16_t dport) {
-  ndpi_default_ports_tree_node_t node;
+/* Returns the default ports table entry of the flow, 0 if none */
+static u_int16_t ndpi_get_guessed_protocol_id(struct ndpi_detection_module_struct *ndpi_str,
+					      u_int8_t proto, u_int16_t sport, u_int16_t dport) {
+  const u_int16_t *ports = (proto == IPPROTO_TCP) ? ndpi_str->tcp_default_ports : ndpi_str->udp_default_ports;
+  u_int16_t found;
 
   if(sport && dport) {
-    int low  = ndpi_min(sport, dport);
-    int high = ndpi_max(sport, dport);
-    const void *ret;
-
-    node.default_port = low; /* Check server port first */
-    ret = ndpi_tfind(&node,
-		     (proto == IPPROTO_TCP) ? (void*)&ndpi_str->tcpRoot : (void*)&ndpi_str->udpRoot,
-		     ndpi_default_ports_tree_node_t_cmp);
-
-    if(ret == NULL) {
-      node.default_port = high;
-      ret = ndpi_tfind(&node,
-		       (proto == IPPROTO_TCP) ? (void*)&ndpi_str->tcpRoot : (void*)&ndpi_str->udpRoot,
-		       ndpi_default_ports_tree_node_t_cmp);
-    }
+    /* Check server port first */
+    if((found = ports[ndpi_min(sport, dport)]) == 0)
+      found = ports[ndpi_max(sport, dport)];
 
-    if(ret) return(*(ndpi_default_ports_tree_node_t**)ret);
+    return(found);
   }
 
-  return(NULL);
+  return(0);
 }
 
 /* ****************************************************** */
@@ -2502,10 +2962,10 @@ u_int16_t ndpi_guess_protocol_id(struct ndpi_detection_module_struct *ndpi_str,
   *user_defined_proto = 0; /* Default */
 
   if(sport && dport) {
-    ndpi_default_ports_tree_node_t *found = ndpi_get_guessed_protocol_id(ndpi_str, proto, sport, dport);
+    u_int16_t found = ndpi_get_guessed_protocol_id(ndpi_str, proto, sport, dport);
 
-    if(found != NULL) {
-      u_int16_t guessed_proto = found->proto->protoId;
+    if(found != 0) {
+      u_int16_t guessed_proto = found & NDPI_DEFAULT_PORT_ID_MASK;
 
       /* We need to check if the guessed protocol isn't excluded by nDPI */
       if(flow
@@ -2515,7 +2975,7 @@ u_int16_t ndpi_guess_protocol_id(struct ndpi_detection_module_struct *ndpi_str,
 	 )
 	return(NDPI_PROTOCOL_UNKNOWN);
       else {
-	*user_defined_proto = found->customUserProto;
+	*user_defined_proto = (found & NDPI_DEFAULT_PORT_CUSTOM) ? 1 : 0;
 	return(guessed_proto);
       }
     }
@@ -2568,6 +3028,29 @@ u_int ndpi_get_num_supported_protocols(struct ndpi_detection_module_struct *ndpi
 
 /* ******************************************************************** */
 
+u_int64_t ndpi_get_num_dissector_calls(struct ndpi_detection_module_struct *ndpi_str) {
+  return(ndpi_str->num_dissector_calls);
+}
+
+/* ******************************************************************** */
+
+int ndpi_get_dissector_stats(struct ndpi_detection_module_struct *ndpi_str,
+			     struct ndpi_dissector_stats *stats, u_int32_t max_num_stats) {
+  u_int32_t i;
+
+  if(ndpi_str->dissector_stats == NULL)
+    return(-1);
+
+  for(i = 0; (i < ndpi_str->callback_buffer_size) && (i < max_num_stats); i++) {
+    stats[i] = ndpi_str->dissector_stats[i];
+    stats[i].protocol_id = ndpi_str->callback_buffer[i].ndpi_protocol_id;
+  }
+
+  return(i);
+}
+
+/* ******************************************************************** */
+
 #ifdef WIN32
 char * strsep(char **sp, char *sep)
 {
@@ -2676,9 +3159,9 @@ int ndpi_handle_rule(struct ndpi_detection_module_struct *ndpi_str,
 
       if(do_add)
 	addDefaultPort(ndpi_str, &range, def, 1 /* Custom user proto */,
-		       is_tcp ? &ndpi_str->tcpRoot : &ndpi_str->udpRoot, __FUNCTION__,__LINE__);
+		       is_tcp ? ndpi_str->tcp_default_ports : ndpi_str->udp_default_ports, __FUNCTION__,__LINE__);
       else
-	removeDefaultPort(&range, def, is_tcp ? &ndpi_str->tcpRoot : &ndpi_str->udpRoot);
+	removeDefaultPort(&range, def, is_tcp ? ndpi_str->tcp_default_ports : ndpi_str->udp_default_ports);
     } else if(is_ip) {
       /* NDPI_PROTOCOL_TOR */
       ndpi_add_host_ip_subprotocol(ndpi_str, value, subprotocol_id);
@@ -2871,6 +3354,9 @@ void ndpi_set_bitmask_protocol_detection(char * label,
       Set ndpi_selection_bitmask for protocol
     */
     ndpi_str->callback_buffer[idx].ndpi_selection_bitmask = ndpi_selection_bitmask;
+    ndpi_str->callback_buffer[idx].ndpi_protocol_id = ndpi_protocol_id;
+    ndpi_str->callback_buffer[idx].has_payload_prefix = 0;
+    ndpi_str->callback_buffer[idx].prefix_on_first_packet = 0;
 
     /*
       Reset protocol detection bitmask via NDPI_PROTOCOL_UNKNOWN and than add specify protocol bitmast to callback
@@ -2885,6 +3371,192 @@ void ndpi_set_bitmask_protocol_detection(char * label,
 
 /* ******************************************************************** */
 
+void ndpi_set_bitmask_protocol_prefix(struct ndpi_detection_module_struct *ndpi_str,
+				      const u_int32_t idx,
+				      const u_int8_t *first_payload_bytes,
+				      u_int16_t num_first_payload_bytes,
+				      u_int8_t b_exclude_on_prefix_mismatch) {
+  struct ndpi_call_function_struct *cb = &ndpi_str->callback_buffer[idx];
+  u_int16_t i;
+
+  if((idx > NDPI_MAX_SUPPORTED_PROTOCOLS) || (num_first_payload_bytes == 0))
+    return;
+
+  memset(cb->first_payload_bytes, 0, sizeof(cb->first_payload_bytes));
+
+  for(i = 0; i < num_first_payload_bytes; i++)
+    NDPI_CALLBACK_SET(cb->first_payload_bytes, first_payload_bytes[i]);
+
+  cb->has_payload_prefix = 1, cb->exclude_on_prefix_mismatch = b_exclude_on_prefix_mismatch ? 1 : 0;
+  cb->prefix_on_first_packet = (b_exclude_on_prefix_mismatch == EXCLUDE_ON_FIRST_PACKET_PREFIX_MISMATCH) ? 1 : 0;
+}
+
+/* ******************************************************************** */
+
+static u_int8_t ndpi_selection_dispatch_idx(NDPI_SELECTION_BITMASK_PROTOCOL_SIZE ndpi_selection_packet) {
+  return(((ndpi_selection_packet & NDPI_SELECTION_BITMASK_PROTOCOL_IPV6) ? 4 : 0)
+	 | ((ndpi_selection_packet & NDPI_SELECTION_BITMASK_PROTOCOL_HAS_PAYLOAD) ? 2 : 0)
+	 | ((ndpi_selection_packet & NDPI_SELECTION_BITMASK_PROTOCOL_NO_TCP_RETRANSMISSION) ? 1 : 0));
+}
+
+/* ******************************************************************** */
+
+/*
+  Build, for every packet selection bitmask that ndpi_detection_process_packet()
+  can produce for the given transport, the set of callbacks whose selection
+  bitmask is satisfied, so that the dispatch loop does not need to check it.
+
+  dispatch[NDPI_SELECTION_DISPATCH_SIZE] must already contain all the
+  callbacks of the transport.
+*/
+static void ndpi_build_dispatch_lists(struct ndpi_detection_module_struct *ndpi_str,
+				      struct ndpi_call_function_dispatch *dispatch,
+				      NDPI_SELECTION_BITMASK_PROTOCOL_SIZE l4_selection) {
+  u_int32_t i, a;
+
+  for(i = 0; i < NDPI_SELECTION_DISPATCH_SIZE; i++) {
+    NDPI_SELECTION_BITMASK_PROTOCOL_SIZE ndpi_selection_packet =
+      NDPI_SELECTION_BITMASK_PROTOCOL_COMPLETE_TRAFFIC | NDPI_SELECTION_BITMASK_PROTOCOL_IPV4_OR_IPV6 | l4_selection;
+
+    ndpi_selection_packet |= (i & 4) ? NDPI_SELECTION_BITMASK_PROTOCOL_IPV6 : NDPI_SELECTION_BITMASK_PROTOCOL_IP;
+    if(i & 2) ndpi_selection_packet |= NDPI_SELECTION_BITMASK_PROTOCOL_HAS_PAYLOAD;
+    if(i & 1) ndpi_selection_packet |= NDPI_SELECTION_BITMASK_PROTOCOL_NO_TCP_RETRANSMISSION;
+
+    dispatch[i].ndpi_selection_packet = ndpi_selection_packet;
+    memset(dispatch[i].callbacks, 0, sizeof(dispatch[i].callbacks));
+
+    for(a = 0; a < ndpi_str->callback_buffer_size; a++) {
+      NDPI_SELECTION_BITMASK_PROTOCOL_SIZE bm = ndpi_str->callback_buffer[a].ndpi_selection_bitmask;
+
+      if(NDPI_CALLBACK_ISSET(dispatch[NDPI_SELECTION_DISPATCH_SIZE].callbacks, a)
+	 && ((bm & ndpi_selection_packet) == bm))
+	NDPI_CALLBACK_SET(dispatch[i].callbacks, a);
+    }
+  }
+}
+
+/* ******************************************************************** */
+
+#ifdef NDPI_ENABLE_DISSECTOR_PROFILING
+static inline u_int64_t ndpi_dissector_ticks(void) {
+#if defined(__x86_64__) || defined(__i386__)
+  return(__rdtsc());
+#else
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return((u_int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec);
+#endif
+}
+#endif
+
+/*
+  Invoke the dissector of callback_buffer[idx]: with profiling compiled in,
+  its calls, cycles, detections and exclusions are counted too
+*/
+static inline void ndpi_call_dissector(struct ndpi_detection_module_struct *ndpi_str,
+				       struct ndpi_flow_struct *flow, u_int32_t idx,
+				       void (*func)(struct ndpi_detection_module_struct *,
+						    struct ndpi_flow_struct *)) {
+#ifdef NDPI_ENABLE_DISSECTOR_PROFILING
+  struct ndpi_dissector_stats *stats = &ndpi_str->dissector_stats[idx];
+  u_int16_t protocol_id = ndpi_str->callback_buffer[idx].ndpi_protocol_id;
+  u_int8_t was_detected = (flow->detected_protocol_stack[0] != NDPI_PROTOCOL_UNKNOWN);
+  u_int8_t was_excluded = (NDPI_COMPARE_PROTOCOL_TO_BITMASK(flow->excluded_protocol_bitmask, protocol_id) != 0);
+  u_int64_t begin = ndpi_dissector_ticks();
+#endif
+
+  ndpi_str->num_dissector_calls++;
+  func(ndpi_str, flow);
+
+#ifdef NDPI_ENABLE_DISSECTOR_PROFILING
+  stats->num_cycles += ndpi_dissector_ticks() - begin;
+  stats->num_calls++;
+
+  if((!was_detected) && (flow->detected_protocol_stack[0] != NDPI_PROTOCOL_UNKNOWN))
+    stats->num_detections++;
+
+  if((!was_excluded) && (NDPI_COMPARE_PROTOCOL_TO_BITMASK(flow->excluded_protocol_bitmask, protocol_id) != 0))
+    stats->num_exclusions++;
+#endif
+}
+
+/* ********************************************************************************* */
+
+/*
+  Call the dissectors of the dispatch set matching this packet that the flow
+  has not excluded yet, in callback_buffer order, until one of them detects
+  the protocol.
+
+  Dissectors found excluded are also removed from the flow candidate set
+  (flow->excluded_callbacks) so that the following packets do not even
+  look at them.
+*/
+static void ndpi_dispatch_callbacks(struct ndpi_detection_module_struct *ndpi_str,
+				    struct ndpi_flow_struct *flow,
+				    struct ndpi_call_function_dispatch *dispatch,
+				    NDPI_SELECTION_BITMASK_PROTOCOL_SIZE ndpi_selection_packet,
+				    void *func) {
+  struct ndpi_call_function_dispatch *d = &dispatch[ndpi_selection_dispatch_idx(ndpi_selection_packet)];
+  u_int16_t detected_protocol = ndpi_str->packet.detected_protocol_stack[0];
+  u_int64_t *prefix_callbacks = NULL;
+  u_int8_t check_selection = 0, first_byte = 0;
+  u_int32_t w;
+
+  if((ndpi_str->packet.payload_packet_len > 0) && (!ndpi_str->disable_dissector_prefix_filter)) {
+    first_byte = ndpi_str->packet.payload[0];
+    prefix_callbacks = ndpi_str->prefix_callbacks[first_byte];
+  }
+
+  if(d->ndpi_selection_packet != ndpi_selection_packet) {
+    /* Selection not built by ndpi_detection_process_packet(): check all the transport callbacks */
+    d = &dispatch[NDPI_SELECTION_DISPATCH_SIZE], check_selection = 1;
+  }
+
+  for(w = 0; w < NDPI_CALLBACK_BITMAP_WORDS; w++) {
+    u_int64_t candidates = d->callbacks[w] & ~flow->excluded_callbacks[w];
+
+    if(prefix_callbacks)
+      candidates &= prefix_callbacks[w];
+
+    while(candidates != 0) {
+      u_int32_t a = (w * 64) + __builtin_ctzll(candidates);
+      struct ndpi_call_function_struct *cb = &ndpi_str->callback_buffer[a];
+
+      candidates &= candidates - 1;
+
+      if(NDPI_COMPARE_PROTOCOL_TO_BITMASK(flow->excluded_protocol_bitmask, cb->ndpi_protocol_id) != 0) {
+	NDPI_CALLBACK_SET(flow->excluded_callbacks, a);
+	continue;
+      }
+
+      if((func == cb->func)
+	 || (check_selection && ((cb->ndpi_selection_bitmask & ndpi_selection_packet) != cb->ndpi_selection_bitmask))
+	 || (NDPI_COMPARE_PROTOCOL_TO_BITMASK(cb->detection_bitmask, detected_protocol) == 0))
+	continue;
+
+      if(prefix_callbacks && cb->has_payload_prefix
+	 && ((!cb->prefix_on_first_packet) || (flow->packet_counter == 1))
+	 && (!NDPI_CALLBACK_ISSET(cb->first_payload_bytes, first_byte))) {
+	/* Same outcome as calling the dissector, that would exclude itself */
+	ndpi_exclude_protocol(ndpi_str, flow, cb->ndpi_protocol_id, __FILE__, __FUNCTION__, __LINE__);
+	NDPI_CALLBACK_SET(flow->excluded_callbacks, a);
+	continue;
+      }
+
+      ndpi_call_dissector(ndpi_str, flow, a, cb->func);
+
+      if(NDPI_COMPARE_PROTOCOL_TO_BITMASK(flow->excluded_protocol_bitmask, cb->ndpi_protocol_id) != 0)
+	NDPI_CALLBACK_SET(flow->excluded_callbacks, a);
+
+      if(flow->detected_protocol_stack[0] != NDPI_PROTOCOL_UNKNOWN)
+	return; /* Stop after detecting the first protocol */
+    }
+  }
+}
+
+/* ******************************************************************** */
+
 void ndpi_set_protocol_detection_bitmask2(struct ndpi_detection_module_struct *ndpi_str,
 					  const NDPI_PROTOCOL_BITMASK * dbm) {
   NDPI_PROTOCOL_BITMASK detection_bitmask_local;
@@ -3377,63 +4049,76 @@ void ndpi_set_protocol_detection_bitmask2(struct ndpi_detection_module_struct *n
   NDPI_LOG_DBG2(ndpi_str,
 		"callback_buffer_size is %u\n", ndpi_str->callback_buffer_size);
 
-  /* now build the specific buffer for tcp, udp and non_tcp_udp */
-  ndpi_str->callback_buffer_size_tcp_payload = 0;
-  ndpi_str->callback_buffer_size_tcp_no_payload = 0;
+  /* now build the dispatch sets of tcp, udp and non_tcp_udp */
+  memset(ndpi_str->dispatch_tcp_payload, 0, sizeof(ndpi_str->dispatch_tcp_payload));
+  memset(ndpi_str->dispatch_tcp_no_payload, 0, sizeof(ndpi_str->dispatch_tcp_no_payload));
+  memset(ndpi_str->dispatch_udp, 0, sizeof(ndpi_str->dispatch_udp));
+  memset(ndpi_str->dispatch_non_tcp_udp, 0, sizeof(ndpi_str->dispatch_non_tcp_udp));
+
   for(a = 0; a < ndpi_str->callback_buffer_size; a++) {
+    if(ndpi_str->callback_buffer[a].func == NULL)
+      continue;
+
     if((ndpi_str->callback_buffer[a].ndpi_selection_bitmask
 	& (NDPI_SELECTION_BITMASK_PROTOCOL_INT_TCP |
 	   NDPI_SELECTION_BITMASK_PROTOCOL_INT_TCP_OR_UDP |
 	   NDPI_SELECTION_BITMASK_PROTOCOL_COMPLETE_TRAFFIC)) != 0) {
-      if(_ndpi_debug_callbacks) NDPI_LOG_DBG2(ndpi_str,
-					      "callback_buffer_tcp_payload, adding buffer %u as entry %u\n", a,
-					      ndpi_str->callback_buffer_size_tcp_payload);
+      if(_ndpi_debug_callbacks) NDPI_LOG_DBG2(ndpi_str, "dispatch_tcp_payload: adding buffer %u\n", a);
 
-      memcpy(&ndpi_str->callback_buffer_tcp_payload[ndpi_str->callback_buffer_size_tcp_payload],
-	     &ndpi_str->callback_buffer[a], sizeof(struct ndpi_call_function_struct));
-      ndpi_str->callback_buffer_size_tcp_payload++;
+      NDPI_CALLBACK_SET(ndpi_str->dispatch_tcp_payload[NDPI_SELECTION_DISPATCH_SIZE].callbacks, a);
 
       if((ndpi_str->
 	  callback_buffer[a].ndpi_selection_bitmask & NDPI_SELECTION_BITMASK_PROTOCOL_HAS_PAYLOAD) == 0) {
-	if(_ndpi_debug_callbacks) NDPI_LOG_DBG2(ndpi_str,
-						"\tcallback_buffer_tcp_no_payload, additional adding buffer %u to no_payload process\n", a);
+	if(_ndpi_debug_callbacks) NDPI_LOG_DBG2(ndpi_str, "\tdispatch_tcp_no_payload: adding buffer %u\n", a);
 
-	memcpy(&ndpi_str->callback_buffer_tcp_no_payload
-	       [ndpi_str->callback_buffer_size_tcp_no_payload], &ndpi_str->callback_buffer[a],
-	       sizeof(struct ndpi_call_function_struct));
-	ndpi_str->callback_buffer_size_tcp_no_payload++;
+	NDPI_CALLBACK_SET(ndpi_str->dispatch_tcp_no_payload[NDPI_SELECTION_DISPATCH_SIZE].callbacks, a);
       }
     }
-  }
 
-  ndpi_str->callback_buffer_size_udp = 0;
-  for(a = 0; a < ndpi_str->callback_buffer_size; a++) {
     if((ndpi_str->callback_buffer[a].ndpi_selection_bitmask & (NDPI_SELECTION_BITMASK_PROTOCOL_INT_UDP |
 								  NDPI_SELECTION_BITMASK_PROTOCOL_INT_TCP_OR_UDP |
 								  NDPI_SELECTION_BITMASK_PROTOCOL_COMPLETE_TRAFFIC))
        != 0) {
-      if(_ndpi_debug_callbacks) NDPI_LOG_DBG2(ndpi_str,
-					      "callback_buffer_size_udp: adding buffer : %u as entry %u\n", a, ndpi_str->callback_buffer_size_udp);
+      if(_ndpi_debug_callbacks) NDPI_LOG_DBG2(ndpi_str, "dispatch_udp: adding buffer %u\n", a);
 
-      memcpy(&ndpi_str->callback_buffer_udp[ndpi_str->callback_buffer_size_udp],
-	     &ndpi_str->callback_buffer[a], sizeof(struct ndpi_call_function_struct));
-      ndpi_str->callback_buffer_size_udp++;
+      NDPI_CALLBACK_SET(ndpi_str->dispatch_udp[NDPI_SELECTION_DISPATCH_SIZE].callbacks, a);
     }
-  }
 
-  ndpi_str->callback_buffer_size_non_tcp_udp = 0;
-  for(a = 0; a < ndpi_str->callback_buffer_size; a++) {
     if((ndpi_str->callback_buffer[a].ndpi_selection_bitmask & (NDPI_SELECTION_BITMASK_PROTOCOL_INT_TCP |
 								  NDPI_SELECTION_BITMASK_PROTOCOL_INT_UDP |
 								  NDPI_SELECTION_BITMASK_PROTOCOL_INT_TCP_OR_UDP)) == 0
        || (ndpi_str->
 	   callback_buffer[a].ndpi_selection_bitmask & NDPI_SELECTION_BITMASK_PROTOCOL_COMPLETE_TRAFFIC) != 0) {
-      if(_ndpi_debug_callbacks) NDPI_LOG_DBG2(ndpi_str,
-					      "callback_buffer_non_tcp_udp: adding buffer : %u as entry %u\n", a, ndpi_str->callback_buffer_size_non_tcp_udp);
+      if(_ndpi_debug_callbacks) NDPI_LOG_DBG2(ndpi_str, "dispatch_non_tcp_udp: adding buffer %u\n", a);
 
-      memcpy(&ndpi_str->callback_buffer_non_tcp_udp[ndpi_str->callback_buffer_size_non_tcp_udp],
-	     &ndpi_str->callback_buffer[a], sizeof(struct ndpi_call_function_struct));
-      ndpi_str->callback_buffer_size_non_tcp_udp++;
+      NDPI_CALLBACK_SET(ndpi_str->dispatch_non_tcp_udp[NDPI_SELECTION_DISPATCH_SIZE].callbacks, a);
+    }
+  }
+
+  ndpi_build_dispatch_lists(ndpi_str, ndpi_str->dispatch_tcp_payload,
+			    NDPI_SELECTION_BITMASK_PROTOCOL_INT_TCP | NDPI_SELECTION_BITMASK_PROTOCOL_INT_TCP_OR_UDP);
+  ndpi_build_dispatch_lists(ndpi_str, ndpi_str->dispatch_tcp_no_payload,
+			    NDPI_SELECTION_BITMASK_PROTOCOL_INT_TCP | NDPI_SELECTION_BITMASK_PROTOCOL_INT_TCP_OR_UDP);
+  ndpi_build_dispatch_lists(ndpi_str, ndpi_str->dispatch_udp,
+			    NDPI_SELECTION_BITMASK_PROTOCOL_INT_UDP | NDPI_SELECTION_BITMASK_PROTOCOL_INT_TCP_OR_UDP);
+  ndpi_build_dispatch_lists(ndpi_str, ndpi_str->dispatch_non_tcp_udp, 0);
+
+  /*
+    For every value of the first payload byte, the callbacks that can be invoked:
+    those without a prefix, those accepting the byte, and those that exclude
+    themselves on mismatch (the exclusion is done by the dispatch loop)
+  */
+  for(a = 0; a < 256; a++) {
+    u_int32_t i;
+
+    memset(ndpi_str->prefix_callbacks[a], 0, sizeof(ndpi_str->prefix_callbacks[a]));
+
+    for(i = 0; i < ndpi_str->callback_buffer_size; i++) {
+      struct ndpi_call_function_struct *cb = &ndpi_str->callback_buffer[i];
+
+      if((!cb->has_payload_prefix) || cb->exclude_on_prefix_mismatch
+	 || NDPI_CALLBACK_ISSET(cb->first_payload_bytes, a))
+	NDPI_CALLBACK_SET(ndpi_str->prefix_callbacks[a], i);
     }
   }
 }
@@ -3606,25 +4291,25 @@ static int ndpi_init_packet_header(struct ndpi_detection_module_struct *ndpi_str
     return(1);
 
   /* reset payload_packet_len, will be set if ipv4 tcp or udp */
-  flow->packet.payload_packet_len = 0;
-  flow->packet.l4_packet_len = 0;
-  flow->packet.l3_packet_len = packetlen;
+  ndpi_str->packet.payload_packet_len = 0;
+  ndpi_str->packet.l4_packet_len = 0;
+  ndpi_str->packet.l3_packet_len = packetlen;
 
-  flow->packet.tcp = NULL, flow->packet.udp = NULL;
-  flow->packet.generic_l4_ptr = NULL;
+  ndpi_str->packet.tcp = NULL, ndpi_str->packet.udp = NULL;
+  ndpi_str->packet.generic_l4_ptr = NULL;
 #ifdef NDPI_DETECTION_SUPPORT_IPV6
-  flow->packet.iphv6 = NULL;
+  ndpi_str->packet.iphv6 = NULL;
 #endif							/* NDPI_DETECTION_SUPPORT_IPV6 */
 
-  ndpi_apply_flow_protocol_to_packet(flow, &flow->packet);
+  ndpi_apply_flow_protocol_to_packet(flow, &ndpi_str->packet);
 
-  l3len = flow->packet.l3_packet_len;
+  l3len = ndpi_str->packet.l3_packet_len;
 
 #ifdef NDPI_DETECTION_SUPPORT_IPV6
-  if(flow->packet.iph != NULL) {
+  if(ndpi_str->packet.iph != NULL) {
 #endif							/* NDPI_DETECTION_SUPPORT_IPV6 */
 
-    decaps_iph = flow->packet.iph;
+    decaps_iph = ndpi_str->packet.iph;
 
 #ifdef NDPI_DETECTION_SUPPORT_IPV6
   }
@@ -3637,12 +4322,12 @@ static int ndpi_init_packet_header(struct ndpi_detection_module_struct *ndpi_str
   else if(decaps_iph && decaps_iph->version == 6 && l3len >= sizeof(struct ndpi_ipv6hdr) &&
 	  (ndpi_str->ip_version_limit & NDPI_DETECTION_ONLY_IPV4) == 0) {
     NDPI_LOG_DBG2(ndpi_str, "ipv6 header\n");
-    flow->packet.iphv6 = (struct ndpi_ipv6hdr *)flow->packet.iph;
-    flow->packet.iph = NULL;
+    ndpi_str->packet.iphv6 = (struct ndpi_ipv6hdr *)ndpi_str->packet.iph;
+    ndpi_str->packet.iph = NULL;
   }
 #endif
   else {
-    flow->packet.iph = NULL;
+    ndpi_str->packet.iph = NULL;
     return(1);
   }
 
@@ -3663,37 +4348,37 @@ static int ndpi_init_packet_header(struct ndpi_detection_module_struct *ndpi_str
     return(1);
   }
 
-  flow->packet.l4_protocol = l4protocol;
-  flow->packet.l4_packet_len = l4len;
+  ndpi_str->packet.l4_protocol = l4protocol;
+  ndpi_str->packet.l4_packet_len = l4len;
   flow->l4_proto = l4protocol;
 
   /* tcp / udp detection */
-  if(l4protocol == IPPROTO_TCP && flow->packet.l4_packet_len >= 20 /* min size of tcp */ ) {
+  if(l4protocol == IPPROTO_TCP && ndpi_str->packet.l4_packet_len >= 20 /* min size of tcp */ ) {
     /* tcp */
-    flow->packet.tcp = (struct ndpi_tcphdr *) l4ptr;
-    if(flow->packet.l4_packet_len >=flow->packet.tcp->doff * 4) {
-      flow->packet.payload_packet_len =
-	flow->packet.l4_packet_len -flow->packet.tcp->doff * 4;
-      flow->packet.actual_payload_len = flow->packet.payload_packet_len;
-      flow->packet.payload = ((u_int8_t *)flow->packet.tcp) + (flow->packet.tcp->doff * 4);
+    ndpi_str->packet.tcp = (struct ndpi_tcphdr *) l4ptr;
+    if(ndpi_str->packet.l4_packet_len >=ndpi_str->packet.tcp->doff * 4) {
+      ndpi_str->packet.payload_packet_len =
+	ndpi_str->packet.l4_packet_len -ndpi_str->packet.tcp->doff * 4;
+      ndpi_str->packet.actual_payload_len = ndpi_str->packet.payload_packet_len;
+      ndpi_str->packet.payload = ((u_int8_t *)ndpi_str->packet.tcp) + (ndpi_str->packet.tcp->doff * 4);
 
       /* check for new tcp syn packets, here
        * idea: reset detection state if a connection is unknown
        */
-      if(flow->packet.tcp->syn != 0
-	 && flow->packet.tcp->ack == 0
+      if(ndpi_str->packet.tcp->syn != 0
+	 && ndpi_str->packet.tcp->ack == 0
 	 && flow->init_finished != 0
 	 && flow->detected_protocol_stack[0] == NDPI_PROTOCOL_UNKNOWN) {
 	u_int8_t backup;
 	u_int16_t backup1, backup2;
 
-	if(flow->http.url)          ndpi_free(flow->http.url);
-	if(flow->http.content_type) ndpi_free(flow->http.content_type);
+	ndpi_free_flow_data(flow); /* Everything the flow points to, as it is zeroed below */
 
 	backup  = flow->num_processed_pkts;
 	backup1 = flow->guessed_protocol_id;
 	backup2 = flow->guessed_host_protocol_id;
 	memset(flow, 0, sizeof(*(flow)));
+	memset(&ndpi_str->packet, 0, sizeof(ndpi_str->packet));
 	flow->num_processed_pkts = backup;
 	flow->guessed_protocol_id      = backup1;
 	flow->guessed_host_protocol_id = backup2;
@@ -3703,14 +4388,14 @@ static int ndpi_init_packet_header(struct ndpi_detection_module_struct *ndpi_str
       }
     } else {
       /* tcp header not complete */
-      flow->packet.tcp = NULL;
+      ndpi_str->packet.tcp = NULL;
     }
-  } else if(l4protocol == IPPROTO_UDP && flow->packet.l4_packet_len >= 8 /* size of udp */ ) {
-    flow->packet.udp = (struct ndpi_udphdr *) l4ptr;
-    flow->packet.payload_packet_len =flow->packet.l4_packet_len - 8;
-    flow->packet.payload = ((u_int8_t *)flow->packet.udp) + 8;
+  } else if(l4protocol == IPPROTO_UDP && ndpi_str->packet.l4_packet_len >= 8 /* size of udp */ ) {
+    ndpi_str->packet.udp = (struct ndpi_udphdr *) l4ptr;
+    ndpi_str->packet.payload_packet_len =ndpi_str->packet.l4_packet_len - 8;
+    ndpi_str->packet.payload = ((u_int8_t *)ndpi_str->packet.udp) + 8;
   } else {
-    flow->packet.generic_l4_ptr = l4ptr;
+    ndpi_str->packet.generic_l4_ptr = l4ptr;
   }
 
   return(0);
@@ -3722,13 +4407,13 @@ void ndpi_connection_tracking(struct ndpi_detection_module_struct *ndpi_str,
     return;
   } else {
     /* const for gcc code optimization and cleaner code */
-    struct ndpi_packet_struct *packet = &flow->packet;
+    struct ndpi_packet_struct *packet = &ndpi_str->packet;
     const struct ndpi_iphdr *iph = packet->iph;
 #ifdef NDPI_DETECTION_SUPPORT_IPV6
     const struct ndpi_ipv6hdr *iphv6 = packet->iphv6;
 #endif
     const struct ndpi_tcphdr *tcph = packet->tcp;
-    const struct ndpi_udphdr *udph = flow->packet.udp;
+    const struct ndpi_udphdr *udph = ndpi_str->packet.udp;
 
     packet->tcp_retransmission = 0, packet->packet_direction = 0;
 
@@ -3782,10 +4467,10 @@ void ndpi_connection_tracking(struct ndpi_detection_module_struct *ndpi_str,
 	 * otherwise use the payload length.
 	 */
 	if(tcph->ack != 0) {
-	  flow->next_tcp_seq_nr[flow->packet.packet_direction] =
+	  flow->next_tcp_seq_nr[ndpi_str->packet.packet_direction] =
 	    ntohl(tcph->seq) + (tcph->syn ? 1 : packet->payload_packet_len);
 
-	  flow->next_tcp_seq_nr[1 -flow->packet.packet_direction] = ntohl(tcph->ack_seq);
+	  flow->next_tcp_seq_nr[1 -ndpi_str->packet.packet_direction] = ntohl(tcph->ack_seq);
 	}
       } else if(packet->payload_packet_len > 0) {
 	/* check tcp sequence counters */
@@ -3847,12 +4532,11 @@ void check_ndpi_other_flow_func(struct ndpi_detection_module_struct *ndpi_str,
   }
 
   void *func = NULL;
-  u_int32_t a;
   u_int16_t proto_index = ndpi_str->proto_defaults[flow->guessed_protocol_id].protoIdx;
   int16_t proto_id = ndpi_str->proto_defaults[flow->guessed_protocol_id].protoId;
   NDPI_PROTOCOL_BITMASK detection_bitmask;
 
-  NDPI_SAVE_AS_BITMASK(detection_bitmask, flow->packet.detected_protocol_stack[0]);
+  NDPI_SAVE_AS_BITMASK(detection_bitmask, ndpi_str->packet.detected_protocol_stack[0]);
 
   if((proto_id != NDPI_PROTOCOL_UNKNOWN)
      && NDPI_BITMASK_COMPARE(flow->excluded_protocol_bitmask,
@@ -3863,27 +4547,11 @@ void check_ndpi_other_flow_func(struct ndpi_detection_module_struct *ndpi_str,
 	 & *ndpi_selection_packet) == ndpi_str->callback_buffer[proto_index].ndpi_selection_bitmask) {
     if((flow->guessed_protocol_id != NDPI_PROTOCOL_UNKNOWN)
        && (ndpi_str->proto_defaults[flow->guessed_protocol_id].func != NULL))
-      ndpi_str->proto_defaults[flow->guessed_protocol_id].func(ndpi_str, flow),
+      ndpi_call_dissector(ndpi_str, flow, proto_index, ndpi_str->proto_defaults[flow->guessed_protocol_id].func),
 	func = ndpi_str->proto_defaults[flow->guessed_protocol_id].func;
   }
 
-  for(a = 0; a < ndpi_str->callback_buffer_size_non_tcp_udp; a++) {
-    if((func != ndpi_str->callback_buffer_non_tcp_udp[a].func)
-       && (ndpi_str->callback_buffer_non_tcp_udp[a].ndpi_selection_bitmask & *ndpi_selection_packet) ==
-       ndpi_str->callback_buffer_non_tcp_udp[a].ndpi_selection_bitmask
-       &&
-	   NDPI_BITMASK_COMPARE(flow->excluded_protocol_bitmask,
-				ndpi_str->callback_buffer_non_tcp_udp[a].excluded_protocol_bitmask) == 0
-       && NDPI_BITMASK_COMPARE(ndpi_str->callback_buffer_non_tcp_udp[a].detection_bitmask,
-			       detection_bitmask) != 0) {
-
-      if(ndpi_str->callback_buffer_non_tcp_udp[a].func != NULL)
-	ndpi_str->callback_buffer_non_tcp_udp[a].func(ndpi_str, flow);
-
-      if(flow->detected_protocol_stack[0] != NDPI_PROTOCOL_UNKNOWN)
-	break; /* Stop after detecting the first protocol */
-    }
-  }
+  ndpi_dispatch_callbacks(ndpi_str, flow, ndpi_str->dispatch_non_tcp_udp, *ndpi_selection_packet, func);
 }
 
 
@@ -3891,12 +4559,11 @@ void check_ndpi_udp_flow_func(struct ndpi_detection_module_struct *ndpi_str,
 			      struct ndpi_flow_struct *flow,
 			      NDPI_SELECTION_BITMASK_PROTOCOL_SIZE *ndpi_selection_packet) {
   void *func = NULL;
-  u_int32_t a;
   u_int16_t proto_index = ndpi_str->proto_defaults[flow->guessed_protocol_id].protoIdx;
   int16_t proto_id = ndpi_str->proto_defaults[flow->guessed_protocol_id].protoId;
   NDPI_PROTOCOL_BITMASK detection_bitmask;
 
-  NDPI_SAVE_AS_BITMASK(detection_bitmask, flow->packet.detected_protocol_stack[0]);
+  NDPI_SAVE_AS_BITMASK(detection_bitmask, ndpi_str->packet.detected_protocol_stack[0]);
 
   if((proto_id != NDPI_PROTOCOL_UNKNOWN)
      && NDPI_BITMASK_COMPARE(flow->excluded_protocol_bitmask,
@@ -3907,27 +4574,11 @@ void check_ndpi_udp_flow_func(struct ndpi_detection_module_struct *ndpi_str,
 	 & *ndpi_selection_packet) == ndpi_str->callback_buffer[proto_index].ndpi_selection_bitmask) {
     if((flow->guessed_protocol_id != NDPI_PROTOCOL_UNKNOWN)
        && (ndpi_str->proto_defaults[flow->guessed_protocol_id].func != NULL))
-      ndpi_str->proto_defaults[flow->guessed_protocol_id].func(ndpi_str, flow),
+      ndpi_call_dissector(ndpi_str, flow, proto_index, ndpi_str->proto_defaults[flow->guessed_protocol_id].func),
 	func = ndpi_str->proto_defaults[flow->guessed_protocol_id].func;
   }
 
-  for(a = 0; a < ndpi_str->callback_buffer_size_udp; a++) {
-    if((func != ndpi_str->callback_buffer_udp[a].func)
-       && (ndpi_str->callback_buffer_udp[a].ndpi_selection_bitmask & *ndpi_selection_packet) ==
-       ndpi_str->callback_buffer_udp[a].ndpi_selection_bitmask
-       && NDPI_BITMASK_COMPARE(flow->excluded_protocol_bitmask,
-			       ndpi_str->callback_buffer_udp[a].excluded_protocol_bitmask) == 0
-       && NDPI_BITMASK_COMPARE(ndpi_str->callback_buffer_udp[a].detection_bitmask,
-			       detection_bitmask) != 0) {
-      ndpi_str->callback_buffer_udp[a].func(ndpi_str, flow);
-
-      // NDPI_LOG_DBG(ndpi_str, "[UDP,CALL] dissector of protocol as callback_buffer idx =  %d\n",a);
-      if(flow->detected_protocol_stack[0] != NDPI_PROTOCOL_UNKNOWN)
-	break; /* Stop after detecting the first protocol */
-    } else
-      if(_ndpi_debug_callbacks) NDPI_LOG_DBG2(ndpi_str,
-					      "[UDP,SKIP] dissector of protocol as callback_buffer idx =  %d\n",a);
-  }
+  ndpi_dispatch_callbacks(ndpi_str, flow, ndpi_str->dispatch_udp, *ndpi_selection_packet, func);
 }
 
 
@@ -3935,14 +4586,13 @@ void check_ndpi_tcp_flow_func(struct ndpi_detection_module_struct *ndpi_str,
 			      struct ndpi_flow_struct *flow,
 			      NDPI_SELECTION_BITMASK_PROTOCOL_SIZE *ndpi_selection_packet) {
   void *func = NULL;
-  u_int32_t a;
   u_int16_t proto_index = ndpi_str->proto_defaults[flow->guessed_protocol_id].protoIdx;
   int16_t proto_id = ndpi_str->proto_defaults[flow->guessed_protocol_id].protoId;
   NDPI_PROTOCOL_BITMASK detection_bitmask;
 
-  NDPI_SAVE_AS_BITMASK(detection_bitmask, flow->packet.detected_protocol_stack[0]);
+  NDPI_SAVE_AS_BITMASK(detection_bitmask, ndpi_str->packet.detected_protocol_stack[0]);
 
-  if(flow->packet.payload_packet_len != 0) {
+  if(ndpi_str->packet.payload_packet_len != 0) {
     if((proto_id != NDPI_PROTOCOL_UNKNOWN)
        && NDPI_BITMASK_COMPARE(flow->excluded_protocol_bitmask,
 			       ndpi_str->callback_buffer[proto_index].excluded_protocol_bitmask) == 0
@@ -3950,25 +4600,12 @@ void check_ndpi_tcp_flow_func(struct ndpi_detection_module_struct *ndpi_str,
        && (ndpi_str->callback_buffer[proto_index].ndpi_selection_bitmask & *ndpi_selection_packet) == ndpi_str->callback_buffer[proto_index].ndpi_selection_bitmask) {
       if((flow->guessed_protocol_id != NDPI_PROTOCOL_UNKNOWN)
 	 && (ndpi_str->proto_defaults[flow->guessed_protocol_id].func != NULL))
-	ndpi_str->proto_defaults[flow->guessed_protocol_id].func(ndpi_str, flow),
+	ndpi_call_dissector(ndpi_str, flow, proto_index, ndpi_str->proto_defaults[flow->guessed_protocol_id].func),
 	  func = ndpi_str->proto_defaults[flow->guessed_protocol_id].func;
     }
 
-    if(flow->detected_protocol_stack[0] == NDPI_PROTOCOL_UNKNOWN) {
-      for(a = 0; a < ndpi_str->callback_buffer_size_tcp_payload; a++) {
-	if((func != ndpi_str->callback_buffer_tcp_payload[a].func)
-	   && (ndpi_str->callback_buffer_tcp_payload[a].ndpi_selection_bitmask & *ndpi_selection_packet) == ndpi_str->callback_buffer_tcp_payload[a].ndpi_selection_bitmask
-	   && NDPI_BITMASK_COMPARE(flow->excluded_protocol_bitmask,
-				   ndpi_str->callback_buffer_tcp_payload[a].excluded_protocol_bitmask) == 0
-	   && NDPI_BITMASK_COMPARE(ndpi_str->callback_buffer_tcp_payload[a].detection_bitmask,
-				   detection_bitmask) != 0) {
-	  ndpi_str->callback_buffer_tcp_payload[a].func(ndpi_str, flow);
-
-	  if(flow->detected_protocol_stack[0] != NDPI_PROTOCOL_UNKNOWN)
-	    break; /* Stop after detecting the first protocol */
-	}
-      }
-    }
+    if(flow->detected_protocol_stack[0] == NDPI_PROTOCOL_UNKNOWN)
+      ndpi_dispatch_callbacks(ndpi_str, flow, ndpi_str->dispatch_tcp_payload, *ndpi_selection_packet, func);
   } else {
     /* no payload */
     if((proto_id != NDPI_PROTOCOL_UNKNOWN)
@@ -3981,24 +4618,11 @@ void check_ndpi_tcp_flow_func(struct ndpi_detection_module_struct *ndpi_str,
       if((flow->guessed_protocol_id != NDPI_PROTOCOL_UNKNOWN)
 	 && (ndpi_str->proto_defaults[flow->guessed_protocol_id].func != NULL)
 	 && ((ndpi_str->callback_buffer[flow->guessed_protocol_id].ndpi_selection_bitmask & NDPI_SELECTION_BITMASK_PROTOCOL_HAS_PAYLOAD) == 0))
-	ndpi_str->proto_defaults[flow->guessed_protocol_id].func(ndpi_str, flow),
+	ndpi_call_dissector(ndpi_str, flow, proto_index, ndpi_str->proto_defaults[flow->guessed_protocol_id].func),
 	  func = ndpi_str->proto_defaults[flow->guessed_protocol_id].func;
     }
 
-    for(a = 0; a < ndpi_str->callback_buffer_size_tcp_no_payload; a++) {
-      if((func != ndpi_str->callback_buffer_tcp_payload[a].func)
-	 && (ndpi_str->callback_buffer_tcp_no_payload[a].ndpi_selection_bitmask & *ndpi_selection_packet) ==
-	 ndpi_str->callback_buffer_tcp_no_payload[a].ndpi_selection_bitmask
-	 && NDPI_BITMASK_COMPARE(flow->excluded_protocol_bitmask,
-				 ndpi_str->callback_buffer_tcp_no_payload[a].excluded_protocol_bitmask) == 0
-	 && NDPI_BITMASK_COMPARE(ndpi_str->callback_buffer_tcp_no_payload[a].detection_bitmask,
-				 detection_bitmask) != 0) {
-	ndpi_str->callback_buffer_tcp_no_payload[a].func(ndpi_str, flow);
-
-	if(flow->detected_protocol_stack[0] != NDPI_PROTOCOL_UNKNOWN)
-	  break; /* Stop after detecting the first protocol */
-      }
-    }
+    ndpi_dispatch_callbacks(ndpi_str, flow, ndpi_str->dispatch_tcp_no_payload, *ndpi_selection_packet, func);
   }
 }
 
@@ -4007,9 +4631,9 @@ void check_ndpi_tcp_flow_func(struct ndpi_detection_module_struct *ndpi_str,
 void ndpi_check_flow_func(struct ndpi_detection_module_struct *ndpi_str,
 			  struct ndpi_flow_struct *flow,
 			  NDPI_SELECTION_BITMASK_PROTOCOL_SIZE *ndpi_selection_packet) {
-  if(flow->packet.tcp != NULL)
+  if(ndpi_str->packet.tcp != NULL)
     check_ndpi_tcp_flow_func(ndpi_str, flow, ndpi_selection_packet);
-  else if(flow->packet.udp != NULL)
+  else if(ndpi_str->packet.udp != NULL)
     check_ndpi_udp_flow_func(ndpi_str, flow, ndpi_selection_packet);
   else
     check_ndpi_other_flow_func(ndpi_str, flow, ndpi_selection_packet);
@@ -4021,19 +4645,25 @@ u_int16_t ndpi_guess_host_protocol_id(struct ndpi_detection_module_struct *ndpi_
 				      struct ndpi_flow_struct *flow) {
   u_int16_t ret = NDPI_PROTOCOL_UNKNOWN;
 
-  if(flow->packet.iph) {
-    struct in_addr addr;
+  if(ndpi_str->packet.iph) {
+    struct in_addr addrs[2];
+    u_int16_t protocols[2];
 
-    addr.s_addr = flow->packet.iph->saddr;
+    addrs[0].s_addr = ndpi_str->packet.iph->saddr, addrs[1].s_addr = ndpi_str->packet.iph->daddr;
 
     /* guess host protocol */
-    ret = ndpi_network_ptree_match(ndpi_str, &addr);
+    ndpi_network_ptree_match_batch(ndpi_str, addrs, 2, protocols);
 
-    if(ret == NDPI_PROTOCOL_UNKNOWN) {
-      addr.s_addr = flow->packet.iph->daddr;
-      ret = ndpi_network_ptree_match(ndpi_str, &addr);
-    }
+    ret = (protocols[0] != NDPI_PROTOCOL_UNKNOWN) ? protocols[0] : protocols[1];
   }
+#ifdef NDPI_DETECTION_SUPPORT_IPV6
+  else if(ndpi_str->packet.iphv6) {
+    ret = ndpi_network_ptree6_match(ndpi_str, &ndpi_str->packet.iphv6->ip6_src);
+
+    if(ret == NDPI_PROTOCOL_UNKNOWN)
+      ret = ndpi_network_ptree6_match(ndpi_str, &ndpi_str->packet.iphv6->ip6_dst);
+  }
+#endif
 
   return(ret);
 }
@@ -4098,10 +4728,57 @@ ndpi_protocol ndpi_get_partial_detection(struct ndpi_detection_module_struct *nd
 
 /* ********************************************************************************* */
 
-ndpi_protocol ndpi_detection_giveup(struct ndpi_detection_module_struct *ndpi_str,
-				    struct ndpi_flow_struct *flow,
-				    u_int8_t enable_guess,
-				    u_int8_t *protocol_was_guessed) {
+static inline u_int ndpi_classification_bin(u_int64_t value) {
+  u_int bin = (value == 0) ? 0 : (64 - __builtin_clzll(value));
+
+  return((bin < NDPI_CLASSIFICATION_HISTOGRAM_BINS) ? bin : (NDPI_CLASSIFICATION_HISTOGRAM_BINS - 1));
+}
+
+/* ********************************************************************************* */
+
+/* Allocates on demand the state of the optional features (NULL when out of memory) */
+static struct ndpi_flow_ext *ndpi_flow_alloc_ext(struct ndpi_flow_struct *flow) {
+  if(flow->ext == NULL)
+    flow->ext = (struct ndpi_flow_ext *)ndpi_calloc(1, sizeof(struct ndpi_flow_ext));
+
+  return(flow->ext);
+}
+
+/* ********************************************************************************* */
+
+/* Called once per flow, when it is classified or given up */
+static void ndpi_account_classification(struct ndpi_detection_module_struct *ndpi_str,
+					struct ndpi_flow_struct *flow, u_int16_t protocol_id,
+					u_int8_t gave_up, u_int64_t current_tick) {
+  struct ndpi_classification_stats *stats;
+
+  flow->classification_accounted = 1;
+
+  if(protocol_id >= (NDPI_MAX_SUPPORTED_PROTOCOLS + NDPI_MAX_NUM_CUSTOM_PROTOCOLS))
+    return;
+
+  stats = &ndpi_str->classification_stats[protocol_id];
+
+  if(gave_up) {
+    stats->num_giveups++;
+    return;
+  }
+
+  if(flow->ext == NULL)
+    return; /* Out of memory when the flow started */
+
+  stats->num_classified++;
+  stats->packets[ndpi_classification_bin(flow->ext->classification.num_packets)]++;
+  stats->bytes[ndpi_classification_bin(flow->ext->classification.num_bytes)]++;
+  stats->ticks[ndpi_classification_bin(current_tick - flow->ext->classification.first_tick)]++;
+}
+
+/* ********************************************************************************* */
+
+static ndpi_protocol ndpi_giveup_flow(struct ndpi_detection_module_struct *ndpi_str,
+				      struct ndpi_flow_struct *flow,
+				      u_int8_t enable_guess,
+				      u_int8_t *protocol_was_guessed) {
   ndpi_protocol ret = { NDPI_PROTOCOL_UNKNOWN, NDPI_PROTOCOL_UNKNOWN, NDPI_PROTOCOL_CATEGORY_UNSPECIFIED };
 
   *protocol_was_guessed = 0;
@@ -4121,14 +4798,19 @@ ndpi_protocol ndpi_detection_giveup(struct ndpi_detection_module_struct *ndpi_st
   if(flow->detected_protocol_stack[0] == NDPI_PROTOCOL_UNKNOWN) {
     u_int16_t guessed_protocol_id, guessed_host_protocol_id;
 
-    if(flow->guessed_protocol_id == NDPI_PROTOCOL_STUN)
+    if(flow->ext && flow->ext->cached_verdict) {
+      /* Given up before the dissectors could verify it: the cached verdict stands */
+      ndpi_set_detected_protocol(ndpi_str, flow, flow->ext->cached_verdict & 0xFFFF, flow->ext->cached_verdict >> 16);
+      flow->ext->cached_verdict = 0, flow->ext->verdict_key = 0;
+      ndpi_str->verdict_stats.n_hits++;
+    } else if(flow->guessed_protocol_id == NDPI_PROTOCOL_STUN)
       goto check_stun_export;
     else if((flow->guessed_protocol_id == NDPI_PROTOCOL_HANGOUT_DUO)
 	    || (flow->guessed_protocol_id == NDPI_PROTOCOL_MESSENGER)
 	    || (flow->guessed_protocol_id == NDPI_PROTOCOL_WHATSAPP_CALL))
       ndpi_set_detected_protocol(ndpi_str, flow, flow->guessed_protocol_id, NDPI_PROTOCOL_UNKNOWN);
     else if((flow->l4.tcp.tls_seen_client_cert == 1)
-	    && (flow->protos.stun_ssl.ssl.client_certificate[0] != '\0')) {
+	    && (ndpi_flow_get_protos(flow)->stun_ssl.ssl.client_certificate[0] != '\0')) {
       ndpi_set_detected_protocol(ndpi_str, flow, NDPI_PROTOCOL_TLS, NDPI_PROTOCOL_UNKNOWN);
     } else {
       ndpi_protocol ret_g = ndpi_get_partial_detection(ndpi_str, flow);
@@ -4141,14 +4823,14 @@ ndpi_protocol ndpi_detection_giveup(struct ndpi_detection_module_struct *ndpi_st
       }
 
       if((flow->guessed_protocol_id == NDPI_PROTOCOL_UNKNOWN)
-	 && (flow->packet.l4_protocol == IPPROTO_TCP)
+	 && (flow->l4_proto == IPPROTO_TCP)
 	 && (flow->l4.tcp.tls_stage > 1))
 	flow->guessed_protocol_id = NDPI_PROTOCOL_TLS;
 
       guessed_protocol_id = flow->guessed_protocol_id, guessed_host_protocol_id = flow->guessed_host_protocol_id;
 
       if((guessed_host_protocol_id != NDPI_PROTOCOL_UNKNOWN)
-	 && ((flow->packet.l4_protocol == IPPROTO_UDP)
+	 && ((flow->l4_proto == IPPROTO_UDP)
 	     && NDPI_ISSET(&flow->excluded_protocol_bitmask, guessed_host_protocol_id)
 	     && is_udp_guessable_protocol(guessed_host_protocol_id)
 	     ))
@@ -4157,7 +4839,7 @@ ndpi_protocol ndpi_detection_giveup(struct ndpi_detection_module_struct *ndpi_st
       /* Ignore guessed protocol if they have been discarded */
       if((guessed_protocol_id != NDPI_PROTOCOL_UNKNOWN)
 	 // && (guessed_host_protocol_id == NDPI_PROTOCOL_UNKNOWN)
-	 && (flow->packet.l4_protocol == IPPROTO_UDP)
+	 && (flow->l4_proto == IPPROTO_UDP)
 	 && NDPI_ISSET(&flow->excluded_protocol_bitmask, guessed_protocol_id)
 	 && is_udp_guessable_protocol(guessed_protocol_id))
 	flow->guessed_protocol_id = guessed_protocol_id = NDPI_PROTOCOL_UNKNOWN;
@@ -4165,8 +4847,8 @@ ndpi_protocol ndpi_detection_giveup(struct ndpi_detection_module_struct *ndpi_st
       if((guessed_protocol_id != NDPI_PROTOCOL_UNKNOWN)
 	 || (guessed_host_protocol_id != NDPI_PROTOCOL_UNKNOWN)) {
 	if((guessed_protocol_id == 0)
-	   && (flow->protos.stun_ssl.stun.num_binding_requests > 0)
-	   && (flow->protos.stun_ssl.stun.num_processed_pkts > 0))
+	   && (flow->stun.num_binding_requests > 0)
+	   && (flow->stun.num_processed_pkts > 0))
 	  guessed_protocol_id = NDPI_PROTOCOL_STUN;
 
 	if(flow->host_server_name[0] != '\0') {
@@ -4198,8 +4880,8 @@ ndpi_protocol ndpi_detection_giveup(struct ndpi_detection_module_struct *ndpi_st
   if((flow->detected_protocol_stack[0] == NDPI_PROTOCOL_UNKNOWN)
      && (flow->guessed_protocol_id == NDPI_PROTOCOL_STUN)) {
   check_stun_export:
-    if(flow->protos.stun_ssl.stun.num_processed_pkts || flow->protos.stun_ssl.stun.num_udp_pkts) {
-      // if(/* (flow->protos.stun_ssl.stun.num_processed_pkts >= NDPI_MIN_NUM_STUN_DETECTION) */
+    if(flow->stun.num_processed_pkts || flow->stun.num_udp_pkts) {
+      // if(/* (flow->stun.num_processed_pkts >= NDPI_MIN_NUM_STUN_DETECTION) */
       ndpi_set_detected_protocol(ndpi_str, flow,
 				 flow->guessed_host_protocol_id,
 				 NDPI_PROTOCOL_STUN);
@@ -4223,16 +4905,16 @@ ndpi_protocol ndpi_detection_giveup(struct ndpi_detection_module_struct *ndpi_st
 
   if(enable_guess
      && (ret.app_protocol == NDPI_PROTOCOL_UNKNOWN)
-     && flow->packet.iph /* Guess only IPv4 */
-     && (flow->packet.tcp || flow->packet.udp)
+     && ndpi_str->packet.iph /* Guess only IPv4 */
+     && (ndpi_str->packet.tcp || ndpi_str->packet.udp)
      ) {
     ret = ndpi_guess_undetected_protocol(ndpi_str,
 					 flow,
-					 flow->packet.l4_protocol,
-					 ntohl(flow->packet.iph->saddr),
-					 ntohs(flow->packet.udp ? flow->packet.udp->source : flow->packet.tcp->source),
-					 ntohl(flow->packet.iph->daddr),
-					 ntohs(flow->packet.udp ? flow->packet.udp->dest : flow->packet.tcp->dest)
+					 ndpi_str->packet.l4_protocol,
+					 ntohl(ndpi_str->packet.iph->saddr),
+					 ntohs(ndpi_str->packet.udp ? ndpi_str->packet.udp->source : ndpi_str->packet.tcp->source),
+					 ntohl(ndpi_str->packet.iph->daddr),
+					 ntohs(ndpi_str->packet.udp ? ndpi_str->packet.udp->dest : ndpi_str->packet.tcp->dest)
 					 );
     *protocol_was_guessed = 1;
   }
@@ -4244,6 +4926,63 @@ ndpi_protocol ndpi_detection_giveup(struct ndpi_detection_module_struct *ndpi_st
 
 /* ********************************************************************************* */
 
+ndpi_protocol ndpi_detection_giveup(struct ndpi_detection_module_struct *ndpi_str,
+				    struct ndpi_flow_struct *flow,
+				    u_int8_t enable_guess,
+				    u_int8_t *protocol_was_guessed) {
+  u_int8_t gave_up = (flow != NULL) && ndpi_str->classification_stats
+    && (!flow->classification_accounted)
+    && (flow->detected_protocol_stack[0] == NDPI_PROTOCOL_UNKNOWN);
+  ndpi_protocol ret = ndpi_giveup_flow(ndpi_str, flow, enable_guess, protocol_was_guessed);
+
+  if(gave_up)
+    ndpi_account_classification(ndpi_str, flow,
+				(ret.app_protocol != NDPI_PROTOCOL_UNKNOWN) ? ret.app_protocol : ret.master_protocol,
+				1, 0);
+
+  return(ret);
+}
+
+/* ********************************************************************************* */
+
+static void ndpi_reset_packet_line_info(struct ndpi_packet_struct *packet) {
+  packet->parsed_lines = 0,
+  packet->empty_line_position_set = 0,
+  packet->host_line.ptr = NULL,
+  packet->host_line.len = 0,
+  packet->referer_line.ptr = NULL,
+  packet->referer_line.len = 0,
+  packet->content_line.ptr = NULL,
+  packet->content_line.len = 0,
+  packet->accept_line.ptr = NULL,
+  packet->accept_line.len = 0,
+  packet->user_agent_line.ptr = NULL,
+  packet->user_agent_line.len = 0,
+  packet->http_url_name.ptr = NULL,
+  packet->http_url_name.len = 0,
+  packet->http_encoding.ptr = NULL,
+  packet->http_encoding.len = 0,
+  packet->http_transfer_encoding.ptr = NULL,
+  packet->http_transfer_encoding.len = 0,
+  packet->http_contentlen.ptr = NULL,
+  packet->http_contentlen.len = 0,
+  packet->http_cookie.ptr = NULL,
+  packet->http_cookie.len = 0,
+  packet->http_origin.len = 0,
+  packet->http_origin.ptr = NULL,
+  packet->http_x_session_type.ptr = NULL,
+  packet->http_x_session_type.len = 0,
+  packet->server_line.ptr = NULL,
+  packet->server_line.len = 0,
+  packet->http_method.ptr = NULL,
+  packet->http_method.len = 0,
+  packet->http_response.ptr = NULL,
+  packet->http_response.len = 0,
+  packet->http_num_headers = 0;
+}
+
+/* ********************************************************************************* */
+
 void ndpi_process_extra_packet(struct ndpi_detection_module_struct *ndpi_str,
 			       struct ndpi_flow_struct *flow,
 			       const unsigned char *packet,
@@ -4261,16 +5000,16 @@ void ndpi_process_extra_packet(struct ndpi_detection_module_struct *ndpi_str,
     return;
   }
 
-  flow->packet.tick_timestamp_l = current_tick_l;
-  flow->packet.tick_timestamp = (u_int32_t)(current_tick_l/ndpi_str->ticks_per_second);
+  ndpi_str->packet.tick_timestamp_l = current_tick_l;
+  ndpi_str->packet.tick_timestamp = (u_int32_t)(current_tick_l/ndpi_str->ticks_per_second);
 
   /* parse packet */
-  flow->packet.iph = (struct ndpi_iphdr *)packet;
+  ndpi_str->packet.iph = (struct ndpi_iphdr *)packet;
   /* we are interested in ipv4 packet */
 
   /* set up the packet headers for the extra packet function to use if it wants */
   if(ndpi_init_packet_header(ndpi_str, flow, packetlen) != 0)
-    return;
+    goto invalidate_ptr;
 
   /* detect traffic for tcp or udp only */
   flow->src = src, flow->dst = dst;
@@ -4283,13 +5022,17 @@ void ndpi_process_extra_packet(struct ndpi_detection_module_struct *ndpi_str,
   }
 
   flow->num_extra_packets_checked++;
+
+ invalidate_ptr:
+  /* The packet scratch area is shared by all flows of this module */
+  ndpi_str->packet.iph = NULL, ndpi_str->packet.tcp = NULL, ndpi_str->packet.udp = NULL, ndpi_str->packet.payload = NULL;
+  ndpi_reset_packet_line_info(&ndpi_str->packet);
 }
 
 /* ********************************************************************************* */
 
 int ndpi_load_ip_category(struct ndpi_detection_module_struct *ndpi_str,
 			   const char *ip_address_and_mask, ndpi_protocol_category_t category) {
-  patricia_node_t *node;
   struct in_addr pin;
   int bits = 32;
   char *ptr;
@@ -4298,6 +5041,18 @@ int ndpi_load_ip_category(struct ndpi_detection_module_struct *ndpi_str,
   strncpy(ipbuf, ip_address_and_mask, sizeof(ipbuf));
   ipbuf[sizeof(ipbuf) - 1] = '\0';
 
+  if(strchr(ipbuf, ':') != NULL) {
+    struct ndpi_in6_addr pin6;
+    u_int8_t bits6;
+
+    if(ndpi_parse_ipv6_prefix(ipbuf, &pin6, &bits6) != 0) {
+      NDPI_LOG_DBG2(ndpi_str, "Invalid ip/ip+netmask: %s\n", ip_address_and_mask);
+      return(-1);
+    }
+
+    return(ndpi_lpm6_add(ndpi_str->custom_categories.ipAddresses6_shadow, &pin6, bits6, (u_int32_t)category));
+  }
+
   ptr = strrchr(ipbuf, '/');
 
   if(ptr) {
@@ -4311,10 +5066,7 @@ int ndpi_load_ip_category(struct ndpi_detection_module_struct *ndpi_str,
     return(-1);
   }
 
-  if((node = add_to_ptree(ndpi_str->custom_categories.ipAddresses_shadow,
-			  AF_INET, &pin, bits)) != NULL)
-    node->value.user_value = (int)category;
-  return(0);
+  return(ndpi_lpm4_add(ndpi_str->custom_categories.ipAddresses_shadow, pin.s_addr, bits, (u_int32_t)category));
 }
 
 /* ********************************************************************************* */
@@ -4326,6 +5078,12 @@ int ndpi_load_hostname_category(struct ndpi_detection_module_struct *ndpi_str,
   if(name_to_add == NULL)
     return(-1);
 
+  if(ndpi_str->domain_match
+     && (ndpi_add_domain(&ndpi_str->custom_categories.domains_shadow, name_to_add, (u_int32_t)category) == 0))
+    return(0);
+
+  ndpi_category_filter_add_name(ndpi_str, name_to_add);
+
   name = ndpi_strdup(name_to_add);
 
   if(name == NULL)
@@ -4378,6 +5136,9 @@ int ndpi_load_category(struct ndpi_detection_module_struct *ndpi_struct,
 				 const char *ip_or_name, ndpi_protocol_category_t category) {
   int rv;
 
+  if(ndpi_struct->ruleset != NULL)
+    return(0); /* Categories are part of the ruleset */
+
   /* Try to load as IP address first */
   rv = ndpi_load_ip_category(ndpi_struct, ip_or_name, category);
 
@@ -4392,11 +5153,23 @@ int ndpi_load_category(struct ndpi_detection_module_struct *ndpi_struct,
 /* ********************************************************************************* */
 
 int ndpi_enable_loaded_categories(struct ndpi_detection_module_struct *ndpi_str) {
+  u_int8_t domain_match = ndpi_str->domain_match;
   int i;
 
-  /* First add the nDPI known categories matches */
+  if(ndpi_str->ruleset != NULL) {
+    /* The ruleset categories are used in place */
+    ndpi_str->custom_categories.categories_loaded = 1;
+    return(0);
+  }
+
+  /*
+    First add the nDPI known categories matches. They keep their substring
+    semantics: only the user loaded names are matched as domains
+  */
+  ndpi_str->domain_match = 0;
   for(i=0; category_match[i].string_to_match != NULL; i++)
     ndpi_load_category(ndpi_str, category_match[i].string_to_match, category_match[i].protocol_category);
+  ndpi_str->domain_match = domain_match;
 
 #ifdef HAVE_HYPERSCAN
   if(ndpi_str->custom_categories.num_to_load > 0) {
@@ -4475,12 +5248,31 @@ int ndpi_enable_loaded_categories(struct ndpi_detection_module_struct *ndpi_str)
   ndpi_str->custom_categories.hostnames_shadow.ac_automa = ac_automata_init(ac_match_handler);
 #endif
 
-  if(ndpi_str->custom_categories.ipAddresses != NULL)
-    ndpi_Destroy_Patricia((patricia_tree_t*)ndpi_str->custom_categories.ipAddresses,
-			  free_ptree_data);
-
+  ndpi_lpm4_free(ndpi_str->custom_categories.ipAddresses);
   ndpi_str->custom_categories.ipAddresses = ndpi_str->custom_categories.ipAddresses_shadow;
-  ndpi_str->custom_categories.ipAddresses_shadow = ndpi_New_Patricia(32 /* IPv4 */);
+  ndpi_str->custom_categories.ipAddresses_shadow = ndpi_lpm4_init();
+
+  ndpi_lpm6_free(ndpi_str->custom_categories.ipAddresses6);
+  ndpi_str->custom_categories.ipAddresses6 = ndpi_str->custom_categories.ipAddresses6_shadow;
+  ndpi_str->custom_categories.ipAddresses6_shadow = ndpi_lpm6_init();
+
+  ndpi_domain_trie_free(ndpi_str->custom_categories.domains);
+  ndpi_str->custom_categories.domains = ndpi_str->custom_categories.domains_shadow;
+  ndpi_str->custom_categories.domains_shadow = NULL;
+
+  ndpi_bloom_free(ndpi_str->custom_categories.filter);
+  ndpi_str->custom_categories.filter = NULL;
+
+  if(ndpi_str->category_filter && !ndpi_str->custom_categories.filter_unusable
+     && ((ndpi_str->custom_categories.filter = ndpi_bloom_init(ndpi_str->custom_categories.num_filter_keys)) != NULL)) {
+    for(i=0; i<(int)ndpi_str->custom_categories.num_filter_keys; i++)
+      ndpi_bloom_add(ndpi_str->custom_categories.filter, ndpi_str->custom_categories.filter_keys[i]);
+  }
+
+  ndpi_free(ndpi_str->custom_categories.filter_keys);
+  ndpi_str->custom_categories.filter_keys = NULL;
+  ndpi_str->custom_categories.num_filter_keys = ndpi_str->custom_categories.max_filter_keys = 0;
+  ndpi_str->custom_categories.filter_unusable = 0;
 
   ndpi_str->custom_categories.categories_loaded = 1;
 
@@ -4494,27 +5286,50 @@ int ndpi_fill_ip_protocol_category(struct ndpi_detection_module_struct *ndpi_str
 				   u_int32_t daddr,
 				   ndpi_protocol *ret) {
   if(ndpi_str->custom_categories.categories_loaded) {
-    prefix_t prefix;
-    patricia_node_t *node;
+    u_int32_t addrs[2], values[2];
 
-    if(saddr == 0)
-      node = NULL;
-    else {
-      /* Make sure all in network byte order otherwise compares wont work */
-      fill_prefix_v4(&prefix, (struct in_addr *)&saddr,
-		     32, ((patricia_tree_t*)ndpi_str->protocols_ptree)->maxbits);
-      node = ndpi_patricia_search_best(ndpi_str->custom_categories.ipAddresses, &prefix);
-    }
+    /* Both addresses are looked up at once; 0 (no address) is never matched */
+    addrs[0] = saddr, addrs[1] = daddr;
 
-    if(!node) {
-      if(daddr != 0)
-	fill_prefix_v4(&prefix, (struct in_addr *)&daddr,
-		       32, ((patricia_tree_t*)ndpi_str->protocols_ptree)->maxbits);
-      node = ndpi_patricia_search_best(ndpi_str->custom_categories.ipAddresses, &prefix);
+    if(ndpi_str->ruleset != NULL)
+      ndpi_ruleset_lpm4_match_batch(ndpi_str->ruleset, NDPI_RULESET_CATEGORIES_LPM4, addrs, 2,
+				    values, (u_int32_t)-1);
+    else
+      ndpi_lpm4_match_batch(ndpi_str->custom_categories.ipAddresses, addrs, 2, values, (u_int32_t)-1);
+
+    if((saddr != 0) && (values[0] != (u_int32_t)-1)) {
+      ret->category = (ndpi_protocol_category_t)values[0];
+      return(1);
+    } else if((daddr != 0) && (values[1] != (u_int32_t)-1)) {
+      ret->category = (ndpi_protocol_category_t)values[1];
+      return(1);
     }
+  }
+
+  ret->category = ndpi_get_proto_category(ndpi_str, *ret);
+
+  return(0);
+}
+
+/* ********************************************************************************* */
+
+int ndpi_fill_ip6_protocol_category(struct ndpi_detection_module_struct *ndpi_str,
+				    const struct ndpi_in6_addr *saddr,
+				    const struct ndpi_in6_addr *daddr,
+				    ndpi_protocol *ret) {
+  if(ndpi_str->custom_categories.categories_loaded) {
+    u_int32_t value;
+    int found;
+
+    if(ndpi_str->ruleset != NULL)
+      found = ndpi_ruleset_lpm6_match(ndpi_str->ruleset, NDPI_RULESET_CATEGORIES_LPM6, saddr, &value)
+	|| ndpi_ruleset_lpm6_match(ndpi_str->ruleset, NDPI_RULESET_CATEGORIES_LPM6, daddr, &value);
+    else
+      found = ndpi_lpm6_match(ndpi_str->custom_categories.ipAddresses6, saddr, &value)
+	|| ndpi_lpm6_match(ndpi_str->custom_categories.ipAddresses6, daddr, &value);
 
-    if(node) {
-      ret->category = (ndpi_protocol_category_t)node->value.user_value;
+    if(found) {
+      ret->category = (ndpi_protocol_category_t)value;
       return(1);
     }
   }
@@ -4546,11 +5361,11 @@ void ndpi_fill_protocol_category(struct ndpi_detection_module_struct *ndpi_str,
       }
     }
 
-    if((flow->l4.tcp.tls_seen_client_cert == 1) && (flow->protos.stun_ssl.ssl.client_certificate[0] != '\0')) {
+    if((flow->l4.tcp.tls_seen_client_cert == 1) && (ndpi_flow_get_protos(flow)->stun_ssl.ssl.client_certificate[0] != '\0')) {
       unsigned long id;
       int rc = ndpi_match_custom_category(ndpi_str,
-					  (char *)flow->protos.stun_ssl.ssl.client_certificate,
-					  strlen(flow->protos.stun_ssl.ssl.client_certificate),
+					  (char *)ndpi_flow_get_protos(flow)->stun_ssl.ssl.client_certificate,
+					  strlen(ndpi_flow_get_protos(flow)->stun_ssl.ssl.client_certificate),
 					  &id);
 
       if(rc == 0) {
@@ -4565,40 +5380,221 @@ void ndpi_fill_protocol_category(struct ndpi_detection_module_struct *ndpi_str,
 
 /* ********************************************************************************* */
 
-static void ndpi_reset_packet_line_info(struct ndpi_packet_struct *packet) {
-  packet->parsed_lines = 0,
-  packet->empty_line_position_set = 0,
-  packet->host_line.ptr = NULL,
-  packet->host_line.len = 0,
-  packet->referer_line.ptr = NULL,
-  packet->referer_line.len = 0,
-  packet->content_line.ptr = NULL,
-  packet->content_line.len = 0,
-  packet->accept_line.ptr = NULL,
-  packet->accept_line.len = 0,
-  packet->user_agent_line.ptr = NULL,
-  packet->user_agent_line.len = 0,
-  packet->http_url_name.ptr = NULL,
-  packet->http_url_name.len = 0,
-  packet->http_encoding.ptr = NULL,
-  packet->http_encoding.len = 0,
-  packet->http_transfer_encoding.ptr = NULL,
-  packet->http_transfer_encoding.len = 0,
-  packet->http_contentlen.ptr = NULL,
-  packet->http_contentlen.len = 0,
-  packet->http_cookie.ptr = NULL,
-  packet->http_cookie.len = 0,
-  packet->http_origin.len = 0,
-  packet->http_origin.ptr = NULL,
-  packet->http_x_session_type.ptr = NULL,
-  packet->http_x_session_type.len = 0,
-  packet->server_line.ptr = NULL,
-  packet->server_line.len = 0,
-  packet->http_method.ptr = NULL,
-  packet->http_method.len = 0,
-  packet->http_response.ptr = NULL,
-  packet->http_response.len = 0,
-  packet->http_num_headers = 0;
+/*
+  DNS cache: the addresses of the DNS responses whose hostname matched a
+  protocol or a custom category are cached (for the TTL of the answer) so
+  that the flows towards them are classified on their first packet. The
+  category is kept above the protocol in the 29 bits of the cached value
+*/
+
+#define NDPI_DNS_CACHE_VALUE(protocol, category) ((((u_int32_t)(category)) << 16) | (protocol))
+
+static inline u_int64_t ndpi_ip4_cache_key(u_int32_t addr) {
+  return((u_int64_t)addr);
+}
+
+#ifdef NDPI_DETECTION_SUPPORT_IPV6
+/*
+  IPv6 addresses do not fit the keys: they are hashed with SipHash-2-4,
+  keyed with the secret of the cache, so that the addresses colliding with
+  a cached one (e.g. to poison it) cannot be computed. The top bit set
+  keeps IPv6 keys apart from the IPv4 ones
+*/
+static inline u_int64_t ndpi_ip6_cache_key(const struct ndpi_lru_cache *c, const struct ndpi_in6_addr *addr) {
+  return(ndpi_lru_hash_128(c, addr) | (((u_int64_t)1) << 63));
+}
+#endif
+
+void ndpi_dns_cache_add(struct ndpi_detection_module_struct *ndpi_str,
+			const ndpi_ip_addr_t *addr, u_int8_t is_ipv6,
+			u_int16_t protocol, ndpi_protocol_category_t category, u_int32_t ttl) {
+  u_int64_t key;
+
+  if((ttl == 0)
+     || ((protocol == NDPI_PROTOCOL_UNKNOWN) && (category == NDPI_PROTOCOL_CATEGORY_UNSPECIFIED)))
+    return;
+
+  if(ndpi_str->dns_cache == NULL) {
+    if(ndpi_str->dns_cache_num_entries == 0)
+      return; /* Disabled */
+
+    if((ndpi_str->dns_cache = ndpi_lru_cache_init(ndpi_str->dns_cache_num_entries, 0)) == NULL)
+      return;
+  }
+
+#ifdef NDPI_DETECTION_SUPPORT_IPV6
+  if(is_ipv6)
+    key = ndpi_ip6_cache_key(ndpi_str->dns_cache, &addr->ipv6);
+  else
+#endif
+    key = ndpi_ip4_cache_key(addr->ipv4);
+
+  if(ndpi_str->dns_cache_max_ttl && (ttl > ndpi_str->dns_cache_max_ttl))
+    ttl = ndpi_str->dns_cache_max_ttl;
+
+  ndpi_lru_add_to_cache_ttl(ndpi_str->dns_cache, key, NDPI_DNS_CACHE_VALUE(protocol, category),
+			    ndpi_str->packet.tick_timestamp, ttl);
+}
+
+/*
+  Returns the value cached for the destination (else the source) address
+  of the packet (see NDPI_DNS_CACHE_VALUE), 0 if none
+*/
+static u_int32_t ndpi_dns_cache_match(struct ndpi_detection_module_struct *ndpi_str) {
+  struct ndpi_packet_struct *packet = &ndpi_str->packet;
+  u_int32_t value;
+
+  if(packet->iph) {
+    if(ndpi_lru_find_cache(ndpi_str->dns_cache, ndpi_ip4_cache_key(packet->iph->daddr),
+			   &value, 0, packet->tick_timestamp)
+       || ndpi_lru_find_cache(ndpi_str->dns_cache, ndpi_ip4_cache_key(packet->iph->saddr),
+			      &value, 0, packet->tick_timestamp))
+      return(value);
+  }
+#ifdef NDPI_DETECTION_SUPPORT_IPV6
+  else if(packet->iphv6) {
+    if(ndpi_lru_find_cache(ndpi_str->dns_cache, ndpi_ip6_cache_key(ndpi_str->dns_cache, &packet->iphv6->ip6_dst),
+			   &value, 0, packet->tick_timestamp)
+       || ndpi_lru_find_cache(ndpi_str->dns_cache, ndpi_ip6_cache_key(ndpi_str->dns_cache, &packet->iphv6->ip6_src),
+			      &value, 0, packet->tick_timestamp))
+      return(value);
+  }
+#endif
+
+  return(0);
+}
+
+/* ********************************************************************************* */
+
+/*
+  Verdict cache: the verdicts of the flows detected by the dissectors are
+  cached by server endpoint (address, port, L4 protocol), so that the next
+  flows towards it are classified on their first packet. With
+  ndpi_pref_verdict_cache_verify_packets the cached verdict is only
+  provisional: the flow is dissected as usual for that many packets and
+  the verdict of the dissectors, if any, wins
+*/
+
+#define NDPI_VERDICT(master, app) ((((u_int32_t)(master)) << 16) | (app))
+
+static void ndpi_verdict_to_protocol(struct ndpi_detection_module_struct *ndpi_str,
+				     u_int32_t verdict, ndpi_protocol *ret) {
+  ret->app_protocol = verdict & 0xFFFF, ret->master_protocol = verdict >> 16;
+
+  if(ret->master_protocol == ret->app_protocol)
+    ret->master_protocol = NDPI_PROTOCOL_UNKNOWN;
+
+  ret->category = ndpi_get_proto_category(ndpi_str, *ret);
+}
+
+/* Called on the first packet of the flow: returns 1 if the cached verdict is final */
+static int ndpi_verdict_cache_lookup(struct ndpi_detection_module_struct *ndpi_str,
+				     struct ndpi_flow_struct *flow,
+				     u_int8_t l4_proto, u_int16_t dport, ndpi_protocol *ret) {
+  struct ndpi_packet_struct *packet = &ndpi_str->packet;
+  u_int64_t endpoint = (((u_int64_t)l4_proto) << 48) | (((u_int64_t)dport) << 32);
+  u_int32_t verdict;
+
+  /* Only the first packet of a flow tells which side is the server */
+  if(packet->tcp ? ((packet->tcp->syn == 0) || (packet->tcp->ack != 0)) : (packet->udp == NULL))
+    return(0);
+
+  /* The IPv6 keys depend on the secret of the cache */
+  if((ndpi_str->verdict_cache == NULL)
+     && ((ndpi_str->verdict_cache = ndpi_lru_cache_init(ndpi_str->verdict_cache_num_entries,
+							 ndpi_str->verdict_cache_ttl)) == NULL))
+    return(0);
+
+  if(ndpi_flow_alloc_ext(flow) == NULL)
+    return(0);
+
+#ifdef NDPI_DETECTION_SUPPORT_IPV6
+  if(packet->iphv6)
+    flow->ext->verdict_key = ndpi_ip6_cache_key(ndpi_str->verdict_cache, &packet->iphv6->ip6_dst) ^ endpoint;
+  else
+#endif
+    flow->ext->verdict_key = ndpi_ip4_cache_key(packet->iph->daddr) | endpoint;
+
+  if(!ndpi_lru_find_cache(ndpi_str->verdict_cache, flow->ext->verdict_key, &verdict, 0, packet->tick_timestamp))
+    return(0);
+
+  if(ndpi_str->verdict_cache_verify_pkts > 0) {
+    flow->ext->cached_verdict = verdict;
+    return(0);
+  }
+
+  ndpi_set_detected_protocol(ndpi_str, flow, verdict & 0xFFFF, verdict >> 16);
+  ndpi_verdict_to_protocol(ndpi_str, verdict, ret);
+  ndpi_fill_protocol_category(ndpi_str, flow, ret);
+  flow->ext->verdict_key = 0; /* Nothing new to cache */
+  ndpi_str->verdict_stats.n_hits++;
+
+  return(1);
+}
+
+/* Called after the dissectors: caches their verdict or checks the cached one */
+static void ndpi_verdict_cache_update(struct ndpi_detection_module_struct *ndpi_str,
+				      struct ndpi_flow_struct *flow) {
+  struct ndpi_flow_ext *ext = flow->ext;
+  u_int32_t verdict;
+
+  if(flow->detected_protocol_stack[0] == NDPI_PROTOCOL_UNKNOWN) {
+    if(ext->cached_verdict && (flow->num_processed_pkts >= ndpi_str->verdict_cache_verify_pkts)) {
+      /* The dissectors could not tell: the cached verdict stands */
+      ndpi_set_detected_protocol(ndpi_str, flow, ext->cached_verdict & 0xFFFF, ext->cached_verdict >> 16);
+      ext->cached_verdict = 0, ext->verdict_key = 0;
+      ndpi_str->verdict_stats.n_hits++;
+    }
+
+    return;
+  }
+
+  verdict = NDPI_VERDICT(flow->detected_protocol_stack[1], flow->detected_protocol_stack[0]);
+
+  if(ext->cached_verdict) {
+    ndpi_str->verdict_stats.n_verified++;
+    if(verdict != ext->cached_verdict) ndpi_str->verdict_stats.n_mismatch++;
+    ext->cached_verdict = 0;
+  }
+
+  /* The DNS subprotocols come from the queried name, not from the server */
+  if((flow->detected_protocol_stack[0] != NDPI_PROTOCOL_DNS)
+     && (flow->detected_protocol_stack[1] != NDPI_PROTOCOL_DNS)) {
+    if(ndpi_str->verdict_cache != NULL) {
+      ndpi_lru_add_to_cache(ndpi_str->verdict_cache, ext->verdict_key, verdict, ndpi_str->packet.tick_timestamp);
+      ndpi_str->verdict_stats.n_cached++;
+    }
+  }
+
+  ext->verdict_key = 0;
+}
+
+/* ********************************************************************************* */
+
+/*
+  Returns 1 and fills ret if the flow is already detected and the packet
+  would only be used to report the detected protocol
+*/
+static int ndpi_detected_flow_fast_path(struct ndpi_flow_struct *flow,
+					struct ndpi_id_struct *dst,
+					ndpi_protocol *ret) {
+  if((flow->detected_protocol_stack[0] == NDPI_PROTOCOL_UNKNOWN)
+     || flow->check_extra_packets
+     || (flow->category == NDPI_PROTOCOL_CATEGORY_UNSPECIFIED))
+    return(0);
+
+  flow->num_processed_pkts++;
+  if(flow->server_id == NULL) flow->server_id = dst; /* Default */
+
+  ret->app_protocol = flow->detected_protocol_stack[0], ret->category = flow->category;
+
+  if((flow->detected_protocol_stack[1] != NDPI_PROTOCOL_UNKNOWN)
+     && (flow->detected_protocol_stack[1] != flow->detected_protocol_stack[0]))
+    ret->master_protocol = flow->detected_protocol_stack[1];
+  else
+    ret->master_protocol = NDPI_PROTOCOL_UNKNOWN;
+
+  return(1);
 }
 
 /* ********************************************************************************* */
@@ -4620,9 +5616,14 @@ ndpi_protocol ndpi_detection_process_packet(struct ndpi_detection_module_struct
 
   if(flow == NULL)
     return(ret);
+  else if(ndpi_detected_flow_fast_path(flow, dst, &ret))
+    return(ret); /* Already classified: the packet state is not touched */
   else
     ret.category = flow->category;
 
+  if(ndpi_str->ruleset != NULL)
+    ndpi_update_ruleset(ndpi_str); /* No match in progress: rules can be replaced */
+
   flow->num_processed_pkts++;
 
   /* Init default */
@@ -4649,15 +5650,15 @@ ndpi_protocol ndpi_detection_process_packet(struct ndpi_detection_module_struct
   /* need at least 20 bytes for ip header */
   if(packetlen < 20) {
     /* reset protocol which is normally done in init_packet_header */
-    ndpi_int_reset_packet_protocol(&flow->packet);
+    ndpi_int_reset_packet_protocol(&ndpi_str->packet);
     goto invalidate_ptr;
   }
 
-  flow->packet.tick_timestamp_l = current_tick_l;
-  flow->packet.tick_timestamp = (u_int32_t)(current_tick_l/ndpi_str->ticks_per_second);
+  ndpi_str->packet.tick_timestamp_l = current_tick_l;
+  ndpi_str->packet.tick_timestamp = (u_int32_t)(current_tick_l/ndpi_str->ticks_per_second);
 
   /* parse packet */
-  flow->packet.iph = (struct ndpi_iphdr *)packet;
+  ndpi_str->packet.iph = (struct ndpi_iphdr *)packet;
   /* we are interested in ipv4 packet */
 
   if(ndpi_init_packet_header(ndpi_str, flow, packetlen) != 0)
@@ -4668,36 +5669,46 @@ ndpi_protocol ndpi_detection_process_packet(struct ndpi_detection_module_struct
 
   ndpi_connection_tracking(ndpi_str, flow);
 
+  if(ndpi_str->classification_stats && ndpi_flow_alloc_ext(flow)) {
+    if(flow->ext->classification.num_packets == 0)
+      flow->ext->classification.first_tick = current_tick_l;
+
+    if(flow->ext->classification.num_packets < 0xFFFF)
+      flow->ext->classification.num_packets++;
+
+    flow->ext->classification.num_bytes += ndpi_str->packet.payload_packet_len;
+  }
+
   /* build ndpi_selection packet bitmask */
   ndpi_selection_packet = NDPI_SELECTION_BITMASK_PROTOCOL_COMPLETE_TRAFFIC;
-  if(flow->packet.iph != NULL)
+  if(ndpi_str->packet.iph != NULL)
     ndpi_selection_packet |= NDPI_SELECTION_BITMASK_PROTOCOL_IP | NDPI_SELECTION_BITMASK_PROTOCOL_IPV4_OR_IPV6;
 
-  if(flow->packet.tcp != NULL)
+  if(ndpi_str->packet.tcp != NULL)
     ndpi_selection_packet |=
       (NDPI_SELECTION_BITMASK_PROTOCOL_INT_TCP | NDPI_SELECTION_BITMASK_PROTOCOL_INT_TCP_OR_UDP);
 
-  if(flow->packet.udp != NULL)
+  if(ndpi_str->packet.udp != NULL)
     ndpi_selection_packet |=
       (NDPI_SELECTION_BITMASK_PROTOCOL_INT_UDP | NDPI_SELECTION_BITMASK_PROTOCOL_INT_TCP_OR_UDP);
 
-  if(flow->packet.payload_packet_len != 0)
+  if(ndpi_str->packet.payload_packet_len != 0)
     ndpi_selection_packet |= NDPI_SELECTION_BITMASK_PROTOCOL_HAS_PAYLOAD;
 
-  if(flow->packet.tcp_retransmission == 0)
+  if(ndpi_str->packet.tcp_retransmission == 0)
     ndpi_selection_packet |= NDPI_SELECTION_BITMASK_PROTOCOL_NO_TCP_RETRANSMISSION;
 
 #ifdef NDPI_DETECTION_SUPPORT_IPV6
-  if(flow->packet.iphv6 != NULL)
+  if(ndpi_str->packet.iphv6 != NULL)
     ndpi_selection_packet |= NDPI_SELECTION_BITMASK_PROTOCOL_IPV6 | NDPI_SELECTION_BITMASK_PROTOCOL_IPV4_OR_IPV6;
 #endif							/* NDPI_DETECTION_SUPPORT_IPV6 */
 
   if((!flow->protocol_id_already_guessed)
      && (
 #ifdef NDPI_DETECTION_SUPPORT_IPV6
-	 flow->packet.iphv6 ||
+	 ndpi_str->packet.iphv6 ||
 #endif
-	 flow->packet.iph)) {
+	 ndpi_str->packet.iph)) {
     u_int16_t sport, dport;
     u_int8_t protocol;
     u_int8_t user_defined_proto;
@@ -4705,26 +5716,34 @@ ndpi_protocol ndpi_detection_process_packet(struct ndpi_detection_module_struct
     flow->protocol_id_already_guessed = 1;
 
 #ifdef NDPI_DETECTION_SUPPORT_IPV6
-    if(flow->packet.iphv6 != NULL) {
-      protocol = flow->packet.iphv6->ip6_hdr.ip6_un1_nxt;
+    if(ndpi_str->packet.iphv6 != NULL) {
+      protocol = ndpi_str->packet.iphv6->ip6_hdr.ip6_un1_nxt;
     } else
 #endif
       {
-	protocol = flow->packet.iph->protocol;
+	protocol = ndpi_str->packet.iph->protocol;
       }
 
-    if(flow->packet.udp) sport = ntohs(flow->packet.udp->source), dport = ntohs(flow->packet.udp->dest);
-    else if(flow->packet.tcp) sport = ntohs(flow->packet.tcp->source), dport = ntohs(flow->packet.tcp->dest);
+    if(ndpi_str->packet.udp) sport = ntohs(ndpi_str->packet.udp->source), dport = ntohs(ndpi_str->packet.udp->dest);
+    else if(ndpi_str->packet.tcp) sport = ntohs(ndpi_str->packet.tcp->source), dport = ntohs(ndpi_str->packet.tcp->dest);
     else sport = dport = 0;
 
     /* guess protocol */
     flow->guessed_protocol_id = (int16_t)ndpi_guess_protocol_id(ndpi_str, flow, protocol, sport, dport, &user_defined_proto);
     flow->guessed_host_protocol_id = ndpi_guess_host_protocol_id(ndpi_str, flow);
 
-    if(ndpi_str->custom_categories.categories_loaded && flow->packet.iph) {
-      ndpi_fill_ip_protocol_category(ndpi_str, flow->packet.iph->saddr, flow->packet.iph->daddr, &ret);
+    if(ndpi_str->custom_categories.categories_loaded && ndpi_str->packet.iph) {
+      ndpi_fill_ip_protocol_category(ndpi_str, ndpi_str->packet.iph->saddr, ndpi_str->packet.iph->daddr, &ret);
       flow->guessed_header_category = ret.category;
-    } else
+    }
+#ifdef NDPI_DETECTION_SUPPORT_IPV6
+    else if(ndpi_str->custom_categories.categories_loaded && ndpi_str->packet.iphv6) {
+      ndpi_fill_ip6_protocol_category(ndpi_str, &ndpi_str->packet.iphv6->ip6_src,
+				      &ndpi_str->packet.iphv6->ip6_dst, &ret);
+      flow->guessed_header_category = ret.category;
+    }
+#endif
+    else
       flow->guessed_header_category = NDPI_PROTOCOL_CATEGORY_UNSPECIFIED;
 
     if(flow->guessed_protocol_id >= (NDPI_MAX_SUPPORTED_PROTOCOLS-1)) {
@@ -4735,8 +5754,13 @@ ndpi_protocol ndpi_detection_process_packet(struct ndpi_detection_module_struct
       goto invalidate_ptr;
     }
 
+    /* After the guesses: the flows served from the cache keep them and the IP category */
+    if((ndpi_str->verdict_cache_num_entries > 0)
+       && ndpi_verdict_cache_lookup(ndpi_str, flow, protocol, dport, &ret))
+      goto invalidate_ptr;
+
     if(user_defined_proto && flow->guessed_protocol_id != NDPI_PROTOCOL_UNKNOWN) {
-      if(flow->packet.iph) {
+      if(ndpi_str->packet.iph) {
 	if(flow->guessed_host_protocol_id != NDPI_PROTOCOL_UNKNOWN) {
 	  u_int8_t protocol_was_guessed;
 	    
@@ -4748,16 +5772,27 @@ ndpi_protocol ndpi_detection_process_packet(struct ndpi_detection_module_struct
 	goto invalidate_ptr;
       }
     } else {
-      /* guess host protocol */
-      if(flow->packet.iph) {
-	struct in_addr addr;
-
-	addr.s_addr = flow->packet.iph->saddr;
-	flow->guessed_host_protocol_id = ndpi_network_ptree_match(ndpi_str, &addr);
-
-	if(flow->guessed_host_protocol_id == NDPI_PROTOCOL_UNKNOWN) {
-	  addr.s_addr = flow->packet.iph->daddr;
-	  flow->guessed_host_protocol_id = ndpi_network_ptree_match(ndpi_str, &addr);
+      /* The host protocol was guessed above by ndpi_guess_host_protocol_id() */
+      if((ndpi_str->dns_cache != NULL) && (flow->guessed_protocol_id != NDPI_PROTOCOL_DNS)) {
+	u_int32_t cached = ndpi_dns_cache_match(ndpi_str);
+	u_int16_t cached_protocol = cached & 0xFFFF;
+	ndpi_protocol_category_t cached_category = (ndpi_protocol_category_t)(cached >> 16);
+
+	/* The category of the resolved name, as the IP based one, wins over the protocol category */
+	if((cached_category != NDPI_PROTOCOL_CATEGORY_UNSPECIFIED)
+	   && (flow->guessed_header_category == NDPI_PROTOCOL_CATEGORY_UNSPECIFIED))
+	  flow->guessed_header_category = cached_category;
+
+	if(cached_protocol != NDPI_PROTOCOL_UNKNOWN) {
+	  /* The host was resolved earlier: no need to wait for its name (e.g. the TLS SNI) */
+	  ret.app_protocol = cached_protocol;
+	  ret.master_protocol = ((flow->guessed_protocol_id != cached_protocol)
+				 && ndpi_str->proto_defaults[flow->guessed_protocol_id].can_have_a_subprotocol) ?
+	    flow->guessed_protocol_id : NDPI_PROTOCOL_UNKNOWN;
+
+	  ndpi_set_detected_protocol(ndpi_str, flow, ret.app_protocol, ret.master_protocol);
+	  ndpi_fill_protocol_category(ndpi_str, flow, &ret);
+	  goto invalidate_ptr;
 	}
       }
     }
@@ -4767,12 +5802,12 @@ ndpi_protocol ndpi_detection_process_packet(struct ndpi_detection_module_struct
     /* This is a custom protocol and it has priority over everything else */
     ret.master_protocol = NDPI_PROTOCOL_UNKNOWN, ret.app_protocol = flow->guessed_host_protocol_id;
 
-    if(flow->packet.tcp && (ret.master_protocol == NDPI_PROTOCOL_UNKNOWN)) {
+    if(ndpi_str->packet.tcp && (ret.master_protocol == NDPI_PROTOCOL_UNKNOWN)) {
       /* Minimal guess for HTTP/SSL-based protocols */
       int i;
 
       for(i=0; i<2; i++) {
-	u_int16_t port = (i == 0) ? ntohs(flow->packet.tcp->dest) : ntohs(flow->packet.tcp->source);
+	u_int16_t port = (i == 0) ? ntohs(ndpi_str->packet.tcp->dest) : ntohs(ndpi_str->packet.tcp->source);
 
 	switch(port) {
 	case 80:
@@ -4795,7 +5830,7 @@ ndpi_protocol ndpi_detection_process_packet(struct ndpi_detection_module_struct
 
   ndpi_check_flow_func(ndpi_str, flow, &ndpi_selection_packet);
 
-  a = flow->packet.detected_protocol_stack[0];
+  a = ndpi_str->packet.detected_protocol_stack[0];
   if(NDPI_COMPARE_PROTOCOL_TO_BITMASK(ndpi_str->detection_bitmask, a) == 0)
     a = NDPI_PROTOCOL_UNKNOWN;
 
@@ -4812,6 +5847,9 @@ ndpi_protocol ndpi_detection_process_packet(struct ndpi_detection_module_struct
     }
   }
 
+  if(flow->ext && (flow->ext->verdict_key != 0))
+    ndpi_verdict_cache_update(ndpi_str, flow);
+
  ret_protocols:
   if(flow->detected_protocol_stack[1] != NDPI_PROTOCOL_UNKNOWN) {
     ret.master_protocol = flow->detected_protocol_stack[1], ret.app_protocol = flow->detected_protocol_stack[0];
@@ -4830,8 +5868,8 @@ ndpi_protocol ndpi_detection_process_packet(struct ndpi_detection_module_struct
   if((flow->num_processed_pkts == 1)
      && (ret.master_protocol == NDPI_PROTOCOL_UNKNOWN)
      && (ret.app_protocol == NDPI_PROTOCOL_UNKNOWN)
-     && flow->packet.tcp
-     && (flow->packet.tcp->syn == 0)
+     && ndpi_str->packet.tcp
+     && (ndpi_str->packet.tcp->syn == 0)
      && (flow->guessed_protocol_id == 0)
      ) {
     u_int8_t protocol_was_guessed;
@@ -4847,19 +5885,146 @@ ndpi_protocol ndpi_detection_process_packet(struct ndpi_detection_module_struct
     ret = ndpi_detection_giveup(ndpi_str, flow, 0, &protocol_was_guessed);
   }
 
+  if((ret.app_protocol == NDPI_PROTOCOL_UNKNOWN) && flow->ext && flow->ext->cached_verdict)
+    ndpi_verdict_to_protocol(ndpi_str, flow->ext->cached_verdict, &ret); /* Provisional */
+
  invalidate_ptr:
+  if(ndpi_str->classification_stats
+     && (!flow->classification_accounted)
+     && (flow->detected_protocol_stack[0] != NDPI_PROTOCOL_UNKNOWN))
+    ndpi_account_classification(ndpi_str, flow, flow->detected_protocol_stack[0], 0, current_tick_l);
+
   /*
      Invalidate packet memory to avoid accessing the pointers below
      when the packet is no longer accessible
   */
-  flow->packet.iph = NULL, flow->packet.tcp = NULL, flow->packet.udp = NULL, flow->packet.payload = NULL;
-  ndpi_reset_packet_line_info(&flow->packet);
+  ndpi_str->packet.iph = NULL, ndpi_str->packet.tcp = NULL, ndpi_str->packet.udp = NULL, ndpi_str->packet.payload = NULL;
+  ndpi_reset_packet_line_info(&ndpi_str->packet);
 
   return(ret);
 }
 
 /* ********************************************************************************* */
 
+/* Burst grouping: packets are dispatched TCP first, then UDP, then the rest */
+#define NDPI_BURST_GROUP_TCP    0
+#define NDPI_BURST_GROUP_UDP    1
+#define NDPI_BURST_GROUP_OTHER  2
+#define NDPI_BURST_NUM_GROUPS   3
+
+static u_int8_t ndpi_burst_group(const unsigned char *packet, const unsigned short packetlen) {
+  u_int8_t l4_proto;
+
+  if((packet == NULL) || (packetlen < 20))
+    return(NDPI_BURST_GROUP_OTHER);
+
+  if((packet[0] >> 4) == 4)
+    l4_proto = packet[9];
+  else if(((packet[0] >> 4) == 6) && (packetlen >= 40))
+    l4_proto = packet[6]; /* extension headers fall in the last group (see ndpi_burst_flow_group) */
+  else
+    return(NDPI_BURST_GROUP_OTHER);
+
+  switch(l4_proto) {
+  case IPPROTO_TCP:
+    return(NDPI_BURST_GROUP_TCP);
+  case IPPROTO_UDP:
+    return(NDPI_BURST_GROUP_UDP);
+  default:
+    return(NDPI_BURST_GROUP_OTHER);
+  }
+}
+
+/* ********************************************************************************* */
+
+/* Open addressing table of the flows of a burst, twice as large as the burst */
+#define NDPI_BURST_FLOW_SLOTS   (2 * NDPI_MAX_BURST_SIZE)
+
+struct ndpi_burst_flow_slot {
+  struct ndpi_flow_struct *flow;
+  u_int8_t group;
+};
+
+/*
+  The packets of a flow take the group of its first packet in the burst:
+  grouping never reorders them, even when they are classified differently
+  (e.g. some with IPv6 extension headers or truncated)
+*/
+static u_int8_t ndpi_burst_flow_group(struct ndpi_burst_flow_slot *slots,
+				      struct ndpi_flow_struct *flow,
+				      const unsigned char *packet,
+				      const unsigned short packetlen) {
+  u_int32_t i;
+
+  if(flow == NULL)
+    return(NDPI_BURST_GROUP_OTHER);
+
+  i = (u_int32_t)((((uintptr_t)flow) >> 4) * 0x9E3779B1u);
+
+  for(i &= (NDPI_BURST_FLOW_SLOTS - 1); slots[i].flow != NULL; i = (i + 1) & (NDPI_BURST_FLOW_SLOTS - 1)) {
+    if(slots[i].flow == flow)
+      return(slots[i].group);
+  }
+
+  slots[i].flow = flow, slots[i].group = ndpi_burst_group(packet, packetlen);
+
+  return(slots[i].group);
+}
+
+/* ********************************************************************************* */
+
+void ndpi_detection_process_packet_burst(struct ndpi_detection_module_struct *ndpi_str,
+					 struct ndpi_flow_struct **flows,
+					 const unsigned char **packets,
+					 const unsigned short *packetlens,
+					 const u_int64_t *current_ticks,
+					 struct ndpi_id_struct **srcs,
+					 struct ndpi_id_struct **dsts,
+					 u_int32_t num_packets,
+					 ndpi_protocol *ret) {
+  struct ndpi_burst_flow_slot slots[NDPI_BURST_FLOW_SLOTS];
+  u_int16_t order[NDPI_MAX_BURST_SIZE];
+  u_int8_t group[NDPI_MAX_BURST_SIZE];
+  u_int32_t base;
+
+  for(base = 0; base < num_packets; base += NDPI_MAX_BURST_SIZE) {
+    u_int32_t n = ndpi_min(num_packets - base, NDPI_MAX_BURST_SIZE);
+    u_int32_t group_start[NDPI_BURST_NUM_GROUPS + 1] = { 0 };
+    u_int32_t i;
+
+    memset(slots, 0, sizeof(slots));
+
+    /* Stable counting sort by L4 group: packets of the same flow keep their order */
+    for(i = 0; i < n; i++) {
+      group[i] = ndpi_burst_flow_group(slots, flows[base + i], packets[base + i], packetlens[base + i]);
+      group_start[group[i] + 1]++;
+    }
+
+    for(i = 1; i <= NDPI_BURST_NUM_GROUPS; i++)
+      group_start[i] += group_start[i - 1];
+
+    for(i = 0; i < n; i++)
+      order[group_start[group[i]]++] = (u_int16_t)i;
+
+    for(i = 0; i < n; i++) {
+      u_int32_t idx = base + order[i];
+      struct ndpi_flow_struct *flow = flows[idx];
+
+      if(i + NDPI_BURST_PREFETCH_DISTANCE < n) {
+	u_int32_t next = base + order[i + NDPI_BURST_PREFETCH_DISTANCE];
+
+	__builtin_prefetch(flows[next]);
+	__builtin_prefetch(packets[next]);
+      }
+
+      ret[idx] = ndpi_detection_process_packet(ndpi_str, flow, packets[idx], packetlens[idx],
+					       current_ticks[idx], srcs[idx], dsts[idx]);
+    }
+  }
+}
+
+/* ********************************************************************************* */
+
 u_int32_t ndpi_bytestream_to_number(const u_int8_t * str, u_int16_t max_chars_to_read, u_int16_t * bytes_read)
 {
   u_int32_t val;
@@ -5013,7 +6178,7 @@ void ndpi_parse_packet_line_info(struct ndpi_detection_module_struct *ndpi_str,
 				 struct ndpi_flow_struct *flow)
 {
   u_int32_t a;
-  struct ndpi_packet_struct *packet = &flow->packet;
+  struct ndpi_packet_struct *packet = &ndpi_str->packet;
 
   if(packet->packet_lines_parsed_complete != 0)
     return;
@@ -5235,7 +6400,7 @@ void ndpi_parse_packet_line_info(struct ndpi_detection_module_struct *ndpi_str,
 void ndpi_parse_packet_line_info_any(struct ndpi_detection_module_struct *ndpi_str,
 				     struct ndpi_flow_struct *flow)
 {
-  struct ndpi_packet_struct *packet = &flow->packet;
+  struct ndpi_packet_struct *packet = &ndpi_str->packet;
   u_int32_t a;
   u_int16_t end = packet->payload_packet_len;
 
@@ -5281,7 +6446,7 @@ u_int16_t ndpi_check_for_email_address(struct ndpi_detection_module_struct *ndpi
 				       struct ndpi_flow_struct *flow, u_int16_t counter)
 {
 
-  struct ndpi_packet_struct *packet = &flow->packet;
+  struct ndpi_packet_struct *packet = &ndpi_str->packet;
 
   NDPI_LOG_DBG2(ndpi_str, "called ndpi_check_for_email_address\n");
 
@@ -5436,7 +6601,7 @@ void ndpi_int_change_packet_protocol(struct ndpi_detection_module_struct *ndpi_s
 				     struct ndpi_flow_struct *flow,
 				     u_int16_t upper_detected_protocol,
 				     u_int16_t lower_detected_protocol) {
-  struct ndpi_packet_struct *packet = &flow->packet;
+  struct ndpi_packet_struct *packet = &ndpi_str->packet;
   /* NOTE: everything below is identically to change_flow_protocol
    *        except flow->packet If you want to change something here,
    *        don't! Change it for the flow function and apply it here
@@ -6071,6 +7236,17 @@ int ndpi_match_string_subprotocol(struct ndpi_detection_module_struct *ndpi_str,
   AC_TEXT_t ac_input_text;
   ndpi_automa *automa = is_host_match ? &ndpi_str->host_automa : &ndpi_str->content_automa;
   AC_REP_t match = { NDPI_PROTOCOL_UNKNOWN, NDPI_PROTOCOL_CATEGORY_UNSPECIFIED, NDPI_PROTOCOL_UNRATED };
+  u_int32_t value;
+
+  /* Hosts added as domains: see ndpi_add_host_url_subprotocol() */
+  if(is_host_match
+     && ndpi_match_domain(ndpi_str, NDPI_RULESET_HOST_DOMAINS, string_to_match, string_to_match_len, &value)) {
+    ret_match->protocol_id = value & 0xFFFF,
+      ret_match->protocol_category = (value >> 16) & 0xFF,
+      ret_match->protocol_breed = value >> 24;
+
+    return(ret_match->protocol_id);
+  }
 
   if((automa->ac_automa == NULL) || (string_to_match_len == 0))
     return(NDPI_PROTOCOL_UNKNOWN);
@@ -6117,7 +7293,7 @@ static u_int16_t ndpi_automa_match_string_subprotocol(struct ndpi_detection_modu
 						      ndpi_protocol_match_result *ret_match,
 						      u_int8_t is_host_match) {
   int matching_protocol_id;
-  struct ndpi_packet_struct *packet = &flow->packet;
+  struct ndpi_packet_struct *packet = &ndpi_str->packet;
 
 #ifndef HAVE_HYPERSCAN
   matching_protocol_id = ndpi_match_string_subprotocol(ndpi_str, string_to_match,
@@ -6260,8 +7436,27 @@ int ndpi_match_bigram(struct ndpi_detection_module_struct *ndpi_str,
 
 /* ****************************************************** */
 
-void ndpi_free_flow(struct ndpi_flow_struct *flow) {
+union ndpi_flow_protos *ndpi_flow_alloc_protos(struct ndpi_flow_struct *flow) {
+  if(flow->protos == NULL)
+    flow->protos = (union ndpi_flow_protos *)ndpi_calloc(1, sizeof(union ndpi_flow_protos));
+
+  return(flow->protos);
+}
+
+/* ****************************************************** */
+
+const union ndpi_flow_protos *ndpi_flow_get_protos(const struct ndpi_flow_struct *flow) {
+  static const union ndpi_flow_protos no_protos; /* all zero */
+
+  return((flow && flow->protos) ? flow->protos : &no_protos);
+}
+
+/* ****************************************************** */
+
+void ndpi_free_flow_data(struct ndpi_flow_struct *flow) {
   if(flow) {
+    if(flow->protos)            ndpi_free(flow->protos);
+    if(flow->ext)               ndpi_free(flow->ext);
     if(flow->http.url)          ndpi_free(flow->http.url);
     if(flow->http.content_type) ndpi_free(flow->http.content_type);
 
@@ -6269,13 +7464,67 @@ void ndpi_free_flow(struct ndpi_flow_struct *flow) {
       if(flow->l4.tcp.tls_srv_cert_fingerprint_ctx)
 	ndpi_free(flow->l4.tcp.tls_srv_cert_fingerprint_ctx);
     }
+  }
+}
 
+/* ****************************************************** */
+
+void ndpi_free_flow(struct ndpi_flow_struct *flow) {
+  if(flow) {
+    ndpi_free_flow_data(flow);
     ndpi_free(flow);
   }
 }
 
 /* ****************************************************** */
 
+u_int8_t ndpi_flow_get_verdict(struct ndpi_detection_module_struct *ndpi_str,
+			       struct ndpi_flow_struct *flow,
+			       ndpi_flow_verdict *verdict) {
+  memset(verdict, 0, sizeof(ndpi_flow_verdict));
+
+  if(flow == NULL)
+    return(0);
+
+  verdict->protocol.app_protocol = flow->detected_protocol_stack[0];
+
+  if((flow->detected_protocol_stack[1] != NDPI_PROTOCOL_UNKNOWN)
+     && (flow->detected_protocol_stack[1] != flow->detected_protocol_stack[0]))
+    verdict->protocol.master_protocol = flow->detected_protocol_stack[1];
+
+  if(flow->category == NDPI_PROTOCOL_CATEGORY_UNSPECIFIED)
+    ndpi_fill_protocol_category(ndpi_str, flow, &verdict->protocol);
+  else
+    verdict->protocol.category = flow->category;
+
+  verdict->detection_completed = (flow->detected_protocol_stack[0] != NDPI_PROTOCOL_UNKNOWN) ? 1 : 0;
+  verdict->extra_dissection = flow->check_extra_packets ? 1 : 0;
+
+  return((verdict->detection_completed && (!verdict->extra_dissection)) ? 1 : 0);
+}
+
+/* ****************************************************** */
+
+void ndpi_flow_release(struct ndpi_detection_module_struct *ndpi_str,
+		       struct ndpi_flow_struct *flow,
+		       ndpi_flow_verdict *verdict,
+		       void (*flow_free)(void *ptr)) {
+  if(verdict)
+    ndpi_flow_get_verdict(ndpi_str, flow, verdict);
+
+  if(flow == NULL)
+    return;
+
+  if(flow_free == NULL)
+    ndpi_flow_free(flow); /* Allocated with ndpi_flow_malloc() */
+  else {
+    ndpi_free_flow_data(flow);
+    flow_free(flow);
+  }
+}
+
+/* ****************************************************** */
+
 char* ndpi_revision() { return(NDPI_GIT_RELEASE); }
 
 /* ****************************************************** */
@@ -6362,45 +7611,331 @@ void ndpi_set_log_level(struct ndpi_detection_module_struct *ndpi_str, u_int l)
 /* ******************************************************************** */
 
 /* LRU cache */
-struct ndpi_lru_cache* ndpi_lru_cache_init(u_int32_t num_entries) {
-  struct ndpi_lru_cache *c = (struct ndpi_lru_cache*)ndpi_malloc(sizeof(struct ndpi_lru_cache));
 
-  if(!c) return(NULL);
+/*
+  Set associative cache: the key hash selects a set of NDPI_LRU_CACHE_WAYS
+  entries (a cache line) and the entries of the set are ranked by recency,
+  so that the least recently used one is replaced when the set is full.
+
+  A shared cache is used by several detection modules (threads) at once:
+  its sets are spread over a power of 2 number of shards, each with a
+  spinlock and its own counters, so that threads only contend when they
+  touch sets of the same shard
+*/
+
+/* The secret keying the hashes of a cache: from the system random source if any */
+static void ndpi_lru_cache_secret(struct ndpi_lru_cache *c) {
+  FILE *fd = fopen("/dev/urandom", "rb");
+  u_int64_t seed;
+  u_int i;
+
+  if(fd != NULL) {
+    size_t n = fread(c->secret, sizeof(c->secret), 1, fd);
+
+    fclose(fd);
+
+    if(n == 1)
+      return;
+  }
+
+  /* No random source: the best we can do is mixing the time and the address of the cache */
+  seed = ((u_int64_t)time(NULL) << 32) ^ (u_int64_t)clock() ^ (u_int64_t)(uintptr_t)c;
+
+  for(i=0; i<2; i++) {
+    u_int64_t z = (seed += 0x9E3779B97F4A7C15ULL);
+
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    c->secret[i] = z ^ (z >> 31);
+  }
+}
+
+#define NDPI_ROTL64(x, b) (((x) << (b)) | ((x) >> (64 - (b))))
+
+#define NDPI_SIPROUND					\
+  do {							\
+    v0 += v1; v1 = NDPI_ROTL64(v1, 13); v1 ^= v0;	\
+    v0 = NDPI_ROTL64(v0, 32);				\
+    v2 += v3; v3 = NDPI_ROTL64(v3, 16); v3 ^= v2;	\
+    v0 += v3; v3 = NDPI_ROTL64(v3, 21); v3 ^= v0;	\
+    v2 += v1; v1 = NDPI_ROTL64(v1, 17); v1 ^= v2;	\
+    v2 = NDPI_ROTL64(v2, 32);				\
+  } while(0)
+
+/* SipHash-2-4 of a 16 bytes key (e.g. an IPv6 address), keyed with the secret of the cache */
+u_int64_t ndpi_lru_hash_128(const struct ndpi_lru_cache *c, const void *data) {
+  u_int64_t v0 = c->secret[0] ^ 0x736f6d6570736575ULL, v1 = c->secret[1] ^ 0x646f72616e646f6dULL;
+  u_int64_t v2 = c->secret[0] ^ 0x6c7967656e657261ULL, v3 = c->secret[1] ^ 0x7465646279746573ULL;
+  u_int64_t m[2], b = ((u_int64_t)16) << 56;
+  u_int i;
+
+  memcpy(m, data, sizeof(m));
+
+  for(i=0; i<2; i++) {
+    v3 ^= m[i];
+    NDPI_SIPROUND; NDPI_SIPROUND;
+    v0 ^= m[i];
+  }
+
+  v3 ^= b;
+  NDPI_SIPROUND; NDPI_SIPROUND;
+  v0 ^= b;
+
+  v2 ^= 0xff;
+  NDPI_SIPROUND; NDPI_SIPROUND; NDPI_SIPROUND; NDPI_SIPROUND;
+
+  return(v0 ^ v1 ^ v2 ^ v3);
+}
+
+static struct ndpi_lru_cache* ndpi_lru_cache_alloc(u_int32_t num_entries, u_int32_t ttl, u_int32_t num_shards) {
+  struct ndpi_lru_cache *c;
+  size_t shards_len;
+  u_int64_t i;
+
+  if(num_entries == 0)
+    return(NULL);
+
+  if((c = (struct ndpi_lru_cache*)ndpi_calloc(1, sizeof(struct ndpi_lru_cache))) == NULL)
+    return(NULL);
 
-  c->entries = (struct ndpi_lru_cache_entry*)ndpi_calloc(num_entries,
-							 sizeof(struct ndpi_lru_cache_entry));
+  c->num_sets = (num_entries + NDPI_LRU_CACHE_WAYS - 1) / NDPI_LRU_CACHE_WAYS, c->ttl = ttl;
+  c->num_shards = num_shards, c->num_refs = 1;
+  ndpi_lru_cache_secret(c);
+  shards_len = (size_t)num_shards * sizeof(struct ndpi_lru_cache_shard);
 
-  if(!c->entries) {
+  if((c->mem = ndpi_calloc(shards_len + (size_t)c->num_sets * NDPI_LRU_CACHE_WAYS * sizeof(struct ndpi_lru_cache_entry) + 63, 1)) == NULL) {
     ndpi_free(c);
     return(NULL);
-  } else
-    c->num_entries = num_entries;
+  }
+
+  /* Shards first (if any), then the sets, all cache line aligned */
+  if(num_shards > 0)
+    c->shards = (struct ndpi_lru_cache_shard*)(((uintptr_t)c->mem + 63) & ~((uintptr_t)63));
+
+  c->entries = (struct ndpi_lru_cache_entry*)((((uintptr_t)c->mem + 63) & ~((uintptr_t)63)) + shards_len);
+
+  /* The ranks of each set are a permutation of 0..NDPI_LRU_CACHE_WAYS-1 */
+  for(i=0; i<(u_int64_t)c->num_sets * NDPI_LRU_CACHE_WAYS; i++)
+    c->entries[i].rank = i % NDPI_LRU_CACHE_WAYS;
 
   return(c);
 }
 
+struct ndpi_lru_cache* ndpi_lru_cache_init(u_int32_t num_entries, u_int32_t ttl) {
+  return(ndpi_lru_cache_alloc(num_entries, ttl, 0));
+}
+
+struct ndpi_lru_cache* ndpi_lru_cache_init_shared(u_int32_t num_entries, u_int32_t ttl, u_int32_t num_shards) {
+  u_int32_t n = 1;
+
+  while((n < num_shards) && (n < NDPI_LRU_CACHE_MAX_SHARDS)) n <<= 1;
+
+  return(ndpi_lru_cache_alloc(num_entries, ttl, n));
+}
+
 void ndpi_lru_free_cache(struct ndpi_lru_cache *c) {
-  ndpi_free(c->entries);
-  ndpi_free(c);
+  if(__sync_sub_and_fetch(&c->num_refs, 1) == 0) {
+    ndpi_free(c->mem);
+    ndpi_free(c);
+  }
 }
 
-u_int8_t ndpi_lru_find_cache(struct ndpi_lru_cache *c, u_int32_t key, u_int16_t *value, u_int8_t clean_key_when_found) {
-  u_int32_t slot = key % c->num_entries;
+static inline u_int32_t ndpi_lru_get_set(struct ndpi_lru_cache *c, u_int64_t key) {
+  u_int64_t hash = key * 0x9E3779B97F4A7C15ULL;
 
-  if(c->entries[slot].is_full) {
-    *value = c->entries[slot].value;
-    if(clean_key_when_found) c->entries[slot].is_full = 0;
-    return(1);
-  } else
-    return(0);
+  return((u_int32_t)((hash >> 32) * c->num_sets >> 32));
+}
+
+/* Locks the shard of the set (shared caches only) and returns the counters to update */
+static inline struct ndpi_lru_cache_stats* ndpi_lru_lock(struct ndpi_lru_cache *c, u_int32_t set_id) {
+  struct ndpi_lru_cache_shard *shard;
+  u_int8_t contended = 0;
+
+  if(c->shards == NULL)
+    return(&c->stats);
+
+  shard = &c->shards[set_id & (c->num_shards - 1)];
+
+  while(__sync_lock_test_and_set(&shard->lock.val, 1)) {
+    contended = 1;
+
+    while(shard->lock.val)
+      ; /* Spin reading the lock, without stealing its cache line */
+  }
+
+  if(contended) shard->stats.n_contended++;
+
+  return(&shard->stats);
+}
+
+static inline void ndpi_lru_unlock(struct ndpi_lru_cache *c, u_int32_t set_id) {
+  if(c->shards != NULL)
+    __sync_lock_release(&c->shards[set_id & (c->num_shards - 1)].lock.val);
 }
 
-void ndpi_lru_add_to_cache(struct ndpi_lru_cache *c, u_int32_t key, u_int16_t value) {
-  u_int32_t slot = key % c->num_entries;
+/* Makes way the most recently used of its set */
+static inline void ndpi_lru_touch(struct ndpi_lru_cache_entry *set, u_int way) {
+  u_int i;
 
-  c->entries[slot].is_full = 1,
-    c->entries[slot].key = key,
-    c->entries[slot].value = value;
+  if(set[way].rank == 0)
+    return; /* Already there: do not dirty the set */
+
+  for(i=0; i<NDPI_LRU_CACHE_WAYS; i++)
+    if(set[i].rank < set[way].rank) set[i].rank++;
+
+  set[way].rank = 0;
+}
+
+u_int8_t ndpi_lru_find_cache(struct ndpi_lru_cache *c, u_int64_t key,
+			     u_int32_t *value, u_int8_t clean_key_when_found, u_int32_t now_sec) {
+  u_int32_t set_id = ndpi_lru_get_set(c, key);
+  struct ndpi_lru_cache_entry *set = &c->entries[(u_int64_t)set_id * NDPI_LRU_CACHE_WAYS];
+  struct ndpi_lru_cache_stats *stats = ndpi_lru_lock(c, set_id);
+  u_int8_t found = 0;
+  u_int i;
+
+  stats->n_search++;
+
+  for(i=0; i<NDPI_LRU_CACHE_WAYS; i++) {
+    if(set[i].is_full && (set[i].key == key)) {
+      /* Module clocks may lag a bit behind the one that added the entry */
+      if(set[i].expiry && (now_sec > set[i].expiry)) {
+	set[i].is_full = 0;
+	stats->n_expired++;
+	break;
+      }
+
+      *value = set[i].value;
+
+      if(clean_key_when_found)
+	set[i].is_full = 0;
+      else
+	ndpi_lru_touch(set, i);
+
+      stats->n_found++, found = 1;
+      break;
+    }
+  }
+
+  ndpi_lru_unlock(c, set_id);
+
+  return(found);
+}
+
+void ndpi_lru_add_to_cache_ttl(struct ndpi_lru_cache *c, u_int64_t key, u_int32_t value,
+				u_int32_t now_sec, u_int32_t ttl) {
+  u_int32_t set_id = ndpi_lru_get_set(c, key);
+  struct ndpi_lru_cache_entry *set = &c->entries[(u_int64_t)set_id * NDPI_LRU_CACHE_WAYS];
+  struct ndpi_lru_cache_stats *stats = ndpi_lru_lock(c, set_id);
+  u_int i, way = 0;
+
+  stats->n_insert++;
+
+  /* The same key, else an empty entry, else the least recently used one */
+  for(i=0; i<NDPI_LRU_CACHE_WAYS; i++) {
+    if(set[i].is_full && (set[i].key == key)) {
+      way = i;
+      break;
+    } else if(!set[i].is_full) {
+      if(set[way].is_full) way = i;
+    } else if(set[way].is_full && (set[i].rank > set[way].rank))
+      way = i;
+  }
+
+  if((i == NDPI_LRU_CACHE_WAYS) && set[way].is_full)
+    stats->n_evicted++;
+
+  set[way].is_full = 1, set[way].key = key, set[way].value = value & NDPI_LRU_CACHE_VALUE_MASK;
+  set[way].expiry = ttl ? (now_sec + ttl) : 0;
+  ndpi_lru_touch(set, way);
+
+  ndpi_lru_unlock(c, set_id);
+}
+
+void ndpi_lru_add_to_cache(struct ndpi_lru_cache *c, u_int64_t key, u_int32_t value, u_int32_t now_sec) {
+  ndpi_lru_add_to_cache_ttl(c, key, value, now_sec, c->ttl);
+}
+
+void ndpi_lru_get_stats(struct ndpi_lru_cache *c, struct ndpi_lru_cache_stats *stats) {
+  u_int32_t i;
+
+  *stats = c->stats;
+
+  /* The shard counters are read without locking: they are only approximate while in use */
+  for(i=0; i<c->num_shards; i++) {
+    stats->n_insert += c->shards[i].stats.n_insert;
+    stats->n_search += c->shards[i].stats.n_search;
+    stats->n_found += c->shards[i].stats.n_found;
+    stats->n_evicted += c->shards[i].stats.n_evicted;
+    stats->n_expired += c->shards[i].stats.n_expired;
+    stats->n_contended += c->shards[i].stats.n_contended;
+  }
+}
+
+static struct ndpi_lru_cache** ndpi_lru_cache_slot(struct ndpi_detection_module_struct *ndpi_str,
+						   ndpi_lru_cache_type cache_type) {
+  switch(cache_type) {
+  case ndpi_lru_cache_ookla:
+    return(&ndpi_str->ookla_cache);
+
+  case ndpi_lru_cache_stun:
+    return(&ndpi_str->stun_cache);
+
+  case ndpi_lru_cache_tinc:
+    return(&ndpi_str->tinc_cache);
+
+  case ndpi_lru_cache_dns:
+    return(&ndpi_str->dns_cache);
+
+  case ndpi_lru_cache_verdict:
+    return(&ndpi_str->verdict_cache);
+
+  default:
+    return(NULL);
+  }
+}
+
+int ndpi_set_lru_cache(struct ndpi_detection_module_struct *ndpi_str,
+		       ndpi_lru_cache_type cache_type, struct ndpi_lru_cache *c) {
+  struct ndpi_lru_cache **slot = ndpi_lru_cache_slot(ndpi_str, cache_type);
+
+  if(slot == NULL)
+    return(-1);
+
+  if(c != NULL)
+    __sync_fetch_and_add(&c->num_refs, 1);
+
+  if(*slot != NULL)
+    ndpi_lru_free_cache(*slot);
+
+  *slot = c;
+  return(0);
+}
+
+void ndpi_get_verdict_cache_stats(struct ndpi_detection_module_struct *ndpi_str,
+				  struct ndpi_verdict_cache_stats *stats) {
+  *stats = ndpi_str->verdict_stats;
+}
+
+int ndpi_get_classification_stats(struct ndpi_detection_module_struct *ndpi_str,
+				  u_int16_t protocol_id, struct ndpi_classification_stats *stats) {
+  if((ndpi_str->classification_stats == NULL)
+     || (protocol_id >= (NDPI_MAX_SUPPORTED_PROTOCOLS + NDPI_MAX_NUM_CUSTOM_PROTOCOLS)))
+    return(-1);
+
+  *stats = ndpi_str->classification_stats[protocol_id];
+  return(0);
+}
+
+int ndpi_get_lru_cache_stats(struct ndpi_detection_module_struct *ndpi_str,
+			     ndpi_lru_cache_type cache_type, struct ndpi_lru_cache_stats *stats) {
+  struct ndpi_lru_cache **slot = ndpi_lru_cache_slot(ndpi_str, cache_type);
+
+  if((slot == NULL) || (*slot == NULL))
+    return(-1);
+
+  ndpi_lru_get_stats(*slot, stats);
+  return(0);
 }
 
 /* ******************************************************************** */
@@ -6458,13 +7993,13 @@ u_int8_t ndpi_extra_dissection_possible(struct ndpi_detection_module_struct *ndp
 
   case NDPI_PROTOCOL_DNS:
     if((ndpi_str->dns_dont_dissect_response == 0)
-       && (flow->protos.dns.num_answers == 0))
+       && (ndpi_flow_get_protos(flow)->dns.num_answers == 0))
       return(1);
     break;
 
   case NDPI_PROTOCOL_SSH:
-    if((flow->protos.ssh.hassh_client[0] == '\0')
-       || (flow->protos.ssh.hassh_server[0] == '\0'))
+    if((ndpi_flow_get_protos(flow)->ssh.hassh_client[0] == '\0')
+       || (ndpi_flow_get_protos(flow)->ssh.hassh_server[0] == '\0'))
       return(1);
     break;
   }
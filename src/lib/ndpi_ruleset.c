@@ -0,0 +1,522 @@
+/*
+ * ndpi_ruleset.c
+ *
+ * Copyright (C) 2020 - ntop.org
+ *
+ * This file is part of nDPI, an open source deep packet inspection
+ * library.
+ *
+ * nDPI is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * nDPI is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with nDPI.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "ndpi_config.h"
+#endif
+
+#include <stdlib.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#ifndef WIN32
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+#define NDPI_CURRENT_PROTO NDPI_PROTOCOL_UNKNOWN
+
+#include "ndpi_api.h"
+#include "ahocorasick.h"
+
+/*
+  A compiled ruleset file is a header followed by one image per section:
+  the automata images are written by ac_automata_write_image(), the IP
+  prefixes images by ndpi_lpm4_write_image() and ndpi_lpm6_write_image(),
+  the domain tries images by
+  ndpi_domain_trie_write_image() and the categories filter (if any) by
+  ndpi_bloom_write_image(). Images have no pointers, so
+  the file is mmap()ed read-only and used in place: its pages are shared by
+  all the modules, threads and processes mapping it.
+
+  The file uses the host byte order and is only valid for the nDPI version
+  that wrote it: the header records the API version and the size of the
+  module and flow structures, so that an image built by a library with a
+  different layout is rejected.
+
+  The same images can also be compiled in memory: either way a ruleset is
+  immutable and reference counted, so any number of modules (e.g. one per
+  thread) use a single copy of the rules and only keep their mutable state.
+
+  Rulesets are updated RCU style: ndpi_publish_ruleset() links the update
+  to the ruleset it replaces, and each module moves to it at its next
+  unclassified packet (see ndpi_detection_process_packet) or quiescent point
+  (ndpi_ruleset_quiescent). Packets being processed keep using the old
+  images, which are released with the last module (the grace period) and
+  never modified meanwhile: a module that never gets there pins the whole
+  chain of updates.
+*/
+
+#define NDPI_RULESET_MAGIC    "nDPIrset"
+#define NDPI_RULESET_VERSION  6
+#define NDPI_RULESET_ALIGN(x) (((x) + 63) & ~((u_int64_t)63))
+
+struct ndpi_ruleset_header {
+  char magic[8];
+  u_int32_t version, api_version;
+  u_int32_t max_supported_protocols, num_sections;
+  u_int32_t module_size, flow_size; /* Layout of the library that built the image */
+  u_int64_t file_len;
+  struct {
+    u_int64_t offset, len;
+  } sections[NDPI_RULESET_NUM_SECTIONS];
+};
+
+/* ********************************************************************************* */
+
+#if !defined(WIN32) && !defined(HAVE_HYPERSCAN)
+
+static AC_AUTOMATA_t* ndpi_ruleset_section_automa(struct ndpi_detection_module_struct *ndpi_str,
+						  u_int id) {
+  ndpi_automa *automa;
+
+  switch(id) {
+  case NDPI_RULESET_HOST_AUTOMA:              automa = &ndpi_str->host_automa; break;
+  case NDPI_RULESET_CONTENT_AUTOMA:           automa = &ndpi_str->content_automa; break;
+  case NDPI_RULESET_BIGRAMS_AUTOMA:           automa = &ndpi_str->bigrams_automa; break;
+  case NDPI_RULESET_IMPOSSIBLE_BIGRAMS_AUTOMA: automa = &ndpi_str->impossible_bigrams_automa; break;
+  case NDPI_RULESET_CATEGORIES_AUTOMA:        automa = &ndpi_str->custom_categories.hostnames; break;
+  default:
+    return(NULL);
+  }
+
+  if(automa->ac_automa && !automa->ac_automa_finalized) {
+    ac_automata_finalize((AC_AUTOMATA_t*)automa->ac_automa);
+    automa->ac_automa_finalized = 1;
+  }
+
+  return((AC_AUTOMATA_t*)automa->ac_automa);
+}
+
+/* ********************************************************************************* */
+
+static struct ndpi_lpm4* ndpi_ruleset_section_lpm4(struct ndpi_detection_module_struct *ndpi_str,
+						   u_int id) {
+  switch(id) {
+  case NDPI_RULESET_PROTOCOLS_LPM4:  return(ndpi_str->protocols_lpm4);
+  case NDPI_RULESET_CATEGORIES_LPM4: return(ndpi_str->custom_categories.ipAddresses);
+  default:
+    return(NULL);
+  }
+}
+
+/* ********************************************************************************* */
+
+static int ndpi_ruleset_is_domains_section(u_int id) {
+  return((id == NDPI_RULESET_HOST_DOMAINS) || (id == NDPI_RULESET_CATEGORIES_DOMAINS));
+}
+
+/* ********************************************************************************* */
+
+static struct ndpi_domain_trie* ndpi_ruleset_section_domains(struct ndpi_detection_module_struct *ndpi_str,
+							     u_int id) {
+  return((id == NDPI_RULESET_HOST_DOMAINS) ? ndpi_str->host_domains : ndpi_str->custom_categories.domains);
+}
+
+/* ********************************************************************************* */
+
+static int ndpi_ruleset_is_lpm6_section(u_int id) {
+  return((id == NDPI_RULESET_PROTOCOLS_LPM6) || (id == NDPI_RULESET_CATEGORIES_LPM6));
+}
+
+/* ********************************************************************************* */
+
+static struct ndpi_lpm6* ndpi_ruleset_section_lpm6(struct ndpi_detection_module_struct *ndpi_str,
+						   u_int id) {
+  return((id == NDPI_RULESET_PROTOCOLS_LPM6) ? ndpi_str->protocols_lpm6 : ndpi_str->custom_categories.ipAddresses6);
+}
+
+/* ********************************************************************************* */
+
+/* Returns the ruleset image of a module (to be freed with ndpi_free) */
+static u_int8_t* ndpi_ruleset_build(struct ndpi_detection_module_struct *ndpi_str, u_int64_t *len) {
+  struct ndpi_ruleset_header header;
+  u_int8_t *buf;
+  u_int64_t offset;
+  u_int i;
+  int rc = 0;
+
+  if(ndpi_str->ruleset != NULL) {
+    NDPI_LOG_ERR(ndpi_str, "The module already uses a compiled ruleset\n");
+    return(NULL);
+  }
+
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, NDPI_RULESET_MAGIC, sizeof(header.magic));
+  header.version = NDPI_RULESET_VERSION, header.api_version = NDPI_API_VERSION;
+  header.max_supported_protocols = NDPI_MAX_SUPPORTED_PROTOCOLS;
+  header.num_sections = NDPI_RULESET_NUM_SECTIONS;
+  header.module_size = sizeof(struct ndpi_detection_module_struct);
+  header.flow_size = sizeof(struct ndpi_flow_struct);
+
+  /* Sizes */
+  offset = NDPI_RULESET_ALIGN(sizeof(header));
+
+  for(i=0; i<NDPI_RULESET_NUM_SECTIONS; i++) {
+    AC_AUTOMATA_t *automa = ndpi_ruleset_section_automa(ndpi_str, i);
+    struct ndpi_lpm4 *lpm4 = ndpi_ruleset_section_lpm4(ndpi_str, i);
+
+    if(automa)
+      header.sections[i].len = ac_automata_image_size(automa);
+    else if(ndpi_ruleset_is_domains_section(i)) /* Possibly an empty trie */
+      header.sections[i].len = ndpi_domain_trie_image_size(ndpi_ruleset_section_domains(ndpi_str, i));
+    else if(ndpi_ruleset_is_lpm6_section(i))
+      header.sections[i].len = ndpi_lpm6_image_size(ndpi_ruleset_section_lpm6(ndpi_str, i));
+    else if((i == NDPI_RULESET_CATEGORIES_FILTER) && ndpi_str->custom_categories.filter)
+      header.sections[i].len = ndpi_bloom_image_size(ndpi_str->custom_categories.filter);
+    else if(lpm4)
+      header.sections[i].len = ndpi_lpm4_image_size(lpm4);
+
+    if((automa != NULL) && (header.sections[i].len == 0)) {
+      NDPI_LOG_ERR(ndpi_str, "Ruleset section %u cannot be compiled (too large)\n", i);
+      return(NULL);
+    }
+
+    header.sections[i].offset = offset;
+    offset = NDPI_RULESET_ALIGN(offset + header.sections[i].len);
+  }
+
+  header.file_len = offset;
+
+  if((buf = (u_int8_t*)ndpi_calloc(1, offset)) == NULL) {
+    NDPI_LOG_ERR(ndpi_str, "Memory allocation failure\n");
+    return(NULL);
+  }
+
+  /* Images */
+  memcpy(buf, &header, sizeof(header));
+
+  for(i=0; (i<NDPI_RULESET_NUM_SECTIONS) && (rc == 0); i++) {
+    AC_AUTOMATA_t *automa = ndpi_ruleset_section_automa(ndpi_str, i);
+    struct ndpi_lpm4 *lpm4 = ndpi_ruleset_section_lpm4(ndpi_str, i);
+
+    if(automa)
+      rc = ac_automata_write_image(automa, &buf[header.sections[i].offset], header.sections[i].len);
+    else if(ndpi_ruleset_is_domains_section(i))
+      ndpi_domain_trie_write_image(ndpi_ruleset_section_domains(ndpi_str, i), &buf[header.sections[i].offset]);
+    else if(ndpi_ruleset_is_lpm6_section(i))
+      ndpi_lpm6_write_image(ndpi_ruleset_section_lpm6(ndpi_str, i), &buf[header.sections[i].offset]);
+    else if((i == NDPI_RULESET_CATEGORIES_FILTER) && ndpi_str->custom_categories.filter)
+      ndpi_bloom_write_image(ndpi_str->custom_categories.filter, &buf[header.sections[i].offset]);
+    else if(lpm4)
+      ndpi_lpm4_write_image(lpm4, &buf[header.sections[i].offset]);
+  }
+
+  if(rc != 0) {
+    ndpi_free(buf);
+    return(NULL);
+  }
+
+  *len = offset;
+  return(buf);
+}
+
+/* ********************************************************************************* */
+
+/*
+  The file is written aside and renamed over path: the rulesets loaded
+  from the previous file keep mapping its pages, that must never be
+  truncated nor rewritten while modules use them
+*/
+int ndpi_save_ruleset(struct ndpi_detection_module_struct *ndpi_str, const char *path) {
+  u_int64_t len, written = 0;
+  u_int8_t *buf = ndpi_ruleset_build(ndpi_str, &len);
+  size_t path_len = strlen(path);
+  char *tmp_path;
+  int fd, rc = 0;
+
+  if(buf == NULL)
+    return(-1);
+
+  if((tmp_path = (char*)ndpi_malloc(path_len + 8)) == NULL) {
+    ndpi_free(buf);
+    return(-1);
+  }
+
+  /* Same directory, so that rename() is atomic */
+  snprintf(tmp_path, path_len + 8, "%s.XXXXXX", path);
+
+  if((fd = mkstemp(tmp_path)) < 0) {
+    NDPI_LOG_ERR(ndpi_str, "Unable to create file %s [%s]\n", tmp_path, strerror(errno));
+    ndpi_free(tmp_path);
+    ndpi_free(buf);
+    return(-1);
+  }
+
+  while(written < len) {
+    ssize_t n = write(fd, &buf[written], len - written);
+
+    if(n < 0) {
+      if(errno == EINTR) continue;
+      rc = -1;
+      break;
+    }
+
+    written += n;
+  }
+
+  if((rc == 0)
+     && ((fchmod(fd, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH) != 0) || (fsync(fd) != 0)))
+    rc = -1;
+
+  if(close(fd) != 0)
+    rc = -1;
+
+  if((rc == 0) && (rename(tmp_path, path) != 0))
+    rc = -1;
+
+  if(rc != 0) {
+    NDPI_LOG_ERR(ndpi_str, "Unable to write file %s [%s]\n", path, strerror(errno));
+    unlink(tmp_path);
+  }
+
+  ndpi_free(tmp_path);
+  ndpi_free(buf);
+
+  return(rc);
+}
+
+/* ********************************************************************************* */
+
+struct ndpi_ruleset* ndpi_compile_ruleset(struct ndpi_detection_module_struct *ndpi_str) {
+  struct ndpi_ruleset *r;
+  u_int64_t len;
+  u_int8_t *buf = ndpi_ruleset_build(ndpi_str, &len);
+
+  if(buf == NULL)
+    return(NULL);
+
+  if((r = (struct ndpi_ruleset*)ndpi_calloc(1, sizeof(struct ndpi_ruleset))) == NULL) {
+    ndpi_free(buf);
+    return(NULL);
+  }
+
+  r->base = buf, r->len = len, r->num_refs = 1;
+
+  return(r);
+}
+
+/* ********************************************************************************* */
+
+struct ndpi_ruleset* ndpi_load_ruleset(const char *path) {
+  struct ndpi_ruleset *r;
+  const struct ndpi_ruleset_header *header;
+  struct stat st;
+  void *base;
+  u_int i;
+  int fd;
+
+  if((fd = open(path, O_RDONLY)) < 0)
+    return(NULL);
+
+  if((fstat(fd, &st) != 0) || (st.st_size < (off_t)sizeof(struct ndpi_ruleset_header))) {
+    close(fd);
+    return(NULL);
+  }
+
+  base = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+
+  if(base == MAP_FAILED)
+    return(NULL);
+
+  header = (const struct ndpi_ruleset_header*)base;
+
+  if((memcmp(header->magic, NDPI_RULESET_MAGIC, sizeof(header->magic)) != 0)
+     || (header->version != NDPI_RULESET_VERSION)
+     || (header->api_version != NDPI_API_VERSION)
+     || (header->max_supported_protocols != NDPI_MAX_SUPPORTED_PROTOCOLS)
+     || (header->num_sections != NDPI_RULESET_NUM_SECTIONS)
+     || (header->module_size != sizeof(struct ndpi_detection_module_struct))
+     || (header->flow_size != sizeof(struct ndpi_flow_struct))
+     || (header->file_len != (u_int64_t)st.st_size))
+    goto invalid;
+
+  for(i=0; i<NDPI_RULESET_NUM_SECTIONS; i++) {
+    if((header->sections[i].offset & 63)
+       || (header->sections[i].offset > header->file_len)
+       || (header->sections[i].len > header->file_len - header->sections[i].offset))
+      goto invalid;
+  }
+
+  /* Check the images now rather than when a module uses them */
+  for(i=0; i<NDPI_RULESET_NUM_SECTIONS; i++) {
+    AC_AUTOMATA_t *automa;
+
+    if((i == NDPI_RULESET_PROTOCOLS_LPM4) || (i == NDPI_RULESET_CATEGORIES_LPM4)) {
+      if(ndpi_lpm4_image_check((const u_int8_t*)base + header->sections[i].offset,
+			       header->sections[i].len) != 0)
+	goto invalid;
+
+      continue;
+    }
+
+    if(ndpi_ruleset_is_domains_section(i)) {
+      if(ndpi_domain_trie_image_check((const u_int8_t*)base + header->sections[i].offset,
+				      header->sections[i].len) != 0)
+	goto invalid;
+
+      continue;
+    }
+
+    if(ndpi_ruleset_is_lpm6_section(i)) {
+      if(ndpi_lpm6_image_check((const u_int8_t*)base + header->sections[i].offset,
+			       header->sections[i].len) != 0)
+	goto invalid;
+
+      continue;
+    }
+
+    if(i == NDPI_RULESET_CATEGORIES_FILTER) {
+      /* Empty when the ruleset has no filter */
+      if((header->sections[i].len != 0)
+	 && (ndpi_bloom_image_check((const u_int8_t*)base + header->sections[i].offset,
+				    header->sections[i].len) != 0))
+	goto invalid;
+
+      continue;
+    }
+
+    if((automa = ac_automata_init_image(NULL, (const u_int8_t*)base + header->sections[i].offset,
+					header->sections[i].len)) == NULL)
+      goto invalid;
+
+    ac_automata_release(automa, 0);
+  }
+
+  if((r = (struct ndpi_ruleset*)ndpi_calloc(1, sizeof(struct ndpi_ruleset))) == NULL)
+    goto invalid;
+
+  r->base = base, r->len = st.st_size, r->num_refs = 1, r->mapped = 1;
+
+  return(r);
+
+ invalid:
+  munmap(base, st.st_size);
+  return(NULL);
+}
+
+/* ********************************************************************************* */
+
+struct ndpi_ruleset* ndpi_ruleset_get(struct ndpi_ruleset *r) {
+  __sync_fetch_and_add(&r->num_refs, 1);
+
+  return(r);
+}
+
+/* ********************************************************************************* */
+
+void ndpi_release_ruleset(struct ndpi_ruleset *r) {
+  while(r && (__sync_sub_and_fetch(&r->num_refs, 1) == 0)) {
+    struct ndpi_ruleset *next = r->next;
+
+    if(r->mapped)
+      munmap(r->base, r->len);
+    else
+      ndpi_free(r->base);
+
+    ndpi_free(r);
+
+    r = next; /* Drop the reference held by r */
+  }
+}
+
+/* ********************************************************************************* */
+
+int ndpi_publish_ruleset(struct ndpi_ruleset *r, struct ndpi_ruleset *update) {
+  ndpi_ruleset_get(update);
+
+  if(!__sync_bool_compare_and_swap(&r->next, NULL, update)) {
+    /* r has already been replaced */
+    ndpi_release_ruleset(update);
+    return(-1);
+  }
+
+  return(0);
+}
+
+#else
+
+int ndpi_save_ruleset(struct ndpi_detection_module_struct *ndpi_str, const char *path) {
+  NDPI_LOG_ERR(ndpi_str, "Compiled rulesets are not supported on this platform\n");
+  return(-1);
+}
+
+struct ndpi_ruleset* ndpi_compile_ruleset(struct ndpi_detection_module_struct *ndpi_str) { return(NULL); }
+struct ndpi_ruleset* ndpi_load_ruleset(const char *path) { return(NULL); }
+struct ndpi_ruleset* ndpi_ruleset_get(struct ndpi_ruleset *r) { return(r); }
+void ndpi_release_ruleset(struct ndpi_ruleset *r) { ; }
+int ndpi_publish_ruleset(struct ndpi_ruleset *r, struct ndpi_ruleset *update) { return(-1); }
+
+#endif
+
+/* ********************************************************************************* */
+
+const void* ndpi_ruleset_get_section(struct ndpi_ruleset *r, u_int id, size_t *len) {
+  const struct ndpi_ruleset_header *header = (const struct ndpi_ruleset_header*)r->base;
+
+  *len = header->sections[id].len;
+
+  return(&((const u_int8_t*)r->base)[header->sections[id].offset]);
+}
+
+/* ********************************************************************************* */
+
+int ndpi_ruleset_lpm4_match(struct ndpi_ruleset *r, u_int id,
+			    u_int32_t addr /* network byte order */, u_int32_t *value) {
+  size_t len;
+  const void *image = ndpi_ruleset_get_section(r, id, &len);
+
+  return(ndpi_lpm4_image_match(image, addr, value));
+}
+
+/* ********************************************************************************* */
+
+void ndpi_ruleset_lpm4_match_batch(struct ndpi_ruleset *r, u_int id, const u_int32_t *addrs, u_int num,
+				   u_int32_t *values, u_int32_t not_found) {
+  size_t len;
+  const void *image = ndpi_ruleset_get_section(r, id, &len);
+
+  ndpi_lpm4_image_match_batch(image, addrs, num, values, not_found);
+}
+
+/* ********************************************************************************* */
+
+int ndpi_ruleset_domain_match(struct ndpi_ruleset *r, u_int id,
+			      const char *name, u_int name_len, u_int32_t *value) {
+  size_t len;
+  const void *image = ndpi_ruleset_get_section(r, id, &len);
+
+  return(ndpi_domain_trie_image_match(image, len, name, name_len, value));
+}
+
+/* ********************************************************************************* */
+
+int ndpi_ruleset_lpm6_match(struct ndpi_ruleset *r, u_int id,
+			    const struct ndpi_in6_addr *addr, u_int32_t *value) {
+  size_t len;
+  const void *image = ndpi_ruleset_get_section(r, id, &len);
+
+  return(ndpi_lpm6_image_match(image, addr, value));
+}
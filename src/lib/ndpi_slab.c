@@ -0,0 +1,234 @@
+/*
+ * ndpi_slab.c
+ *
+ * Copyright (C) 2020 - ntop.org
+ *
+ * This file is part of nDPI, an open source deep packet inspection
+ * library.
+ *
+ * nDPI is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * nDPI is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with nDPI.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "ndpi_config.h"
+#endif
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <sys/types.h>
+#ifndef WIN32
+#include <sys/mman.h>
+#endif
+#include "ndpi_api.h"
+
+/*
+  Objects are carved out of NDPI_SLAB_CHUNK_SIZE chunks aligned to their
+  size: the chunk (and thus the slab) owning an object is found by masking
+  the object address, so ndpi_slab_free() does not need the slab.
+
+  A slab is not thread safe: use one slab per thread.
+*/
+
+#ifdef WIN32
+#define NDPI_SLAB_THREAD_LOCAL __declspec(thread)
+#else
+#define NDPI_SLAB_THREAD_LOCAL __thread
+#endif
+
+#define NDPI_SLAB_ALIGN(x)     (((x) + 15) & ~((size_t)15))
+
+struct ndpi_slab_chunk {
+  struct ndpi_slab *slab;
+  struct ndpi_slab_chunk *next;
+  u_int8_t huge_page;
+};
+
+static NDPI_SLAB_THREAD_LOCAL struct ndpi_slab *ndpi_thread_flow_slab;
+
+/* ********************************************************************************* */
+
+static struct ndpi_slab_chunk* ndpi_slab_ptr_to_chunk(void *ptr) {
+  return((struct ndpi_slab_chunk*)((uintptr_t)ptr & ~((uintptr_t)NDPI_SLAB_CHUNK_SIZE - 1)));
+}
+
+/* ********************************************************************************* */
+
+static struct ndpi_slab_chunk* ndpi_slab_alloc_chunk(struct ndpi_slab *s) {
+  struct ndpi_slab_chunk *c = NULL;
+  u_int8_t huge_page = 0;
+
+#if defined(MAP_HUGETLB) && defined(MAP_ANONYMOUS)
+  if(s->use_huge_pages) {
+    void *p = mmap(NULL, NDPI_SLAB_CHUNK_SIZE, PROT_READ | PROT_WRITE,
+		   MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+
+    if(p != MAP_FAILED) {
+      if(((uintptr_t)p & (NDPI_SLAB_CHUNK_SIZE - 1)) == 0)
+	c = (struct ndpi_slab_chunk*)p, huge_page = 1;
+      else
+	munmap(p, NDPI_SLAB_CHUNK_SIZE); /* Huge pages larger than a chunk */
+    }
+  }
+#endif
+
+  if(c == NULL) {
+#ifdef WIN32
+    c = (struct ndpi_slab_chunk*)_aligned_malloc(NDPI_SLAB_CHUNK_SIZE, NDPI_SLAB_CHUNK_SIZE);
+#else
+    void *p;
+
+    if(posix_memalign(&p, NDPI_SLAB_CHUNK_SIZE, NDPI_SLAB_CHUNK_SIZE) != 0)
+      return(NULL);
+
+    c = (struct ndpi_slab_chunk*)p;
+
+#ifdef MADV_HUGEPAGE
+    /* No reserved huge pages: ask for transparent ones */
+    if(s->use_huge_pages)
+      madvise(p, NDPI_SLAB_CHUNK_SIZE, MADV_HUGEPAGE);
+#endif
+#endif
+
+    if(c == NULL)
+      return(NULL);
+  }
+
+  c->slab = s, c->huge_page = huge_page;
+  c->next = s->chunks, s->chunks = c;
+  s->num_chunks++;
+  if(huge_page) s->num_huge_page_chunks++;
+
+  s->next_obj  = (u_int8_t*)c + NDPI_SLAB_ALIGN(sizeof(struct ndpi_slab_chunk));
+  s->chunk_end = s->next_obj + (size_t)s->objs_per_chunk * s->obj_size;
+
+  return(c);
+}
+
+/* ********************************************************************************* */
+
+static void ndpi_slab_free_chunk(struct ndpi_slab_chunk *c) {
+#if defined(MAP_HUGETLB) && defined(MAP_ANONYMOUS)
+  if(c->huge_page) {
+    munmap(c, NDPI_SLAB_CHUNK_SIZE);
+    return;
+  }
+#endif
+
+#ifdef WIN32
+  _aligned_free(c);
+#else
+  free(c);
+#endif
+}
+
+/* ********************************************************************************* */
+
+struct ndpi_slab* ndpi_slab_init(u_int32_t obj_size, u_int8_t use_huge_pages) {
+  struct ndpi_slab *s;
+  size_t usable = NDPI_SLAB_CHUNK_SIZE - NDPI_SLAB_ALIGN(sizeof(struct ndpi_slab_chunk));
+
+  if(obj_size < sizeof(void*)) obj_size = sizeof(void*); /* Room for the free list link */
+  obj_size = NDPI_SLAB_ALIGN(obj_size);
+
+  if(obj_size > usable)
+    return(NULL);
+
+  if((s = ndpi_calloc(1, sizeof(struct ndpi_slab))) == NULL)
+    return(NULL);
+
+  s->obj_size = obj_size, s->objs_per_chunk = usable / obj_size;
+  s->use_huge_pages = use_huge_pages ? 1 : 0;
+
+  return(s);
+}
+
+/* ********************************************************************************* */
+
+void* ndpi_slab_alloc(struct ndpi_slab *s) {
+  void *ret;
+
+  if(s->free_list != NULL) {
+    ret = s->free_list;
+    s->free_list = *(void**)ret;
+  } else {
+    if((s->next_obj == s->chunk_end) && (ndpi_slab_alloc_chunk(s) == NULL))
+      return(NULL);
+
+    ret = s->next_obj;
+    s->next_obj += s->obj_size;
+  }
+
+  s->num_allocs++, s->num_in_use++;
+  memset(ret, 0, s->obj_size);
+
+  return(ret);
+}
+
+/* ********************************************************************************* */
+
+void ndpi_slab_free(void *ptr) {
+  struct ndpi_slab *s;
+
+  if(ptr == NULL)
+    return;
+
+  s = ndpi_slab_ptr_to_chunk(ptr)->slab;
+  *(void**)ptr = s->free_list, s->free_list = ptr;
+  s->num_in_use--;
+}
+
+/* ********************************************************************************* */
+
+void ndpi_slab_destroy(struct ndpi_slab *s) {
+  struct ndpi_slab_chunk *c, *next;
+
+  if(s == NULL)
+    return;
+
+  if(ndpi_thread_flow_slab == s)
+    ndpi_thread_flow_slab = NULL;
+
+  for(c = s->chunks; c != NULL; c = next) {
+    next = c->next;
+    ndpi_slab_free_chunk(c);
+  }
+
+  ndpi_free(s);
+}
+
+/* ********************************************************************************* */
+
+void ndpi_slab_set_thread_flow_slab(struct ndpi_slab *s) {
+  ndpi_thread_flow_slab = s;
+}
+
+/* ********************************************************************************* */
+
+void* ndpi_slab_flow_malloc(size_t size) {
+  /* No ndpi_malloc() fallback: ndpi_slab_flow_free() could not tell the objects apart */
+  if((ndpi_thread_flow_slab == NULL) || (size > ndpi_thread_flow_slab->obj_size))
+    return(NULL);
+
+  return(ndpi_slab_alloc(ndpi_thread_flow_slab));
+}
+
+/* ********************************************************************************* */
+
+void ndpi_slab_flow_free(void *ptr) {
+  if(ptr) {
+    ndpi_free_flow_data((struct ndpi_flow_struct*)ptr);
+    ndpi_slab_free(ptr);
+  }
+}
@@ -40,7 +40,7 @@ static void ndpi_int_amqp_add_connection(struct ndpi_detection_module_struct *nd
 }
 
 void ndpi_search_amqp(struct ndpi_detection_module_struct *ndpi_struct, struct ndpi_flow_struct *flow) {
-	struct ndpi_packet_struct *packet = &flow->packet;
+	struct ndpi_packet_struct *packet = &ndpi_struct->packet;
 
 	NDPI_LOG_DBG(ndpi_struct, "search amqp\n");
 
@@ -75,12 +75,16 @@ void ndpi_search_amqp(struct ndpi_detection_module_struct *ndpi_struct, struct n
 
 
 void init_amqp_dissector(struct ndpi_detection_module_struct *ndpi_struct, u_int32_t *id, NDPI_PROTOCOL_BITMASK *detection_bitmask) {
+	static const u_int8_t first_bytes[] = { 0x00, 0x01, 0x02, 0x03 };
+
 	ndpi_set_bitmask_protocol_detection("AMQP", ndpi_struct, detection_bitmask, *id,
 					    NDPI_PROTOCOL_AMQP,
 					    ndpi_search_amqp,
 					    NDPI_SELECTION_BITMASK_PROTOCOL_V4_V6_TCP_WITH_PAYLOAD,
 					    SAVE_DETECTION_BITMASK_AS_UNKNOWN,
 					    ADD_TO_DETECTION_BITMASK);
+	ndpi_set_bitmask_protocol_prefix(ndpi_struct, *id, first_bytes, sizeof(first_bytes),
+					 NO_EXCLUDE_ON_PREFIX_MISMATCH);
 
 	*id += 1;
 }
@@ -38,7 +38,7 @@ static void ndpi_int_applejuice_add_connection(struct ndpi_detection_module_stru
 void ndpi_search_applejuice_tcp(struct ndpi_detection_module_struct *ndpi_struct,
 				struct ndpi_flow_struct *flow)
 {
-	struct ndpi_packet_struct *packet = &flow->packet;
+	struct ndpi_packet_struct *packet = &ndpi_struct->packet;
 
 	NDPI_LOG_DBG(ndpi_struct, "search applejuice\n");
 
@@ -56,12 +56,16 @@ void ndpi_search_applejuice_tcp(struct ndpi_detection_module_struct *ndpi_struct
 
 void init_applejuice_dissector(struct ndpi_detection_module_struct *ndpi_struct, u_int32_t *id, NDPI_PROTOCOL_BITMASK *detection_bitmask)
 {
+  static const u_int8_t first_bytes[] = { 'a' };
+
   ndpi_set_bitmask_protocol_detection("AppleJuice", ndpi_struct, detection_bitmask, *id,
 				      NDPI_PROTOCOL_APPLEJUICE,
 				      ndpi_search_applejuice_tcp,
 				      NDPI_SELECTION_BITMASK_PROTOCOL_V4_V6_TCP_WITH_PAYLOAD_WITHOUT_RETRANSMISSION,
 				      SAVE_DETECTION_BITMASK_AS_UNKNOWN,
 				      ADD_TO_DETECTION_BITMASK);
+  ndpi_set_bitmask_protocol_prefix(ndpi_struct, *id, first_bytes, sizeof(first_bytes),
+				   EXCLUDE_ON_PREFIX_MISMATCH);
 
   *id += 1;
 }
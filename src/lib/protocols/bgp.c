@@ -31,7 +31,7 @@
 /* this detection also works asymmetrically */
 void ndpi_search_bgp(struct ndpi_detection_module_struct *ndpi_struct, struct ndpi_flow_struct *flow)
 {
-  struct ndpi_packet_struct *packet = &flow->packet;
+  struct ndpi_packet_struct *packet = &ndpi_struct->packet;
   u_int16_t bgp_port = htons(179);
 
   NDPI_LOG_DBG(ndpi_struct, "search BGP\n");
@@ -56,12 +56,16 @@ void ndpi_search_bgp(struct ndpi_detection_module_struct *ndpi_struct, struct nd
 
 void init_bgp_dissector(struct ndpi_detection_module_struct *ndpi_struct, u_int32_t *id, NDPI_PROTOCOL_BITMASK *detection_bitmask)
 {
+  static const u_int8_t first_bytes[] = { 0xff };
+
   ndpi_set_bitmask_protocol_detection("BGP", ndpi_struct, detection_bitmask, *id,
 				      NDPI_PROTOCOL_BGP,
 				      ndpi_search_bgp,
 				      NDPI_SELECTION_BITMASK_PROTOCOL_V4_V6_TCP_WITH_PAYLOAD_WITHOUT_RETRANSMISSION,
 				      SAVE_DETECTION_BITMASK_AS_UNKNOWN,
 				      ADD_TO_DETECTION_BITMASK);
+  ndpi_set_bitmask_protocol_prefix(ndpi_struct, *id, first_bytes, sizeof(first_bytes),
+				   EXCLUDE_ON_PREFIX_MISMATCH);
   *id += 1;
 }
 
@@ -64,16 +64,16 @@ static void ndpi_add_connection_as_bittorrent(struct ndpi_detection_module_struc
     const char *bt_hash = NULL; /* 20 bytes long */
 
     if(bt_offset == -1) {
-      const char *bt_magic = ndpi_strnstr((const char *)flow->packet.payload,
-					  "BitTorrent protocol", flow->packet.payload_packet_len);
+      const char *bt_magic = ndpi_strnstr((const char *)ndpi_struct->packet.payload,
+					  "BitTorrent protocol", ndpi_struct->packet.payload_packet_len);
 
       if(bt_magic)
 	bt_hash = &bt_magic[19];
     } else
-      bt_hash = (const char*)&flow->packet.payload[28];
+      bt_hash = (const char*)&ndpi_struct->packet.payload[28];
 
     if(!ndpi_struct->disable_metadata_export) {
-      if(bt_hash) memcpy(flow->protos.bittorrent.hash, bt_hash, 20);
+      if(bt_hash && ndpi_flow_alloc_protos(flow)) memcpy(flow->protos->bittorrent.hash, bt_hash, 20);
     }
   }
 
@@ -83,7 +83,7 @@ static void ndpi_add_connection_as_bittorrent(struct ndpi_detection_module_struc
 static u_int8_t ndpi_int_search_bittorrent_tcp_zero(struct ndpi_detection_module_struct
 						    *ndpi_struct, struct ndpi_flow_struct *flow)
 {
-  struct ndpi_packet_struct *packet = &flow->packet;
+  struct ndpi_packet_struct *packet = &ndpi_struct->packet;
   u_int16_t a = 0;
 
   if(packet->payload_packet_len == 1 && packet->payload[0] == 0x13) {
@@ -357,7 +357,7 @@ static u_int8_t ndpi_int_search_bittorrent_tcp_zero(struct ndpi_detection_module
 /*Search for BitTorrent commands*/
 static void ndpi_int_search_bittorrent_tcp(struct ndpi_detection_module_struct *ndpi_struct, struct ndpi_flow_struct *flow)
 {
-  struct ndpi_packet_struct *packet = &flow->packet;
+  struct ndpi_packet_struct *packet = &ndpi_struct->packet;
 
   if(packet->payload_packet_len == 0) {
     return;
@@ -378,7 +378,7 @@ static void ndpi_int_search_bittorrent_tcp(struct ndpi_detection_module_struct *
 
 void ndpi_search_bittorrent(struct ndpi_detection_module_struct *ndpi_struct, struct ndpi_flow_struct *flow)
 {
-  struct ndpi_packet_struct *packet = &flow->packet;
+  struct ndpi_packet_struct *packet = &ndpi_struct->packet;
   char *bt_proto = NULL;
 
   /* This is broadcast */
@@ -473,8 +473,8 @@ void ndpi_search_bittorrent(struct ndpi_detection_module_struct *ndpi_struct, st
 	       || (bt_proto = ndpi_strnstr((const char *)packet->payload, "BitTorrent protocol", packet->payload_packet_len))
 	       ) {
 	    bittorrent_found:
-	      if(bt_proto && (packet->payload_packet_len > 47))
-		memcpy(flow->protos.bittorrent.hash, &bt_proto[27], 20);
+	      if(bt_proto && (packet->payload_packet_len > 47) && ndpi_flow_alloc_protos(flow))
+		memcpy(flow->protos->bittorrent.hash, &bt_proto[27], 20);
 
 	      NDPI_LOG_INFO(ndpi_struct, "found BT: plain\n");
 	      ndpi_add_connection_as_bittorrent(ndpi_struct, flow, -1, 0,
@@ -31,7 +31,7 @@ static void ndpi_int_corba_add_connection(struct ndpi_detection_module_struct
 }
 void ndpi_search_corba(struct ndpi_detection_module_struct *ndpi_struct, struct ndpi_flow_struct *flow)
 {
-  struct ndpi_packet_struct *packet = &flow->packet;
+  struct ndpi_packet_struct *packet = &ndpi_struct->packet;
 
   NDPI_LOG_DBG(ndpi_struct, "search for CORBA\n");
   if(packet->tcp != NULL) {
@@ -50,11 +50,15 @@ void ndpi_search_corba(struct ndpi_detection_module_struct *ndpi_struct, struct
 
 void init_corba_dissector(struct ndpi_detection_module_struct *ndpi_struct, u_int32_t *id, NDPI_PROTOCOL_BITMASK *detection_bitmask)
 {
+  static const u_int8_t first_bytes[] = { 'G' };
+
   ndpi_set_bitmask_protocol_detection("Corba", ndpi_struct, detection_bitmask, *id,
 				      NDPI_PROTOCOL_CORBA,
 				      ndpi_search_corba,
 				      NDPI_SELECTION_BITMASK_PROTOCOL_V4_V6_TCP_WITH_PAYLOAD_WITHOUT_RETRANSMISSION,
 				      SAVE_DETECTION_BITMASK_AS_UNKNOWN,
 				      ADD_TO_DETECTION_BITMASK);
+  ndpi_set_bitmask_protocol_prefix(ndpi_struct, *id, first_bytes, sizeof(first_bytes),
+				   NO_EXCLUDE_ON_PREFIX_MISMATCH);
   *id += 1;
 }
@@ -60,7 +60,7 @@ static void ndpi_int_dhcp_add_connection(struct ndpi_detection_module_struct *nd
 
 void ndpi_search_dhcp_udp(struct ndpi_detection_module_struct *ndpi_struct, struct ndpi_flow_struct *flow)
 {
-  struct ndpi_packet_struct *packet = &flow->packet;
+  struct ndpi_packet_struct *packet = &ndpi_struct->packet;
 
   NDPI_LOG_DBG(ndpi_struct, "search DHCP\n");
 
@@ -100,31 +100,31 @@ void ndpi_search_dhcp_udp(struct ndpi_detection_module_struct *ndpi_struct, stru
 
 	    if(msg_type <= 8) foundValidMsgType = 1;
 	  } else if(id == 55 /* Parameter Request List / Fingerprint */) {
-	    if(!ndpi_struct->disable_metadata_export) {
+	    if((!ndpi_struct->disable_metadata_export) && ndpi_flow_alloc_protos(flow)) {
 	      u_int idx, offset = 0;
 	      
-	      for(idx = 0; idx < len && offset < sizeof(flow->protos.dhcp.fingerprint) - 2; idx++) {
+	      for(idx = 0; idx < len && offset < sizeof(flow->protos->dhcp.fingerprint) - 2; idx++) {
 #if 1
-		offset += snprintf((char*)&flow->protos.dhcp.fingerprint[offset],
-				   sizeof(flow->protos.dhcp.fingerprint) - offset,
+		offset += snprintf((char*)&flow->protos->dhcp.fingerprint[offset],
+				   sizeof(flow->protos->dhcp.fingerprint) - offset,
 				   "%s%u", (idx > 0) ? "," : "", dhcp->options[i+2+idx] & 0xFF);
 #else
-		offset += snprintf((char*)&flow->protos.dhcp.fingerprint[offset],
-				   sizeof(flow->protos.dhcp.fingerprint) - offset,
+		offset += snprintf((char*)&flow->protos->dhcp.fingerprint[offset],
+				   sizeof(flow->protos->dhcp.fingerprint) - offset,
 				   "%02X", dhcp->options[i+2+idx] & 0xFF);
 #endif
 	      }
 	      
-	      flow->protos.dhcp.fingerprint[sizeof(flow->protos.dhcp.fingerprint) - 1] = '\0';
+	      flow->protos->dhcp.fingerprint[sizeof(flow->protos->dhcp.fingerprint) - 1] = '\0';
 	    }
 	  } else if(id == 60 /* Class Identifier */) {
-	    if(!ndpi_struct->disable_metadata_export) {
+	    if((!ndpi_struct->disable_metadata_export) && ndpi_flow_alloc_protos(flow)) {
 	      char *name = (char*)&dhcp->options[i+2];
 	      int j = 0;
 	      
-	      j = ndpi_min(len, sizeof(flow->protos.dhcp.class_ident)-1);
-	      strncpy((char*)flow->protos.dhcp.class_ident, name, j);
-	      flow->protos.dhcp.class_ident[j] = '\0';
+	      j = ndpi_min(len, sizeof(flow->protos->dhcp.class_ident)-1);
+	      strncpy((char*)flow->protos->dhcp.class_ident, name, j);
+	      flow->protos->dhcp.class_ident[j] = '\0';
 	    }
 	  } else if(id == 12 /* Host Name */) {
 	    if(!ndpi_struct->disable_metadata_export) {
@@ -30,6 +30,15 @@
 
 #define FLAGS_MASK 0x8000
 
+/* Max number of A/AAAA answers of a response added to the DNS cache */
+#define DNS_CACHE_MAX_ANSWERS 8
+
+struct dns_answer_addr {
+  ndpi_ip_addr_t addr;
+  u_int32_t ttl;
+  u_int8_t is_ipv6;
+};
+
 // #define DNS_DEBUG 1
 
 /* *********************************************** */
@@ -44,19 +53,35 @@ static u_int16_t get16(int *i, const u_int8_t *payload) {
 
 /* *********************************************** */
 
+static u_int32_t get32(int *i, const u_int8_t *payload) {
+  u_int32_t v;
+
+  memcpy(&v, &payload[*i], sizeof(v));
+  (*i) += 4;
+
+  return(ntohl(v));
+}
+
+/* *********************************************** */
+
 static u_int getNameLength(u_int i, const u_int8_t *payload, u_int payloadLen) {
-  if(payload[i] == 0x00)
+  if(i >= payloadLen)
+    return(0);
+  else if(payload[i] == 0x00)
     return(1);
-  else if(payload[i] == 0xC0)
-    return(2);
+  else if((payload[i] & 0xC0) == 0xC0) /* Compression pointer */
+    return(((i + 2) <= payloadLen) ? 2 : 0);
   else {
     u_int8_t len = payload[i];
     u_int8_t off = len + 1;
+    u_int next;
 
-    if(off == 0) /* Bad packet */
+    if((off == 0) /* Bad packet */
+       || ((i + off) >= payloadLen) /* The label runs past the packet */
+       || ((next = getNameLength(i+off, payload, payloadLen)) == 0))
       return(0);
     else
-      return(off + getNameLength(i+off, payload, payloadLen));
+      return(off + next);
   }
 }
 /*
@@ -78,10 +103,11 @@ static uint32_t dns_validchar[8] = {
 static int search_valid_dns(struct ndpi_detection_module_struct *ndpi_struct,
 			    struct ndpi_flow_struct *flow,
 			    struct ndpi_dns_packet_header *dns_header,
-			    int payload_offset, u_int8_t *is_query) {
+			    int payload_offset, u_int8_t *is_query,
+			    struct dns_answer_addr *addrs, u_int8_t *num_addrs) {
   int x = payload_offset;
 
-  memcpy(dns_header, (struct ndpi_dns_packet_header*)&flow->packet.payload[x],
+  memcpy(dns_header, (struct ndpi_dns_packet_header*)&ndpi_struct->packet.payload[x],
 	 sizeof(struct ndpi_dns_packet_header));
   dns_header->tr_id = ntohs(dns_header->tr_id);
   dns_header->flags = ntohs(dns_header->flags);
@@ -107,13 +133,13 @@ static int search_valid_dns(struct ndpi_detection_module_struct *ndpi_struct,
        && (((dns_header->flags & 0x2800) == 0x2800 /* Dynamic DNS Update */)
 	   || ((dns_header->num_answers == 0) && (dns_header->authority_rrs == 0)))) {
       /* This is a good query */
-      while(x < flow->packet.payload_packet_len) {
-        if(flow->packet.payload[x] == '\0') {
+      while(x < ndpi_struct->packet.payload_packet_len) {
+        if(ndpi_struct->packet.payload[x] == '\0') {
           x++;
-          flow->protos.dns.query_type = get16(&x, flow->packet.payload);
+          flow->protos->dns.query_type = get16(&x, ndpi_struct->packet.payload);
 #ifdef DNS_DEBUG
-          NDPI_LOG_DBG2(ndpi_struct, "query_type=%2d\n", flow->protos.dns.query_type);
-	  printf("[DNS] query_type=%d\n", flow->protos.dns.query_type);
+          NDPI_LOG_DBG2(ndpi_struct, "query_type=%2d\n", flow->protos->dns.query_type);
+	  printf("[DNS] query_type=%d\n", flow->protos->dns.query_type);
 #endif
 	  break;
 	} else
@@ -123,7 +149,7 @@ static int search_valid_dns(struct ndpi_detection_module_struct *ndpi_struct,
       return(1 /* invalid */);
   } else {
     /* DNS Reply */
-    flow->protos.dns.reply_code = dns_header->flags & 0x0F;
+    flow->protos->dns.reply_code = dns_header->flags & 0x0F;
 
     if((dns_header->num_queries > 0) && (dns_header->num_queries <= NDPI_MAX_DNS_REQUESTS) /* Don't assume that num_queries must be zero */
        && (((dns_header->num_answers > 0) && (dns_header->num_answers <= NDPI_MAX_DNS_REQUESTS))
@@ -136,9 +162,10 @@ static int search_valid_dns(struct ndpi_detection_module_struct *ndpi_struct,
       /* if(ndpi_struct->dns_dont_dissect_response == 0) */ {
 	x++;
 
-	if(flow->packet.payload[x] != '\0') {
-	  while((x < flow->packet.payload_packet_len)
-		&& (flow->packet.payload[x] != '\0')) {
+	if((x < ndpi_struct->packet.payload_packet_len)
+	   && (ndpi_struct->packet.payload[x] != '\0')) {
+	  while((x < ndpi_struct->packet.payload_packet_len)
+		&& (ndpi_struct->packet.payload[x] != '\0')) {
 	    x++;
 	  }
 
@@ -153,35 +180,53 @@ static int search_valid_dns(struct ndpi_detection_module_struct *ndpi_struct,
 
 	  for(num = 0; num < dns_header->num_answers; num++) {
 	    u_int16_t data_len;
+	    u_int32_t ttl;
 
-	    if((x+6) >= flow->packet.payload_packet_len) {
+	    if((x+6) >= ndpi_struct->packet.payload_packet_len) {
 	      break;
 	    }
 
-	    if((data_len = getNameLength(x, flow->packet.payload, flow->packet.payload_packet_len)) == 0) {
+	    if((data_len = getNameLength(x, ndpi_struct->packet.payload, ndpi_struct->packet.payload_packet_len)) == 0) {
 	      break;
 	    } else
 	      x += data_len;
 
-	    rsp_type = get16(&x, flow->packet.payload);
-	    flow->protos.dns.rsp_type = rsp_type;
+	    /* type, class, TTL and rdlength */
+	    if((x + 10) > ndpi_struct->packet.payload_packet_len)
+	      break;
+
+	    rsp_type = get16(&x, ndpi_struct->packet.payload);
+	    if(num == 0) flow->protos->dns.rsp_type = rsp_type;
 
 	    /* here x points to the response "class" field */
-	    if((x+12) <= flow->packet.payload_packet_len) {
-	      x += 6;
-	      data_len = get16(&x, flow->packet.payload);
+	    x += 2;
+	    ttl = get32(&x, ndpi_struct->packet.payload);
+	    data_len = get16(&x, ndpi_struct->packet.payload);
+
+	    if((x + data_len) > ndpi_struct->packet.payload_packet_len)
+	      break; /* Truncated rdata */
 
-	      if(((x + data_len) <= flow->packet.payload_packet_len)
-		 && (((rsp_type == 0x1) && (data_len == 4)) /* A */
+	    if(((rsp_type == 0x1) && (data_len == 4)) /* A */
 #ifdef NDPI_DETECTION_SUPPORT_IPV6
-		     || ((rsp_type == 0x1c) && (data_len == 16)) /* AAAA */
+	       || ((rsp_type == 0x1c) && (data_len == 16)) /* AAAA */
 #endif
-		     )) {
-		memcpy(&flow->protos.dns.rsp_addr, flow->packet.payload + x, data_len);
+	       ) {
+	      if(num == 0)
+		memcpy(&flow->protos->dns.rsp_addr, ndpi_struct->packet.payload + x, data_len);
+
+	      if(*num_addrs < DNS_CACHE_MAX_ANSWERS) {
+		memset(&addrs[*num_addrs].addr, 0, sizeof(addrs[*num_addrs].addr));
+		memcpy(&addrs[*num_addrs].addr, ndpi_struct->packet.payload + x, data_len);
+		addrs[*num_addrs].ttl = ttl, addrs[*num_addrs].is_ipv6 = (data_len == 16);
+		(*num_addrs)++;
 	      }
 	    }
 
-	    break;
+	    x += data_len;
+
+	    /* The other answers only feed the DNS cache */
+	    if(ndpi_struct->dns_cache_num_entries == 0)
+	      break;
 	  }
 	}
       }
@@ -199,7 +244,7 @@ static int search_dns_again(struct ndpi_detection_module_struct *ndpi_struct, st
   /* possibly dissect the DNS reply */
   ndpi_search_dns(ndpi_struct, flow);
 
-  if(flow->protos.dns.num_answers > 0) {
+  if(ndpi_flow_get_protos(flow)->dns.num_answers > 0) {
     /* stop extra processing */
     return(0);
   }
@@ -217,13 +262,13 @@ void ndpi_search_dns(struct ndpi_detection_module_struct *ndpi_struct, struct nd
 
   NDPI_LOG_DBG(ndpi_struct, "search DNS\n");
 
-  if(flow->packet.udp != NULL) {
-    s_port = ntohs(flow->packet.udp->source);
-    d_port = ntohs(flow->packet.udp->dest);
+  if(ndpi_struct->packet.udp != NULL) {
+    s_port = ntohs(ndpi_struct->packet.udp->source);
+    d_port = ntohs(ndpi_struct->packet.udp->dest);
     payload_offset = 0;
-  } else if(flow->packet.tcp != NULL) /* pkt size > 512 bytes */ {
-    s_port = ntohs(flow->packet.tcp->source);
-    d_port = ntohs(flow->packet.tcp->dest);
+  } else if(ndpi_struct->packet.tcp != NULL) /* pkt size > 512 bytes */ {
+    s_port = ntohs(ndpi_struct->packet.tcp->source);
+    d_port = ntohs(ndpi_struct->packet.tcp->dest);
     payload_offset = 2;
   } else {
     NDPI_EXCLUDE_PROTO(ndpi_struct, flow);
@@ -231,11 +276,19 @@ void ndpi_search_dns(struct ndpi_detection_module_struct *ndpi_struct, struct nd
   }
 
   if((s_port == 53 || d_port == 53 || d_port == 5355)
-     && (flow->packet.payload_packet_len > sizeof(struct ndpi_dns_packet_header)+payload_offset)) {
+     && (ndpi_struct->packet.payload_packet_len > sizeof(struct ndpi_dns_packet_header)+payload_offset)) {
     struct ndpi_dns_packet_header dns_header;
     int j = 0, max_len, off;
-    int invalid = search_valid_dns(ndpi_struct, flow, &dns_header, payload_offset, &is_query);
+    int invalid;
     ndpi_protocol ret;
+    struct dns_answer_addr addrs[DNS_CACHE_MAX_ANSWERS];
+    u_int8_t num_addrs = 0;
+
+    if(ndpi_flow_alloc_protos(flow) == NULL)
+      return;
+
+    invalid = search_valid_dns(ndpi_struct, flow, &dns_header, payload_offset, &is_query,
+			       addrs, &num_addrs);
 
     ret.master_protocol   = NDPI_PROTOCOL_UNKNOWN;
     ret.app_protocol      = (d_port == 5355) ? NDPI_PROTOCOL_LLMNR : NDPI_PROTOCOL_DNS;
@@ -249,11 +302,11 @@ void ndpi_search_dns(struct ndpi_detection_module_struct *ndpi_struct, struct nd
     max_len = sizeof(flow->host_server_name)-1;
     off = sizeof(struct ndpi_dns_packet_header) + payload_offset;
 
-    while(j < max_len && off < flow->packet.payload_packet_len && flow->packet.payload[off] != '\0') {
-      uint8_t c, cl = flow->packet.payload[off++];
+    while(j < max_len && off < ndpi_struct->packet.payload_packet_len && ndpi_struct->packet.payload[off] != '\0') {
+      uint8_t c, cl = ndpi_struct->packet.payload[off++];
 
       if( (cl & 0xc0) != 0 || // we not support compressed names in query
-	  off + cl  >= flow->packet.payload_packet_len) {
+	  off + cl  >= ndpi_struct->packet.payload_packet_len) {
 	j = 0;
 	break;
       }
@@ -261,7 +314,7 @@ void ndpi_search_dns(struct ndpi_detection_module_struct *ndpi_struct, struct nd
       if(j && j < max_len) flow->host_server_name[j++] = '.';
 
       while(j < max_len && cl != 0) {
-	c = flow->packet.payload[off++];
+	c = ndpi_struct->packet.payload[off++];
 	flow->host_server_name[j++] = (dns_validchar[c >> 5] & (1 << (c & 0x1f))) ? c : '_';
 	cl--;
       }
@@ -284,10 +337,27 @@ void ndpi_search_dns(struct ndpi_detection_module_struct *ndpi_struct, struct nd
 	ret.master_protocol = (d_port == 5355) ? NDPI_PROTOCOL_LLMNR : NDPI_PROTOCOL_DNS;
       else
 	ret.master_protocol = NDPI_PROTOCOL_DNS;
+
+      if((!is_query) && (num_addrs > 0) && (flow->protos->dns.reply_code == 0)
+	 && (ndpi_struct->dns_cache_num_entries > 0)) {
+	/* The resolved addresses get the protocol and the custom category of the name */
+	u_int16_t cached_protocol = (ret.app_protocol != NDPI_PROTOCOL_DNS) ? ret.app_protocol : NDPI_PROTOCOL_UNKNOWN;
+	ndpi_protocol_category_t cached_category = NDPI_PROTOCOL_CATEGORY_UNSPECIFIED;
+	unsigned long id;
+	u_int8_t i;
+
+	if(ndpi_struct->custom_categories.categories_loaded
+	   && (ndpi_match_custom_category(ndpi_struct, (char *)flow->host_server_name, j, &id) == 0))
+	  cached_category = (ndpi_protocol_category_t)id;
+
+	for(i = 0; i < num_addrs; i++)
+	  ndpi_dns_cache_add(ndpi_struct, &addrs[i].addr, addrs[i].is_ipv6,
+			     cached_protocol, cached_category, addrs[i].ttl);
+      }
     }
 
     /* Report if this is a DNS query or reply */
-    flow->protos.dns.is_query = is_query;
+    flow->protos->dns.is_query = is_query;
     
     if(is_query && (ndpi_struct->dns_dont_dissect_response == 0) && (flow->check_extra_packets == 0)) {
       /* In this case we say that the protocol has been detected just to let apps carry on with their activities */
@@ -302,17 +372,17 @@ void ndpi_search_dns(struct ndpi_detection_module_struct *ndpi_struct, struct nd
       return; /* The response will set the verdict */
     }
 
-    flow->protos.dns.num_queries = (u_int8_t)dns_header.num_queries,
-      flow->protos.dns.num_answers = (u_int8_t) (dns_header.num_answers + dns_header.authority_rrs + dns_header.additional_rrs);
+    flow->protos->dns.num_queries = (u_int8_t)dns_header.num_queries,
+      flow->protos->dns.num_answers = (u_int8_t) (dns_header.num_answers + dns_header.authority_rrs + dns_header.additional_rrs);
 
 #ifdef DNS_DEBUG
     NDPI_LOG_DBG2(ndpi_struct, "[num_queries=%d][num_answers=%d][reply_code=%u][rsp_type=%u][host_server_name=%s]\n",
-		  flow->protos.dns.num_queries, flow->protos.dns.num_answers,
-		  flow->protos.dns.reply_code, flow->protos.dns.rsp_type, flow->host_server_name
+		  flow->protos->dns.num_queries, flow->protos->dns.num_answers,
+		  flow->protos->dns.reply_code, flow->protos->dns.rsp_type, flow->host_server_name
 		  );
 #endif
 
-    if(flow->packet.detected_protocol_stack[0] == NDPI_PROTOCOL_UNKNOWN) {
+    if(ndpi_struct->packet.detected_protocol_stack[0] == NDPI_PROTOCOL_UNKNOWN) {
       /**
 	 Do not set the protocol with DNS if ndpi_match_host_subprotocol() has
 	 matched a subprotocol
@@ -320,8 +390,8 @@ void ndpi_search_dns(struct ndpi_detection_module_struct *ndpi_struct, struct nd
       NDPI_LOG_INFO(ndpi_struct, "found DNS\n");
       ndpi_set_detected_protocol(ndpi_struct, flow, ret.app_protocol, ret.master_protocol);
     } else {
-      if((flow->packet.detected_protocol_stack[0] == NDPI_PROTOCOL_DNS)
-	 || (flow->packet.detected_protocol_stack[1] == NDPI_PROTOCOL_DNS))
+      if((ndpi_struct->packet.detected_protocol_stack[0] == NDPI_PROTOCOL_DNS)
+	 || (ndpi_struct->packet.detected_protocol_stack[1] == NDPI_PROTOCOL_DNS))
 	;
       else
 	NDPI_EXCLUDE_PROTO(ndpi_struct, flow);
@@ -30,7 +30,7 @@
 
 void ndpi_search_fix(struct ndpi_detection_module_struct *ndpi_struct, struct ndpi_flow_struct *flow)
 {
-  struct ndpi_packet_struct *packet = &flow->packet;
+  struct ndpi_packet_struct *packet = &ndpi_struct->packet;
 
   NDPI_LOG_DBG(ndpi_struct, "search FIX\n");
   if(packet->tcp) {
@@ -65,11 +65,15 @@ void ndpi_search_fix(struct ndpi_detection_module_struct *ndpi_struct, struct nd
 
 void init_fix_dissector(struct ndpi_detection_module_struct *ndpi_struct, u_int32_t *id, NDPI_PROTOCOL_BITMASK *detection_bitmask)
 {
+  static const u_int8_t first_bytes[] = { '8' };
+
   ndpi_set_bitmask_protocol_detection("FIX", ndpi_struct, detection_bitmask, *id,
 				      NDPI_PROTOCOL_FIX,
 				      ndpi_search_fix,
 				      NDPI_SELECTION_BITMASK_PROTOCOL_V4_V6_TCP_WITH_PAYLOAD,
 				      SAVE_DETECTION_BITMASK_AS_UNKNOWN,
 				      ADD_TO_DETECTION_BITMASK);
+  ndpi_set_bitmask_protocol_prefix(ndpi_struct, *id, first_bytes, sizeof(first_bytes),
+				   EXCLUDE_ON_PREFIX_MISMATCH);
   *id += 1;
 }
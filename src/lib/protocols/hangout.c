@@ -27,7 +27,7 @@
 #include "ndpi_api.h"
 
 /* stun.c */
-extern u_int32_t get_stun_lru_key(struct ndpi_flow_struct *flow);
+extern u_int64_t get_stun_lru_key(struct ndpi_packet_struct *packet, u_int8_t rev);
 
 /* https://support.google.com/a/answer/1279090?hl=en */
 #define HANGOUT_UDP_LOW_PORT  19302
@@ -63,7 +63,7 @@ static u_int8_t google_ptree_match(struct ndpi_detection_module_struct *ndpi_str
 
 static u_int8_t is_google_flow(struct ndpi_detection_module_struct *ndpi_struct,
 			       struct ndpi_flow_struct *flow) {
-  struct ndpi_packet_struct *packet = &flow->packet;
+  struct ndpi_packet_struct *packet = &ndpi_struct->packet;
   
   if(packet->iph) {
     struct in_addr saddr, daddr;
@@ -83,7 +83,7 @@ static u_int8_t is_google_flow(struct ndpi_detection_module_struct *ndpi_struct,
 
 void ndpi_search_hangout(struct ndpi_detection_module_struct *ndpi_struct,
 			 struct ndpi_flow_struct *flow) {
-  struct ndpi_packet_struct * packet = &flow->packet;
+  struct ndpi_packet_struct * packet = &ndpi_struct->packet;
 
   NDPI_LOG_DBG(ndpi_struct, "search Hangout\n");
 
@@ -98,16 +98,16 @@ void ndpi_search_hangout(struct ndpi_detection_module_struct *ndpi_struct,
 
       /* Hangout is over STUN hence the LRU cache is shared */
       if(ndpi_struct->stun_cache == NULL)
-	ndpi_struct->stun_cache = ndpi_lru_cache_init(1024);
+	ndpi_struct->stun_cache = ndpi_lru_cache_init(ndpi_struct->stun_cache_num_entries, ndpi_struct->stun_cache_ttl);
 
-      if(ndpi_struct->stun_cache && flow->packet.iph && flow->packet.udp) {
-	u_int32_t key = get_stun_lru_key(flow);
+      if(ndpi_struct->stun_cache && ndpi_struct->packet.iph && ndpi_struct->packet.udp) {
+	u_int64_t key = get_stun_lru_key(packet, 0);
 	
 #ifdef DEBUG_LRU
-	printf("[LRU] ADDING %u / %u.%u\n", key, NDPI_PROTOCOL_STUN, NDPI_PROTOCOL_HANGOUT_DUO);
+	printf("[LRU] ADDING %llu / %u.%u\n", (unsigned long long)key, NDPI_PROTOCOL_STUN, NDPI_PROTOCOL_HANGOUT_DUO);
 #endif
 
-	ndpi_lru_add_to_cache(ndpi_struct->stun_cache, key, NDPI_PROTOCOL_HANGOUT_DUO);
+	ndpi_lru_add_to_cache(ndpi_struct->stun_cache, key, NDPI_PROTOCOL_HANGOUT_DUO, packet->tick_timestamp);
       }
       
       ndpi_set_detected_protocol(ndpi_struct, flow, NDPI_PROTOCOL_HANGOUT_DUO,
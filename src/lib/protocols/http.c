@@ -52,13 +52,13 @@ static void ndpi_int_http_add_connection(struct ndpi_detection_module_struct *nd
       ndpi_set_detected_protocol(ndpi_struct, flow, flow->http_upper_protocol, flow->http_lower_protocol);
     else {
       flow->detected_protocol_stack[0] = NDPI_PROTOCOL_UNKNOWN, flow->detected_protocol_stack[1] = NDPI_PROTOCOL_UNKNOWN;
-      flow->packet.detected_protocol_stack[0] = NDPI_PROTOCOL_UNKNOWN, flow->packet.detected_protocol_stack[1] = NDPI_PROTOCOL_UNKNOWN;
+      ndpi_struct->packet.detected_protocol_stack[0] = NDPI_PROTOCOL_UNKNOWN, ndpi_struct->packet.detected_protocol_stack[1] = NDPI_PROTOCOL_UNKNOWN;
     }
   } else {
     if((!ndpi_struct->http_dont_dissect_response) && (flow->http.response_status_code == 0)) {
       flow->http_upper_protocol = flow->detected_protocol_stack[0], flow->http_lower_protocol = flow->detected_protocol_stack[1];
       flow->detected_protocol_stack[0] = NDPI_PROTOCOL_UNKNOWN, flow->detected_protocol_stack[1] = NDPI_PROTOCOL_UNKNOWN;
-      flow->packet.detected_protocol_stack[0] = NDPI_PROTOCOL_UNKNOWN, flow->packet.detected_protocol_stack[1] = NDPI_PROTOCOL_UNKNOWN;
+      ndpi_struct->packet.detected_protocol_stack[0] = NDPI_PROTOCOL_UNKNOWN, ndpi_struct->packet.detected_protocol_stack[1] = NDPI_PROTOCOL_UNKNOWN;
     }
   }
 
@@ -68,7 +68,7 @@ static void ndpi_int_http_add_connection(struct ndpi_detection_module_struct *nd
 static void rtsp_parse_packet_acceptline(struct ndpi_detection_module_struct
 					 *ndpi_struct, struct ndpi_flow_struct *flow)
 {
-  struct ndpi_packet_struct *packet = &flow->packet;
+  struct ndpi_packet_struct *packet = &ndpi_struct->packet;
 
   if(packet->accept_line.len >= 28 && memcmp(packet->accept_line.ptr, "application/x-rtsp-tunnelled", 28) == 0) {
     NDPI_LOG_INFO(ndpi_struct, "found RTSP accept line\n");
@@ -91,8 +91,8 @@ static void setHttpUserAgent(struct ndpi_detection_module_struct *ndpi_struct,
    * https://github.com/ua-parser/uap-core/blob/master/regexes.yaml */
 
   //printf("==> %s\n", ua);
-  if(!ndpi_struct->disable_metadata_export) {
-    snprintf((char*)flow->protos.http.detected_os, sizeof(flow->protos.http.detected_os), "%s", ua);
+  if((!ndpi_struct->disable_metadata_export) && ndpi_flow_alloc_protos(flow)) {
+    snprintf((char*)flow->protos->http.detected_os, sizeof(flow->protos->http.detected_os), "%s", ua);
   }
 }
 
@@ -122,7 +122,7 @@ static void parseHttpSubprotocol(struct ndpi_detection_module_struct *ndpi_struc
 static void check_content_type_and_change_protocol(struct ndpi_detection_module_struct *ndpi_struct,
 						   struct ndpi_flow_struct *flow) {
 
-  struct ndpi_packet_struct *packet = &flow->packet;
+  struct ndpi_packet_struct *packet = &ndpi_struct->packet;
 
   if((!ndpi_struct->http_dont_dissect_response) && flow->http_detected && (flow->http.response_status_code != 0)) {
     ndpi_set_detected_protocol(ndpi_struct, flow, flow->http_upper_protocol, flow->http_lower_protocol);
@@ -172,16 +172,16 @@ static void check_content_type_and_change_protocol(struct ndpi_detection_module_
 	flow->http.url[len-1] = '\0';
       }
 
-      if(flow->packet.http_method.len < 3)
+      if(ndpi_struct->packet.http_method.len < 3)
         flow->http.method = NDPI_HTTP_METHOD_UNKNOWN;
       else {
-        switch(flow->packet.http_method.ptr[0]) {
+        switch(ndpi_struct->packet.http_method.ptr[0]) {
         case 'O':  flow->http.method = NDPI_HTTP_METHOD_OPTIONS; break;
         case 'G':  flow->http.method = NDPI_HTTP_METHOD_GET; break;
         case 'H':  flow->http.method = NDPI_HTTP_METHOD_HEAD; break;
 
         case 'P':
-          switch(flow->packet.http_method.ptr[1]) {
+          switch(ndpi_struct->packet.http_method.ptr[1]) {
           case 'A': flow->http.method = NDPI_HTTP_METHOD_PATCH; break;
           case 'O': flow->http.method = NDPI_HTTP_METHOD_POST; break;
           case 'U': flow->http.method = NDPI_HTTP_METHOD_PUT; break;
@@ -307,10 +307,10 @@ static void check_content_type_and_change_protocol(struct ndpi_detection_module_
     flow->server_id = flow->dst;
 
     if(packet->forwarded_line.ptr) {
-      len = ndpi_min(packet->forwarded_line.len, sizeof(flow->protos.http.nat_ip)-1);
-      if(!ndpi_struct->disable_metadata_export) {
-	strncpy((char*)flow->protos.http.nat_ip, (char*)packet->forwarded_line.ptr, len);
-	flow->protos.http.nat_ip[len] = '\0';
+      len = ndpi_min(packet->forwarded_line.len, sizeof(flow->protos->http.nat_ip)-1);
+      if((!ndpi_struct->disable_metadata_export) && ndpi_flow_alloc_protos(flow)) {
+	strncpy((char*)flow->protos->http.nat_ip, (char*)packet->forwarded_line.ptr, len);
+	flow->protos->http.nat_ip[len] = '\0';
       }
     }
 
@@ -425,7 +425,7 @@ static const char *http_fs = "CDGHOPR";
 
 static u_int16_t http_request_url_offset(struct ndpi_detection_module_struct *ndpi_struct, struct ndpi_flow_struct *flow)
 {
-  struct ndpi_packet_struct *packet = &flow->packet;
+  struct ndpi_packet_struct *packet = &ndpi_struct->packet;
   int i;
 
   NDPI_LOG_DBG2(ndpi_struct, "====>>>> HTTP: %c%c%c%c [len: %u]\n",
@@ -457,7 +457,7 @@ static void http_bitmask_exclude_other(struct ndpi_flow_struct *flow)
 
 static void ndpi_check_http_tcp(struct ndpi_detection_module_struct *ndpi_struct,
 				struct ndpi_flow_struct *flow) {
-  struct ndpi_packet_struct *packet = &flow->packet;
+  struct ndpi_packet_struct *packet = &ndpi_struct->packet;
   u_int16_t filename_start; /* the filename in the request method line, e.g., "GET filename_start..."*/
 
   packet->packet_lines_parsed_complete = 0;
@@ -531,13 +531,13 @@ static void ndpi_check_http_tcp(struct ndpi_detection_module_struct *ndpi_struct
         ndpi_set_detected_protocol(ndpi_struct, flow, NDPI_PROTOCOL_OOKLA, NDPI_PROTOCOL_UNKNOWN);
 
 	if(ndpi_struct->ookla_cache == NULL)
-	  ndpi_struct->ookla_cache = ndpi_lru_cache_init(1024);
+	  ndpi_struct->ookla_cache = ndpi_lru_cache_init(ndpi_struct->ookla_cache_num_entries, ndpi_struct->ookla_cache_ttl);
 
 	if(packet->iph != NULL && ndpi_struct->ookla_cache != NULL) {
 	  if(packet->tcp->source == htons(8080))
-	    ndpi_lru_add_to_cache(ndpi_struct->ookla_cache, packet->iph->saddr, 1 /* dummy */);
+	    ndpi_lru_add_to_cache(ndpi_struct->ookla_cache, packet->iph->saddr, 1 /* dummy */, packet->tick_timestamp);
 	  else
-	    ndpi_lru_add_to_cache(ndpi_struct->ookla_cache, packet->iph->daddr, 1 /* dummy */);
+	    ndpi_lru_add_to_cache(ndpi_struct->ookla_cache, packet->iph->daddr, 1 /* dummy */, packet->tick_timestamp);
 	}
 
         return;
@@ -801,7 +801,7 @@ static void ndpi_check_http_tcp(struct ndpi_detection_module_struct *ndpi_struct
 
 void ndpi_search_http_tcp(struct ndpi_detection_module_struct *ndpi_struct,
 			  struct ndpi_flow_struct *flow) {
-  struct ndpi_packet_struct *packet = &flow->packet;
+  struct ndpi_packet_struct *packet = &ndpi_struct->packet;
 
   /* Break after 20 packets. */
   if(flow->packet_counter > 20) {
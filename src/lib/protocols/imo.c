@@ -33,17 +33,17 @@ static void ndpi_int_imo_add_connection(struct ndpi_detection_module_struct
 }
 
 void ndpi_search_imo(struct ndpi_detection_module_struct *ndpi_struct, struct ndpi_flow_struct *flow) {
-  struct ndpi_packet_struct *packet = &flow->packet;
+  struct ndpi_packet_struct *packet = &ndpi_struct->packet;
 
   NDPI_LOG_DBG(ndpi_struct, "search IMO\n");
 
   if(packet->payload_packet_len == 1) {
     /* Two one byte consecutive packets with the same payload */ 
-    if((flow->protos.imo.last_one_byte_pkt == 1)
-       && (flow->protos.imo.last_byte == packet->payload[0]))
+    if((ndpi_flow_get_protos(flow)->imo.last_one_byte_pkt == 1)
+       && (ndpi_flow_get_protos(flow)->imo.last_byte == packet->payload[0]))
       ndpi_int_imo_add_connection(ndpi_struct, flow);
-    else
-      flow->protos.imo.last_one_byte_pkt = 1, flow->protos.imo.last_byte = packet->payload[0];
+    else if(ndpi_flow_alloc_protos(flow))
+      flow->protos->imo.last_one_byte_pkt = 1, flow->protos->imo.last_byte = packet->payload[0];
   } else if(((packet->payload_packet_len == 10)
 	 && (packet->payload[0] == 0x09)
 	 && (packet->payload[1] == 0x02))
@@ -61,8 +61,8 @@ void ndpi_search_imo(struct ndpi_detection_module_struct *ndpi_struct, struct nd
   } else {
     if(flow->num_processed_pkts > 7)
       NDPI_EXCLUDE_PROTO(ndpi_struct, flow);
-    else
-      flow->protos.imo.last_one_byte_pkt = 0;
+    else if(ndpi_flow_get_protos(flow)->imo.last_one_byte_pkt)
+      flow->protos->imo.last_one_byte_pkt = 0;
   }
 }
 
@@ -39,7 +39,7 @@ static void ndpi_int_kerberos_add_connection(struct ndpi_detection_module_struct
 
 void ndpi_search_kerberos(struct ndpi_detection_module_struct *ndpi_struct,
 			  struct ndpi_flow_struct *flow) {
-  struct ndpi_packet_struct *packet = &flow->packet;
+  struct ndpi_packet_struct *packet = &ndpi_struct->packet;
 
   NDPI_LOG_DBG(ndpi_struct, "search KERBEROS\n");
 
@@ -74,7 +74,8 @@ void ndpi_search_kerberos(struct ndpi_detection_module_struct *ndpi_struct,
 	      printf("[Kerberos Cname][len: %u][%s]\n", cname_len, cname_str);
 #endif
 
-	      snprintf(flow->protos.kerberos.cname, sizeof(flow->protos.kerberos.cname), "%s", cname_str);
+	      if(ndpi_flow_alloc_protos(flow))
+		snprintf(flow->protos->kerberos.cname, sizeof(flow->protos->kerberos.cname), "%s", cname_str);
 	      
 	      realm_len = packet->payload[realm_offset];
 
@@ -92,7 +93,8 @@ void ndpi_search_kerberos(struct ndpi_detection_module_struct *ndpi_struct,
 #ifdef KERBEROS_DEBUG
 		printf("[Kerberos Realm][len: %u][%s]\n", realm_len, realm_str);
 #endif
-		snprintf(flow->protos.kerberos.realm, sizeof(flow->protos.kerberos.realm), "%s", realm_str);
+		if(ndpi_flow_alloc_protos(flow))
+		  snprintf(flow->protos->kerberos.realm, sizeof(flow->protos->kerberos.realm), "%s", realm_str);
 	      }
 	    }
 	  }
@@ -25,14 +25,14 @@
 
 
 static void ndpi_line_report_protocol(struct ndpi_detection_module_struct *ndpi_struct, struct ndpi_flow_struct *flow) {
-  /* printf("-> payload_len=%u\n", flow->packet.payload_packet_len); */
+  /* printf("-> payload_len=%u\n", ndpi_struct->packet.payload_packet_len); */
 
   NDPI_LOG_INFO(ndpi_struct, "found line\n");
   ndpi_set_detected_protocol(ndpi_struct, flow, NDPI_PROTOCOL_LINE, NDPI_PROTOCOL_LINE);
 }
 
 void ndpi_search_line(struct ndpi_detection_module_struct *ndpi_struct, struct ndpi_flow_struct *flow) {
-  struct ndpi_packet_struct *packet = &flow->packet;
+  struct ndpi_packet_struct *packet = &ndpi_struct->packet;
 
   NDPI_LOG_DBG(ndpi_struct, "search line\n");
 
@@ -40,9 +40,9 @@ void ndpi_search_line(struct ndpi_detection_module_struct *ndpi_struct, struct n
     /* 125.209.252.xxx */
     if (((ntohl(packet->iph->saddr) & 0xFFFFFF00 /* 255.255.255.0 */) == 0x7DD1FC00) ||
         ((ntohl(packet->iph->daddr) & 0xFFFFFF00 /* 255.255.255.0 */) == 0x7DD1FC00)) {
-      if ((packet->payload_packet_len == 110) && (flow->packet.payload[0] == 0xB6) &&
-          (flow->packet.payload[1] == 0x18) && (flow->packet.payload[2] == 0x00) &&
-          (flow->packet.payload[3] == 0x6A)) {
+      if ((packet->payload_packet_len == 110) && (ndpi_struct->packet.payload[0] == 0xB6) &&
+          (ndpi_struct->packet.payload[1] == 0x18) && (ndpi_struct->packet.payload[2] == 0x00) &&
+          (ndpi_struct->packet.payload[3] == 0x6A)) {
         ndpi_line_report_protocol(ndpi_struct, flow);
         return;
       }
@@ -60,7 +60,7 @@ static void ndpi_int_mdns_add_connection(struct ndpi_detection_module_struct
 
 static int ndpi_int_check_mdns_payload(struct ndpi_detection_module_struct
 				       *ndpi_struct, struct ndpi_flow_struct *flow) {
-  struct ndpi_packet_struct *packet = &flow->packet;
+  struct ndpi_packet_struct *packet = &ndpi_struct->packet;
   struct mdns_header *h = (struct mdns_header*)packet->payload;
   u_int16_t questions = ntohs(h->questions), answers = ntohs(h->answers);
 
@@ -82,10 +82,10 @@ static int ndpi_int_check_mdns_payload(struct ndpi_detection_module_struct
 
     /* printf("==> [%d] %s\n", j, answer);  */
 
-    if(!ndpi_struct->disable_metadata_export) {
-      len = ndpi_min(sizeof(flow->protos.mdns.answer)-1, j);
-      strncpy(flow->protos.mdns.answer, (const char *)answer, len);
-      flow->protos.mdns.answer[len] = '\0';
+    if((!ndpi_struct->disable_metadata_export) && ndpi_flow_alloc_protos(flow)) {
+      len = ndpi_min(sizeof(flow->protos->mdns.answer)-1, j);
+      memcpy(flow->protos->mdns.answer, answer, len);
+      flow->protos->mdns.answer[len] = '\0';
     }
     
     NDPI_LOG_INFO(ndpi_struct, "found MDNS with answer query\n");
@@ -97,7 +97,7 @@ static int ndpi_int_check_mdns_payload(struct ndpi_detection_module_struct
 
 void ndpi_search_mdns(struct ndpi_detection_module_struct *ndpi_struct, struct ndpi_flow_struct *flow)
 {
-  struct ndpi_packet_struct *packet = &flow->packet;
+  struct ndpi_packet_struct *packet = &ndpi_struct->packet;
   NDPI_LOG_DBG(ndpi_struct, "search MDNS\n");
 
   /**
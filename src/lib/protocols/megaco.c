@@ -28,7 +28,7 @@
 void ndpi_search_megaco(struct ndpi_detection_module_struct *ndpi_struct,
 			struct ndpi_flow_struct *flow)
 {
-  struct ndpi_packet_struct *packet = &flow->packet;
+  struct ndpi_packet_struct *packet = &ndpi_struct->packet;
   
   NDPI_LOG_DBG(ndpi_struct, "search for MEGACO\n");
   
@@ -51,12 +51,16 @@ void ndpi_search_megaco(struct ndpi_detection_module_struct *ndpi_struct,
 
 void init_megaco_dissector(struct ndpi_detection_module_struct *ndpi_struct, u_int32_t *id, NDPI_PROTOCOL_BITMASK *detection_bitmask)
 {
+  static const u_int8_t first_bytes[] = { '!', 'M' };
+
   ndpi_set_bitmask_protocol_detection("Megaco", ndpi_struct, detection_bitmask, *id,
 				      NDPI_PROTOCOL_MEGACO,
 				      ndpi_search_megaco,
 				      NDPI_SELECTION_BITMASK_PROTOCOL_UDP_WITH_PAYLOAD,
 				      SAVE_DETECTION_BITMASK_AS_UNKNOWN,
 				      ADD_TO_DETECTION_BITMASK);
+  ndpi_set_bitmask_protocol_prefix(ndpi_struct, *id, first_bytes, sizeof(first_bytes),
+				   EXCLUDE_ON_PREFIX_MISMATCH);
 
   *id += 1;
 }
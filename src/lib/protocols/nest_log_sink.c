@@ -37,7 +37,7 @@ void ndpi_search_nest_log_sink(
         struct ndpi_detection_module_struct *ndpi_struct,
         struct ndpi_flow_struct *flow)
 {
-    struct ndpi_packet_struct *packet = &flow->packet;
+    struct ndpi_packet_struct *packet = &ndpi_struct->packet;
 
     NDPI_LOG_DBG(ndpi_struct, "search nest_log_sink\n");
 
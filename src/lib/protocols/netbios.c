@@ -75,9 +75,9 @@ static void ndpi_int_netbios_add_connection(struct ndpi_detection_module_struct
   char name[64];
 
   if(!ndpi_struct->disable_metadata_export) {
-    u_int off = flow->packet.payload[12] == 0x20 ? 12 : 14;
+    u_int off = ndpi_struct->packet.payload[12] == 0x20 ? 12 : 14;
     
-    if(ndpi_netbios_name_interpret((char*)&flow->packet.payload[off], name, sizeof(name)) > 0)
+    if(ndpi_netbios_name_interpret((char*)&ndpi_struct->packet.payload[off], name, sizeof(name)) > 0)
       snprintf((char*)flow->host_server_name, sizeof(flow->host_server_name)-1, "%s", name);    
   }
   
@@ -87,7 +87,7 @@ static void ndpi_int_netbios_add_connection(struct ndpi_detection_module_struct
 
 void ndpi_search_netbios(struct ndpi_detection_module_struct *ndpi_struct,
 			 struct ndpi_flow_struct *flow) {
-  struct ndpi_packet_struct *packet = &flow->packet;
+  struct ndpi_packet_struct *packet = &ndpi_struct->packet;
   u_int16_t dport;
   
   NDPI_LOG_DBG(ndpi_struct, "search netbios\n");
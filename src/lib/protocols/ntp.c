@@ -36,7 +36,7 @@ static void ndpi_int_ntp_add_connection(struct ndpi_detection_module_struct
 
 void ndpi_search_ntp_udp(struct ndpi_detection_module_struct *ndpi_struct, struct ndpi_flow_struct *flow)
 {
-  struct ndpi_packet_struct *packet = &flow->packet;
+  struct ndpi_packet_struct *packet = &ndpi_struct->packet;
   
   NDPI_LOG_DBG(ndpi_struct, "search NTP\n");
 
@@ -46,11 +46,13 @@ void ndpi_search_ntp_udp(struct ndpi_detection_module_struct *ndpi_struct, struc
   
     if ((((packet->payload[0] & 0x38) >> 3) <= 4)) {
     
-      // 38 in binary representation is 00111000 
-      flow->protos.ntp.version = (packet->payload[0] & 0x38) >> 3;
-    
-      if (flow->protos.ntp.version == 2) {
-        flow->protos.ntp.request_code = packet->payload[3];
+      if (ndpi_flow_alloc_protos(flow)) {
+        // 38 in binary representation is 00111000 
+        flow->protos->ntp.version = (packet->payload[0] & 0x38) >> 3;
+
+        if (flow->protos->ntp.version == 2) {
+          flow->protos->ntp.request_code = packet->payload[3];
+        }
       }
     
       NDPI_LOG_INFO(ndpi_struct, "found NTP\n");
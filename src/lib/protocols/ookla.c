@@ -25,7 +25,7 @@
 
 
 void ndpi_search_ookla(struct ndpi_detection_module_struct* ndpi_struct, struct ndpi_flow_struct* flow) {
-  struct ndpi_packet_struct* packet = &flow->packet;
+  struct ndpi_packet_struct* packet = &ndpi_struct->packet;
   u_int32_t addr = 0;
 
   NDPI_LOG_DBG(ndpi_struct, "Ookla detection\n");
@@ -38,9 +38,10 @@ void ndpi_search_ookla(struct ndpi_detection_module_struct* ndpi_struct, struct
     goto ookla_exclude;
 
   if(ndpi_struct->ookla_cache != NULL) {
-    u_int16_t dummy;
+    u_int32_t dummy;
     
-    if(ndpi_lru_find_cache(ndpi_struct->ookla_cache, addr, &dummy, 0 /* Don't remove it as it can be used for other connections */)) {
+    if(ndpi_lru_find_cache(ndpi_struct->ookla_cache, addr, &dummy, 0 /* Don't remove it as it can be used for other connections */,
+			   packet->tick_timestamp)) {
       NDPI_LOG_INFO(ndpi_struct, "found ookla tcp connection\n");
       ndpi_set_detected_protocol(ndpi_struct, flow, NDPI_PROTOCOL_OOKLA, NDPI_PROTOCOL_UNKNOWN);
       return;
@@ -77,7 +77,7 @@ static void ndpi_int_oscar_add_connection(struct ndpi_detection_module_struct *n
 					  struct ndpi_flow_struct *flow)
 {
 
-  struct ndpi_packet_struct *packet = &flow->packet;
+  struct ndpi_packet_struct *packet = &ndpi_struct->packet;
   struct ndpi_id_struct *src = flow->src;
   struct ndpi_id_struct *dst = flow->dst;
 
@@ -109,7 +109,7 @@ static void ndpi_search_oscar_tcp_connect(struct ndpi_detection_module_struct
   u_int16_t flag;
   u_int32_t req_ID;
 
-  struct ndpi_packet_struct * packet = &flow->packet;
+  struct ndpi_packet_struct * packet = &ndpi_struct->packet;
 
   struct ndpi_id_struct * src = flow->src;
   struct ndpi_id_struct * dst = flow->dst;
@@ -795,7 +795,7 @@ static void ndpi_search_oscar_tcp_connect(struct ndpi_detection_module_struct
 
 void ndpi_search_oscar(struct ndpi_detection_module_struct *ndpi_struct, struct ndpi_flow_struct *flow)
 {
-  struct ndpi_packet_struct *packet = &flow->packet;
+  struct ndpi_packet_struct *packet = &ndpi_struct->packet;
   NDPI_LOG_DBG(ndpi_struct, "search OSCAR\n");
   if (packet->tcp != NULL) {
     ndpi_search_oscar_tcp_connect(ndpi_struct, flow);
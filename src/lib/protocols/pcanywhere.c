@@ -39,7 +39,7 @@ static void ndpi_int_pcanywhere_add_connection(struct ndpi_detection_module_stru
 void ndpi_search_pcanywhere(struct ndpi_detection_module_struct
 			    *ndpi_struct, struct ndpi_flow_struct *flow)
 {
-  struct ndpi_packet_struct *packet = &flow->packet;
+  struct ndpi_packet_struct *packet = &ndpi_struct->packet;
 	
   if (packet->udp != NULL && packet->udp->dest == htons(5632)
       && packet->payload_packet_len == 2
@@ -55,12 +55,16 @@ void ndpi_search_pcanywhere(struct ndpi_detection_module_struct
 
 void init_pcanywhere_dissector(struct ndpi_detection_module_struct *ndpi_struct, u_int32_t *id, NDPI_PROTOCOL_BITMASK *detection_bitmask)
 {
+  static const u_int8_t first_bytes[] = { 'N', 'S' };
+
   ndpi_set_bitmask_protocol_detection("PcAnywhere", ndpi_struct, detection_bitmask, *id,
 				      NDPI_PROTOCOL_PCANYWHERE,
 				      ndpi_search_pcanywhere,
 				      NDPI_SELECTION_BITMASK_PROTOCOL_V4_V6_TCP_OR_UDP_WITH_PAYLOAD_WITHOUT_RETRANSMISSION,
 				      SAVE_DETECTION_BITMASK_AS_UNKNOWN,
 				      ADD_TO_DETECTION_BITMASK);
+  ndpi_set_bitmask_protocol_prefix(ndpi_struct, *id, first_bytes, sizeof(first_bytes),
+				   EXCLUDE_ON_PREFIX_MISMATCH);
 
   *id += 1;
 }
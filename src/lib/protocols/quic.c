@@ -67,7 +67,7 @@ static int quic_len(u_int8_t l) {
 void ndpi_search_quic(struct ndpi_detection_module_struct *ndpi_struct,
 		      struct ndpi_flow_struct *flow)
 {
-  struct ndpi_packet_struct *packet = &flow->packet;
+  struct ndpi_packet_struct *packet = &ndpi_struct->packet;
   u_int32_t udp_len = packet->payload_packet_len;
   u_int version_len = ((packet->payload[0] & 0x01) == 0) ? 0 : 4;
   u_int cid_len = quic_len((packet->payload[0] & 0x0C) >> 2);
@@ -36,7 +36,7 @@ static void ndpi_int_rtmp_add_connection(struct ndpi_detection_module_struct *nd
 
 static void ndpi_check_rtmp(struct ndpi_detection_module_struct *ndpi_struct, struct ndpi_flow_struct *flow)
 {
-  struct ndpi_packet_struct *packet = &flow->packet;  
+  struct ndpi_packet_struct *packet = &ndpi_struct->packet;  
   u_int32_t payload_len = packet->payload_packet_len;
   
   /* Break after 20 packets. */
@@ -78,7 +78,7 @@ static void ndpi_check_rtmp(struct ndpi_detection_module_struct *ndpi_struct, st
 
 void ndpi_search_rtmp(struct ndpi_detection_module_struct *ndpi_struct, struct ndpi_flow_struct *flow)
 {
-  struct ndpi_packet_struct *packet = &flow->packet;
+  struct ndpi_packet_struct *packet = &ndpi_struct->packet;
 
   NDPI_LOG_DBG(ndpi_struct, "search RTMP\n");
 
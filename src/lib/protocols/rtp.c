@@ -78,12 +78,12 @@ static void ndpi_rtp_search(struct ndpi_detection_module_struct *ndpi_struct,
 			    const u_int8_t * payload, const u_int16_t payload_len) {
   NDPI_LOG_DBG(ndpi_struct, "search RTP\n");
 
-  if((payload_len < 2) || flow->protos.stun_ssl.stun.num_binding_requests) {
+  if((payload_len < 2) || flow->stun.num_binding_requests) {
     NDPI_EXCLUDE_PROTO(ndpi_struct, flow);
     return;
   }
 
-  //struct ndpi_packet_struct *packet = &flow->packet;
+  //struct ndpi_packet_struct *packet = &ndpi_struct->packet;
   u_int8_t payloadType, payload_type = payload[1] & 0x7F;
 
   /* Check whether this is an RTP flow */
@@ -95,14 +95,14 @@ static void ndpi_rtp_search(struct ndpi_detection_module_struct *ndpi_struct,
 	 /* http://www.iana.org/assignments/rtp-parameters/rtp-parameters.xhtml */
        )
     ) {
-    struct ndpi_packet_struct *packet = &flow->packet;
+    struct ndpi_packet_struct *packet = &ndpi_struct->packet;
 
     if(packet->iph) {
       /* 125.209.252.xxx */
       if(((ntohl(packet->iph->saddr) & 0xFFFFFF00 /* 255.255.255.0 */) == 0x7DD1FC00)
 	 || ((ntohl(packet->iph->daddr) & 0xFFFFFF00 /* 255.255.255.0 */) == 0x7DD1FC00)) {
-	if((flow->packet.payload[0] == 0x80)
-	   && ((flow->packet.payload[1] == 0x78) || (flow->packet.payload[1] == 0xE8))
+	if((ndpi_struct->packet.payload[0] == 0x80)
+	   && ((ndpi_struct->packet.payload[1] == 0x78) || (ndpi_struct->packet.payload[1] == 0xE8))
 	  ) {
 	  ndpi_set_detected_protocol(ndpi_struct, flow, NDPI_PROTOCOL_LINE, NDPI_PROTOCOL_LINE);
 	  return;
@@ -138,7 +138,7 @@ static void ndpi_rtp_search(struct ndpi_detection_module_struct *ndpi_struct,
 
 void ndpi_search_rtp(struct ndpi_detection_module_struct *ndpi_struct, struct ndpi_flow_struct *flow)
 {
-  struct ndpi_packet_struct *packet = &flow->packet;
+  struct ndpi_packet_struct *packet = &ndpi_struct->packet;
 
   /* printf("*** %s(pkt=%d)\n", __FUNCTION__, flow->packet_counter); */
 
@@ -222,7 +222,7 @@ static void ndpi_rtp_search(struct ndpi_detection_module_struct *ndpi_struct,
 			    struct ndpi_flow_struct *flow,
 			    const u_int8_t * payload, const u_int16_t payload_len)
 {
-  struct ndpi_packet_struct *packet = &flow->packet;
+  struct ndpi_packet_struct *packet = &ndpi_struct->packet;
 
   u_int8_t stage;
   u_int16_t seqnum = ntohs(get_u_int16_t(payload, 2));
@@ -343,7 +343,7 @@ exclude_rtp:
 
 void ndpi_search_rtp(struct ndpi_detection_module_struct *ndpi_struct, struct ndpi_flow_struct *flow)
 {
-  struct ndpi_packet_struct *packet = &flow->packet;
+  struct ndpi_packet_struct *packet = &ndpi_struct->packet;
 
 
   if(packet->udp) {
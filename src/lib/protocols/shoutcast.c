@@ -37,7 +37,7 @@ static void ndpi_int_shoutcast_add_connection(struct ndpi_detection_module_struc
 void ndpi_search_shoutcast_tcp(struct ndpi_detection_module_struct
 								 *ndpi_struct, struct ndpi_flow_struct *flow)
 {
-	struct ndpi_packet_struct *packet = &flow->packet;
+	struct ndpi_packet_struct *packet = &ndpi_struct->packet;
 	
 
 	NDPI_LOG_DBG(ndpi_struct, "search shoutcast\n");
@@ -42,8 +42,8 @@ void ndpi_search_smpp_tcp(struct ndpi_detection_module_struct* ndpi_struct,
                           struct ndpi_flow_struct* flow)
 {
   NDPI_LOG_DBG(ndpi_struct, "search SMPP\n");
-  if (flow->packet.detected_protocol_stack[0] != NDPI_PROTOCOL_SMPP){
-    struct ndpi_packet_struct* packet = &flow->packet;
+  if (ndpi_struct->packet.detected_protocol_stack[0] != NDPI_PROTOCOL_SMPP){
+    struct ndpi_packet_struct* packet = &ndpi_struct->packet;
     // min SMPP packet length = 16 bytes
     if (packet->payload_packet_len < 16) {
       NDPI_EXCLUDE_PROTO(ndpi_struct, flow);
@@ -214,7 +214,7 @@ static void ndpi_ssh_zap_cr(char *str, int len) {
 /* ************************************************************************ */
 
 void ndpi_search_ssh_tcp(struct ndpi_detection_module_struct *ndpi_struct, struct ndpi_flow_struct *flow) {
-  struct ndpi_packet_struct *packet = &flow->packet;
+  struct ndpi_packet_struct *packet = &ndpi_struct->packet;
 
 #ifdef SSH_DEBUG
   printf("\n[SSH] [stage: %u]\n", flow->l4.tcp.ssh_stage);
@@ -223,15 +223,15 @@ void ndpi_search_ssh_tcp(struct ndpi_detection_module_struct *ndpi_struct, struc
   if(flow->l4.tcp.ssh_stage == 0) {
     if(packet->payload_packet_len > 7 && packet->payload_packet_len < 100
 	&& memcmp(packet->payload, "SSH-", 4) == 0) {
-      if(!ndpi_struct->disable_metadata_export) {
-        int len = ndpi_min(sizeof(flow->protos.ssh.client_signature)-1, packet->payload_packet_len);
+      if((!ndpi_struct->disable_metadata_export) && ndpi_flow_alloc_protos(flow)) {
+        int len = ndpi_min(sizeof(flow->protos->ssh.client_signature)-1, packet->payload_packet_len);
 
-	strncpy(flow->protos.ssh.client_signature, (const char *)packet->payload, len);
-	flow->protos.ssh.client_signature[len] = '\0';
-	ndpi_ssh_zap_cr(flow->protos.ssh.client_signature, len);
+	strncpy(flow->protos->ssh.client_signature, (const char *)packet->payload, len);
+	flow->protos->ssh.client_signature[len] = '\0';
+	ndpi_ssh_zap_cr(flow->protos->ssh.client_signature, len);
 
 #ifdef SSH_DEBUG
-	printf("\n[SSH] [client_signature: %s]\n", flow->protos.ssh.client_signature);
+	printf("\n[SSH] [client_signature: %s]\n", flow->protos->ssh.client_signature);
 #endif
       }
 
@@ -244,15 +244,17 @@ void ndpi_search_ssh_tcp(struct ndpi_detection_module_struct *ndpi_struct, struc
     if(packet->payload_packet_len > 7 && packet->payload_packet_len < 500
 	&& memcmp(packet->payload, "SSH-", 4) == 0) {
       if(!ndpi_struct->disable_metadata_export) {
-	int len = ndpi_min(sizeof(flow->protos.ssh.server_signature)-1, packet->payload_packet_len);
+	int len = ndpi_min(sizeof(flow->protos->ssh.server_signature)-1, packet->payload_packet_len);
 
-	strncpy(flow->protos.ssh.server_signature, (const char *)packet->payload, len);
-	flow->protos.ssh.server_signature[len] = '\0';
-	ndpi_ssh_zap_cr(flow->protos.ssh.server_signature, len);
+	if(ndpi_flow_alloc_protos(flow)) {
+	  strncpy(flow->protos->ssh.server_signature, (const char *)packet->payload, len);
+	  flow->protos->ssh.server_signature[len] = '\0';
+	  ndpi_ssh_zap_cr(flow->protos->ssh.server_signature, len);
 
 #ifdef SSH_DEBUG
-	printf("\n[SSH] [server_signature: %s]\n", flow->protos.ssh.server_signature);
+	  printf("\n[SSH] [server_signature: %s]\n", flow->protos->ssh.server_signature);
 #endif
+	}
 
 	NDPI_LOG_DBG2(ndpi_struct, "ssh stage 1 passed\n");
 	flow->guessed_host_protocol_id = flow->guessed_protocol_id = NDPI_PROTOCOL_SSH;
@@ -276,7 +278,7 @@ void ndpi_search_ssh_tcp(struct ndpi_detection_module_struct *ndpi_struct, struc
     printf("\n[SSH] [stage: %u][msg: %u]\n", flow->l4.tcp.ssh_stage, msgcode);
 #endif
 
-    if(msgcode == 20 /* key exchange init */) {
+    if((msgcode == 20 /* key exchange init */) && ndpi_flow_alloc_protos(flow)) {
       char *hassh_buf = calloc(packet->payload_packet_len, sizeof(char));
       u_int i, len;
 
@@ -297,8 +299,8 @@ void ndpi_search_ssh_tcp(struct ndpi_detection_module_struct *ndpi_struct, struc
 	    printf("]\n");
 	  }
 #endif
-	  for(i=0; i<16; i++) sprintf(&flow->protos.ssh.hassh_client[i*2], "%02X", fingerprint_client[i] & 0xFF);
-	  flow->protos.ssh.hassh_client[32] = '\0';
+	  for(i=0; i<16; i++) sprintf(&flow->protos->ssh.hassh_client[i*2], "%02X", fingerprint_client[i] & 0xFF);
+	  flow->protos->ssh.hassh_client[32] = '\0';
 	} else {
 	  u_char fingerprint_server[16];
 
@@ -316,8 +318,8 @@ void ndpi_search_ssh_tcp(struct ndpi_detection_module_struct *ndpi_struct, struc
 	  }
 #endif
 
-	  for(i=0; i<16; i++) sprintf(&flow->protos.ssh.hassh_server[i*2], "%02X", fingerprint_server[i] & 0xFF);
-	  flow->protos.ssh.hassh_server[32] = '\0';
+	  for(i=0; i<16; i++) sprintf(&flow->protos->ssh.hassh_server[i*2], "%02X", fingerprint_server[i] & 0xFF);
+	  flow->protos->ssh.hassh_server[32] = '\0';
 	}
 
 	free(hassh_buf);
@@ -344,12 +346,16 @@ void ndpi_search_ssh_tcp(struct ndpi_detection_module_struct *ndpi_struct, struc
 
 void init_ssh_dissector(struct ndpi_detection_module_struct *ndpi_struct, u_int32_t *id, NDPI_PROTOCOL_BITMASK *detection_bitmask)
 {
+  /* Stage 0 needs "SSH-": the first payload packet of a SSH flow always has it */
+  static const u_int8_t first_bytes[] = { 'S' };
+
   ndpi_set_bitmask_protocol_detection("SSH", ndpi_struct, detection_bitmask, *id,
 				      NDPI_PROTOCOL_SSH,
 				      ndpi_search_ssh_tcp,
 				      NDPI_SELECTION_BITMASK_PROTOCOL_V4_V6_TCP_WITH_PAYLOAD_WITHOUT_RETRANSMISSION,
 				      SAVE_DETECTION_BITMASK_AS_UNKNOWN,
 				      ADD_TO_DETECTION_BITMASK);
-
+  ndpi_set_bitmask_protocol_prefix(ndpi_struct, *id, first_bytes, sizeof(first_bytes),
+				   EXCLUDE_ON_FIRST_PACKET_PREFIX_MISMATCH);
   *id += 1;
 }
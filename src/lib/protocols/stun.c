@@ -41,11 +41,12 @@ struct stun_packet_header {
 
 /* ************************************************************ */
 
-u_int32_t get_stun_lru_key(struct ndpi_flow_struct *flow, u_int8_t rev) {
+/* Address and port of one of the peers (both in network byte order) */
+u_int64_t get_stun_lru_key(struct ndpi_packet_struct *packet, u_int8_t rev) {
   if(rev)
-    return(flow->packet.iph->daddr + flow->packet.udp->dest);
+    return(((u_int64_t)packet->iph->daddr << 16) | packet->udp->dest);
   else
-    return(flow->packet.iph->saddr + flow->packet.udp->source);
+    return(((u_int64_t)packet->iph->saddr << 16) | packet->udp->source);
 }
 
 /* ************************************************************ */
@@ -54,29 +55,31 @@ void ndpi_int_stun_add_connection(struct ndpi_detection_module_struct *ndpi_stru
 				  struct ndpi_flow_struct *flow,
 				  u_int proto, u_int app_proto) {
   if(ndpi_struct->stun_cache == NULL)
-    ndpi_struct->stun_cache = ndpi_lru_cache_init(1024);
+    ndpi_struct->stun_cache = ndpi_lru_cache_init(ndpi_struct->stun_cache_num_entries, ndpi_struct->stun_cache_ttl);
 
   if(ndpi_struct->stun_cache
-     && flow->packet.iph
-     && flow->packet.udp
+     && ndpi_struct->packet.iph
+     && ndpi_struct->packet.udp
      && (app_proto != NDPI_PROTOCOL_UNKNOWN)
      ) /* Cache flow sender info */ {
-    u_int32_t key = get_stun_lru_key(flow, 0);
-    u_int16_t cached_proto;
+    u_int64_t key = get_stun_lru_key(&ndpi_struct->packet, 0);
+    u_int32_t cached_proto;
 
     if(ndpi_lru_find_cache(ndpi_struct->stun_cache, key,
-			   &cached_proto, 0 /* Don't remove it as it can be used for other connections */)) {
+			   &cached_proto, 0 /* Don't remove it as it can be used for other connections */,
+			   ndpi_struct->packet.tick_timestamp)) {
 #ifdef DEBUG_LRU
-      printf("[LRU] FOUND %u / %u: no need to cache %u.%u\n", key, cached_proto, proto, app_proto);
+      printf("[LRU] FOUND %llu / %u: no need to cache %u.%u\n", (unsigned long long)key, cached_proto, proto, app_proto);
 #endif
       app_proto = cached_proto, proto = NDPI_PROTOCOL_STUN;
     } else {
-      u_int32_t key_rev = get_stun_lru_key(flow, 1);
+      u_int64_t key_rev = get_stun_lru_key(&ndpi_struct->packet, 1);
 
       if(ndpi_lru_find_cache(ndpi_struct->stun_cache, key_rev,
-			     &cached_proto, 0 /* Don't remove it as it can be used for other connections */)) {
+			     &cached_proto, 0 /* Don't remove it as it can be used for other connections */,
+			     ndpi_struct->packet.tick_timestamp)) {
 #ifdef DEBUG_LRU
-	printf("[LRU] FOUND %u / %u: no need to cache %u.%u\n", key_rev, cached_proto, proto, app_proto);
+	printf("[LRU] FOUND %llu / %u: no need to cache %u.%u\n", (unsigned long long)key_rev, cached_proto, proto, app_proto);
 #endif
 	app_proto = cached_proto, proto = NDPI_PROTOCOL_STUN;
       } else {
@@ -84,12 +87,12 @@ void ndpi_int_stun_add_connection(struct ndpi_detection_module_struct *ndpi_stru
 	  /* No sense to ass STUN, but only subprotocols */
 
 #ifdef DEBUG_LRU
-	  printf("[LRU] ADDING %u / %u.%u [%u -> %u]\n", key, proto, app_proto,
-		 ntohs(flow->packet.udp->source), ntohs(flow->packet.udp->dest));
+	  printf("[LRU] ADDING %llu / %u.%u [%u -> %u]\n", (unsigned long long)key, proto, app_proto,
+		 ntohs(ndpi_struct->packet.udp->source), ntohs(ndpi_struct->packet.udp->dest));
 #endif
 
-	  ndpi_lru_add_to_cache(ndpi_struct->stun_cache, key, app_proto);
-	  ndpi_lru_add_to_cache(ndpi_struct->stun_cache, key_rev, app_proto);
+	  ndpi_lru_add_to_cache(ndpi_struct->stun_cache, key, app_proto, ndpi_struct->packet.tick_timestamp);
+	  ndpi_lru_add_to_cache(ndpi_struct->stun_cache, key_rev, app_proto, ndpi_struct->packet.tick_timestamp);
 	}
       }
     }
@@ -147,7 +150,7 @@ static ndpi_int_stun_t ndpi_int_check_stun(struct ndpi_detection_module_struct *
   int rc;
   
   /* STUN over TCP does not look good */
-  if (flow->packet.tcp)
+  if (ndpi_struct->packet.tcp)
     return(NDPI_IS_NOT_STUN);
 
   if(payload_length >= 512) {
@@ -155,7 +158,7 @@ static ndpi_int_stun_t ndpi_int_check_stun(struct ndpi_detection_module_struct *
   } else if(payload_length < sizeof(struct stun_packet_header)) {
     /* This looks like an invalid packet */
 
-    if(flow->protos.stun_ssl.stun.num_udp_pkts > 0) {
+    if(flow->stun.num_udp_pkts > 0) {
       flow->guessed_host_protocol_id = NDPI_PROTOCOL_WHATSAPP_CALL;
       return(NDPI_IS_STUN);
     } else
@@ -186,7 +189,7 @@ static ndpi_int_stun_t ndpi_int_check_stun(struct ndpi_detection_module_struct *
      */
     if (payload[0] == 0x16) {
       /* Let's check if this is DTLS used by some socials */
-      struct ndpi_packet_struct *packet = &flow->packet;
+      struct ndpi_packet_struct *packet = &ndpi_struct->packet;
       u_int16_t total_len, version = htons(*((u_int16_t*) &packet->payload[1]));
 
       switch (version) {
@@ -206,42 +209,44 @@ static ndpi_int_stun_t ndpi_int_check_stun(struct ndpi_detection_module_struct *
   }
 
 #if 0
-  if((flow->packet.udp->dest == htons(3480)) ||
-     (flow->packet.udp->source == htons(3480))
+  if((ndpi_struct->packet.udp->dest == htons(3480)) ||
+     (ndpi_struct->packet.udp->source == htons(3480))
     )
     printf("[STUN] Here we go\n");;
 #endif
 
   if (ndpi_struct->stun_cache) {
-    u_int16_t proto;
-    u_int32_t key = get_stun_lru_key(flow, 0);
+    u_int32_t proto;
+    u_int64_t key = get_stun_lru_key(&ndpi_struct->packet, 0);
     int rc = ndpi_lru_find_cache(ndpi_struct->stun_cache, key, &proto,
-                                 0 /* Don't remove it as it can be used for other connections */);
+                                 0 /* Don't remove it as it can be used for other connections */,
+                                 ndpi_struct->packet.tick_timestamp);
 
 #ifdef DEBUG_LRU
-    printf("[LRU] Searching %u\n", key);
+    printf("[LRU] Searching %llu\n", (unsigned long long)key);
 #endif
 
     if (!rc) {
-      key = get_stun_lru_key(flow, 1);
+      key = get_stun_lru_key(&ndpi_struct->packet, 1);
       rc = ndpi_lru_find_cache(ndpi_struct->stun_cache, key, &proto,
-                               0 /* Don't remove it as it can be used for other connections */);
+                               0 /* Don't remove it as it can be used for other connections */,
+                               ndpi_struct->packet.tick_timestamp);
 
 #ifdef DEBUG_LRU
-      printf("[LRU] Searching %u\n", key);
+      printf("[LRU] Searching %llu\n", (unsigned long long)key);
 #endif
     }
 
     if (rc) {
 #ifdef DEBUG_LRU
-      printf("[LRU] Cache FOUND %u / %u\n", key, proto);
+      printf("[LRU] Cache FOUND %llu / %u\n", (unsigned long long)key, proto);
 #endif
 
       flow->guessed_host_protocol_id = proto;
       return(NDPI_IS_STUN);
     } else {
 #ifdef DEBUG_LRU
-      printf("[LRU] NOT FOUND %u\n", key);
+      printf("[LRU] NOT FOUND %llu\n", (unsigned long long)key);
 #endif
     }
   } else {
@@ -251,7 +256,7 @@ static ndpi_int_stun_t ndpi_int_check_stun(struct ndpi_detection_module_struct *
   }
 
   if(msg_type == 0x01 /* Binding Request */) {
-    flow->protos.stun_ssl.stun.num_binding_requests++;
+    flow->stun.num_binding_requests++;
 
     if (!msg_len && flow->guessed_host_protocol_id == NDPI_PROTOCOL_GOOGLE)
       flow->guessed_host_protocol_id = NDPI_PROTOCOL_HANGOUT_DUO;
@@ -259,7 +264,7 @@ static ndpi_int_stun_t ndpi_int_check_stun(struct ndpi_detection_module_struct *
       flow->guessed_protocol_id = NDPI_PROTOCOL_STUN;
 
     if (!msg_len) {
-      /* flow->protos.stun_ssl.stun.num_udp_pkts++; */
+      /* flow->stun.num_udp_pkts++; */
       return(NDPI_IS_NOT_STUN); /* This to keep analyzing STUN instead of giving up */
     }
   }
@@ -269,13 +274,13 @@ static ndpi_int_stun_t ndpi_int_check_stun(struct ndpi_detection_module_struct *
     return(NDPI_IS_NOT_STUN);
   }
 
-  flow->protos.stun_ssl.stun.num_udp_pkts++;
+  flow->stun.num_udp_pkts++;
 
   if((payload[0] == 0x80 && payload_length < 512 && ((msg_len+20) <= payload_length))) {
     flow->guessed_host_protocol_id = NDPI_PROTOCOL_WHATSAPP_CALL;
     return(NDPI_IS_STUN); /* This is WhatsApp Call */
   } else if((payload[0] == 0x90) && (((msg_len+11) == payload_length) ||
-                (flow->protos.stun_ssl.stun.num_binding_requests >= 4))) {
+                (flow->stun.num_binding_requests >= 4))) {
     flow->guessed_host_protocol_id = NDPI_PROTOCOL_WHATSAPP_CALL;
     return(NDPI_IS_STUN); /* This is WhatsApp Call */
   }
@@ -450,16 +455,16 @@ static ndpi_int_stun_t ndpi_int_check_stun(struct ndpi_detection_module_struct *
     }
   }
 
-  if ((flow->protos.stun_ssl.stun.num_udp_pkts > 0) && (msg_type <= 0x00FF)) {
+  if ((flow->stun.num_udp_pkts > 0) && (msg_type <= 0x00FF)) {
     flow->guessed_host_protocol_id = NDPI_PROTOCOL_WHATSAPP_CALL;
     return(NDPI_IS_STUN);
   } else
     return(NDPI_IS_NOT_STUN);
 
 udp_stun_found:
-  flow->protos.stun_ssl.stun.num_processed_pkts++;
+  flow->stun.num_processed_pkts++;
 
-  struct ndpi_packet_struct *packet = &flow->packet;
+  struct ndpi_packet_struct *packet = &ndpi_struct->packet;
 
 #ifdef DEBUG_STUN
   printf("==>> NDPI_PROTOCOL_WHATSAPP_CALL\n");
@@ -470,7 +475,7 @@ udp_stun_found:
   else if(is_google_ip_address(ntohl(packet->iph->saddr)) || is_google_ip_address(ntohl(packet->iph->daddr)))
     flow->guessed_host_protocol_id = NDPI_PROTOCOL_HANGOUT_DUO;
   
-  rc = (flow->protos.stun_ssl.stun.num_udp_pkts < MAX_NUM_STUN_PKTS) ? NDPI_IS_NOT_STUN : NDPI_IS_STUN;
+  rc = (flow->stun.num_udp_pkts < MAX_NUM_STUN_PKTS) ? NDPI_IS_NOT_STUN : NDPI_IS_STUN;
 
   return rc;
 }
@@ -478,7 +483,7 @@ udp_stun_found:
 
 void ndpi_search_stun(struct ndpi_detection_module_struct *ndpi_struct, struct ndpi_flow_struct *flow)
 {
-  struct ndpi_packet_struct *packet = &flow->packet;
+  struct ndpi_packet_struct *packet = &ndpi_struct->packet;
 
   NDPI_LOG_DBG(ndpi_struct, "search stun\n");
 
@@ -521,12 +526,12 @@ void ndpi_search_stun(struct ndpi_detection_module_struct *ndpi_struct, struct n
     return;
   }
 
-  if(flow->protos.stun_ssl.stun.num_udp_pkts >= MAX_NUM_STUN_PKTS)
+  if(flow->stun.num_udp_pkts >= MAX_NUM_STUN_PKTS)
     NDPI_EXCLUDE_PROTO(ndpi_struct, flow);
 
   if(flow->packet_counter > 0) {
     /* This might be a RTP stream: let's make sure we check it */
-    NDPI_CLR(&flow->excluded_protocol_bitmask, NDPI_PROTOCOL_RTP);
+    ndpi_include_protocol(ndpi_struct, flow, NDPI_PROTOCOL_RTP);
   }
 }
 
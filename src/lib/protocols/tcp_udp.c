@@ -55,7 +55,7 @@ void ndpi_search_tcp_or_udp(struct ndpi_detection_module_struct *ndpi_struct, st
 {
   u_int16_t sport, dport;
   u_int proto;
-  struct ndpi_packet_struct *packet = &flow->packet;
+  struct ndpi_packet_struct *packet = &ndpi_struct->packet;
 
   if(flow->host_server_name[0] != '\0')
     return;
@@ -69,17 +69,23 @@ void ndpi_search_tcp_or_udp(struct ndpi_detection_module_struct *ndpi_struct, st
   else if(packet->tcp) sport = ntohs(packet->tcp->source), dport = ntohs(packet->tcp->dest);
   else sport = dport = 0;
   
-  if(packet->iph /* IPv4 Only: we need to support packet->iphv6 at some point */) {
+  if(packet->iph
+#ifdef NDPI_DETECTION_SUPPORT_IPV6
+     || packet->iphv6
+#endif
+     ) {
+    /* The addresses are only used without a flow: IPv6 ones are matched by
+       ndpi_guess_host_protocol_id() */
     proto = ndpi_search_tcp_or_udp_raw(ndpi_struct,
 				       flow,
-				       flow->packet.iph ? flow->packet.iph->protocol :
+				       ndpi_struct->packet.iph ? ndpi_struct->packet.iph->protocol :
 #ifdef NDPI_DETECTION_SUPPORT_IPV6
-				       flow->packet.iphv6->ip6_hdr.ip6_un1_nxt,
+				       ndpi_struct->packet.iphv6->ip6_hdr.ip6_un1_nxt,
 #else
 				       0,
 #endif
-				       ntohl(packet->iph->saddr), 
-				       ntohl(packet->iph->daddr),
+				       packet->iph ? ntohl(packet->iph->saddr) : 0,
+				       packet->iph ? ntohl(packet->iph->daddr) : 0,
 				       sport, dport);
 
     if(proto != NDPI_PROTOCOL_UNKNOWN)
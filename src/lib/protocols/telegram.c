@@ -39,7 +39,7 @@ static void ndpi_int_telegram_add_connection(struct ndpi_detection_module_struct
 
 void ndpi_search_telegram(struct ndpi_detection_module_struct *ndpi_struct, struct ndpi_flow_struct *flow)
 {
-  struct ndpi_packet_struct *packet = &flow->packet;
+  struct ndpi_packet_struct *packet = &ndpi_struct->packet;
   u_int16_t dport /* , sport */;
   
   NDPI_LOG_DBG(ndpi_struct, "search telegram\n");
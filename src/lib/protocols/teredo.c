@@ -27,7 +27,7 @@
 /* https://en.wikipedia.org/wiki/Teredo_tunneling */
 void ndpi_search_teredo(struct ndpi_detection_module_struct *ndpi_struct, struct ndpi_flow_struct *flow)
 {
-  struct ndpi_packet_struct *packet = &flow->packet;
+  struct ndpi_packet_struct *packet = &ndpi_struct->packet;
 
   NDPI_LOG_DBG(ndpi_struct,"search teredo\n");
   if(packet->udp
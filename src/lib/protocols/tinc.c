@@ -23,37 +23,34 @@
 #define NDPI_CURRENT_PROTO NDPI_PROTOCOL_TINC
 
 #include "ndpi_api.h"
-#include "libcache.h"
 
+/* The address pair and port (80 bits) are folded into the 64 bits cache key */
+static u_int64_t tinc_cache_key(u_int32_t src_address, u_int32_t dst_address, u_int16_t dst_port) {
+  return(((((u_int64_t)src_address) << 32) | dst_address) ^ (((u_int64_t)dst_port) << 48));
+}
+
+/* ************************************************************ */
 
 static void ndpi_check_tinc(struct ndpi_detection_module_struct *ndpi_struct, struct ndpi_flow_struct *flow)
 {
-  struct ndpi_packet_struct *packet = &flow->packet;
+  struct ndpi_packet_struct *packet = &ndpi_struct->packet;
   const u_int8_t *packet_payload = packet->payload;
   u_int32_t payload_len = packet->payload_packet_len;
   
   if(packet->udp != NULL) {
     if(ndpi_struct->tinc_cache != NULL) {
-      struct tinc_cache_entry tinc_cache_entry1 = {
-        .src_address = packet->iph->saddr,
-        .dst_address = packet->iph->daddr,
-        .dst_port = packet->udp->dest
-      };
-
-      struct tinc_cache_entry tinc_cache_entry2 = {
-        .src_address = packet->iph->daddr,
-        .dst_address = packet->iph->saddr,
-        .dst_port = packet->udp->source
-      };
-
-      if(cache_remove(ndpi_struct->tinc_cache, &tinc_cache_entry1, sizeof(tinc_cache_entry1)) == CACHE_NO_ERROR ||
-	 cache_remove(ndpi_struct->tinc_cache, &tinc_cache_entry2, sizeof(tinc_cache_entry2)) == CACHE_NO_ERROR) {
-
-        cache_remove(ndpi_struct->tinc_cache, &tinc_cache_entry1, sizeof(tinc_cache_entry1));
-        cache_remove(ndpi_struct->tinc_cache, &tinc_cache_entry2, sizeof(tinc_cache_entry2));
-
-	/* cache_free(ndpi_struct->tinc_cache); */
-
+      u_int32_t dummy;
+      u_int8_t found1, found2;
+
+      /* Both directions are looked up (and removed) */
+      found1 = ndpi_lru_find_cache(ndpi_struct->tinc_cache,
+				   tinc_cache_key(packet->iph->saddr, packet->iph->daddr, packet->udp->dest),
+				   &dummy, 1 /* Remove it */, packet->tick_timestamp);
+      found2 = ndpi_lru_find_cache(ndpi_struct->tinc_cache,
+				   tinc_cache_key(packet->iph->daddr, packet->iph->saddr, packet->udp->source),
+				   &dummy, 1 /* Remove it */, packet->tick_timestamp);
+
+      if(found1 || found2) {
         NDPI_LOG_INFO(ndpi_struct, "found tinc udp connection\n");
         ndpi_set_detected_protocol(ndpi_struct, flow, NDPI_PROTOCOL_TINC, NDPI_PROTOCOL_UNKNOWN);
       }
@@ -110,9 +107,14 @@ static void ndpi_check_tinc(struct ndpi_detection_module_struct *ndpi_struct, st
 	if(packet_payload[i] == '\n') {
 	  if(++flow->tinc_state > 3) {
 	    if(ndpi_struct->tinc_cache == NULL)
-	      ndpi_struct->tinc_cache = cache_new(TINC_CACHE_MAX_SIZE);              
-
-	    cache_add(ndpi_struct->tinc_cache, &(flow->tinc_cache_entry), sizeof(flow->tinc_cache_entry));
+	      ndpi_struct->tinc_cache = ndpi_lru_cache_init(TINC_CACHE_MAX_SIZE, 0 /* No expiry */);
+
+	    if(ndpi_struct->tinc_cache != NULL)
+	      ndpi_lru_add_to_cache(ndpi_struct->tinc_cache,
+				    tinc_cache_key(flow->tinc_cache_entry.src_address,
+						   flow->tinc_cache_entry.dst_address,
+						   flow->tinc_cache_entry.dst_port),
+				    1 /* dummy */, packet->tick_timestamp);
 	    NDPI_LOG_INFO(ndpi_struct, "found tinc tcp connection\n");
 	    ndpi_set_detected_protocol(ndpi_struct, flow, NDPI_PROTOCOL_TINC, NDPI_PROTOCOL_UNKNOWN);
 	  }
@@ -129,7 +131,7 @@ static void ndpi_check_tinc(struct ndpi_detection_module_struct *ndpi_struct, st
 }
 
 void ndpi_search_tinc(struct ndpi_detection_module_struct* ndpi_struct, struct ndpi_flow_struct* flow) {
-  struct ndpi_packet_struct* packet = &flow->packet;
+  struct ndpi_packet_struct* packet = &ndpi_struct->packet;
 
   NDPI_LOG_DBG(ndpi_struct, "tinc detection\n");
 
@@ -57,13 +57,13 @@ extern u_int8_t is_skype_flow(struct ndpi_detection_module_struct *ndpi_struct,
 			      struct ndpi_flow_struct *flow);
 
 /* stun.c */
-extern u_int32_t get_stun_lru_key(struct ndpi_flow_struct *flow, u_int8_t rev);
+extern u_int64_t get_stun_lru_key(struct ndpi_packet_struct *packet, u_int8_t rev);
 
 /* **************************************** */
 
 static u_int32_t ndpi_tls_refine_master_protocol(struct ndpi_detection_module_struct *ndpi_struct,
 						 struct ndpi_flow_struct *flow, u_int32_t protocol) {
-  struct ndpi_packet_struct *packet = &flow->packet;
+  struct ndpi_packet_struct *packet = &ndpi_struct->packet;
 
   protocol = NDPI_PROTOCOL_TLS;
 
@@ -188,7 +188,7 @@ struct ja3_info {
 int getTLScertificate(struct ndpi_detection_module_struct *ndpi_struct,
 		      struct ndpi_flow_struct *flow,
 		      char *buffer, int buffer_len) {
-  struct ndpi_packet_struct *packet = &flow->packet;
+  struct ndpi_packet_struct *packet = &ndpi_struct->packet;
   struct ja3_info ja3;
   u_int8_t invalid_ja3 = 0;
   u_int16_t pkt_tls_version = (packet->payload[1] << 8) + packet->payload[2], ja3_str_len;
@@ -206,7 +206,10 @@ int getTLScertificate(struct ndpi_detection_module_struct *ndpi_struct,
     }
   }
 
-  flow->protos.stun_ssl.ssl.ssl_version = pkt_tls_version;
+  if(ndpi_flow_alloc_protos(flow) == NULL)
+    return(0);
+
+  flow->protos->stun_ssl.ssl.ssl_version = pkt_tls_version;
 
   memset(&ja3, 0, sizeof(ja3));
 
@@ -277,7 +280,7 @@ int getTLScertificate(struct ndpi_detection_module_struct *ndpi_struct,
 	     The server hello decides about the SSL version of this flow
 	     https://networkengineering.stackexchange.com/questions/55752/why-does-wireshark-show-version-tls-1-2-here-instead-of-tls-1-3
 	  */
-	  flow->protos.stun_ssl.ssl.ssl_version = tls_version;
+	  flow->protos->stun_ssl.ssl.ssl_version = tls_version;
 
 	  if(packet->udp)
 	    offset += 1;
@@ -287,8 +290,8 @@ int getTLScertificate(struct ndpi_detection_module_struct *ndpi_struct,
 	  }
 
 	  ja3.num_cipher = 1, ja3.cipher[0] = ntohs(*((u_int16_t*)&packet->payload[offset]));
-	  flow->protos.stun_ssl.ssl.server_unsafe_cipher = ndpi_is_safe_ssl_cipher(ja3.cipher[0]);
-	  flow->protos.stun_ssl.ssl.server_cipher = ja3.cipher[0];
+	  flow->protos->stun_ssl.ssl.server_unsafe_cipher = ndpi_is_safe_ssl_cipher(ja3.cipher[0]);
+	  flow->protos->stun_ssl.ssl.server_cipher = ja3.cipher[0];
 
 #ifdef DEBUG_TLS
 	  printf("TLS [server][session_id_len: %u][cipher: %04X]\n", session_id_len, ja3.cipher[0]);
@@ -326,7 +329,7 @@ int getTLScertificate(struct ndpi_detection_module_struct *ndpi_struct,
 		printf("TLS [server] [TLS version: 0x%04X]\n", tls_version);
 #endif
 		
-		flow->protos.stun_ssl.ssl.ssl_version = tls_version;
+		flow->protos->stun_ssl.ssl.ssl_version = tls_version;
 	      }
 	    }
 	    
@@ -358,11 +361,11 @@ int getTLScertificate(struct ndpi_detection_module_struct *ndpi_struct,
 	  ndpi_MD5Final(md5_hash, &ctx);
 
 	  for(i=0, j=0; i<16; i++)
-	    j += snprintf(&flow->protos.stun_ssl.ssl.ja3_server[j],
-			  sizeof(flow->protos.stun_ssl.ssl.ja3_server)-j, "%02x", md5_hash[i]);
+	    j += snprintf(&flow->protos->stun_ssl.ssl.ja3_server[j],
+			  sizeof(flow->protos->stun_ssl.ssl.ja3_server)-j, "%02x", md5_hash[i]);
 
 #ifdef DEBUG_TLS
-	  printf("[JA3] Server: %s \n", flow->protos.stun_ssl.ssl.ja3_server);
+	  printf("[JA3] Server: %s \n", flow->protos->stun_ssl.ssl.ja3_server);
 #endif
 
 	  flow->l4.tcp.tls_seen_server_cert = 1;
@@ -412,8 +415,8 @@ int getTLScertificate(struct ndpi_detection_module_struct *ndpi_struct,
 	      if(num_dots >= 1) {
 		if(!ndpi_struct->disable_metadata_export) {
 		  stripCertificateTrailer(buffer, buffer_len);
-		  snprintf(flow->protos.stun_ssl.ssl.server_certificate,
-			   sizeof(flow->protos.stun_ssl.ssl.server_certificate), "%s", buffer);
+		  snprintf(flow->protos->stun_ssl.ssl.server_certificate,
+			   sizeof(flow->protos->stun_ssl.ssl.server_certificate), "%s", buffer);
 		}
 
 		return(1 /* Server Certificate */);
@@ -558,8 +561,8 @@ int getTLScertificate(struct ndpi_detection_module_struct *ndpi_struct,
 		      stripCertificateTrailer(buffer, buffer_len);
 
 		      if(!ndpi_struct->disable_metadata_export) {
-			snprintf(flow->protos.stun_ssl.ssl.client_certificate,
-				 sizeof(flow->protos.stun_ssl.ssl.client_certificate), "%s", buffer);
+			snprintf(flow->protos->stun_ssl.ssl.client_certificate,
+				 sizeof(flow->protos->stun_ssl.ssl.client_certificate), "%s", buffer);
 		      }
 		    } else if(extension_id == 10 /* supported groups */) {
 		      u_int16_t s_offset = offset+extension_offset + 2;
@@ -687,12 +690,12 @@ int getTLScertificate(struct ndpi_detection_module_struct *ndpi_struct,
 		    ndpi_MD5Final(md5_hash, &ctx);
 
 		    for(i=0, j=0; i<16; i++)
-		      j += snprintf(&flow->protos.stun_ssl.ssl.ja3_client[j],
-				    sizeof(flow->protos.stun_ssl.ssl.ja3_client)-j, "%02x",
+		      j += snprintf(&flow->protos->stun_ssl.ssl.ja3_client[j],
+				    sizeof(flow->protos->stun_ssl.ssl.ja3_client)-j, "%02x",
 				    md5_hash[i]);
 
 #ifdef DEBUG_TLS
-		    printf("[JA3] Client: %s \n", flow->protos.stun_ssl.ssl.ja3_client);
+		    printf("[JA3] Client: %s \n", flow->protos->stun_ssl.ssl.ja3_client);
 #endif
 		  }
 
@@ -717,7 +720,7 @@ int getTLScertificate(struct ndpi_detection_module_struct *ndpi_struct,
 /* See https://blog.catchpoint.com/2017/05/12/dissecting-tls-using-wireshark/ */
 int getSSCertificateFingerprint(struct ndpi_detection_module_struct *ndpi_struct,
 				struct ndpi_flow_struct *flow) {
-  struct ndpi_packet_struct *packet = &flow->packet;
+  struct ndpi_packet_struct *packet = &ndpi_struct->packet;
   u_int8_t multiple_messages;
 
   if(flow->l4.tcp.tls_srv_cert_fingerprint_processed)
@@ -876,7 +879,7 @@ int getSSCertificateFingerprint(struct ndpi_detection_module_struct *ndpi_struct
 void getSSLorganization(struct ndpi_detection_module_struct *ndpi_struct,
 			struct ndpi_flow_struct *flow,
 			char *buffer, int buffer_len) {
-  struct ndpi_packet_struct *packet = &flow->packet;
+  struct ndpi_packet_struct *packet = &ndpi_struct->packet;
   u_int16_t total_len;
   u_int8_t handshake_protocol;
   
@@ -890,6 +893,9 @@ void getSSLorganization(struct ndpi_detection_module_struct *ndpi_struct,
      && (handshake_protocol != 0xb) /* Server Hello and Certificate message types are interesting for us */)
     return;
 
+  if(ndpi_flow_alloc_protos(flow) == NULL)
+    return;
+
 #ifdef DEBUG_TLS
   printf("=>> [TLS] Certificate [total_len: %u/%u]\n", ntohs(*(u_int16_t*)&packet->payload[3]), total_len);
 #endif
@@ -933,10 +939,10 @@ void getSSLorganization(struct ndpi_detection_module_struct *ndpi_struct,
       }
 
       if(is_printable == 1) {
-	snprintf(flow->protos.stun_ssl.ssl.server_organization,
-		 sizeof(flow->protos.stun_ssl.ssl.server_organization), "%s", buffer);
+	snprintf(flow->protos->stun_ssl.ssl.server_organization,
+		 sizeof(flow->protos->stun_ssl.ssl.server_organization), "%s", buffer);
 #ifdef DEBUG_TLS
-	printf("Certificate organization: %s\n", flow->protos.stun_ssl.ssl.server_organization);
+	printf("Certificate organization: %s\n", flow->protos->stun_ssl.ssl.server_organization);
 #endif
       }
     } else if((packet->payload[i] == 0x30) && (packet->payload[i+1] == 0x1e) && (packet->payload[i+2] == 0x17)) {
@@ -961,10 +967,10 @@ void getSSLorganization(struct ndpi_detection_module_struct *ndpi_struct,
 
 	  /* 141021000000Z */
 	  if(strptime(utcDate, "%y%m%d%H%M%SZ", &utc) != NULL) {
-	    flow->protos.stun_ssl.ssl.notBefore = timegm(&utc);
+	    flow->protos->stun_ssl.ssl.notBefore = timegm(&utc);
 #ifdef DEBUG_TLS
 	    printf("[CERTIFICATE] notBefore %u [%s]\n",
-		   flow->protos.stun_ssl.ssl.notBefore, utcDate);
+		   flow->protos->stun_ssl.ssl.notBefore, utcDate);
 #endif
 	  }
 	}
@@ -992,10 +998,10 @@ void getSSLorganization(struct ndpi_detection_module_struct *ndpi_struct,
 
 	      /* 141021000000Z */
 	      if(strptime(utcDate, "%y%m%d%H%M%SZ", &utc) != NULL) {
-		flow->protos.stun_ssl.ssl.notAfter = timegm(&utc);
+		flow->protos->stun_ssl.ssl.notAfter = timegm(&utc);
 #ifdef DEBUG_TLS
 		printf("[CERTIFICATE] notAfter %u [%s]\n",
-		       flow->protos.stun_ssl.ssl.notAfter, utcDate);
+		       flow->protos->stun_ssl.ssl.notAfter, utcDate);
 #endif
 	      }
 	    }
@@ -1010,7 +1016,7 @@ void getSSLorganization(struct ndpi_detection_module_struct *ndpi_struct,
 
 int sslTryAndRetrieveServerCertificate(struct ndpi_detection_module_struct *ndpi_struct,
 				       struct ndpi_flow_struct *flow) {
-  struct ndpi_packet_struct *packet = &flow->packet;
+  struct ndpi_packet_struct *packet = &ndpi_struct->packet;
   int rc = 1;
   
   if(packet->tcp) {
@@ -1026,7 +1032,7 @@ int sslTryAndRetrieveServerCertificate(struct ndpi_detection_module_struct *ndpi
 
     certificate[0] = '\0';
     rc = getTLScertificate(ndpi_struct, flow, certificate, sizeof(certificate));
-    packet->tls_certificate_num_checks++;
+    flow->tls_certificate_num_checks++;
 
     if(rc > 0) {
       char organization[64];
@@ -1035,10 +1041,10 @@ int sslTryAndRetrieveServerCertificate(struct ndpi_detection_module_struct *ndpi
       organization[0] = '\0';
       getSSLorganization(ndpi_struct, flow, organization, sizeof(organization));
 
-      packet->tls_certificate_detected++;
+      flow->tls_certificate_detected++;
 #if 0
       if((flow->l4.tcp.tls_seen_server_cert == 1)
-	 && (flow->protos.stun_ssl.ssl.server_certificate[0] != '\0'))
+	 && (ndpi_flow_get_protos(flow)->stun_ssl.ssl.server_certificate[0] != '\0'))
         /* 0 means we've done processing extra packets (since we found what we wanted) */
         return 0;
 #endif
@@ -1046,12 +1052,12 @@ int sslTryAndRetrieveServerCertificate(struct ndpi_detection_module_struct *ndpi
 
     if(flow->l4.tcp.tls_record_offset == 0) {
     /* Client hello, Server Hello, and certificate packets probably all checked in this case */
-      if(((packet->tls_certificate_num_checks >= 3)
+      if(((flow->tls_certificate_num_checks >= 3)
 	  && (flow->l4.tcp.seen_syn)
 	  && (flow->l4.tcp.seen_syn_ack)
 	  && (flow->l4.tcp.seen_ack) /* We have seen the 3-way handshake */
 	  && flow->l4.tcp.tls_srv_cert_fingerprint_processed)
-	 /* || (flow->protos.stun_ssl.ssl.ja3_server[0] != '\0') */
+	 /* || (ndpi_flow_get_protos(flow)->stun_ssl.ssl.ja3_server[0] != '\0') */
 	 ) {
 	/* We're done processing extra packets since we've probably checked all possible cert packets */
 	return(rc);
@@ -1082,7 +1088,7 @@ void sslInitExtraPacketProcessing(int caseNum, struct ndpi_flow_struct *flow) {
 int tlsDetectProtocolFromCertificate(struct ndpi_detection_module_struct *ndpi_struct,
 				     struct ndpi_flow_struct *flow,
 				     u_int8_t skip_cert_processing) {
-  struct ndpi_packet_struct *packet = &flow->packet;
+  struct ndpi_packet_struct *packet = &ndpi_struct->packet;
 
   if((!skip_cert_processing) && packet->tcp) {
     if(!flow->l4.tcp.tls_srv_cert_fingerprint_processed)
@@ -1098,10 +1104,10 @@ int tlsDetectProtocolFromCertificate(struct ndpi_detection_module_struct *ndpi_s
 
       certificate[0] = '\0';
       rc = getTLScertificate(ndpi_struct, flow, certificate, sizeof(certificate));
-      packet->tls_certificate_num_checks++;
+      flow->tls_certificate_num_checks++;
 
       if(rc > 0) {
-	packet->tls_certificate_detected++;
+	flow->tls_certificate_detected++;
 #ifdef DEBUG_TLS
 	NDPI_LOG_DBG2(ndpi_struct, "***** [SSL] %s\n", certificate);
 #endif
@@ -1115,8 +1121,8 @@ int tlsDetectProtocolFromCertificate(struct ndpi_detection_module_struct *ndpi_s
 	  /* If we've detected the subprotocol from client certificate but haven't had a chance
 	   * to see the server certificate yet, set up extra packet processing to wait
 	   * a few more packets. */
-	  if(((flow->l4.tcp.tls_seen_client_cert == 1) && (flow->protos.stun_ssl.ssl.client_certificate[0] != '\0'))
-	     && ((flow->l4.tcp.tls_seen_server_cert != 1) && (flow->protos.stun_ssl.ssl.server_certificate[0] == '\0'))) {
+	  if(((flow->l4.tcp.tls_seen_client_cert == 1) && (ndpi_flow_get_protos(flow)->stun_ssl.ssl.client_certificate[0] != '\0'))
+	     && ((flow->l4.tcp.tls_seen_server_cert != 1) && (ndpi_flow_get_protos(flow)->stun_ssl.ssl.server_certificate[0] == '\0'))) {
 	    sslInitExtraPacketProcessing(0, flow);
 	  }
 
@@ -1129,7 +1135,7 @@ int tlsDetectProtocolFromCertificate(struct ndpi_detection_module_struct *ndpi_s
 	  return(rc);
       }
 
-      if(((packet->tls_certificate_num_checks >= 3)
+      if(((flow->tls_certificate_num_checks >= 3)
 	  && flow->l4.tcp.seen_syn
 	  && flow->l4.tcp.seen_syn_ack
 	  && flow->l4.tcp.seen_ack /* We have seen the 3-way handshake */
@@ -1138,9 +1144,9 @@ int tlsDetectProtocolFromCertificate(struct ndpi_detection_module_struct *ndpi_s
 	 /*
 	 || ((flow->l4.tcp.tls_seen_certificate == 1)
 	     && (flow->l4.tcp.tls_seen_server_cert == 1)
-	     && (flow->protos.stun_ssl.ssl.server_certificate[0] != '\0'))
+	     && (ndpi_flow_get_protos(flow)->stun_ssl.ssl.server_certificate[0] != '\0'))
 	 */
-	 /* || ((flow->l4.tcp.tls_seen_client_cert == 1) && (flow->protos.stun_ssl.ssl.client_certificate[0] != '\0')) */
+	 /* || ((flow->l4.tcp.tls_seen_client_cert == 1) && (ndpi_flow_get_protos(flow)->stun_ssl.ssl.client_certificate[0] != '\0')) */
 	 ) {
 	ndpi_int_tls_add_connection(ndpi_struct, flow, NDPI_PROTOCOL_TLS);
       }
@@ -1155,7 +1161,7 @@ int tlsDetectProtocolFromCertificate(struct ndpi_detection_module_struct *ndpi_s
 static void tls_mark_and_payload_search(struct ndpi_detection_module_struct
 					*ndpi_struct, struct ndpi_flow_struct *flow,
 					u_int8_t skip_cert_processing) {
-  struct ndpi_packet_struct *packet = &flow->packet;
+  struct ndpi_packet_struct *packet = &ndpi_struct->packet;
   u_int32_t a;
   u_int32_t end;
 
@@ -1228,12 +1234,12 @@ static void tls_mark_and_payload_search(struct ndpi_detection_module_struct
     NDPI_LOG_DBG(ndpi_struct, "found ssl connection\n");
     tlsDetectProtocolFromCertificate(ndpi_struct, flow, skip_cert_processing);
     
-    if(!packet->tls_certificate_detected
+    if(!flow->tls_certificate_detected
        && (!(flow->l4.tcp.tls_seen_client_cert && flow->l4.tcp.tls_seen_server_cert))) {
       /* SSL without certificate (Skype, Ultrasurf?) */
       NDPI_LOG_INFO(ndpi_struct, "found ssl NO_CERT\n");
       ndpi_int_tls_add_connection(ndpi_struct, flow, NDPI_PROTOCOL_TLS);
-    } else if((packet->tls_certificate_num_checks >= 3)
+    } else if((flow->tls_certificate_num_checks >= 3)
 	      && flow->l4.tcp.tls_srv_cert_fingerprint_processed) {
       NDPI_LOG_INFO(ndpi_struct, "found ssl\n");
       ndpi_int_tls_add_connection(ndpi_struct, flow, NDPI_PROTOCOL_TLS);
@@ -1245,7 +1251,7 @@ static void tls_mark_and_payload_search(struct ndpi_detection_module_struct
 
 static u_int8_t ndpi_search_tlsv3_direction1(struct ndpi_detection_module_struct *ndpi_struct,
 					     struct ndpi_flow_struct *flow) {
-  struct ndpi_packet_struct *packet = &flow->packet;
+  struct ndpi_packet_struct *packet = &ndpi_struct->packet;
 
   if((packet->payload_packet_len >= 5)
      && ((packet->payload[0] == 0x16) || packet->payload[0] == 0x17)
@@ -1350,7 +1356,7 @@ static u_int8_t ndpi_search_tlsv3_direction1(struct ndpi_detection_module_struct
 
 void ndpi_search_tls_tcp_udp(struct ndpi_detection_module_struct *ndpi_struct,
 			     struct ndpi_flow_struct *flow) {
-  struct ndpi_packet_struct *packet = &flow->packet;
+  struct ndpi_packet_struct *packet = &ndpi_struct->packet;
   u_int8_t ret, skip_cert_processing = 0;
 
   if(packet->udp != NULL) {
@@ -1359,29 +1365,29 @@ void ndpi_search_tls_tcp_udp(struct ndpi_detection_module_struct *ndpi_struct,
 
 #ifdef DEBUG_TLS
     printf("==>> %u [rc: %d][len: %u][%s][version: %u]\n",
-	   flow->guessed_host_protocol_id, rc, packet->payload_packet_len, flow->protos.stun_ssl.ssl.ja3_server,
-	   flow->protos.stun_ssl.ssl.ssl_version);
+	   flow->guessed_host_protocol_id, rc, packet->payload_packet_len, ndpi_flow_get_protos(flow)->stun_ssl.ssl.ja3_server,
+	   ndpi_flow_get_protos(flow)->stun_ssl.ssl.ssl_version);
 #endif
 
-    if((rc == 0) && (flow->protos.stun_ssl.ssl.ssl_version != 0)) {
+    if((rc == 0) && (ndpi_flow_get_protos(flow)->stun_ssl.ssl.ssl_version != 0)) {
       flow->guessed_protocol_id = NDPI_PROTOCOL_TLS;
 
-      if(flow->protos.stun_ssl.stun.num_udp_pkts > 0) {
+      if(flow->stun.num_udp_pkts > 0) {
 	if(ndpi_struct->stun_cache == NULL)
-	  ndpi_struct->stun_cache = ndpi_lru_cache_init(1024);
+	  ndpi_struct->stun_cache = ndpi_lru_cache_init(ndpi_struct->stun_cache_num_entries, ndpi_struct->stun_cache_ttl);
 
 	if(ndpi_struct->stun_cache) {
 #ifdef DEBUG_TLS
 	  printf("[LRU] Adding Signal cached keys\n");
 #endif
 	  
-	  ndpi_lru_add_to_cache(ndpi_struct->stun_cache, get_stun_lru_key(flow, 0), NDPI_PROTOCOL_SIGNAL);
-	  ndpi_lru_add_to_cache(ndpi_struct->stun_cache, get_stun_lru_key(flow, 1), NDPI_PROTOCOL_SIGNAL);
+	  ndpi_lru_add_to_cache(ndpi_struct->stun_cache, get_stun_lru_key(packet, 0), NDPI_PROTOCOL_SIGNAL, packet->tick_timestamp);
+	  ndpi_lru_add_to_cache(ndpi_struct->stun_cache, get_stun_lru_key(packet, 1), NDPI_PROTOCOL_SIGNAL, packet->tick_timestamp);
 	}
 		
 	/* In Signal protocol STUN turns into DTLS... */
 	ndpi_int_tls_add_connection(ndpi_struct, flow, NDPI_PROTOCOL_SIGNAL);
-      } else if(flow->protos.stun_ssl.ssl.ja3_server[0] != '\0') {
+      } else if(ndpi_flow_get_protos(flow)->stun_ssl.ssl.ja3_server[0] != '\0') {
 	/* Wait the server certificate the bless this flow as TLS */
 	ndpi_int_tls_add_connection(ndpi_struct, flow, NDPI_PROTOCOL_TLS);
       }
@@ -96,12 +96,12 @@ int ndpi_is_tls_tor(struct ndpi_detection_module_struct *ndpi_struct,
 
 void ndpi_search_tor(struct ndpi_detection_module_struct *ndpi_struct, struct ndpi_flow_struct *flow)
 {
-  struct ndpi_packet_struct *packet = &flow->packet;
+  struct ndpi_packet_struct *packet = &ndpi_struct->packet;
 
   NDPI_LOG_DBG(ndpi_struct, "search for TOR\n");
 
   if((packet->tcp != NULL)
-     && (!packet->tls_certificate_detected)) {
+     && (!flow->tls_certificate_detected)) {
     u_int16_t dport, sport;
     
     sport = ntohs(packet->tcp->source), dport = ntohs(packet->tcp->dest);
@@ -55,8 +55,48 @@ typedef struct
   /* Statistic Variables */
   unsigned long total_patterns; /* Total patterns in the automata */
 
+  /* Compiled form built by ac_automata_finalize(): a DFA with the failure
+   * links resolved, so that the search does one lookup per input byte.
+   * Input bytes are mapped to the classes of the alphabets used by the
+   * patterns, and every state has a row of dfa_num_classes transitions.
+   * A transition is the offset of the target row, with AC_DFA_FINAL set
+   * when the target is a final node. dfa is NULL when the automata is too
+   * large to be compiled: the search then walks the nodes. */
+  u_int32_t * dfa;
+  AC_NODE_t ** dfa_nodes; /* Node of every DFA state */
+  unsigned int dfa_num_classes;
+  u_int16_t dfa_class[256];
+  u_int32_t current_state; /* Row of current_node while searching */
+
+  /* Set for automata created by ac_automata_init_image(): dfa points into
+   * the image and there are no nodes. matches are copied to image_patterns
+   * when reported. */
+  const struct ac_image * image;
+  AC_PATTERN_t * image_patterns;
+
 } AC_AUTOMATA_t;
 
+/* Read-only image of a compiled automata (see ac_automata_write_image):
+ * it has no pointers, so it can be mmap()ed. It is followed by
+ *   u_int32_t dfa[num_states*num_classes];
+ *   u_int32_t state_matches[num_states+1]; (matches of state i are the
+ *     entries state_matches[i] ... state_matches[i+1]-1)
+ *   struct ac_image_match matches[num_matches];
+ *   char strings[strings_len]; (NUL terminated pattern strings)
+ */
+struct ac_image
+{
+  u_int32_t num_states, num_classes, num_matches, strings_len;
+  u_int32_t total_patterns, max_state_matches;
+  u_int16_t dfa_class[256];
+};
+
+struct ac_image_match
+{
+  u_int32_t string_offset, length;
+  AC_REP_t rep;
+};
+
 
 AC_AUTOMATA_t * ac_automata_init     (MATCH_CALLBACK_f mc);
 AC_ERROR_t      ac_automata_add      (AC_AUTOMATA_t * thiz, AC_PATTERN_t * str);
@@ -65,5 +105,8 @@ int             ac_automata_search   (AC_AUTOMATA_t * thiz, AC_TEXT_t * str, AC_
 void            ac_automata_reset    (AC_AUTOMATA_t * thiz);
 void            ac_automata_release  (AC_AUTOMATA_t * thiz, u_int8_t free_pattern);
 void            ac_automata_display  (AC_AUTOMATA_t * thiz, char repcast);
+size_t          ac_automata_image_size  (AC_AUTOMATA_t * thiz);
+int             ac_automata_write_image (AC_AUTOMATA_t * thiz, void * buf, size_t len);
+AC_AUTOMATA_t * ac_automata_init_image  (MATCH_CALLBACK_f mc, const void * buf, size_t len);
 
 #endif
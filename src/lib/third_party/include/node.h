@@ -43,6 +43,8 @@ typedef struct ac_node
   struct edge * outgoing; /* Array of outgoing edges */
   unsigned short outgoing_degree; /* Number of outgoing edges */
   unsigned short outgoing_max; /* Max capacity of allocated memory for outgoing */
+
+  unsigned int dfa_state; /* Row of this node in the compiled DFA */
 } AC_NODE_t;
 
 /* The Edge of the Node */
@@ -29,6 +29,10 @@
 /* Allocation step for automata.all_nodes */
 #define REALLOC_CHUNK_ALLNODES 200
 
+/* Compiled DFA: transition flag and max size of the transition table */
+#define AC_DFA_FINAL    0x80000000
+#define AC_DFA_MAX_SIZE (32*1024*1024)
+
 /* Private function prototype */
 static void ac_automata_register_nodeptr
 (AC_AUTOMATA_t * thiz, AC_NODE_t * node);
@@ -38,6 +42,10 @@ static void ac_automata_set_failure
 (AC_AUTOMATA_t * thiz, AC_NODE_t * node, AC_ALPHABET_t * alphas);
 static void ac_automata_traverse_setfailure
 (AC_AUTOMATA_t * thiz, AC_NODE_t * node, AC_ALPHABET_t * alphas);
+static void ac_automata_compile
+(AC_AUTOMATA_t * thiz);
+static void ac_automata_set_matches
+(AC_AUTOMATA_t * thiz, u_int32_t state);
 
 
 /******************************************************************************
@@ -118,8 +126,9 @@ AC_ERROR_t ac_automata_add (AC_AUTOMATA_t * thiz, AC_PATTERN_t * patt)
  * FUNCTION: ac_automata_finalize
  * Locate the failure node for all nodes and collect all matched pattern for
  * every node. it also sorts outgoing edges of node, so binary search could be
- * performed on them. after calling this function the automate literally will
- * be finalized and you can not add new patterns to the automate.
+ * performed on them, and compiles the DFA used by ac_automata_search(). after
+ * calling this function the automate literally will be finalized and you can
+ * not add new patterns to the automate.
  * PARAMS:
  * AC_AUTOMATA_t * thiz: the pointer to the automata
  ******************************************************************************/
@@ -129,6 +138,9 @@ void ac_automata_finalize (AC_AUTOMATA_t * thiz)
   AC_ALPHABET_t *alphas;
   AC_NODE_t * node;
 
+  if(!thiz->automata_open)
+    return; /* Already finalized */
+
   if((alphas = ndpi_malloc(AC_PATTRN_MAX_LENGTH)) != NULL) {
     ac_automata_traverse_setfailure (thiz, thiz->root, alphas);
 
@@ -138,6 +150,7 @@ void ac_automata_finalize (AC_AUTOMATA_t * thiz)
 	ac_automata_union_matchstrs (node);
 	node_sort_edges (node);
       }
+    ac_automata_compile (thiz);
     thiz->automata_open = 0; /* do not accept patterns any more */
     ndpi_free(alphas);
   }
@@ -170,6 +183,33 @@ int ac_automata_search (AC_AUTOMATA_t * thiz, AC_TEXT_t * txt, AC_REP_t * param)
     return -1;
 
   position = 0;
+
+  if(thiz->dfa)
+    {
+      u_int32_t state = thiz->current_state;
+
+      /* One transition per byte: the failure links are already resolved */
+      while (position < txt->length)
+	{
+	  state = thiz->dfa[state + thiz->dfa_class[(u_int8_t)txt->astring[position++]]];
+
+	  if(state & AC_DFA_FINAL)
+	    {
+	      state &= ~AC_DFA_FINAL;
+	      ac_automata_set_matches (thiz, state / thiz->dfa_num_classes);
+	      thiz->match.position = position + thiz->base_position;
+	      /* we found a match! do call-back */
+	      if (thiz->match_callback(&thiz->match, txt, param))
+		return 1;
+	    }
+	}
+
+      /* save status variables */
+      thiz->current_state = state;
+      thiz->base_position += position;
+      return 0;
+    }
+
   curr = thiz->current_node;
 
   /* This is the main search loop.
@@ -219,6 +259,7 @@ int ac_automata_search (AC_AUTOMATA_t * thiz, AC_TEXT_t * txt, AC_REP_t * param)
 void ac_automata_reset (AC_AUTOMATA_t * thiz)
 {
   thiz->current_node = thiz->root;
+  thiz->current_state = 0;
   thiz->base_position = 0;
 }
 
@@ -239,7 +280,15 @@ void ac_automata_release (AC_AUTOMATA_t * thiz, u_int8_t free_pattern)
       n = thiz->all_nodes[i];
       node_release(n, free_pattern);
     }
-  ndpi_free(thiz->all_nodes);
+  if(thiz->image)
+    ndpi_free(thiz->image_patterns); /* dfa belongs to the image */
+  else if(thiz->dfa)
+    {
+      ndpi_free(thiz->dfa);
+      ndpi_free(thiz->dfa_nodes);
+    }
+  if(thiz->all_nodes)
+    ndpi_free(thiz->all_nodes);
   ndpi_free(thiz);
 }
 
@@ -385,3 +434,261 @@ static void ac_automata_traverse_setfailure
       ac_automata_traverse_setfailure (thiz, next, alphas);
     }
 }
+
+/******************************************************************************
+ * FUNCTION: ac_automata_compile
+ * Build the DFA of the finalized automata. states are numbered in BFS order
+ * so that the failure node of a state always precedes it: its row is then
+ * the row of its failure node overridden by its own outgoing edges. on
+ * failure, or when the table would be larger than AC_DFA_MAX_SIZE, thiz->dfa
+ * is left NULL.
+ ******************************************************************************/
+static void ac_automata_compile (AC_AUTOMATA_t * thiz)
+{
+  unsigned int i, j, num_classes = 1 /* bytes not used by any pattern */;
+  unsigned int head, tail;
+  AC_NODE_t * node;
+  u_int32_t * row;
+
+  memset(thiz->dfa_class, 0, sizeof(thiz->dfa_class));
+
+  for (i=0; i < thiz->all_nodes_num; i++)
+    {
+      node = thiz->all_nodes[i];
+      for (j=0; j < node->outgoing_degree; j++)
+	{
+	  u_int8_t alpha = (u_int8_t)node->outgoing[j].alpha;
+
+	  if(!thiz->dfa_class[alpha])
+	    thiz->dfa_class[alpha] = num_classes++;
+	}
+    }
+
+  if(((u_int64_t)thiz->all_nodes_num * num_classes * sizeof(u_int32_t)) > AC_DFA_MAX_SIZE)
+    return;
+
+  thiz->dfa_nodes = (AC_NODE_t **) ndpi_malloc(thiz->all_nodes_num * sizeof(AC_NODE_t *));
+  thiz->dfa = (u_int32_t *) ndpi_calloc(thiz->all_nodes_num * num_classes, sizeof(u_int32_t));
+
+  if((thiz->dfa_nodes == NULL) || (thiz->dfa == NULL))
+    {
+      if(thiz->dfa_nodes) ndpi_free(thiz->dfa_nodes);
+      if(thiz->dfa) ndpi_free(thiz->dfa);
+      thiz->dfa_nodes = NULL, thiz->dfa = NULL;
+      return;
+    }
+
+  thiz->dfa_num_classes = num_classes;
+
+  /* dfa_nodes is also the BFS queue */
+  thiz->dfa_nodes[0] = thiz->root, thiz->root->dfa_state = 0;
+  head = 0, tail = 1;
+
+  while (head < tail)
+    {
+      node = thiz->dfa_nodes[head];
+      row = &thiz->dfa[node->dfa_state];
+
+      /* The root row is all zeros: missing edges go back to the root */
+      if(node != thiz->root)
+	memcpy(row, &thiz->dfa[node->failure_node->dfa_state], num_classes * sizeof(u_int32_t));
+
+      for (j=0; j < node->outgoing_degree; j++)
+	{
+	  AC_NODE_t * next = node->outgoing[j].next;
+
+	  next->dfa_state = tail * num_classes;
+	  thiz->dfa_nodes[tail++] = next;
+	  row[thiz->dfa_class[(u_int8_t)node->outgoing[j].alpha]] = next->dfa_state | (next->final ? AC_DFA_FINAL : 0);
+	}
+
+      head++;
+    }
+}
+
+/******************************************************************************
+ * FUNCTION: ac_automata_set_matches
+ * Set the patterns matched by the given DFA state in thiz->match.
+ ******************************************************************************/
+static void ac_automata_set_matches (AC_AUTOMATA_t * thiz, u_int32_t state)
+{
+  if(thiz->image)
+    {
+      const u_int32_t * state_matches = &thiz->dfa[thiz->image->num_states * thiz->image->num_classes];
+      const struct ac_image_match * m = (const struct ac_image_match *)&state_matches[thiz->image->num_states + 1];
+      const char * strings = (const char *)&m[thiz->image->num_matches];
+      u_int32_t i, n = 0;
+
+      for (i = state_matches[state]; i < state_matches[state + 1]; i++, n++)
+	{
+	  thiz->image_patterns[n].astring = (AC_ALPHABET_t *)&strings[m[i].string_offset];
+	  thiz->image_patterns[n].length = m[i].length;
+	  thiz->image_patterns[n].rep = m[i].rep;
+	}
+
+      thiz->match.match_num = n;
+      thiz->match.patterns = thiz->image_patterns;
+    }
+  else
+    {
+      AC_NODE_t * node = thiz->dfa_nodes[state];
+
+      thiz->match.match_num = node->matched_patterns_num;
+      thiz->match.patterns = node->matched_patterns;
+    }
+}
+
+/******************************************************************************
+ * FUNCTION: ac_automata_image_size
+ * Return the size of the image of the finalized automata, or 0 when it has
+ * no DFA (see ac_automata_compile).
+ ******************************************************************************/
+size_t ac_automata_image_size (AC_AUTOMATA_t * thiz)
+{
+  size_t len;
+  unsigned int i, j;
+
+  if(thiz->automata_open || (thiz->dfa == NULL) || thiz->image)
+    return 0;
+
+  len = sizeof(struct ac_image)
+    + (thiz->all_nodes_num * thiz->dfa_num_classes + thiz->all_nodes_num + 1) * sizeof(u_int32_t);
+
+  for (i=0; i < thiz->all_nodes_num; i++)
+    for (j=0; j < thiz->all_nodes[i]->matched_patterns_num; j++)
+      len += sizeof(struct ac_image_match) + thiz->all_nodes[i]->matched_patterns[j].length + 1;
+
+  return len;
+}
+
+/******************************************************************************
+ * FUNCTION: ac_automata_write_image
+ * Write the image of the finalized automata to buf, that must be at least
+ * ac_automata_image_size() bytes and aligned to 4 bytes.
+ * RETURN VALUE: 0 on success, -1 on failure
+ ******************************************************************************/
+int ac_automata_write_image (AC_AUTOMATA_t * thiz, void * buf, size_t len)
+{
+  struct ac_image * img = (struct ac_image *)buf;
+  u_int32_t * state_matches;
+  struct ac_image_match * m;
+  char * strings;
+  unsigned int i, j, n = 0, num_dfa = thiz->all_nodes_num * thiz->dfa_num_classes;
+  u_int32_t strings_len = 0;
+
+  if((len == 0) || (len < ac_automata_image_size(thiz)))
+    return -1;
+
+  memset(img, 0, sizeof(struct ac_image));
+  img->num_states = thiz->all_nodes_num, img->num_classes = thiz->dfa_num_classes;
+  img->total_patterns = thiz->total_patterns;
+  memcpy(img->dfa_class, thiz->dfa_class, sizeof(img->dfa_class));
+  memcpy(&img[1], thiz->dfa, num_dfa * sizeof(u_int32_t));
+
+  state_matches = &((u_int32_t *)&img[1])[num_dfa];
+
+  for (i=0; i < thiz->all_nodes_num; i++)
+    {
+      state_matches[i] = n;
+      n += thiz->dfa_nodes[i]->matched_patterns_num;
+      if(thiz->dfa_nodes[i]->matched_patterns_num > img->max_state_matches)
+	img->max_state_matches = thiz->dfa_nodes[i]->matched_patterns_num;
+    }
+  state_matches[i] = img->num_matches = n;
+
+  m = (struct ac_image_match *)&state_matches[thiz->all_nodes_num + 1];
+  strings = (char *)&m[n];
+
+  for (i=0, n=0; i < thiz->all_nodes_num; i++)
+    for (j=0; j < thiz->dfa_nodes[i]->matched_patterns_num; j++, n++)
+      {
+	AC_PATTERN_t * p = &thiz->dfa_nodes[i]->matched_patterns[j];
+
+	m[n].string_offset = strings_len, m[n].length = p->length;
+	memset(&m[n].rep, 0, sizeof(AC_REP_t));
+	m[n].rep.number = p->rep.number, m[n].rep.category = p->rep.category, m[n].rep.breed = p->rep.breed;
+	memcpy(&strings[strings_len], p->astring, p->length);
+	strings[strings_len + p->length] = '\0';
+	strings_len += p->length + 1;
+      }
+
+  img->strings_len = strings_len;
+
+  return 0;
+}
+
+/******************************************************************************
+ * FUNCTION: ac_automata_init_image
+ * Create a finalized automata searching with the image in buf, written by
+ * ac_automata_write_image(). buf is not copied: it must stay mapped until
+ * the automata is released.
+ * RETURN VALUE: the automata or NULL if the image is invalid
+ ******************************************************************************/
+AC_AUTOMATA_t * ac_automata_init_image (MATCH_CALLBACK_f mc, const void * buf, size_t len)
+{
+  const struct ac_image * img = (const struct ac_image *)buf;
+  AC_AUTOMATA_t * thiz;
+  u_int64_t expected;
+  unsigned int i;
+
+  if(len < sizeof(struct ac_image) || (img->num_states == 0)
+     || (img->num_classes == 0) || (img->num_classes > 257))
+    return NULL;
+
+  expected = sizeof(struct ac_image)
+    + ((u_int64_t)img->num_states * img->num_classes + img->num_states + 1) * sizeof(u_int32_t)
+    + (u_int64_t)img->num_matches * sizeof(struct ac_image_match) + img->strings_len;
+
+  if(expected != len)
+    return NULL;
+
+  for (i=0; i < 256; i++)
+    if(img->dfa_class[i] >= img->num_classes)
+      return NULL;
+
+  /* Check that the search cannot read outside of the image */
+  {
+    const u_int32_t * dfa = (const u_int32_t *)&img[1];
+    u_int32_t num_dfa = img->num_states * img->num_classes;
+    const u_int32_t * state_matches = &dfa[num_dfa];
+    const struct ac_image_match * m = (const struct ac_image_match *)&state_matches[img->num_states + 1];
+
+    for (i=0; i < num_dfa; i++)
+      if(((dfa[i] & ~AC_DFA_FINAL) >= num_dfa) || ((dfa[i] & ~AC_DFA_FINAL) % img->num_classes))
+	return NULL;
+
+    for (i=0; i < img->num_states; i++)
+      if((state_matches[i] > state_matches[i + 1])
+	 || (state_matches[i + 1] - state_matches[i] > img->max_state_matches))
+	return NULL;
+
+    if((state_matches[0] != 0) || (state_matches[img->num_states] != img->num_matches))
+      return NULL;
+
+    for (i=0; i < img->num_matches; i++)
+      if(((u_int64_t)m[i].string_offset + m[i].length >= img->strings_len)
+	 || (((const char *)&m[img->num_matches])[m[i].string_offset + m[i].length] != '\0'))
+	return NULL;
+  }
+
+  if((thiz = (AC_AUTOMATA_t *)ndpi_calloc(1, sizeof(AC_AUTOMATA_t))) == NULL)
+    return NULL;
+
+  thiz->image_patterns = (AC_PATTERN_t *)ndpi_calloc(img->max_state_matches + 1, sizeof(AC_PATTERN_t));
+  if(thiz->image_patterns == NULL)
+    {
+      ndpi_free(thiz);
+      return NULL;
+    }
+
+  thiz->image = img;
+  thiz->dfa = (u_int32_t *)&img[1];
+  thiz->dfa_num_classes = img->num_classes;
+  memcpy(thiz->dfa_class, img->dfa_class, sizeof(thiz->dfa_class));
+  thiz->total_patterns = img->total_patterns;
+  thiz->match_callback = mc;
+  thiz->automata_open = 0;
+  ac_automata_reset (thiz);
+
+  return thiz;
+}
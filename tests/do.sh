@@ -37,7 +37,65 @@ check_results() {
     done
 }
 
+# Runs with the reader options of the optional features, one per line:
+# <result file> <pcap> <options>. The runs that must not change the
+# classification are checked against the result of the pcap without options
+check_option_results() {
+    $READER -S /tmp/reader.ruleset > /dev/null
+
+    while read OUT f OPTIONS; do
+	if [ ! -f result/$OUT ]; then
+	    $READER $OPTIONS -q -i pcap/$f -w result/$OUT -v 2
+	fi
+
+	CMD="$READER $OPTIONS -q -i pcap/$f -w /tmp/reader.out -v 2"
+	$CMD > /dev/null # Statistics (e.g. -K) are not checked
+	NUM_DIFF=`diff result/$OUT /tmp/reader.out | wc -l`
+
+	if [ $NUM_DIFF -eq 0 ]; then
+	    printf "%-32s\tOK\n" "$f $OPTIONS"
+	else
+	    printf "%-32s\tERROR\n" "$f $OPTIONS"
+	    echo "$CMD"
+	    diff result/$OUT /tmp/reader.out
+	    RC=1
+	fi
+
+	/bin/rm /tmp/reader.out
+    done <<EOF
+malware.pcap.out malware.pcap -R /tmp/reader.ruleset
+http_ipv6.pcap.out http_ipv6.pcap -R /tmp/reader.ruleset
+weibo.pcap.domain_match.out weibo.pcap -c domains.txt -D
+weibo.pcap.category_filter.out weibo.pcap -c domains.txt -B
+malware.pcap.out malware.pcap -B
+nintendo.pcap.dns_cache.out nintendo.pcap -Y 1024
+weibo.pcap.dns_cache.out weibo.pcap -c domains.txt -Y 1024
+ubntac2.pcap.verdict_cache.out ubntac2.pcap -E 1024
+ubntac2.pcap.out ubntac2.pcap -E 1024:2
+http_ipv6.pcap.verdict_cache.out http_ipv6.pcap -E 1024
+whatsapp_login_call.pcap.out whatsapp_login_call.pcap -W
+tinc.pcap.out tinc.pcap -W
+nintendo.pcap.dns_cache.out nintendo.pcap -W -Y 1024
+ubntac2.pcap.verdict_cache.out ubntac2.pcap -W -E 1024
+skype.pcap.out skype.pcap -K
+skype.pcap.out skype.pcap -L
+ubntac2.pcap.verdict_cache.out ubntac2.pcap -E 1024 -L
+EOF
+
+    /bin/rm /tmp/reader.ruleset
+}
+
+check_unit() {
+    if [ -x unit/unit ]; then
+	if ! ./unit/unit; then
+	    RC=1
+	fi
+    fi
+}
+
 build_results
 check_results
+check_option_results
+check_unit
 
 exit $RC
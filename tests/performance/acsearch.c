@@ -0,0 +1,153 @@
+/*
+ * acsearch.c
+ *
+ * Copyright (C) 2020 - ntop.org
+ *
+ * nDPI is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * nDPI is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with nDPI.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+  Micro-benchmark of ac_automata_search(): the host patterns of nDPI are
+  searched with the compiled DFA and with the node walk (the search used
+  when the DFA is not built). Both must report the same match checksum.
+
+  Usage: acsearch [<rounds>]
+*/
+
+#define NDPI_LIB_COMPILATION /* The automata internals */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "ndpi_api.h"
+#include "ahocorasick.h"
+
+#define NUM_TEXTS  20000
+#define ALPHABET   "abcdefghijklmnopqrstuvwxyz0123456789.-_"
+
+static unsigned long checksum;
+
+/* ********************************** */
+
+static int match_handler(AC_MATCH_t *m, AC_TEXT_t *txt, AC_REP_t *match) {
+  checksum = checksum * 31 + m->position * 7 + m->match_num + m->patterns[0].rep.number;
+
+  return(0); /* Keep searching */
+}
+
+/* ********************************** */
+
+static double now_sec(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return(ts.tv_sec + ts.tv_nsec / 1e9);
+}
+
+/* ********************************** */
+
+int main(int argc, char **argv) {
+  struct ndpi_detection_module_struct *ndpi_str = ndpi_init_detection_module();
+  static char *texts[NUM_TEXTS];
+  static unsigned int texts_len[NUM_TEXTS];
+  unsigned int rounds = (argc > 1) ? atoi(argv[1]) : 50;
+  unsigned int i, j, r, num_texts = 0, use_dfa;
+  AC_AUTOMATA_t *hosts, *automa;
+
+  if(ndpi_str == NULL) {
+    printf("Unable to initialize the detection module\n");
+    return(1);
+  }
+
+  hosts = (AC_AUTOMATA_t*)ndpi_str->host_automa.ac_automa;
+
+  /* Same patterns as the host automata, with a handler that never stops the search */
+  automa = ac_automata_init(match_handler);
+
+  for(i = 0; i < hosts->all_nodes_num; i++) {
+    AC_NODE_t *node = hosts->all_nodes[i];
+
+    for(j = 0; j < node->matched_patterns_num; j++) {
+      AC_PATTERN_t pattern = node->matched_patterns[j];
+
+      if(pattern.is_existing || (num_texts == NUM_TEXTS))
+	continue;
+
+      ac_automata_add(automa, &pattern);
+
+      /* Every pattern embedded in a hostname */
+      texts[num_texts] = malloc(pattern.length + 32);
+      texts_len[num_texts] = sprintf(texts[num_texts], "www.%.*s.example.com", pattern.length, pattern.astring);
+      num_texts++;
+    }
+  }
+
+  /* Then random names, a few with bytes not used by the patterns */
+  srand(1);
+
+  for(; num_texts < NUM_TEXTS; num_texts++) {
+    texts_len[num_texts] = 8 + rand() % 40;
+    texts[num_texts] = malloc(texts_len[num_texts]);
+
+    for(j = 0; j < texts_len[num_texts]; j++)
+      texts[num_texts][j] = (rand() % 50 == 0) ? (char)(rand() & 0xFF) : ALPHABET[rand() % (sizeof(ALPHABET) - 1)];
+  }
+
+  ac_automata_finalize(automa);
+
+  printf("Patterns: %lu, nodes: %u, byte classes: %u, DFA: %s\n",
+	 automa->total_patterns, automa->all_nodes_num, automa->dfa_num_classes,
+	 automa->dfa ? "yes" : "no (too large)");
+
+  for(use_dfa = 1; ; use_dfa = 0) {
+    u_int32_t *dfa = automa->dfa;
+    unsigned long num_bytes = 0;
+    double begin, elapsed;
+
+    if(!use_dfa)
+      automa->dfa = NULL; /* Force the node walk */
+
+    checksum = 0, begin = now_sec();
+
+    for(r = 0; r < rounds; r++) {
+      for(i = 0; i < num_texts; i++) {
+	AC_TEXT_t txt;
+
+	txt.astring = texts[i], txt.length = texts_len[i];
+	ac_automata_search(automa, &txt, NULL);
+	ac_automata_reset(automa);
+	num_bytes += texts_len[i];
+      }
+    }
+
+    elapsed = now_sec() - begin;
+    automa->dfa = dfa;
+
+    printf("%-9s: %6.2f ns/byte %7.1f ns/search [checksum: %lx]\n",
+	   use_dfa ? "DFA" : "Node walk", (elapsed * 1e9) / num_bytes,
+	   (elapsed * 1e9) / ((double)rounds * num_texts), checksum);
+
+    if(!use_dfa)
+      break;
+  }
+
+  for(i = 0; i < num_texts; i++)
+    free(texts[i]);
+
+  ac_automata_release(automa, 0);
+  ndpi_exit_detection_module(ndpi_str);
+
+  return(0);
+}
@@ -0,0 +1,722 @@
+/*
+ * unit.c
+ *
+ * Copyright (C) 2020 - ntop.org
+ *
+ * nDPI is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * nDPI is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with nDPI.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+  Unit checks of the nDPI data structures: one line per structure, followed
+  by the checks that failed (if any). The exit code is the number of failed
+  structures.
+
+  Usage: unit
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+#include "ndpi_api.h"
+
+static u_int32_t num_failed_checks;
+
+#define CHECK(cond)							\
+  do {									\
+    if(!(cond)) {							\
+      printf("\t%s:%d: %s\n", __FILE__, __LINE__, #cond);		\
+      num_failed_checks++;						\
+    }									\
+  } while(0)
+
+/* ********************************** */
+
+/* Flow table */
+
+#define FT_NUM_KEYS 100000
+
+static int ft_cmp(const void *key, const void *entry) {
+  return(*(const u_int32_t*)key != *(const u_int32_t*)entry);
+}
+
+static u_int32_t ft_hash(u_int32_t key) {
+  return(key * 2654435761U);
+}
+
+static void ft_count(void *entry, void *user_data) {
+  u_int32_t *counters = (u_int32_t*)user_data;
+
+  counters[0]++, counters[1] += *(u_int32_t*)entry;
+}
+
+static u_int32_t ft_num_freed;
+
+static void ft_free(void *entry) {
+  ft_num_freed++;
+}
+
+static void flow_table_test(void) {
+  static u_int32_t keys[FT_NUM_KEYS];
+  struct ndpi_flow_table *t = ndpi_flow_table_init(16, ft_cmp);
+  u_int32_t i, n, sum, counters[2], missing = FT_NUM_KEYS;
+
+  CHECK(t != NULL);
+  if(t == NULL) return;
+
+  /* Empty table */
+  CHECK(ndpi_flow_table_find(t, ft_hash(missing), &missing) == NULL);
+  CHECK(ndpi_flow_table_remove(t, ft_hash(missing), &missing) == NULL);
+
+  /* Growth from 16 slots */
+  for(i = 0, sum = 0; i < FT_NUM_KEYS; i++) {
+    keys[i] = i, sum += i;
+    CHECK(ndpi_flow_table_insert(t, ft_hash(i), &keys[i]) == 0);
+  }
+
+  for(i = 0, n = 0; i < FT_NUM_KEYS; i++)
+    if(ndpi_flow_table_find(t, ft_hash(i), &i) == &keys[i]) n++;
+
+  CHECK(n == FT_NUM_KEYS);
+  CHECK(ndpi_flow_table_find(t, ft_hash(missing), &missing) == NULL);
+
+  /* Removal of every other key, then of keys no longer there */
+  for(i = 0, n = 0; i < FT_NUM_KEYS; i += 2)
+    if(ndpi_flow_table_remove(t, ft_hash(i), &i) == &keys[i]) n++;
+
+  CHECK(n == FT_NUM_KEYS / 2);
+
+  for(i = 0, n = 0; i < FT_NUM_KEYS; i += 2)
+    if(ndpi_flow_table_remove(t, ft_hash(i), &i) != NULL) n++;
+
+  CHECK(n == 0);
+
+  for(i = 0, n = 0; i < FT_NUM_KEYS; i++)
+    if(ndpi_flow_table_find(t, ft_hash(i), &i) == ((i & 1) ? &keys[i] : NULL)) n++;
+
+  CHECK(n == FT_NUM_KEYS);
+
+  /* Reinsertion over the removed slots */
+  for(i = 0; i < FT_NUM_KEYS; i += 2)
+    CHECK(ndpi_flow_table_insert(t, ft_hash(i), &keys[i]) == 0);
+
+  /* Churn at constant size, that must not fill the table with removed slots */
+  for(i = 0, n = 0; i < 10 * FT_NUM_KEYS; i++) {
+    u_int32_t k = i % FT_NUM_KEYS;
+
+    if(ndpi_flow_table_remove(t, ft_hash(k), &k) == &keys[k]
+       && ndpi_flow_table_insert(t, ft_hash(k), &keys[k]) == 0)
+      n++;
+  }
+
+  CHECK(n == 10 * FT_NUM_KEYS);
+
+  /* Every entry is walked once, whole or in chunks */
+  counters[0] = counters[1] = 0;
+  ndpi_flow_table_walk(t, ft_count, counters);
+  CHECK((counters[0] == FT_NUM_KEYS) && (counters[1] == sum));
+
+  counters[0] = counters[1] = 0, i = 0;
+  do {
+    i = ndpi_flow_table_walk_slots(t, i, 1000, ft_count, counters);
+  } while(i != 0);
+  CHECK((counters[0] == FT_NUM_KEYS) && (counters[1] == sum));
+
+  /* Removed entries are not walked nor freed */
+  for(i = 0; i < FT_NUM_KEYS / 2; i++)
+    ndpi_flow_table_remove(t, ft_hash(i), &i);
+
+  ft_num_freed = 0;
+  ndpi_flow_table_destroy(t, ft_free);
+  CHECK(ft_num_freed == FT_NUM_KEYS - FT_NUM_KEYS / 2);
+
+  /* Keys with the same hash */
+  t = ndpi_flow_table_init(16, ft_cmp);
+  CHECK(t != NULL);
+  if(t == NULL) return;
+
+  for(i = 0; i < 1000; i++)
+    CHECK(ndpi_flow_table_insert(t, 42, &keys[i]) == 0);
+
+  for(i = 0, n = 0; i < 1000; i++)
+    if(ndpi_flow_table_find(t, 42, &i) == &keys[i]) n++;
+
+  CHECK(n == 1000);
+
+  i = 500;
+  CHECK(ndpi_flow_table_remove(t, 42, &i) == &keys[500]);
+  CHECK(ndpi_flow_table_find(t, 42, &i) == NULL);
+  i = 999;
+  CHECK(ndpi_flow_table_find(t, 42, &i) == &keys[999]);
+  CHECK(ndpi_flow_table_find(t, 42, &missing) == NULL);
+
+  ndpi_flow_table_destroy(t, NULL);
+}
+
+/* ********************************** */
+
+/* Bloom filter */
+
+#define BLOOM_NUM_KEYS 100000
+
+/* Keys must be well distributed 64 bit hashes (splitmix64) */
+static u_int64_t bloom_key(u_int64_t i) {
+  u_int64_t z = (i + 1) * 0x9E3779B97F4A7C15ULL;
+
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+
+  return(z ^ (z >> 31));
+}
+
+static void bloom_test(void) {
+  struct ndpi_bloom *b = ndpi_bloom_init(BLOOM_NUM_KEYS);
+  u_int32_t i, n;
+  size_t len;
+  void *img;
+
+  CHECK(b != NULL);
+  if(b == NULL) return;
+
+  for(i = 0, n = 0; i < BLOOM_NUM_KEYS; i++)
+    if(ndpi_bloom_contains(b, bloom_key(i))) n++;
+
+  CHECK(n == 0);
+
+  for(i = 0; i < BLOOM_NUM_KEYS; i++)
+    ndpi_bloom_add(b, bloom_key(i));
+
+  /* No false negatives, about 0.5% of false positives */
+  for(i = 0, n = 0; i < BLOOM_NUM_KEYS; i++)
+    if(ndpi_bloom_contains(b, bloom_key(i))) n++;
+
+  CHECK(n == BLOOM_NUM_KEYS);
+
+  for(i = 0, n = 0; i < BLOOM_NUM_KEYS; i++)
+    if(ndpi_bloom_contains(b, bloom_key(BLOOM_NUM_KEYS + i))) n++;
+
+  CHECK(n < BLOOM_NUM_KEYS / 100);
+
+  /* Images (rulesets) answer as the filter */
+  len = ndpi_bloom_image_size(b);
+  CHECK((img = malloc(len)) != NULL);
+
+  if(img != NULL) {
+    ndpi_bloom_write_image(b, img);
+    CHECK(ndpi_bloom_image_check(img, len) == 0);
+    CHECK(ndpi_bloom_image_check(img, len - 1) != 0);
+
+    for(i = 0, n = 0; i < 2 * BLOOM_NUM_KEYS; i++)
+      if(ndpi_bloom_image_contains(img, bloom_key(i)) == ndpi_bloom_contains(b, bloom_key(i))) n++;
+
+    CHECK(n == 2 * BLOOM_NUM_KEYS);
+    free(img);
+  }
+
+  ndpi_bloom_free(b);
+
+  /* An empty filter still has a block */
+  b = ndpi_bloom_init(0);
+  CHECK(b != NULL);
+  if(b == NULL) return;
+
+  CHECK(ndpi_bloom_contains(b, bloom_key(0)) == 0);
+  ndpi_bloom_add(b, bloom_key(0));
+  CHECK(ndpi_bloom_contains(b, bloom_key(0)) == 1);
+  ndpi_bloom_free(b);
+}
+
+/* ********************************** */
+
+/* Longest prefix match */
+
+#define LPM_NUM_PREFIXES 1000
+#define LPM_NUM_LOOKUPS  20000
+
+static u_int64_t lpm_seed = 88172645463325252ULL;
+
+static u_int64_t lpm_rand(void) {
+  lpm_seed ^= lpm_seed << 13, lpm_seed ^= lpm_seed >> 7, lpm_seed ^= lpm_seed << 17;
+
+  return(lpm_seed);
+}
+
+static u_int32_t lpm4_addr(const char *str) {
+  struct in_addr a;
+
+  inet_pton(AF_INET, str, &a);
+  return(a.s_addr);
+}
+
+static u_int32_t lpm4_mask(u_int8_t bits) {
+  return(bits ? (0xFFFFFFFF << (32 - bits)) : 0);
+}
+
+static int lpm4_lookup(const struct ndpi_lpm4 *t, const char *addr) {
+  u_int32_t value;
+
+  return(ndpi_lpm4_match(t, lpm4_addr(addr), &value) ? (int)value : -1);
+}
+
+static void lpm4_test(void) {
+  static struct { u_int32_t addr /* host byte order */; u_int8_t bits; } prefixes[LPM_NUM_PREFIXES];
+  static u_int32_t addrs[LPM_NUM_LOOKUPS], values[LPM_NUM_LOOKUPS], image_values[LPM_NUM_LOOKUPS];
+  static const u_int8_t lengths[] = { 0, 8, 12, 16, 17, 20, 22, 24, 24, 25, 28, 30, 32, 32 };
+  struct ndpi_lpm4 *t = ndpi_lpm4_init(), *r = ndpi_lpm4_init();
+  u_int32_t i, j, n, value;
+  void *img = NULL;
+  size_t len;
+
+  CHECK((t != NULL) && (r != NULL));
+  if((t == NULL) || (r == NULL)) return;
+
+  /* Nested prefixes, each at a different level of the table */
+  CHECK(lpm4_lookup(t, "10.1.2.3") == -1);
+  CHECK(ndpi_lpm4_add(t, lpm4_addr("10.1.2.3"), 32, 4) == 0);
+  CHECK(ndpi_lpm4_add(t, lpm4_addr("10.1.2.0"), 24, 3) == 0);
+  CHECK(ndpi_lpm4_add(t, lpm4_addr("10.1.0.0"), 16, 2) == 0);
+  CHECK(ndpi_lpm4_add(t, lpm4_addr("10.0.0.0"), 8, 1) == 0);
+  CHECK(lpm4_lookup(t, "10.1.2.3") == 4);
+  CHECK(lpm4_lookup(t, "10.1.2.2") == 3);
+  CHECK(lpm4_lookup(t, "10.1.2.255") == 3);
+  CHECK(lpm4_lookup(t, "10.1.3.0") == 2);
+  CHECK(lpm4_lookup(t, "10.0.255.255") == 1);
+  CHECK(lpm4_lookup(t, "9.255.255.255") == -1);
+  CHECK(lpm4_lookup(t, "11.0.0.0") == -1);
+
+  /* Bits past the prefix length are ignored, values are replaced */
+  CHECK(ndpi_lpm4_add(t, lpm4_addr("10.1.77.77"), 16, 5) == 0);
+  CHECK(lpm4_lookup(t, "10.1.3.0") == 5);
+  CHECK(lpm4_lookup(t, "10.1.2.2") == 3);
+
+  /* Default route */
+  CHECK(ndpi_lpm4_add(t, lpm4_addr("1.2.3.4"), 0, 6) == 0);
+  CHECK(lpm4_lookup(t, "11.0.0.0") == 6);
+  CHECK(lpm4_lookup(t, "255.255.255.255") == 6);
+  CHECK(lpm4_lookup(t, "10.1.2.3") == 4);
+
+  /* Invalid prefixes */
+  CHECK(ndpi_lpm4_add(t, lpm4_addr("10.0.0.0"), 33, 1) == -1);
+  CHECK(ndpi_lpm4_add(t, lpm4_addr("10.0.0.0"), 8, 0x7FFFFFFF) == -1);
+  CHECK(lpm4_lookup(t, "10.0.0.0") == 1);
+
+  ndpi_lpm4_free(t);
+  t = ndpi_lpm4_init();
+  CHECK(t != NULL);
+  if(t == NULL) { ndpi_lpm4_free(r); return; }
+
+  /* Random prefixes (half of them in 10/8) against a linear search */
+  for(i = 0; i < LPM_NUM_PREFIXES; i++) {
+    prefixes[i].bits = lengths[lpm_rand() % sizeof(lengths)];
+    prefixes[i].addr = (u_int32_t)lpm_rand();
+    if(lpm_rand() & 1) prefixes[i].addr = (prefixes[i].addr & 0x00FFFFFF) | 0x0A000000;
+    prefixes[i].addr &= lpm4_mask(prefixes[i].bits);
+
+    for(j = 0; j < i; j++)
+      if((prefixes[j].addr == prefixes[i].addr) && (prefixes[j].bits == prefixes[i].bits))
+	break;
+
+    if(j < i) { i--; continue; } /* Unique prefixes, so that the insertion order does not matter */
+
+    CHECK(ndpi_lpm4_add(t, htonl(prefixes[i].addr), prefixes[i].bits, i) == 0);
+  }
+
+  for(i = LPM_NUM_PREFIXES; i > 0; i--)
+    CHECK(ndpi_lpm4_add(r, htonl(prefixes[i - 1].addr), prefixes[i - 1].bits, i - 1) == 0);
+
+  for(i = 0; i < LPM_NUM_LOOKUPS; i++) {
+    j = lpm_rand() % LPM_NUM_PREFIXES;
+    addrs[i] = (lpm_rand() % 4) ? (prefixes[j].addr | ((u_int32_t)lpm_rand() & ~lpm4_mask(prefixes[j].bits))) : (u_int32_t)lpm_rand();
+  }
+
+  len = ndpi_lpm4_image_size(t);
+  CHECK(posix_memalign(&img, 64, len) == 0);
+  if(img != NULL) {
+    ndpi_lpm4_write_image(t, img);
+    CHECK(ndpi_lpm4_image_check(img, len) == 0);
+  }
+
+  for(i = 0; i < LPM_NUM_LOOKUPS; i++) addrs[i] = htonl(addrs[i]);
+  ndpi_lpm4_match_batch(t, addrs, LPM_NUM_LOOKUPS, values, 0xFFFFFFFF);
+  if(img != NULL) ndpi_lpm4_image_match_batch(img, addrs, LPM_NUM_LOOKUPS, image_values, 0xFFFFFFFF);
+
+  for(i = 0, n = 0; i < LPM_NUM_LOOKUPS; i++) {
+    u_int32_t addr = ntohl(addrs[i]), expected = 0xFFFFFFFF, image_value;
+    int best = -1;
+
+    for(j = 0; j < LPM_NUM_PREFIXES; j++)
+      if(((addr & lpm4_mask(prefixes[j].bits)) == prefixes[j].addr)
+	 && ((best == -1) || (prefixes[j].bits > prefixes[best].bits)))
+	best = j;
+
+    if(best != -1) expected = best;
+
+    if((ndpi_lpm4_match(t, addrs[i], &value) ? value : 0xFFFFFFFF) == expected
+       && (ndpi_lpm4_match(r, addrs[i], &value) ? value : 0xFFFFFFFF) == expected
+       && values[i] == expected
+       && ((img == NULL)
+	   || (((ndpi_lpm4_image_match(img, addrs[i], &image_value) ? image_value : 0xFFFFFFFF) == expected)
+	       && image_values[i] == expected)))
+      n++;
+  }
+
+  CHECK(n == LPM_NUM_LOOKUPS);
+
+  free(img);
+  ndpi_lpm4_free(t);
+  ndpi_lpm4_free(r);
+}
+
+/* ********************************** */
+
+static struct ndpi_in6_addr lpm6_addr(const char *str) {
+  struct ndpi_in6_addr a;
+
+  inet_pton(AF_INET6, str, &a);
+  return(a);
+}
+
+static int lpm6_contains(const struct ndpi_in6_addr *prefix, u_int8_t bits, const struct ndpi_in6_addr *addr) {
+  u_int8_t i;
+
+  for(i = 0; i < bits; i++)
+    if((prefix->u6_addr.u6_addr8[i / 8] ^ addr->u6_addr.u6_addr8[i / 8]) & (0x80 >> (i % 8)))
+      return(0);
+
+  return(1);
+}
+
+static int lpm6_lookup(const struct ndpi_lpm6 *t, const char *addr) {
+  struct ndpi_in6_addr a = lpm6_addr(addr);
+  u_int32_t value;
+
+  return(ndpi_lpm6_match(t, &a, &value) ? (int)value : -1);
+}
+
+static int lpm6_add(struct ndpi_lpm6 *t, const char *addr, u_int8_t bits, u_int32_t value) {
+  struct ndpi_in6_addr a = lpm6_addr(addr);
+
+  return(ndpi_lpm6_add(t, &a, bits, value));
+}
+
+static void lpm6_test(void) {
+  static struct { struct ndpi_in6_addr addr; u_int8_t bits; } prefixes[LPM_NUM_PREFIXES];
+  static const u_int8_t lengths[] = { 0, 8, 16, 19, 24, 29, 32, 32, 40, 44, 48, 48, 56, 64, 64, 96, 127, 128 };
+  struct ndpi_lpm6 *t = ndpi_lpm6_init();
+  u_int32_t i, j, n, value, image_value;
+  void *img = NULL;
+  size_t len;
+
+  CHECK(t != NULL);
+  if(t == NULL) return;
+
+  /* Nested prefixes, shorter ones added after the longer ones below them */
+  CHECK(lpm6_lookup(t, "2001:db8::1") == -1);
+  CHECK(lpm6_add(t, "2001:db8:1::1", 128, 3) == 0);
+  CHECK(lpm6_add(t, "2001:db8:1::", 48, 2) == 0);
+  CHECK(lpm6_add(t, "2001:db8::", 32, 1) == 0);
+  CHECK(lpm6_add(t, "2001::", 20, 4) == 0);
+  CHECK(lpm6_lookup(t, "2001:db8:1::1") == 3);
+  CHECK(lpm6_lookup(t, "2001:db8:1::2") == 2);
+  CHECK(lpm6_lookup(t, "2001:db8:2::1") == 1);
+  CHECK(lpm6_lookup(t, "2001:db9::") == 4);
+  CHECK(lpm6_lookup(t, "2001:fff::") == 4);
+  CHECK(lpm6_lookup(t, "2001:1000::") == -1);
+  CHECK(lpm6_lookup(t, "2002::") == -1);
+
+  /* Bits past the prefix length are ignored, values are replaced */
+  CHECK(lpm6_add(t, "2001:db8:1:ffff::", 48, 5) == 0);
+  CHECK(lpm6_lookup(t, "2001:db8:1::2") == 5);
+  CHECK(lpm6_lookup(t, "2001:db8:1::1") == 3);
+
+  /* Default route */
+  CHECK(lpm6_add(t, "fe80::1", 0, 6) == 0);
+  CHECK(lpm6_lookup(t, "2002::") == 6);
+  CHECK(lpm6_lookup(t, "ffff:ffff:ffff:ffff:ffff:ffff:ffff:ffff") == 6);
+  CHECK(lpm6_lookup(t, "2001:db8:2::1") == 1);
+
+  /* Invalid prefixes */
+  CHECK(lpm6_add(t, "2001:db8::", 129, 1) == -1);
+  CHECK(lpm6_lookup(t, "2001:db8::") == 1);
+
+  ndpi_lpm6_free(t);
+  t = ndpi_lpm6_init();
+  CHECK(t != NULL);
+  if(t == NULL) return;
+
+  /* Random prefixes (under a few /16) against a linear search */
+  for(i = 0; i < LPM_NUM_PREFIXES; i++) {
+    prefixes[i].bits = lengths[lpm_rand() % sizeof(lengths)];
+    prefixes[i].addr.u6_addr.u6_addr64[0] = lpm_rand(), prefixes[i].addr.u6_addr.u6_addr64[1] = lpm_rand();
+    prefixes[i].addr.u6_addr.u6_addr8[0] = 0x2A, prefixes[i].addr.u6_addr.u6_addr8[1] = lpm_rand() % 4;
+
+    for(j = 0; j < i; j++)
+      if((prefixes[j].bits == prefixes[i].bits)
+	 && lpm6_contains(&prefixes[j].addr, prefixes[j].bits, &prefixes[i].addr))
+	break;
+
+    if(j < i) { i--; continue; }
+
+    CHECK(ndpi_lpm6_add(t, &prefixes[i].addr, prefixes[i].bits, i) == 0);
+  }
+
+  len = ndpi_lpm6_image_size(t);
+  CHECK(posix_memalign(&img, 64, len) == 0);
+  if(img != NULL) {
+    ndpi_lpm6_write_image(t, img);
+    CHECK(ndpi_lpm6_image_check(img, len) == 0);
+  }
+
+  for(i = 0, n = 0; i < LPM_NUM_LOOKUPS; i++) {
+    struct ndpi_in6_addr addr;
+    u_int32_t expected = 0xFFFFFFFF;
+    int best = -1;
+
+    /* An address of a prefix, sometimes with a flipped bit past it or a random suffix */
+    j = lpm_rand() % LPM_NUM_PREFIXES, addr = prefixes[j].addr;
+    if((lpm_rand() & 1) && (prefixes[j].bits < 128)) {
+      u_int8_t bit = prefixes[j].bits + lpm_rand() % (128 - prefixes[j].bits);
+
+      addr.u6_addr.u6_addr8[bit / 8] ^= 0x80 >> (bit % 8);
+    }
+    if(lpm_rand() % 4 == 0) addr.u6_addr.u6_addr64[1] = lpm_rand();
+
+    for(j = 0; j < LPM_NUM_PREFIXES; j++)
+      if(lpm6_contains(&prefixes[j].addr, prefixes[j].bits, &addr)
+	 && ((best == -1) || (prefixes[j].bits > prefixes[best].bits)))
+	best = j;
+
+    if(best != -1) expected = best;
+
+    if((ndpi_lpm6_match(t, &addr, &value) ? value : 0xFFFFFFFF) == expected
+       && ((img == NULL)
+	   || (ndpi_lpm6_image_match(img, &addr, &image_value) ? image_value : 0xFFFFFFFF) == expected))
+      n++;
+  }
+
+  CHECK(n == LPM_NUM_LOOKUPS);
+
+  free(img);
+  ndpi_lpm6_free(t);
+}
+
+/* ********************************** */
+
+/* LRU cache */
+
+static int lru_lookup(struct ndpi_lru_cache *c, u_int64_t key, u_int32_t now_sec) {
+  u_int32_t value;
+
+  return(ndpi_lru_find_cache(c, key, &value, 0, now_sec) ? (int)value : -1);
+}
+
+static void lru_test(void) {
+  struct ndpi_lru_cache_stats stats;
+  struct ndpi_lru_cache *c;
+  u_int32_t i, n, value;
+
+  CHECK(ndpi_lru_cache_init(0, 0) == NULL);
+
+  /* A single set: the least recently used entry is evicted */
+  c = ndpi_lru_cache_init(NDPI_LRU_CACHE_WAYS, 0);
+  CHECK(c != NULL);
+  if(c == NULL) return;
+
+  for(i = 1; i <= NDPI_LRU_CACHE_WAYS; i++)
+    ndpi_lru_add_to_cache(c, i, 100 + i, 0);
+
+  CHECK(lru_lookup(c, 1, 0) == 101);
+  ndpi_lru_add_to_cache(c, NDPI_LRU_CACHE_WAYS + 1, 200, 0);
+  CHECK(lru_lookup(c, 2, 0) == -1);
+  CHECK(lru_lookup(c, 1, 0) == 101);
+  CHECK(lru_lookup(c, 3, 0) == 103);
+  CHECK(lru_lookup(c, NDPI_LRU_CACHE_WAYS + 1, 0) == 200);
+
+  /* Updates do not evict, keys are compared in full, values are masked */
+  ndpi_lru_add_to_cache(c, 3, 0xFFFFFFFF, 0);
+  CHECK(lru_lookup(c, 3, 0) == NDPI_LRU_CACHE_VALUE_MASK);
+  CHECK(lru_lookup(c, 1, 0) == 101);
+  CHECK(lru_lookup(c, 1 | (1ULL << 32), 0) == -1);
+
+  ndpi_lru_get_stats(c, &stats);
+  CHECK((stats.n_insert == NDPI_LRU_CACHE_WAYS + 2) && (stats.n_evicted == 1));
+  CHECK((stats.n_search == 8) && (stats.n_found == 6) && (stats.n_expired == 0));
+
+  /* Entries removed when found */
+  CHECK(ndpi_lru_find_cache(c, 1, &value, 1, 0) == 1);
+  CHECK(ndpi_lru_find_cache(c, 1, &value, 1, 0) == 0);
+  ndpi_lru_free_cache(c);
+
+  /* Expiry: cache TTL, then entry TTL (0 = never) */
+  c = ndpi_lru_cache_init(NDPI_LRU_CACHE_WAYS, 10);
+  CHECK(c != NULL);
+  if(c == NULL) return;
+
+  ndpi_lru_add_to_cache(c, 1, 1, 100);
+  ndpi_lru_add_to_cache_ttl(c, 2, 2, 100, 0);
+  ndpi_lru_add_to_cache_ttl(c, 3, 3, 100, 1000);
+  CHECK(lru_lookup(c, 1, 110) == 1);
+  CHECK(lru_lookup(c, 1, 111) == -1);
+  CHECK(lru_lookup(c, 1, 105) == -1); /* Removed once expired */
+  CHECK(lru_lookup(c, 2, 0xFFFFFFFF) == 2);
+  CHECK(lru_lookup(c, 3, 1100) == 3);
+  CHECK(lru_lookup(c, 3, 1101) == -1);
+
+  ndpi_lru_get_stats(c, &stats);
+  CHECK(stats.n_expired == 2);
+  ndpi_lru_free_cache(c);
+
+  /* A full cache: every key is either still there or has been evicted */
+  c = ndpi_lru_cache_init(4096, 0);
+  CHECK(c != NULL);
+  if(c == NULL) return;
+
+  for(i = 0; i < 4096; i++)
+    ndpi_lru_add_to_cache(c, i, i, 0);
+
+  for(i = 0, n = 0; i < 4096; i++)
+    if(lru_lookup(c, i, 0) == (int)i) n++;
+
+  ndpi_lru_get_stats(c, &stats);
+  CHECK((n + stats.n_evicted == 4096) && (n > 4096 / 2));
+  ndpi_lru_free_cache(c);
+
+  /* Long keys: SipHash-2-4 (reference vector), keyed by a secret of each cache */
+  c = ndpi_lru_cache_init(NDPI_LRU_CACHE_WAYS, 0);
+  CHECK(c != NULL);
+  if(c == NULL) return;
+
+  {
+    struct ndpi_lru_cache *c2 = ndpi_lru_cache_init(NDPI_LRU_CACHE_WAYS, 0);
+    u_int8_t data[16];
+
+    for(i = 0; i < 16; i++) data[i] = i;
+
+    CHECK(c2 != NULL);
+    if(c2 != NULL) {
+      CHECK(ndpi_lru_hash_128(c, data) != ndpi_lru_hash_128(c2, data));
+      ndpi_lru_free_cache(c2);
+    }
+
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    memcpy(c->secret, data, sizeof(c->secret)); /* Key 00..0f */
+    CHECK(ndpi_lru_hash_128(c, data) == 0x3f2acc7f57c29bdbULL);
+#endif
+  }
+
+  ndpi_lru_free_cache(c);
+}
+
+/* ********************************** */
+
+#define LRU_NUM_THREADS 4
+#define LRU_NUM_KEYS    50000 /* Per thread */
+
+static struct ndpi_lru_cache *lru_shared;
+
+static void* lru_thread(void *arg) {
+  u_int64_t i, first = (uintptr_t)arg * LRU_NUM_KEYS;
+  u_int32_t value;
+
+  for(i = first; i < first + LRU_NUM_KEYS; i++) {
+    ndpi_lru_add_to_cache(lru_shared, i, (u_int32_t)i, 0);
+    ndpi_lru_find_cache(lru_shared, i, &value, 0, 0);
+  }
+
+  return(NULL);
+}
+
+static void lru_shared_test(void) {
+  struct ndpi_lru_cache_stats stats;
+  pthread_t threads[LRU_NUM_THREADS];
+  u_int32_t i, n, value;
+
+  /* Shards are rounded up to a power of 2 and capped */
+  lru_shared = ndpi_lru_cache_init_shared(1024, 0, 3);
+  CHECK((lru_shared != NULL) && (lru_shared->num_shards == 4));
+  if(lru_shared) ndpi_lru_free_cache(lru_shared);
+
+  lru_shared = ndpi_lru_cache_init_shared(1024, 0, 100000);
+  CHECK((lru_shared != NULL) && (lru_shared->num_shards == NDPI_LRU_CACHE_MAX_SHARDS));
+  if(lru_shared) ndpi_lru_free_cache(lru_shared);
+
+  CHECK(ndpi_lru_cache_init_shared(0, 0, 4) == NULL);
+
+  /* Same behavior as a private cache */
+  lru_shared = ndpi_lru_cache_init_shared(NDPI_LRU_CACHE_WAYS, 10, 4);
+  CHECK(lru_shared != NULL);
+  if(lru_shared == NULL) return;
+
+  for(i = 1; i <= NDPI_LRU_CACHE_WAYS + 1; i++)
+    ndpi_lru_add_to_cache(lru_shared, i, i, 100);
+
+  CHECK(lru_lookup(lru_shared, 1, 100) == -1);
+  CHECK(lru_lookup(lru_shared, 2, 110) == 2);
+  CHECK(lru_lookup(lru_shared, 2, 111) == -1);
+
+  ndpi_lru_get_stats(lru_shared, &stats);
+  CHECK((stats.n_insert == NDPI_LRU_CACHE_WAYS + 1) && (stats.n_evicted == 1) && (stats.n_expired == 1));
+  ndpi_lru_free_cache(lru_shared);
+
+  /* Threads adding distinct keys: none is lost but for the evicted ones */
+  lru_shared = ndpi_lru_cache_init_shared(LRU_NUM_THREADS * LRU_NUM_KEYS, 0, 16);
+  CHECK(lru_shared != NULL);
+  if(lru_shared == NULL) return;
+
+  for(i = 0; i < LRU_NUM_THREADS; i++)
+    pthread_create(&threads[i], NULL, lru_thread, (void*)(uintptr_t)i);
+
+  for(i = 0; i < LRU_NUM_THREADS; i++)
+    pthread_join(threads[i], NULL);
+
+  for(i = 0, n = 0; i < LRU_NUM_THREADS * LRU_NUM_KEYS; i++)
+    if(ndpi_lru_find_cache(lru_shared, i, &value, 0, 0) && (value == i)) n++;
+
+  ndpi_lru_get_stats(lru_shared, &stats);
+  CHECK(stats.n_insert == LRU_NUM_THREADS * LRU_NUM_KEYS);
+  CHECK(stats.n_search == 2 * LRU_NUM_THREADS * LRU_NUM_KEYS);
+  CHECK(n + stats.n_evicted == LRU_NUM_THREADS * LRU_NUM_KEYS);
+  ndpi_lru_free_cache(lru_shared);
+}
+
+/* ********************************** */
+
+static struct {
+  const char *name;
+  void (*test)(void);
+} tests[] = {
+  { "Flow table", flow_table_test },
+  { "Bloom filter", bloom_test },
+  { "IPv4 longest prefix match", lpm4_test },
+  { "IPv6 longest prefix match", lpm6_test },
+  { "LRU cache", lru_test },
+  { "Shared LRU cache", lru_shared_test },
+  { NULL, NULL }
+};
+
+int main(int argc, char **argv) {
+  int i, num_failed = 0;
+
+  for(i = 0; tests[i].name != NULL; i++) {
+    num_failed_checks = 0;
+    tests[i].test();
+
+    printf("%-32s\t%s\n", tests[i].name, num_failed_checks ? "ERROR" : "OK");
+    if(num_failed_checks) num_failed++;
+  }
+
+  return(num_failed);
+}